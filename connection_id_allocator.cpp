@@ -0,0 +1,173 @@
+#include "connection_id_allocator.h"
+#include "error_exception.h"
+
+#include <algorithm>
+
+namespace connection_id_allocator
+{
+	using error_exception::Exception;
+	using error_exception::ERROR_NUM;
+
+	ConnectionIDAllocator::ConnectionIDAllocator(quarantine_duration_t Quarantine, size_t MaxIDs)
+		: _Quarantine(Quarantine), _MaxIDs(std::min(MaxIDs, MaxConnectionIDs))
+	{}
+
+	protocol_thread_id_t ConnectionIDAllocator::Allocate(id_clock_t::time_point Now)
+	{
+		protocol_thread_id_t newID;
+
+		// Prefer the oldest released slot once its quarantine has passed. Its next generation wraps around in the high bits
+		if(!this->_ReleasedIDs.empty() && this->_ReleasedIDs.front().ReuseTime <= Now)
+		{
+			newID = this->_ReleasedIDs.front().ID + (ConnectionSlotMask + 1);
+			this->_ReleasedIDs.pop_front();
+		}
+		else
+		{
+			if(this->_SlotIDs.size() >= this->_MaxIDs)
+				throw Exception(ERROR_NUM, "ERROR ConnectionIDAllocator::Allocate(): No free connection ID available");
+
+			newID = static_cast<protocol_thread_id_t>(ConnectionIDStart + this->_SlotIDs.size());
+			this->_SlotIDs.push_back(newID);
+			this->_Allocated.push_back(false);
+		}
+
+		const auto slotIndex = GetIndex(newID);
+		this->_SlotIDs[slotIndex] = newID;
+		this->_Allocated[slotIndex] = true;
+		++this->_NumAllocated;
+
+		return newID;
+	}
+
+	void ConnectionIDAllocator::Release(protocol_thread_id_t ID, id_clock_t::time_point Now)
+	{
+		if(!this->IsAllocated(ID))
+			throw Exception(ERROR_NUM, "ERROR ConnectionIDAllocator::Release(): ID not allocated");
+
+		this->_Allocated[GetIndex(ID)] = false;
+		--this->_NumAllocated;
+
+		this->_ReleasedIDs.push_back(released_id_t{ID, Now + this->_Quarantine});
+	}
+
+	bool ConnectionIDAllocator::IsAllocated(protocol_thread_id_t ID) const noexcept
+	{
+		const auto slotIndex = GetIndex(ID);
+		if((ID & ConnectionSlotMask) < ConnectionIDStart || slotIndex >= this->_Allocated.size())
+			return false;
+
+		return this->_Allocated[slotIndex] && this->_SlotIDs[slotIndex] == ID;
+	}
+
+	size_t ConnectionIDAllocator::GetNumAllocated() const noexcept
+	{
+		return this->_NumAllocated;
+	}
+}
+
+namespace connection_id_allocator
+{
+	class TestConnectionIDAllocator
+	{
+		public:
+			static bool Testing();
+	};
+
+	bool TestConnectionIDAllocator::Testing()
+	{
+		try
+		{
+			const auto testStart = id_clock_t::time_point();
+			const quarantine_duration_t testQuarantine = std::chrono::seconds(1);
+
+			ConnectionIDAllocator testAllocator(testQuarantine, 4);
+
+			const auto firstID = testAllocator.Allocate(testStart);
+			const auto secondID = testAllocator.Allocate(testStart);
+			if(firstID != ConnectionIDStart || secondID != ConnectionIDStart+1 || testAllocator.GetNumAllocated() != 2)
+				return 0;
+
+			// Released slot must not be reused during quarantine
+			testAllocator.Release(firstID, testStart);
+			if(testAllocator.IsAllocated(firstID) || !testAllocator.IsAllocated(secondID))
+				return 0;
+
+			const auto thirdID = testAllocator.Allocate(testStart + testQuarantine/2);
+			if(thirdID != ConnectionIDStart+2)
+				return 0;
+
+			// Reuse after quarantine, oldest first. A reused slot gets a new ID, so the old one stays invalid
+			testAllocator.Release(secondID, testStart + testQuarantine/2);
+			const auto reusedFirstID = testAllocator.Allocate(testStart + testQuarantine);
+			if(reusedFirstID == firstID || ConnectionIDAllocator::GetIndex(reusedFirstID) != ConnectionIDAllocator::GetIndex(firstID))
+				return 0;
+
+			if(!testAllocator.IsAllocated(reusedFirstID) || testAllocator.IsAllocated(firstID))
+				return 0;
+
+			if(testAllocator.Allocate(testStart + testQuarantine) != ConnectionIDStart+3)
+				return 0;
+
+			const auto reusedSecondID = testAllocator.Allocate(testStart + 2*testQuarantine);
+			if(reusedSecondID == secondID || ConnectionIDAllocator::GetIndex(reusedSecondID) != ConnectionIDAllocator::GetIndex(secondID))
+				return 0;
+
+			if(testAllocator.GetNumAllocated() != 4)
+				return 0;
+
+			// Stale IDs can't be released
+			try
+			{
+				testAllocator.Release(firstID);
+				return 0;
+			}
+			catch(Exception &)
+			{}
+
+			// Double release must fail
+			testAllocator.Release(thirdID);
+			try
+			{
+				testAllocator.Release(thirdID);
+				return 0;
+			}
+			catch(Exception &)
+			{}
+
+			if(testAllocator.IsAllocated(ConnectionIDStart-1) || testAllocator.IsAllocated(ConnectionIDStart+100))
+				return 0;
+
+			// Exhaustion. All four slots are taken or quarantined
+			try
+			{
+				testAllocator.Allocate(testStart + 2*testQuarantine);
+				return 0;
+			}
+			catch(Exception &)
+			{}
+
+			// Generations wrap around, stale IDs only match again after all of them were used
+			ConnectionIDAllocator wrapAllocator(quarantine_duration_t::zero(), 1);
+			const auto wrapID = wrapAllocator.Allocate(testStart);
+			auto curID = wrapID;
+			for(size_t i = 0; i < (size_t(1) << (sizeof(protocol_thread_id_t)*8 - ConnectionSlotBits)) - 1; ++i)
+			{
+				wrapAllocator.Release(curID, testStart);
+				curID = wrapAllocator.Allocate(testStart);
+				if(curID == wrapID)
+					return 0;
+			}
+
+			wrapAllocator.Release(curID, testStart);
+			if(wrapAllocator.Allocate(testStart) != wrapID)
+				return 0;
+
+			return 1;
+		}
+		catch(Exception &)
+		{
+			return 0;
+		}
+	}
+}
@@ -0,0 +1,138 @@
+#ifndef CONNECTION_ID_ALLOCATOR_H
+#define CONNECTION_ID_ALLOCATOR_H
+
+/*! \file connection_id_allocator.h
+ *  \brief Header for ConnectionIDAllocator class
+ */
+
+
+#include "protocol_data.h"
+#include "vector_t.h"
+
+#include <chrono>
+#include <deque>
+
+/*!
+ *  \brief Namespace for ConnectionIDAllocator class
+ */
+namespace connection_id_allocator
+{
+	using std::deque;
+
+	using vector_t::vector_type;
+
+	using protocol_data::protocol_thread_id_t;
+	using protocol_data::ConnectionIDStart;
+
+	using id_clock_t = std::chrono::steady_clock;
+	using quarantine_duration_t = id_clock_t::duration;
+
+	/*!
+	 * \brief Number of low ID bits that select the connection slot. The remaining high bits count how often the slot was reused
+	 */
+	static constexpr unsigned ConnectionSlotBits = 24;
+
+	/*!
+	 * \brief Mask of the slot bits of an ID
+	 */
+	static constexpr protocol_thread_id_t ConnectionSlotMask = (protocol_thread_id_t(1) << ConnectionSlotBits) - 1;
+
+	/*!
+	 * \brief Maximum number of simultaneously allocated IDs
+	 */
+	static constexpr size_t MaxConnectionIDs = ConnectionSlotMask - ConnectionIDStart + 1;
+
+	/*!
+	 * \brief Minimum time a released slot stays unused. A stale ID only matches its slot again after the generation wrapped, which takes at least 256 times this duration
+	 */
+	static constexpr quarantine_duration_t ConnectionIDQuarantine = std::chrono::seconds(10);
+
+	/*!
+	 * \brief Hands out connection IDs and recycles released ones
+	 *
+	 * An ID consists of a slot, starting at ConnectionIDStart, and a generation in the bits above ConnectionSlotBits. Each reuse of a slot increments its generation, so
+	 * messages, timers and routes that still carry the old ID can't reach the new connection. The generation has 8 bits and wraps after 256 reuses of a slot. Since every
+	 * reuse waits for the quarantine, a stale ID is only safe if it is dropped within 256 quarantine periods (about 42 minutes with ConnectionIDQuarantine). Released slots are queued in release
+	 * order and only reused after the quarantine has passed. Fresh slots are only taken if no released slot is ready, so slots stay dense.
+	 * Allocation and release are O(1)
+	 */
+	class ConnectionIDAllocator
+	{
+		public:
+			/*!
+			 * \brief Constructor
+			 * \param Quarantine Minimum time between release and reuse of a slot
+			 * \param MaxIDs Maximum number of slots. Clamped to MaxConnectionIDs
+			 */
+			ConnectionIDAllocator(quarantine_duration_t Quarantine = ConnectionIDQuarantine, size_t MaxIDs = MaxConnectionIDs);
+
+			/*!
+			 * \brief Allocates an ID. Throws if all IDs are in use or quarantined
+			 * \param Now Current time
+			 */
+			protocol_thread_id_t Allocate(id_clock_t::time_point Now = id_clock_t::now());
+
+			/*!
+			 * \brief Returns ID to allocator. Throws if ID is not allocated
+			 * \param ID ID to release
+			 * \param Now Current time. Quarantine starts here
+			 */
+			void Release(protocol_thread_id_t ID, id_clock_t::time_point Now = id_clock_t::now());
+
+			/*!
+			 * \brief Is ID currently allocated. False for earlier generations of an allocated slot
+			 */
+			bool IsAllocated(protocol_thread_id_t ID) const noexcept;
+
+			/*!
+			 * \brief Number of allocated IDs
+			 */
+			size_t GetNumAllocated() const noexcept;
+
+			/*!
+			 * \brief Converts ID to the index of its slot. Indices are dense, starting at zero. All generations of a slot share the index
+			 */
+			static constexpr size_t GetIndex(protocol_thread_id_t ID) noexcept
+			{
+				return static_cast<size_t>((ID & ConnectionSlotMask) - ConnectionIDStart);
+			}
+
+		private:
+
+			struct released_id_t
+			{
+				protocol_thread_id_t ID;
+				id_clock_t::time_point ReuseTime;
+			};
+
+			/*!
+			 * \brief Minimum time between release and reuse
+			 */
+			quarantine_duration_t _Quarantine;
+
+			/*!
+			 * \brief Maximum number of slots
+			 */
+			size_t _MaxIDs;
+
+			/*!
+			 * \brief Released IDs, oldest first
+			 */
+			deque<released_id_t> _ReleasedIDs;
+
+			/*!
+			 * \brief Latest ID of all slots handed out so far, indexed by GetIndex()
+			 */
+			vector_type<protocol_thread_id_t> _SlotIDs;
+
+			/*!
+			 * \brief Allocation state of all slots handed out so far, indexed by GetIndex()
+			 */
+			vector_type<bool> _Allocated;
+
+			size_t _NumAllocated = 0;
+	};
+} // namespace connection_id_allocator
+
+
+#endif // CONNECTION_ID_ALLOCATOR_H
@@ -43,6 +43,20 @@ namespace dynamic_pointer
 		}
 	}
 
+	/*!
+	 * \brief Counts live instances. Not trivially copyable, so it is stored on the heap
+	 */
+	struct test_shared_counter_t
+	{
+		static int NumInstances;
+
+		test_shared_counter_t() { ++NumInstances; }
+		test_shared_counter_t(const test_shared_counter_t &) { ++NumInstances; }
+		~test_shared_counter_t() { --NumInstances; }
+	};
+
+	int test_shared_counter_t::NumInstances = 0;
+
 	class TestSharedDynamicPointer
 	{
 		public:
@@ -61,7 +75,122 @@ namespace dynamic_pointer
 			if(testVoid.Get<int>() != pTestData)
 				return 0;
 
-			if(testShared.Get<int>() != pTestData)
+			if(testShared.Get<int>() != pTestData || testShared.GetUseCount() != 2)
+				return 0;
+
+			// Payload is destroyed with the last reference, for both created and adopted payloads
+			{
+				auto testCreated = SharedDynamicPointer<void>::Create<test_shared_counter_t>();
+				SharedDynamicPointer<void> testAdopted(new test_shared_counter_t());
+				if(testCreated.IsStoredInline() || test_shared_counter_t::NumInstances != 2)
+					return 0;
+
+				auto testCopy = testCreated;
+				auto testMoved = std::move(testCreated);
+				if(testMoved.GetUseCount() != 2 || testCreated.GetUseCount() != 0 || testMoved.Get<test_shared_counter_t>() != testCopy.Get<test_shared_counter_t>())
+					return 0;
+
+				testCopy = testAdopted;
+				if(testMoved.GetUseCount() != 1 || testAdopted.GetUseCount() != 2 || test_shared_counter_t::NumInstances != 2)
+					return 0;
+			}
+
+			if(test_shared_counter_t::NumInstances != 0)
+				return 0;
+
+			return 1;
+		}
+		catch(Exception &)
+		{
+			return 0;
+		}
+	}
+
+	/*!
+	 * \brief Small and trivially copyable, but kept on the heap
+	 */
+	struct test_heap_only_t
+	{
+		int Value;
+	};
+
+	template<>
+	struct dynamic_pointer_inline_t<test_heap_only_t>
+	{
+		static constexpr bool value = false;
+	};
+
+	struct test_pooled_t
+	{
+		char Data[64];
+		int Value;
+	};
+
+	template<>
+	struct dynamic_pointer_pooled_t<test_pooled_t>
+	{
+		static constexpr bool value = true;
+	};
+
+	class TestSharedDynamicPointerInline
+	{
+		public:
+			static bool Testing();
+	};
+
+	bool TestSharedDynamicPointerInline::Testing()
+	{
+		try
+		{
+			// Trivially copyable payloads are stored inline, large ones on the heap
+			auto testInt = SharedDynamicPointer<void>::Create<int>(5);
+			if(!testInt.IsStoredInline() || *testInt.Get<int>() != 5)
+				return 0;
+
+			auto testVector = SharedDynamicPointer<void>::Create<std::vector<int>>(3, 7);
+			auto testVectorShared = testVector;
+			if(testVector.IsStoredInline() || testVector.Get<std::vector<int>>() != testVectorShared.Get<std::vector<int>>())
+				return 0;
+
+			// Pooled payloads take their memory from the pool of their type
+			{
+				auto testPooled = SharedDynamicPointer<void>::Create<test_pooled_t>(test_pooled_t{{}, 9});
+				if(testPooled.IsStoredInline() || testPooled.Get<test_pooled_t>()->Value != 9 || SharedDynamicPointer<void>::GetPoolStatistics<test_pooled_t>().Misses != 1)
+					return 0;
+			}
+
+			// Small payloads that aren't trivially copyable stay on the heap and are shared on fan-out
+			{
+				auto testCounter = SharedDynamicPointer<void>::Create<test_shared_counter_t>();
+				auto testFanOut = testCounter;
+				if(testCounter.IsStoredInline() || testFanOut.Get<test_shared_counter_t>() != testCounter.Get<test_shared_counter_t>() || testFanOut.GetUseCount() != 2)
+					return 0;
+			}
+
+			if(test_shared_counter_t::NumInstances != 0)
+				return 0;
+
+			auto testHeapOnly = SharedDynamicPointer<void>::Create<test_heap_only_t>(test_heap_only_t{4});
+			auto testHeapOnlyShared = testHeapOnly;
+			if(testHeapOnly.IsStoredInline() || testHeapOnlyShared.Get<test_heap_only_t>() != testHeapOnly.Get<test_heap_only_t>())
+				return 0;
+
+			// Inline payloads are copied and moved bytewise. Copies hold the same value and are not shared
+			auto testCopy = testInt;
+			if(!testCopy.IsStoredInline() || *testCopy.Get<int>() != 5 || testCopy.GetUseCount() != 1)
+				return 0;
+
+			auto testMoved = std::move(testInt);
+			if(testInt.IsStoredInline() || testInt.GetUseCount() != 0 || *testMoved.Get<int>() != 5)
+				return 0;
+
+			// Replacing an inline payload with a heap payload and back
+			testCopy = testVector;
+			if(testCopy.IsStoredInline() || testVector.GetUseCount() != 3)
+				return 0;
+
+			testCopy = testMoved;
+			if(!testCopy.IsStoredInline() || *testCopy.Get<int>() != 5 || testVector.GetUseCount() != 2)
 				return 0;
 
 			return 1;
@@ -8,13 +8,34 @@
 
 #include <memory>
 #include "error_exception.h"
+#include "dynamic_pointer_pool.h"
 
 #include "debug_flag.h"
 
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <type_traits>
+
 #ifdef DEBUG
 #include <typeinfo>
 #endif
 
+/*!
+ * \brief Size of the inline storage of SharedDynamicPointer<void>. Can be set at compile time. Must be a multiple of the pointer size, at least two pointers
+ */
+#ifndef DYNAMIC_POINTER_INLINE_SIZE
+#define DYNAMIC_POINTER_INLINE_SIZE 16
+#endif
+
+/*!
+ * \brief Set to 1 to count the reference count operations of SharedDynamicPointer<void>. Used by benchmarks
+ */
+#ifndef DYNAMIC_POINTER_COUNT_REFERENCE_OPS
+#define DYNAMIC_POINTER_COUNT_REFERENCE_OPS 0
+#endif
+
 /*!
  *  \brief Namespace for DynamicPointer class
  */
@@ -23,13 +44,45 @@ namespace dynamic_pointer
 	using error_exception::Exception;
 	using error_exception::ERROR_NUM;
 
-	using std::shared_ptr;
+	using std::atomic;
+
+	using dynamic_pointer_pool::DynamicPointerPool;
+	using dynamic_pointer_pool::pool_statistics_t;
 
 	using type_number_t = unsigned int;
 
+	/*!
+	 * \brief Payloads up to this size can be stored inside SharedDynamicPointer<void> instead of on the heap. The storage overlaps the heap pointers
+	 */
+	static constexpr size_t DynamicPointerInlineSize = DYNAMIC_POINTER_INLINE_SIZE;
+
+	static_assert(DynamicPointerInlineSize >= 2*sizeof(void*) && DynamicPointerInlineSize % sizeof(void*) == 0, "ERROR DYNAMIC_POINTER_INLINE_SIZE must be a multiple of the pointer size and hold at least two pointers");
+
+	static constexpr bool DynamicPointerCountReferenceOps = DYNAMIC_POINTER_COUNT_REFERENCE_OPS;
+
+	/*!
+	 * \brief May T be stored inline in SharedDynamicPointer<void>. Only small trivially copyable types are ever stored inline. Specialize to false to keep such a type on the heap,
+	 * e.g. if receivers of a fanned out message must see each other's changes
+	 */
+	template<class T>
+	struct dynamic_pointer_inline_t
+	{
+		static constexpr bool value = std::is_trivially_copyable<T>::value;
+	};
+
+	/*!
+	 * \brief Should heap payloads of type T come from DynamicPointerPool<T>. Specialize for large payloads that are created often
+	 */
+	template<class T>
+	struct dynamic_pointer_pooled_t
+	{
+		static constexpr bool value = false;
+	};
+
 	class TestDynamicPointer;
 	class TestSharedDynamicPointer;
 	class TestSharedDynamicPointerTyped;
+	class TestSharedDynamicPointerInline;
 
 	template<class T>
 	class DynamicPointer;
@@ -181,76 +234,366 @@ namespace dynamic_pointer
 	template<>
 	class SharedDynamicPointer<void>
 	{
-		public:
+			/*!
+			 * \brief Type of an inline payload. Inline payloads are trivially copyable, so they are copied and moved bytewise and need no destructor
+			 */
+			struct inline_type_t
+			{
+#ifdef DEBUG
+				const std::type_info *DataType;
+#endif
+			};
 
 			template<class T>
-			SharedDynamicPointer(T *MemPtr)
-				: _MemData(MemPtr,
-						   //&SharedDynamicPointer<void>::Destructor<T>)
-						   std::is_destructible<T>::value
-								? [](const void *ClassPtr){ if(!ClassPtr) {static_cast<const T*>(ClassPtr)->~T(); delete static_cast<const T*>(ClassPtr); }}
-								: [](const void *ClassPtr){ if(!ClassPtr) {delete static_cast<const T*>(ClassPtr); }})
+			static constexpr inline_type_t InlineType = inline_type_t{
 #ifdef DEBUG
-				, _DataType(&(typeid(T)))
+					&(typeid(T))
 #endif
-			{}
+				};
+
+			/*!
+			 * \brief Header of heap payloads. Destroys payload and header once the last reference is gone
+			 */
+			struct shared_block_t
+			{
+				using destroy_fcn_t = void(shared_block_t *Block, void *Data) noexcept;
+
+				atomic<size_t> RefCount{1};
+
+				destroy_fcn_t *const Destroy;
+
+#ifdef DEBUG
+				const std::type_info *DataType = &(typeid(void));
+#endif
+
+				explicit shared_block_t(destroy_fcn_t *_Destroy)
+					: Destroy(_Destroy)
+				{}
+			};
+
+			/*!
+			 * \brief Header and payload in one allocation
+			 */
+			template<class T>
+			struct shared_block_data_t : public shared_block_t
+			{
+				T Data;
+
+				template<class ...Args>
+				explicit shared_block_data_t(destroy_fcn_t *_Destroy, Args &&...Arguments)
+					: shared_block_t(_Destroy),
+					  Data(std::forward<Args>(Arguments)...)
+				{}
+			};
+
+		public:
+
+			/*!
+			 * \brief Can T be stored inline
+			 */
+			template<class T>
+			static constexpr bool IsInline = sizeof(T) <= DynamicPointerInlineSize &&
+											 alignof(T) <= alignof(void*) &&
+											 std::is_trivially_copyable<T>::value &&
+											 dynamic_pointer_inline_t<T>::value;
+
+			/*!
+			 * \brief Creates a T from Arguments. Small trivially copyable payloads are stored inline. Others are stored on the heap or in their pool, in one allocation with their reference count
+			 *
+			 * Copies of an inline payload are bytewise copies. Like a heap payload with a use count above one, it must not be modified once the pointer was copied
+			 */
+			template<class T, class ...Args>
+			static SharedDynamicPointer Create(Args &&...Arguments)
+			{
+				SharedDynamicPointer tmpPtr;
+
+				if constexpr (IsInline<T>)
+				{
+					new (tmpPtr._InlineData) T(std::forward<Args>(Arguments)...);
+					tmpPtr._InlineType = &InlineType<T>;
+				}
+				else
+				{
+					shared_block_data_t<T> *pBlock;
+					if constexpr (dynamic_pointer_pooled_t<T>::value)
+					{
+						void *const pMemData = DynamicPointerPool<shared_block_data_t<T>>::Allocate();
+						try
+						{
+							pBlock = new (pMemData) shared_block_data_t<T>(&SharedDynamicPointer::DestroyPooledBlock<T>, std::forward<Args>(Arguments)...);
+						}
+						catch(...)
+						{
+							DynamicPointerPool<shared_block_data_t<T>>::Free(pMemData);
+							throw;
+						}
+					}
+					else
+						pBlock = new shared_block_data_t<T>(&SharedDynamicPointer::DestroyBlock<T>, std::forward<Args>(Arguments)...);
 
-			SharedDynamicPointer()
-				: _MemData(),
 #ifdef DEBUG
-				  _DataType(&(typeid(void)))
+					pBlock->DataType = &(typeid(T));
 #endif
+					tmpPtr._Heap.Block = pBlock;
+					tmpPtr._Heap.MemData = std::addressof(pBlock->Data);
+				}
+
+				return tmpPtr;
+			}
+
+			/*!
+			 * \brief Pool statistics of T. Only used if T is pooled
+			 */
+			template<class T>
+			static pool_statistics_t GetPoolStatistics()
+			{
+				return DynamicPointerPool<shared_block_data_t<T>>::GetStatistics();
+			}
+
+			/*!
+			 * \brief Takes ownership of MemPtr, which must have been allocated with new. The reference count is allocated separately
+			 */
+			template<class T>
+			SharedDynamicPointer(T *MemPtr)
+				: _Heap{MemPtr, SharedDynamicPointer::CreateExternalBlock(MemPtr)}
 			{}
 
-			~SharedDynamicPointer() = default;
+			SharedDynamicPointer() = default;
 
-			SharedDynamicPointer(const SharedDynamicPointer &S) = default;
-			SharedDynamicPointer &operator=(const SharedDynamicPointer &S) = default;
-			SharedDynamicPointer(SharedDynamicPointer &&S) = default;
-			SharedDynamicPointer &operator=(SharedDynamicPointer &&S) = default;
+			~SharedDynamicPointer()
+			{
+				this->Reset();
+			}
+
+			SharedDynamicPointer(const SharedDynamicPointer &S) noexcept
+			{
+				this->CopyFrom(S);
+			}
+
+			SharedDynamicPointer &operator=(const SharedDynamicPointer &S) noexcept
+			{
+				if(this != &S)
+				{
+					this->Reset();
+					this->CopyFrom(S);
+				}
+
+				return *this;
+			}
+
+			SharedDynamicPointer(SharedDynamicPointer &&S) noexcept
+			{
+				this->MoveFrom(S);
+			}
+
+			SharedDynamicPointer &operator=(SharedDynamicPointer &&S) noexcept
+			{
+				if(this != &S)
+				{
+					this->Reset();
+					this->MoveFrom(S);
+				}
+
+				return *this;
+			}
 
 			template<class T>
 			T *Get()
 			{
-				return reinterpret_cast<T*>(this->_MemData.get());
+				if(this->_InlineType != nullptr)
+					return reinterpret_cast<T*>(this->_InlineData);
+
+				return reinterpret_cast<T*>(this->_Heap.MemData);
 			}
 
 			template<class T>
 			const T *Get() const
 			{
-				return reinterpret_cast<const T*>(this->_MemData.get());
+				if(this->_InlineType != nullptr)
+					return reinterpret_cast<const T*>(this->_InlineData);
+
+				return reinterpret_cast<const T*>(this->_Heap.MemData);
+			}
+
+			/*!
+			 * \brief Is the payload stored inline
+			 */
+			bool IsStoredInline() const noexcept
+			{
+				return this->_InlineType != nullptr;
+			}
+
+			/*!
+			 * \brief Number of reference count increments and decrements of all pointers so far. Always 0 unless DYNAMIC_POINTER_COUNT_REFERENCE_OPS is set
+			 */
+			static size_t GetReferenceOpCount() noexcept
+			{
+				return SharedDynamicPointer::_ReferenceOps.load(std::memory_order_relaxed);
+			}
+
+			/*!
+			 * \brief Number of pointers sharing the heap payload. Inline payloads are never shared. If it returns 1, the caller may modify the payload
+			 */
+			size_t GetUseCount() const noexcept
+			{
+				if(this->_InlineType != nullptr)
+					return 1;
+
+				if(this->_Heap.Block != nullptr)
+					return this->_Heap.Block->RefCount.load(std::memory_order_acquire);
+
+				return 0;
 			}
 
 #ifdef DEBUG
 			std::string PrintType() const
 			{
-				return _DataType->name();
+				if(this->_InlineType != nullptr)
+					return this->_InlineType->DataType->name();
+
+				if(this->_Heap.Block != nullptr)
+					return this->_Heap.Block->DataType->name();
+
+				return typeid(void).name();
 			}
 #endif
 
 		private:
 
-			shared_ptr<void> _MemData;
+			struct heap_payload_t
+			{
+				void *MemData;
+
+				/*!
+				 * \brief Reference count of heap payload
+				 */
+				shared_block_t *Block;
+			};
+
+			/*!
+			 * \brief Heap payload or inline payload, depending on _InlineType
+			 */
+			union
+			{
+				heap_payload_t _Heap{nullptr, nullptr};
+
+				alignas(void*) unsigned char _InlineData[DynamicPointerInlineSize];
+			};
+
+			/*!
+			 * \brief Type of the inline payload. nullptr if the payload is on the heap or there is none
+			 */
+			const inline_type_t *_InlineType = nullptr;
+
+			inline static atomic<size_t> _ReferenceOps{0};
+
+			static void CountReferenceOp() noexcept
+			{
+				if constexpr (DynamicPointerCountReferenceOps)
+					SharedDynamicPointer::_ReferenceOps.fetch_add(1, std::memory_order_relaxed);
+			}
+
+			/*!
+			 * \brief Decrements the reference count. Returns true if this was the last reference
+			 */
+			static bool ReleaseReference(shared_block_t &Block) noexcept
+			{
+				SharedDynamicPointer::CountReferenceOp();
+				return Block.RefCount.fetch_sub(1, std::memory_order_acq_rel) == 1;
+			}
+
+			/*!
+			 * \brief Shares the heap payload of S or copies its inline payload. This pointer must be empty
+			 */
+			void CopyFrom(const SharedDynamicPointer &S) noexcept
+			{
+				std::memcpy(this->_InlineData, S._InlineData, DynamicPointerInlineSize);
+				this->_InlineType = S._InlineType;
+
+				if(this->_InlineType == nullptr && this->_Heap.Block != nullptr)
+				{
+					SharedDynamicPointer::CountReferenceOp();
+					this->_Heap.Block->RefCount.fetch_add(1, std::memory_order_relaxed);
+				}
+			}
+
+			/*!
+			 * \brief Takes the payload of S and leaves S empty. This pointer must be empty
+			 */
+			void MoveFrom(SharedDynamicPointer &S) noexcept
+			{
+				std::memcpy(this->_InlineData, S._InlineData, DynamicPointerInlineSize);
+				this->_InlineType = S._InlineType;
+
+				S._Heap = heap_payload_t{nullptr, nullptr};
+				S._InlineType = nullptr;
+			}
+
+			/*!
+			 * \brief Drops the reference to the heap payload or forgets the inline payload
+			 */
+			void Reset() noexcept
+			{
+				if(this->_InlineType == nullptr && this->_Heap.Block != nullptr)
+				{
+					// The only owner can destroy the payload without a read-modify-write, no other thread can take a reference anymore
+					if(this->_Heap.Block->RefCount.load(std::memory_order_acquire) == 1 || SharedDynamicPointer::ReleaseReference(*(this->_Heap.Block)))
+						this->_Heap.Block->Destroy(this->_Heap.Block, this->_Heap.MemData);
+				}
+
+				this->_Heap = heap_payload_t{nullptr, nullptr};
+				this->_InlineType = nullptr;
+			}
+
+			template<class T>
+			static shared_block_t *CreateExternalBlock(T *MemPtr)
+			{
+				if(MemPtr == nullptr)
+					return nullptr;
+
+				shared_block_t *pBlock;
+				try
+				{
+					pBlock = new shared_block_t(&SharedDynamicPointer::DestroyExternal<T>);
+				}
+				catch(...)
+				{
+					delete MemPtr;
+					throw;
+				}
 
 #ifdef DEBUG
-			const std::type_info *_DataType;
+				pBlock->DataType = &(typeid(T));
 #endif
 
+				return pBlock;
+			}
+
 			template<class T>
-			static void Destructor(const void *MemData)
+			static void DestroyBlock(shared_block_t *Block, void *) noexcept
 			{
-				if(MemData != nullptr)
-				{
-					if(std::is_destructible<T>::value)
-					{
-						reinterpret_cast<const T*>(MemData)->~T();
-					}
+				delete static_cast<shared_block_data_t<T>*>(Block);
+			}
 
-					delete reinterpret_cast<const T*>(MemData);
-				}
+			template<class T>
+			static void DestroyPooledBlock(shared_block_t *Block, void *) noexcept
+			{
+				auto *const pBlock = static_cast<shared_block_data_t<T>*>(Block);
+				pBlock->~shared_block_data_t<T>();
+
+				DynamicPointerPool<shared_block_data_t<T>>::Free(pBlock);
+			}
+
+			template<class T>
+			static void DestroyExternal(shared_block_t *Block, void *MemData) noexcept
+			{
+				delete static_cast<T*>(MemData);
+				delete Block;
 			}
 	};
 
+	static_assert(sizeof(SharedDynamicPointer<void>) == DynamicPointerInlineSize + sizeof(void*), "ERROR SharedDynamicPointer<void>: Inline storage must overlap the heap pointers");
+
 	template<type_number_t N, class ...DataTypes>
 	struct type_struct_t
 	{
@@ -0,0 +1,87 @@
+#include "dynamic_pointer_pool.h"
+#include "error_exception.h"
+
+#include <thread>
+
+namespace dynamic_pointer_pool
+{
+	using error_exception::Exception;
+
+	class TestDynamicPointerPool
+	{
+		public:
+			static bool Testing();
+
+		private:
+			struct test_data_t
+			{
+				char Data[40];
+			};
+
+			using test_pool_t = DynamicPointerPool<test_data_t>;
+	};
+
+	bool TestDynamicPointerPool::Testing()
+	{
+		try
+		{
+			// First allocation creates a slab, the following ones are served from the thread cache
+			void *const pFirst = test_pool_t::Allocate();
+			void *const pSecond = test_pool_t::Allocate();
+
+			auto testStatistics = test_pool_t::GetStatistics();
+			if(pFirst == pSecond || testStatistics.Misses != 1 || testStatistics.Hits != 1 || testStatistics.ResidentBytes < PoolSlabBlocks*sizeof(test_data_t))
+				return 0;
+
+			test_pool_t::Free(pSecond);
+			if(test_pool_t::Allocate() != pSecond)
+				return 0;
+
+			// Blocks allocated here and freed on another thread come back through the shared list
+			vector_type<void*> testBlocks;
+			for(size_t curBlock = 0; curBlock < 4*PoolSlabBlocks; ++curBlock)
+				testBlocks.push_back(test_pool_t::Allocate());
+
+			const size_t testResident = test_pool_t::GetStatistics().ResidentBytes;
+
+			std::thread testFreeThread([&testBlocks]()
+			{
+				for(void *const pBlock : testBlocks)
+					test_pool_t::Free(pBlock);
+			});
+			testFreeThread.join();
+
+			if(test_pool_t::GetInstance()._SharedBlocks.Size != testBlocks.size())
+				return 0;
+
+			for(size_t curBlock = 0; curBlock < testBlocks.size(); ++curBlock)
+				test_pool_t::Allocate();
+
+			if(test_pool_t::GetStatistics().ResidentBytes != testResident)
+				return 0;
+
+			// Hits are counted per thread and kept by the pool after the thread ended
+			const auto testPrevStatistics = test_pool_t::GetStatistics();
+			const size_t testNumCaches = test_pool_t::GetInstance()._Caches.size();
+
+			std::thread testAllocThread([]()
+			{
+				test_pool_t::Free(test_pool_t::Allocate());
+				test_pool_t::Free(test_pool_t::Allocate());
+			});
+			testAllocThread.join();
+
+			testStatistics = test_pool_t::GetStatistics();
+			if(testStatistics.Hits + testStatistics.Misses != testPrevStatistics.Hits + testPrevStatistics.Misses + 2 ||
+					testStatistics.Hits < testPrevStatistics.Hits + 1 ||
+					test_pool_t::GetInstance()._Caches.size() != testNumCaches)
+				return 0;
+
+			return 1;
+		}
+		catch(Exception &)
+		{
+			return 0;
+		}
+	}
+}
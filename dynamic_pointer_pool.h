@@ -0,0 +1,314 @@
+#ifndef DYNAMIC_POINTER_POOL_H
+#define DYNAMIC_POINTER_POOL_H
+
+/*! \file dynamic_pointer_pool.h
+ *  \brief Header for DynamicPointerPool class
+ */
+
+
+#include "vector_t.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+/*!
+ *  \brief Namespace for DynamicPointerPool class
+ */
+namespace dynamic_pointer_pool
+{
+	using std::atomic;
+	using std::mutex;
+	using std::lock_guard;
+	using std::unique_ptr;
+
+	using vector_t::vector_type;
+
+	class TestDynamicPointerPool;
+
+	/*!
+	 * \brief Number of blocks allocated at once when a pool runs empty
+	 */
+	static constexpr size_t PoolSlabBlocks = 64;
+
+	/*!
+	 * \brief Maximum number of free blocks a thread keeps for itself. Further freed blocks go to the shared list
+	 */
+	static constexpr size_t PoolLocalCacheBlocks = 128;
+
+	/*!
+	 * \brief Number of blocks moved between a thread cache and the shared list at once
+	 */
+	static constexpr size_t PoolTransferBlocks = 64;
+
+	struct pool_statistics_t
+	{
+		/*!
+		 * \brief Allocations served from free blocks
+		 */
+		size_t Hits = 0;
+
+		/*!
+		 * \brief Allocations that required a new slab
+		 */
+		size_t Misses = 0;
+
+		/*!
+		 * \brief Memory held by all slabs of the pool. Slabs are never returned to the system
+		 */
+		size_t ResidentBytes = 0;
+	};
+
+	/*!
+	 * \brief Pool of memory blocks for objects of type T. One pool exists per type
+	 *
+	 * Each thread keeps a cache of free blocks, so allocating and freeing usually takes no lock. Blocks freed on a consumer thread collect in its cache,
+	 * overflow into a shared list in batches and are picked up from there by the allocating threads
+	 */
+	template<class T>
+	class DynamicPointerPool
+	{
+			union block_t
+			{
+				block_t *Next;
+				alignas(T) unsigned char Data[sizeof(T)];
+			};
+
+			struct free_list_t
+			{
+				block_t *Head = nullptr;
+				size_t Size = 0;
+
+				void Push(block_t *Block) noexcept
+				{
+					Block->Next = this->Head;
+					this->Head = Block;
+					++this->Size;
+				}
+
+				block_t *Pop() noexcept
+				{
+					block_t *const pBlock = this->Head;
+					this->Head = pBlock->Next;
+					--this->Size;
+
+					return pBlock;
+				}
+
+				/*!
+				 * \brief Moves up to NumBlocks blocks to Dst
+				 */
+				void Transfer(free_list_t &Dst, size_t NumBlocks) noexcept
+				{
+					while(this->Head != nullptr && NumBlocks-- > 0)
+						Dst.Push(this->Pop());
+				}
+			};
+
+			/*!
+			 * \brief Free blocks and allocation count of one thread. Registered with the pool while the thread runs. Blocks and count go to the pool when the thread ends
+			 */
+			struct local_cache_t
+			{
+				free_list_t FreeBlocks;
+
+				/*!
+				 * \brief Allocations served from FreeBlocks. Only written by the owning thread, so counting needs no shared cache line
+				 */
+				atomic<size_t> Hits{0};
+
+				local_cache_t()
+				{
+					DynamicPointerPool::GetInstance().AddCache(this);
+				}
+
+				~local_cache_t()
+				{
+					DynamicPointerPool::GetInstance().RemoveCache(this);
+					DynamicPointerPool::_LocalCacheDestroyed = true;
+				}
+			};
+
+		public:
+			/*!
+			 * \brief Allocates uninitialized memory for one T
+			 */
+			static void *Allocate()
+			{
+				local_cache_t *const pCache = GetLocalCache();
+				if(pCache != nullptr && pCache->FreeBlocks.Head != nullptr)
+				{
+					pCache->Hits.store(pCache->Hits.load(std::memory_order_relaxed)+1, std::memory_order_relaxed);
+					return pCache->FreeBlocks.Pop()->Data;
+				}
+
+				return GetInstance().AllocateSlow(pCache != nullptr ? &(pCache->FreeBlocks) : nullptr);
+			}
+
+			/*!
+			 * \brief Returns memory from Allocate(). Can be called from any thread
+			 */
+			static void Free(void *Data) noexcept
+			{
+				block_t *const pBlock = reinterpret_cast<block_t*>(Data);
+
+				local_cache_t *const pCache = GetLocalCache();
+				if(pCache == nullptr)
+				{
+					free_list_t tmpList;
+					tmpList.Push(pBlock);
+					GetInstance().ReturnBlocks(tmpList, 1);
+
+					return;
+				}
+
+				pCache->FreeBlocks.Push(pBlock);
+				if(pCache->FreeBlocks.Size > PoolLocalCacheBlocks)
+					GetInstance().ReturnBlocks(pCache->FreeBlocks, PoolTransferBlocks);
+			}
+
+			/*!
+			 * \brief Sums the counts of the pool and of all running threads. Counts of other threads may lag behind by a few allocations
+			 */
+			static pool_statistics_t GetStatistics()
+			{
+				auto &pool = GetInstance();
+				lock_guard<mutex> lock(pool._Lock);
+
+				pool_statistics_t tmpStatistics;
+				tmpStatistics.Hits = pool._Hits;
+				tmpStatistics.Misses = pool._Misses;
+				tmpStatistics.ResidentBytes = pool._ResidentBytes;
+
+				for(const local_cache_t *const pCache : pool._Caches)
+					tmpStatistics.Hits += pCache->Hits.load(std::memory_order_relaxed);
+
+				return tmpStatistics;
+			}
+
+		private:
+			/*!
+			 * \brief Protects all members below
+			 */
+			mutex _Lock;
+
+			/*!
+			 * \brief Free blocks that are not in any thread cache
+			 */
+			free_list_t _SharedBlocks;
+
+			vector_type<unique_ptr<block_t[]>> _Slabs;
+
+			/*!
+			 * \brief Thread caches of running threads
+			 */
+			vector_type<local_cache_t*> _Caches;
+
+			/*!
+			 * \brief Hits of the shared list and of ended threads. Fast path hits are counted in each thread cache
+			 */
+			size_t _Hits = 0;
+			size_t _Misses = 0;
+			size_t _ResidentBytes = 0;
+
+			inline static thread_local local_cache_t _LocalCache;
+
+			/*!
+			 * \brief Set once _LocalCache of this thread was destroyed. Blocks freed afterwards go to the shared list directly
+			 */
+			inline static thread_local bool _LocalCacheDestroyed = false;
+
+			DynamicPointerPool() = default;
+
+			/*!
+			 * \brief The pool is never destroyed, so that blocks can still be freed while static and thread local objects are torn down
+			 */
+			static DynamicPointerPool &GetInstance()
+			{
+				static DynamicPointerPool *const pInstance = new DynamicPointerPool();
+				return *pInstance;
+			}
+
+			static local_cache_t *GetLocalCache() noexcept
+			{
+				if(_LocalCacheDestroyed)
+					return nullptr;
+
+				return &_LocalCache;
+			}
+
+			void AddCache(local_cache_t *Cache)
+			{
+				lock_guard<mutex> lock(this->_Lock);
+				this->_Caches.push_back(Cache);
+			}
+
+			/*!
+			 * \brief Moves blocks and hits of an ending thread to the pool
+			 */
+			void RemoveCache(local_cache_t *Cache) noexcept
+			{
+				lock_guard<mutex> lock(this->_Lock);
+
+				Cache->FreeBlocks.Transfer(this->_SharedBlocks, Cache->FreeBlocks.Size);
+				this->_Hits += Cache->Hits.load(std::memory_order_relaxed);
+
+				for(auto curCache = this->_Caches.begin(); curCache != this->_Caches.end(); ++curCache)
+				{
+					if(*curCache == Cache)
+					{
+						*curCache = this->_Caches.back();
+						this->_Caches.pop_back();
+						break;
+					}
+				}
+			}
+
+			/*!
+			 * \brief Refills the thread cache from the shared list, or from a new slab if the shared list is empty
+			 */
+			void *AllocateSlow(free_list_t *Cache)
+			{
+				free_list_t tmpList;
+				free_list_t &dstList = Cache != nullptr ? *Cache : tmpList;
+
+				{
+					lock_guard<mutex> lock(this->_Lock);
+
+					this->_SharedBlocks.Transfer(dstList, PoolTransferBlocks);
+					if(dstList.Head == nullptr)
+					{
+						this->_Slabs.emplace_back(new block_t[PoolSlabBlocks]);
+
+						block_t *const pSlab = this->_Slabs.back().get();
+						for(size_t curBlock = 0; curBlock < PoolSlabBlocks; ++curBlock)
+							dstList.Push(pSlab + curBlock);
+
+						++this->_Misses;
+						this->_ResidentBytes += sizeof(block_t)*PoolSlabBlocks;
+					}
+					else
+						++this->_Hits;
+				}
+
+				block_t *const pBlock = dstList.Pop();
+
+				// Without a thread cache, the rest of the batch goes straight back
+				if(Cache == nullptr)
+					this->ReturnBlocks(tmpList, tmpList.Size);
+
+				return pBlock->Data;
+			}
+
+			void ReturnBlocks(free_list_t &Src, size_t NumBlocks) noexcept
+			{
+				lock_guard<mutex> lock(this->_Lock);
+				Src.Transfer(this->_SharedBlocks, NumBlocks);
+			}
+
+			friend class TestDynamicPointerPool;
+	};
+} // namespace dynamic_pointer_pool
+
+
+#endif // DYNAMIC_POINTER_POOL_H
@@ -3,22 +3,73 @@
 namespace global_message_queue_thread
 {
 	constexpr decltype(GlobalMessageQueueThread::QueueID) GlobalMessageQueueThread::QueueID;
+	constexpr decltype(GlobalMessageQueueThread::DefaultShardCount) GlobalMessageQueueThread::DefaultShardCount;
 
-	GlobalMessageQueueThread::GlobalMessageQueueThread()
-		: thread_multi_module_manager_t(GlobalMessageQueueThread::QueueID, thread_queued::THREAD_PAUSED)
+	thread_local GlobalMessageQueueThread::thread_routing_readers_t GlobalMessageQueueThread::_ThreadReaders;
+
+	GlobalMessageQueueThread::thread_routing_readers_t::~thread_routing_readers_t()
+	{
+		for(auto &curEntry : this->Readers)
+			curEntry.Reader->InUse.store(false, std::memory_order_release);
+	}
+
+	GlobalMessageQueueThread::routing_guard_t::routing_guard_t(const GlobalMessageQueueThread &Router)
+		: _Reader(Router.GetThreadReader())
+	{
+		// Nested guards keep the snapshot of the outer one
+		if(this->_Reader.GuardDepth++ == 0)
+			this->_Routing = Router.LoadRouting(this->_Reader);
+		else
+			this->_Routing = this->_Reader.Routing;
+	}
+
+	GlobalMessageQueueThread::routing_guard_t::~routing_guard_t()
+	{
+		if(--(this->_Reader.GuardDepth) == 0)
+			GlobalMessageQueueThread::ReleaseRouting(this->_Reader);
+	}
+
+	GlobalMessageQueueThread::router_shard_t::router_shard_t(GlobalMessageQueueThread &Router)
+		: Propagation(&Router),
+		  Thread(&GlobalMessageQueueThread::PropagateMessageToQueues, &(this->Propagation), thread_queued::THREAD_PAUSED)
+	{
+		this->Propagation.Thread = &(this->Thread);
+		this->Thread.SetDropFunction(&GlobalMessageQueueThread::DiscardRoutedMessage);
+	}
+
+	GlobalMessageQueueThread::GlobalMessageQueueThread(size_t ShardCount)
+		: thread_multi_module_manager_t(GlobalMessageQueueThread::QueueID, thread_queued::THREAD_PAUSED),
+		  _MessageTimers(&GlobalMessageQueueThread::PushTimedMessage, this),
+		  _Propagation(this),
+		  _Routing(new routing_snapshot_t())
 	{
 		// Set correct callback function
 		//this->_MessageCallbackFcn = bind(&GlobalMessageQueueThread::PropagateMessageToQueues, this, std::placeholders::_1);
 		this->SetMessageFunction(&GlobalMessageQueueThread::PropagateMessageToQueues);;
-		this->SetExtraData(this);
+		this->SetExtraData(&(this->_Propagation));
+		this->SetDropFunction(&GlobalMessageQueueThread::DiscardRoutedMessage);
+
+		// The global queue thread is the first router thread
+		for(size_t curShard = 1; curShard < ShardCount; ++curShard)
+			this->_Shards.push_back(unique_ptr<router_shard_t>(new router_shard_t(*this)));
 
 		this->SetThreadState(thread_queued::THREAD_RUNNING);
 	}
 
 	GlobalMessageQueueThread::~GlobalMessageQueueThread()
 	{
-		// Stop thread before deleting queues
-		this->thread_multi_module_manager_t::~thread_multi_module_manager_t();
+		// Timed messages must not be pushed anymore
+		this->_MessageTimers.Stop();
+
+		// Stop threads before deleting queues
+		for(auto &curShard : this->_Shards)
+			curShard->Thread.ShutdownThread();
+
+		this->ShutdownThread();
+
+		// No thread reads the snapshots anymore. Producer threads keep their readers until they exit
+		this->_RetiredRoutings.clear();
+		delete this->_Routing.load();
 	}
 
 	void GlobalMessageQueueThread::RegisterQueue(const thread_multi_module_manager_shared_ptr_t &NewMessageQueue)
@@ -27,7 +78,18 @@ namespace global_message_queue_thread
 		std::cout << "Registering queue with ID " << NewMessageQueue->GetID().MessageQueueID << ":" << NewMessageQueue->GetID().ModuleID << ":" << NewMessageQueue->GetID().ThreadID << "\n";
 #endif
 
+		// Move queue to the scheduler before it receives messages
+		ThreadScheduler *const scheduler = this->GetScheduler();
+		if(scheduler != nullptr)
+			NewMessageQueue->SetScheduler(scheduler);
+
+		lock_guard<mutex> routingLock(this->_RoutingLock);
+
 		this->Register(NewMessageQueue);
+
+		auto routing = this->CopyRoutingNoLock();
+		routing->QueueRoutes[NewMessageQueue->GetID().GetQueueKey()].Queue = NewMessageQueue;
+		this->PublishRoutingNoLock(std::move(routing));
 	}
 
 	thread_multi_module_shared_ptr_t GlobalMessageQueueThread::UnregisterQueue(const thread_multi_module_manager_shared_ptr_t &MessageQueueToUnregister)
@@ -35,28 +97,33 @@ namespace global_message_queue_thread
 		bool queueFound = false;
 		identifier_t deleteQueueID(0,0,0);
 
-		this->_LockLinks.lock();
-
-		this->_ModuleListLock.lock();
+		this->_RoutingLock.lock();
 
 		// Look for queue and store ID
-		auto deleteQueue = this->FindQueueNoLock(MessageQueueToUnregister->GetID().MessageQueueID, MessageQueueToUnregister->GetID().ThreadID);
-		if(deleteQueue != this->_Modules.end())
+		auto routing = this->CopyRoutingNoLock();
+		auto deleteQueue = routing->QueueRoutes.find(MessageQueueToUnregister->GetID().GetQueueKey());
+		if(deleteQueue != routing->QueueRoutes.end())
 		{
-			// Store queue ID to delete later. This must be done separately (see below) to be able to unlock the mutex again
+			// Store queue ID to delete later
 			queueFound = true;
-			deleteQueueID = (*deleteQueue)->GetID();
+			deleteQueueID = deleteQueue->second.Queue->GetID();
+
+			// Stop routing messages to the queue. Messages that are being propagated with the old snapshot may still reach it, they are counted as not accepted once the queue stops accepting messages
+			routing->QueueRoutes.erase(deleteQueue);
+			this->PublishRoutingNoLock(std::move(routing));
 		}
 
+		this->_LockLinks.lock();
+
 		// Go through all queue modules and unlink them
 		for(const auto &curModule : MessageQueueToUnregister->GetModulesNoLock())
 		{
 			MessageQueueToUnregister->UnlinkModuleNoLock(curModule->GetID());
 		}
 
-		this->_LockLinks.lock();
+		this->_LockLinks.unlock();
 
-		this->_ModuleListLock.unlock();
+		this->_RoutingLock.unlock();
 
 		// Delete queue if it was found
 		if(queueFound)
@@ -72,41 +139,39 @@ namespace global_message_queue_thread
 
 	void GlobalMessageQueueThread::RegisterModule(const thread_multi_module_shared_ptr_t &NewModule, const id_vector_t &SenderLinks, const id_vector_t &ReceiverLinks)
 	{
-		this->_LockLinks.lock();
-
-		this->_ModuleListLock.lock();
+		// The links are only published if the queue accepted the module
+		lock_guard<mutex> routingLock(this->_RoutingLock);
 
 		// Save links
+		auto routing = this->CopyRoutingNoLock();
+
 		for(const auto &curID : SenderLinks)
-			this->LinkIDsNoLock(this->_SenderIDLinks, curID, NewModule->GetID());
+			routing->SenderIDLinks.Link(curID, NewModule->GetID());
 
 		for(const auto &curID : ReceiverLinks)
-			this->LinkIDsNoLock(this->_ReceiverIDLinks, curID, NewModule->GetID());
-
+			routing->ReceiverIDLinks.Link(curID, NewModule->GetID());
 
 		// Find correct queue
-		auto moduleQueue = this->FindQueueNoLock(NewModule->GetID().MessageQueueID, NewModule->GetID().ThreadID);
-		if(moduleQueue != this->_Modules.end())
+		const auto *const moduleQueue = GlobalMessageQueueThread::FindQueueRoute(*routing, NewModule->GetID().MessageQueueID, NewModule->GetID().ThreadID);
+		if(moduleQueue != nullptr)
 		{
 			// Register to manager
 
 			// Create registration message
 			auto registrationMessage = module_registration_message_t::CreateMessageToReceiver(ModuleRegistrationID, module_registration_message_t(NewModule, id_vector_t(SenderLinks), id_vector_t(ReceiverLinks)));
 
-			// Register module
+			// Register module. If an earlier module with this ID waits for its unregistration, the queue registers this one after it
 #ifdef DEBUG
 			std::cout << "Registering module with ID " << NewModule->GetID().MessageQueueID << ":" << NewModule->GetID().ModuleID << ":" << NewModule->GetID().ThreadID << "\n";
 #endif
-			(*moduleQueue)->HandleMessage(registrationMessage);
+			moduleQueue->Queue->HandleMessage(registrationMessage);
 		}
 #ifdef DEBUG
 		else
 			std::cout << "Couldn't find queue for module ID" << NewModule->GetID().MessageQueueID << ":" << NewModule->GetID().ModuleID << ":" << NewModule->GetID().ThreadID << "\n";
 #endif
 
-		this->_ModuleListLock.unlock();
-
-		this->_LockLinks.unlock();
+		this->PublishRoutingNoLock(std::move(routing));
 	}
 
 	void GlobalMessageQueueThread::RegisterModule(const thread_multi_module_shared_ptr_t &NewModule, id_vector_t &&SendLinks, id_vector_t &&ReceiverLinks)
@@ -117,383 +182,1837 @@ namespace global_message_queue_thread
 	thread_multi_module_shared_ptr_t GlobalMessageQueueThread::UnregisterModule(identifier_t ModuleID)
 	{
 		thread_multi_module_shared_ptr_t retVal;
+		module_shared_ptr_t moduleQueue;
+		size_t shardIndex;
 
-		this->_LockLinks.lock();
+		{
+			lock_guard<mutex> routingLock(this->_RoutingLock);
 
-		this->_ModuleListLock.lock();
+			auto routing = this->CopyRoutingNoLock();
 
-		// Find correct queue that has registered module
-		auto moduleQueue = this->FindQueueNoLock(ModuleID.MessageQueueID, ModuleID.ThreadID);
-		if(moduleQueue != this->_Modules.end())
-		{
-			// Unregister from manager
+			// Messages to the module that were pushed while it was linked use the first router thread. The unregistration must follow them
+			shardIndex = this->SelectShardIndex(*routing, ModuleRegistrationID, ModuleID);
 
-			// Create registration message
-			module_unregistration_message_t unregistrationMessageData{ModuleID, &retVal};
+			// Find correct queue that has registered module
+			const auto *const moduleRoute = GlobalMessageQueueThread::FindQueueRoute(*routing, ModuleID.MessageQueueID, ModuleID.ThreadID);
+			if(moduleRoute != nullptr)
+			{
+				auto *const pModuleQueue = dynamic_cast<thread_multi_module_manager_t*>(moduleRoute->Queue.get());
+				if(pModuleQueue != nullptr)
+				{
+					// A module that still waits for the unregistration of its predecessor is never registered. That unregistration is already on its way
+					retVal = pModuleQueue->CancelDeferredRegistration(ModuleID);
+					if(retVal == nullptr)
+					{
+						// Announced while the routing lock is held, so that a following registration of this ID waits for it
+						retVal = pModuleQueue->AnnounceUnregistration(ModuleID);
+						if(retVal != nullptr)
+							moduleQueue = moduleRoute->Queue;
+					}
+				}
+			}
+
+			// Unlink from this module
+			routing->SenderIDLinks.UnlinkModule(ModuleID);
+			routing->ReceiverIDLinks.UnlinkModule(ModuleID);
 
-			thread_multi_module_message_t unregistrationMessage(ModuleRegistrationID, ModuleRegistrationID, message_t(ModuleUnregistrationMessageType, 0), message_ptr(new module_unregistration_message_t(std::move(unregistrationMessageData))));
+			this->PublishRoutingNoLock(std::move(routing));
+		}
 
-			// Unregister module (this function also stores the unregistered Module address in retVal)
+		if(moduleQueue != nullptr)
+		{
+			// Unregister from manager. The message takes the same router thread and lane as messages to the module, so the ones pushed before still reach it
 #ifdef DEBUG
 			std::cout << "Unregistering module with ID " << ModuleID.MessageQueueID << ":" << ModuleID.ModuleID << ":" << ModuleID.ThreadID << "\n";
 #endif
-			(*moduleQueue)->HandleMessage(unregistrationMessage);
+			auto unregistrationMessage = thread_multi_module_message_t(ModuleID, ModuleRegistrationID, message_t(ModuleUnregistrationMessageType, 0), message_ptr(new module_unregistration_message_t(ModuleID)));
+
+			// Router threads that were stopped don't propagate anymore, so the module queue gets the message right away
+			if(this->PushMessageToShard(thread_multi_module_message_t(unregistrationMessage), shardIndex) == thread_queued::QUEUE_PUSH_NOT_ACCEPTED)
+				moduleQueue->HandleMessage(unregistrationMessage);
 		}
 
-		// Unlink from this module
-		this->UnlinkModuleNoLock(ModuleID);
+		return retVal;
+	}
 
-		this->_LockLinks.unlock();
+	void GlobalMessageQueueThread::AddSendLink(identifier_t SendID, identifier_t ModuleID)
+	{
+		lock_guard<mutex> routingLock(this->_RoutingLock);
 
-		this->_ModuleListLock.unlock();
+		auto routing = this->CopyRoutingNoLock();
+		if(routing->SenderIDLinks.Link(SendID, ModuleID))
+		{
+			GlobalMessageQueueThread::LinkModuleInQueue(*routing, module_link_message_t(ModuleID, id_vector_t{SendID}, id_vector_t()));
+			this->PublishRoutingNoLock(std::move(routing));
+		}
+	}
 
-		return retVal;
+	void GlobalMessageQueueThread::AddReceiverLink(identifier_t ReceiverID, identifier_t ModuleID)
+	{
+		lock_guard<mutex> routingLock(this->_RoutingLock);
+
+		auto routing = this->CopyRoutingNoLock();
+		if(routing->ReceiverIDLinks.Link(ReceiverID, ModuleID))
+		{
+			GlobalMessageQueueThread::LinkModuleInQueue(*routing, module_link_message_t(ModuleID, id_vector_t(), id_vector_t{ReceiverID}));
+			this->PublishRoutingNoLock(std::move(routing));
+		}
+	}
+
+	void GlobalMessageQueueThread::LinkModuleInQueue(const routing_snapshot_t &Routing, module_link_message_t &&Links)
+	{
+		// Find queue that has registered module
+		const auto *const moduleQueue = GlobalMessageQueueThread::FindQueueRoute(Routing, Links.ModuleID.MessageQueueID, Links.ModuleID.ThreadID);
+		if(moduleQueue != nullptr)
+		{
+			auto linkMessage = module_link_message_t::CreateMessageToReceiver(ModuleRegistrationID, std::move(Links));
+			moduleQueue->Queue->HandleMessage(linkMessage);
+		}
 	}
 
-	void GlobalMessageQueueThread::PushMessage(thread_multi_module_message_t Message)
+	queue_push_result_t GlobalMessageQueueThread::PushMessage(thread_multi_module_message_t Message)
 	{
 #ifdef DEBUG
 		std::cout << "Pushing message type onto queue: " << Message.Get<MessageDataNum>().PrintType() << "\n";
 #endif
-		this->thread_multi_module_manager_t::PushMessage(Message);
+		const identifier_t receiverID = Message.Get<MessageReceiverIDNum>();
+
+		const queue_push_result_t pushResult = this->PushMessageToShard(std::move(Message));
+		if(pushResult != QUEUE_PUSH_SUCCESS)
+			return pushResult;
+
+		// Callers that hold a guard, like PushMessageDirect(), keep their snapshot for the check
+		const routing_guard_t routing(*this);
+
+		return GlobalMessageQueueThread::CheckReceiverSaturation(pushResult, receiverID, *routing);
 	}
 
-	void GlobalMessageQueueThread::PushMessageFront(thread_multi_module_message_t Message)
+	queue_push_result_t GlobalMessageQueueThread::PushMessageDirect(thread_multi_module_message_t Message)
 	{
+		const identifier_t senderID = Message.Get<MessageSenderIDNum>();
+		const identifier_t receiverID = Message.Get<MessageReceiverIDNum>();
+
+		// Registrations and stopped queues are handled by the global thread
+		if(senderID == ModuleRegistrationID || !this->GetMessageAcceptance())
+			return this->PushMessage(std::move(Message));
+
+		// Messages to the same receiver that are still waiting in a router thread must not be overtaken
+		if(this->GetRoutedMessages(receiverID).load(std::memory_order_acquire) != 0)
+			return this->PushMessage(std::move(Message));
+
+		const routing_guard_t routing(*this);
+
+		// Linked messages go to several queues, leave the expansion to the global thread. Copies of such messages are only counted for the original receiver,
+		// so messages to the linked modules take the same path
+		if(GlobalMessageQueueThread::IsLinkedMessage(*routing, senderID, receiverID))
+			return this->PushMessage(std::move(Message));
+
+		const auto *const receiverQueue = GlobalMessageQueueThread::FindQueueRoute(*routing, receiverID.MessageQueueID, receiverID.ThreadID);
+		if(receiverQueue == nullptr)
+			return this->PushMessage(std::move(Message));
+
+		auto *const pReceiverQueue = dynamic_cast<thread_multi_module_manager_t*>(receiverQueue->Queue.get());
+		if(pReceiverQueue == nullptr)
+			return this->PushMessage(std::move(Message));
+
+		// A full receiver is handled like on the router path. The router thread keeps the message and the producer learns that the receiver is saturated
+		if(pReceiverQueue->IsQueueSaturated())
+			return this->PushMessage(std::move(Message));
+
+		// Messages between modules of the same queue thread don't leave that thread
+		if(pReceiverQueue->PushLocalMessage(Message))
+			return QUEUE_PUSH_SUCCESS;
+
 #ifdef DEBUG
-		std::cout << "Pushing message type onto queue front: " << Message.Get<MessageDataNum>().PrintType() << "\n";
+		std::cout << "Pushing message type directly to queue with QueueID " << receiverID.MessageQueueID << " and ThreadID " << receiverID.ThreadID << ": " << Message.Get<MessageDataNum>().PrintType() << "\n";
 #endif
-		this->thread_multi_module_manager_t::PushMessageFront(Message);
+
+		return GlobalMessageQueueThread::CheckReceiverSaturation(pReceiverQueue->PushMessage(std::move(Message)), receiverID, *routing);
 	}
 
-	void GlobalMessageQueueThread::SetThreadState(thread_state_t ThreadState)
+	void GlobalMessageQueueThread::SetBatchSize(size_t BatchSize)
 	{
-		this->thread_multi_module_manager_t::SetThreadState(ThreadState);
+		this->thread_multi_module_manager_t::SetBatchSize(BatchSize);
+
+		for(auto &curShard : this->_Shards)
+			curShard->Thread.SetBatchSize(BatchSize);
 	}
 
-	GlobalMessageQueueThread::msg_struct_t GlobalMessageQueueThread::Pop()
+	void GlobalMessageQueueThread::SetLaneScheduling(queue_lane_scheduling_t LaneScheduling)
 	{
-		return thread_multi_module_manager_t::Pop();
+		this->thread_multi_module_manager_t::SetLaneScheduling(LaneScheduling);
+
+		for(auto &curShard : this->_Shards)
+			curShard->Thread.SetLaneScheduling(LaneScheduling);
 	}
 
-	void GlobalMessageQueueThread::PropagateMessageToQueues(msg_struct_t &Message, void *ExtraData)
+	void GlobalMessageQueueThread::SetLaneWeight(queue_lane_t Lane, queue_lane_weight_t Weight)
 	{
-		auto *const pClass = reinterpret_cast<GlobalMessageQueueThread*>(ExtraData);
-
-		const auto &senderID = Message.Get<MessageSenderIDNum>();
-		const auto &receiverID = Message.Get<MessageReceiverIDNum>();
+		this->thread_multi_module_manager_t::SetLaneWeight(Lane, Weight);
 
-		// Store all queues that should receive the message
-		vector_t<module_shared_ptr_t> queueReceivers;
+		for(auto &curShard : this->_Shards)
+			curShard->Thread.SetLaneWeight(Lane, Weight);
+	}
 
-		pClass->_LockLinks.lock();
+	void GlobalMessageQueueThread::SetQueueLimit(size_t MaxQueuedMessages, queue_overflow_policy_t OverflowPolicy)
+	{
+		this->thread_multi_module_manager_t::SetQueueLimit(MaxQueuedMessages, OverflowPolicy);
 
-		pClass->_ModuleListLock.lock();
+		for(auto &curShard : this->_Shards)
+			curShard->Thread.SetQueueLimit(MaxQueuedMessages, OverflowPolicy);
+	}
 
-#ifdef DEBUG
-		std::cout << "Propagating message type: " << Message.Get<MessageDataNum>().PrintType() << "\n";
-#endif
+	queue_overflow_stats_t GlobalMessageQueueThread::GetOverflowStats() const
+	{
+		auto overflowStats = this->thread_multi_module_manager_t::GetOverflowStats();
 
-		// Send to receiver queue
-		auto receiverQueue = pClass->FindQueueNoLock(receiverID.MessageQueueID, receiverID.ThreadID);
-		if(receiverQueue != pClass->_Modules.end())
+		for(const auto &curShard : this->_Shards)
 		{
-			queueReceivers.push_back(*receiverQueue);
-			//(*receiverQueue)->HandleMessage(Message);
+			const auto shardStats = curShard->Thread.GetOverflowStats();
 
-#ifdef DEBUG
-			std::cout << "\tTo Receiver queue with QueueID " << receiverID.MessageQueueID << " and ThreadID " << receiverID.ThreadID << "\n";
-#endif
+			overflowStats.RejectedMessages += shardStats.RejectedMessages;
+			overflowStats.DroppedOldestMessages += shardStats.DroppedOldestMessages;
+			overflowStats.DroppedNewestMessages += shardStats.DroppedNewestMessages;
+			overflowStats.BlockedPushes += shardStats.BlockedPushes;
+			overflowStats.NotAcceptedMessages += shardStats.NotAcceptedMessages;
 		}
 
-		// Send to receiver linked queues
-		pClass->AddLinkedQueues(queueReceivers, receiverID, pClass->_ReceiverIDLinks);
+		return overflowStats;
+	}
+
+	void GlobalMessageQueueThread::SetStatisticsEnabled(bool Enabled)
+	{
+		this->thread_multi_module_manager_t::SetStatisticsEnabled(Enabled);
+
+		for(auto &curShard : this->_Shards)
+			curShard->Thread.SetStatisticsEnabled(Enabled);
 
-		// Send to sender linked queues
-		pClass->AddLinkedQueues(queueReceivers, senderID, pClass->_SenderIDLinks);
+		this->_ModuleListLock.lock();
 
-		// Send to all receivers that require message
-		for(auto &curReceiverQueue : queueReceivers)
+		for(const auto &curQueue : this->_Modules)
 		{
-			curReceiverQueue->HandleMessage(Message);
+			auto *const pQueue = dynamic_cast<thread_multi_module_manager_t*>(curQueue.get());
+			if(pQueue != nullptr)
+				pQueue->SetStatisticsEnabled(Enabled);
 		}
 
-		pClass->_LockLinks.unlock();
-
-		pClass->_ModuleListLock.unlock();
+		this->_ModuleListLock.unlock();
 	}
 
-	GlobalMessageQueueThread::module_list_t::iterator GlobalMessageQueueThread::FindQueueNoLock(identifier_t::queue_id_t QueueID, identifier_t::thread_id_t MessageQueueThreadID)
+	timer_id_t GlobalMessageQueueThread::PushMessageAfter(timer_duration_t Delay, thread_multi_module_message_t Message)
 	{
-		// Find queue with ID
-		for(auto curIterator = this->_Modules.begin(); curIterator != this->_Modules.end(); ++curIterator)
-		{
-			const auto curID = (*curIterator)->GetID();
-			if(curID.MessageQueueID == QueueID && curID.ThreadID == MessageQueueThreadID)
-				return curIterator;
-		}
+		return this->_MessageTimers.AddTimer(Delay, std::move(Message));
+	}
 
-		return this->_Modules.end();
+	timer_id_t GlobalMessageQueueThread::PushMessagePeriodic(timer_duration_t Period, thread_multi_module_message_t Message)
+	{
+		return this->_MessageTimers.AddTimer(Period, std::move(Message), Period);
 	}
 
-	void GlobalMessageQueueThread::AddLinkedQueues(vector_t<module_shared_ptr_t> &Queues, identifier_t ID, id_link_vector_t &LinkedIDs)
+	bool GlobalMessageQueueThread::CancelTimedMessage(timer_id_t TimerID)
 	{
-		// Send to receiver linked queues
-		auto curLink = LinkedIDs.Find(ID);
-		if(curLink != LinkedIDs.end())
-		{
-			for(const auto &linkID : *curLink)
-			{
-				// Send to linked queue
-				auto linkedQueue = this->FindQueueNoLock(linkID.MessageQueueID, linkID.ThreadID);
-				if(linkedQueue != this->_Modules.end())
-				{
-					// Check that message isn't already in vector, then add it
-					if(Queues.end() == Queues.Find<identifier_t>(linkID, [] (const module_shared_ptr_t &ModulePtr, identifier_t ID) { return ModulePtr->GetID().MessageQueueID == ID.MessageQueueID && ModulePtr->GetID().ThreadID == ID.ThreadID; } ))
-					{
-						Queues.push_back(*linkedQueue);
+		return this->_MessageTimers.CancelTimer(TimerID);
+	}
 
-#ifdef DEBUG
-						std::cout << "\tTo linked queue with QueueID " << linkID.MessageQueueID << " and ThreadID " << linkID.ThreadID << "\n";
-#endif
-					}
-				}
-			}
-		}
+	void GlobalMessageQueueThread::PushTimedMessage(thread_multi_module_message_t &Message, void *ExtraData)
+	{
+		static_cast<GlobalMessageQueueThread*>(ExtraData)->PushMessage(std::move(Message));
 	}
 
-	void test()
+	void GlobalMessageQueueThread::SetScheduler(ThreadScheduler *Scheduler)
 	{
-		GlobalMessageQueueThread testQueue;
+		this->thread_multi_module_manager_t::SetScheduler(Scheduler);
 
-		thread_multi_module_message_t *pMsg = nullptr;
+		for(auto &curShard : this->_Shards)
+			curShard->Thread.SetScheduler(Scheduler);
 
-		testQueue.PushMessage(*pMsg);
+		// Switch queues without holding the list lock. SetScheduler() waits for running handlers, which may register modules
+		this->_ModuleListLock.lock();
+		const module_list_t queues = this->_Modules;
+		this->_ModuleListLock.unlock();
+
+		for(const auto &curQueue : queues)
+		{
+			auto *const pQueue = dynamic_cast<thread_multi_module_manager_t*>(curQueue.get());
+			if(pQueue != nullptr)
+				pQueue->SetScheduler(Scheduler);
+		}
 	}
-}
 
-#include "error_exception.h"
-#include "dynamic_pointer.h"
-#include "string_thread_message.h"
+	queue_statistics_t GlobalMessageQueueThread::GetQueueStatistics() const
+	{
+		auto stats = this->thread_multi_module_manager_t::GetQueueStatistics();
 
-namespace global_message_queue_thread
-{
-	using namespace error_exception;
-	using namespace dynamic_pointer;
-	using namespace silkstring_message;
+		for(const auto &curShard : this->_Shards)
+			stats.Add(curShard->Thread.GetQueueStatistics());
 
-	using thread_queued::THREAD_PAUSED;
-	using thread_queued::THREAD_RUNNING;
+		return stats;
+	}
 
-	static constexpr message_t::message_type_t MessageIntType = 0;
+	size_t GlobalMessageQueueThread::GetShardCount() const
+	{
+		return this->_Shards.size() + 1;
+	}
 
-	struct message_data_int_t : public message_id_thread_struct_t<1,1,0, MessageIntType, message_data_int_t>
+	queue_statistics_t GlobalMessageQueueThread::GetShardStatistics(size_t ShardIndex) const
 	{
-		int Data;
-		SharedDynamicPointer<void> Target;
-	};
+		if(ShardIndex == 0)
+			return this->thread_multi_module_manager_t::GetQueueStatistics();
 
-	static constexpr message_t::message_type_t MessageCharType = 1;
+		return this->_Shards.at(ShardIndex-1)->Thread.GetQueueStatistics();
+	}
 
-	struct message_data_char_t : public message_id_thread_struct_t<1,1,0, MessageCharType, message_data_char_t>
+	queue_statistics_t GlobalMessageQueueThread::GetQueueStatistics(identifier_t::queue_id_t QueueID, identifier_t::thread_id_t MessageQueueThreadID)
 	{
-		char Data;
-		SharedDynamicPointer<void> Target;
-	};
+		queue_statistics_t stats;
 
-	template<identifier_t::queue_id_t QueueID, identifier_t::thread_id_t ThreadID>
-	struct TestQueueClasses
-	{
-		class TestQueue : public thread_multi_module_manager_t
-		{
-			public:
-				TestQueue()
-					: thread_multi_module_manager_t(QueueID, ThreadID, THREAD_PAUSED)
-				{}
-		};
+		const routing_guard_t routing(*this);
 
-		template<identifier_t::module_id_t ModuleID>
-		class TestModuleClass : public thread_multi_module_t
+		const auto *const statsQueue = GlobalMessageQueueThread::FindQueueRoute(*routing, QueueID, MessageQueueThreadID);
+		if(statsQueue != nullptr)
 		{
-			public:
-				using msg_struct_t = thread_multi_module_t::msg_struct_t;
+			auto *const pQueue = dynamic_cast<thread_multi_module_manager_t*>(statsQueue->Queue.get());
+			if(pQueue != nullptr)
+				stats = pQueue->GetQueueStatistics();
+		}
 
-				TestModuleClass()
-					: thread_multi_module_t(identifier_t(QueueID, ModuleID, ThreadID))
-				{}
+		return stats;
+	}
 
-				void HandleMessage(msg_struct_t &Message) = 0;
-		};
+	latency_histogram_t GlobalMessageQueueThread::GetModuleHandlerTime(identifier_t ModuleID)
+	{
+		latency_histogram_t handlerTime;
 
-		//using msg_struct_t = thread_multi_module_t::msg_struct_t;
+		const routing_guard_t routing(*this);
 
-		class TestModule1 : public TestModuleClass<1>
+		const auto *const moduleQueue = GlobalMessageQueueThread::FindQueueRoute(*routing, ModuleID.MessageQueueID, ModuleID.ThreadID);
+		if(moduleQueue != nullptr)
 		{
-			public:
-				//using msg_struct_t = typename TestModuleClass<1>::msg_struct_t;
+			auto *const pQueue = dynamic_cast<thread_multi_module_manager_t*>(moduleQueue->Queue.get());
+			if(pQueue != nullptr)
+				handlerTime = pQueue->GetModuleHandlerTime(ModuleID);
+		}
 
-				TestModule1() = default;
+		return handlerTime;
+	}
 
-				void HandleMessage(thread_multi_module_t::msg_struct_t &Message);
-		};
+	bool GlobalMessageQueueThread::WaitForDrain(drain_timeout_t Timeout)
+	{
+		bool isDrained = this->thread_multi_module_manager_t::WaitForDrain(Timeout);
 
-		class TestModule2 : public TestModuleClass<2>
-		{
-			public:
-				TestModule2() = default;
+		// Router threads only push to registered queues, so a drained one stays drained
+		for(auto &curShard : this->_Shards)
+			isDrained = curShard->Thread.WaitForDrain(Timeout) && isDrained;
 
-				void HandleMessage(thread_multi_module_t::msg_struct_t &Message);
-		};
-	};
+		return isDrained;
+	}
 
-	using TestQueueClasses10 = TestQueueClasses<1,0>;
+	void GlobalMessageQueueThread::SetThreadState(thread_state_t ThreadState)
+	{
+		this->thread_multi_module_manager_t::SetThreadState(ThreadState);
 
-	template<>
-	void TestQueueClasses10::TestModule1::HandleMessage(msg_struct_t &Message)
+		for(auto &curShard : this->_Shards)
+			curShard->Thread.SetThreadState(ThreadState);
+	}
+
+	queue_push_result_t GlobalMessageQueueThread::PushMessageToShard(thread_multi_module_message_t Message)
 	{
-		if(message_data_int_t::CheckMessageDataType(Message))
+		size_t shardIndex = 0;
+		if(!this->_Shards.empty())
 		{
-			auto *const pMessageData = message_data_int_t::GetMessageData(Message);
-
-			*(pMessageData->Target.Get<int>()) = pMessageData->Data;
+			const routing_guard_t routing(*this);
+			shardIndex = this->SelectShardIndex(*routing, Message.Get<MessageSenderIDNum>(), Message.Get<MessageReceiverIDNum>());
 		}
-		else if(message_data_char_t::CheckMessageDataType(Message))
-		{
-			auto *const pMessageData = message_data_char_t::GetMessageData(Message);
 
-			*(pMessageData->Target.Get<char>()) = pMessageData->Data;
-		}
+		return this->PushMessageToShard(std::move(Message), shardIndex);
 	}
 
-	template<>
-	void TestQueueClasses10::TestModule2::HandleMessage(msg_struct_t &Message)
+	queue_push_result_t GlobalMessageQueueThread::PushMessageToShard(thread_multi_module_message_t Message, size_t ShardIndex)
 	{
-		if(message_data_int_t::CheckMessageDataType(Message))
-		{
-			auto *const pMessageData = message_data_int_t::GetMessageData(Message);
+		const identifier_t receiverID = Message.Get<MessageReceiverIDNum>();
 
-			*(pMessageData->Target.Get<int>()) = 0;
+		// Count the message before it can be propagated. Later direct messages of this producer see it and don't overtake it
+		auto &routedMessages = this->GetRoutedMessages(receiverID);
+		routedMessages.fetch_add(1);
+
+		queue_push_result_t pushResult;
+		if(Message.Get<MessageSenderIDNum>() == ModuleRegistrationID)
+		{
+			pushResult = ShardIndex == 0 ?
+						this->thread_multi_module_manager_t::ForcePushMessage(std::move(Message)) :
+						this->_Shards[ShardIndex-1]->Thread.ForcePushMessage(std::move(Message));
 		}
-		else if(message_data_char_t::CheckMessageDataType(Message))
+		else
 		{
-			auto *const pMessageData = message_data_char_t::GetMessageData(Message);
-
-			*(pMessageData->Target.Get<char>()) = 0;
+			pushResult = ShardIndex == 0 ?
+						this->thread_multi_module_manager_t::PushMessage(std::move(Message)) :
+						this->_Shards[ShardIndex-1]->Thread.PushMessage(std::move(Message));
 		}
+
+		if(pushResult != QUEUE_PUSH_SUCCESS && pushResult != QUEUE_PUSH_DROPPED_OLDEST)
+			routedMessages.fetch_sub(1);
+
+		return pushResult;
 	}
 
-	class TestGlobalMessageQueueThread
+	uint64_t GlobalMessageQueueThread::MixQueueKey(identifier_t ReceiverID)
 	{
-		public:
-			static bool Testing();
-	};
+		return ReceiverID.GetQueueKey() * UINT64_C(0x9E3779B97F4A7C15);
+	}
 
-	bool TestGlobalMessageQueueThread::Testing()
+	size_t GlobalMessageQueueThread::GetShardIndex(identifier_t ReceiverID) const
 	{
-		try
-		{
-			GlobalMessageQueueThread testQueueHandle;
+		if(this->_Shards.empty())
+			return 0;
 
-			testQueueHandle.SetThreadState(THREAD_PAUSED);
+		return static_cast<size_t>(GlobalMessageQueueThread::MixQueueKey(ReceiverID) >> 32) % (this->_Shards.size() + 1);
+	}
 
-			auto testQueue = shared_ptr<TestQueueClasses10::TestQueue>(new TestQueueClasses10::TestQueue());
-			auto testQueueModule1 = shared_ptr<TestQueueClasses10::TestModule1>(new TestQueueClasses10::TestModule1());
-			auto testQueueModule2 = shared_ptr<TestQueueClasses10::TestModule2>(new TestQueueClasses10::TestModule2());
+	size_t GlobalMessageQueueThread::SelectShardIndex(const routing_snapshot_t &Routing, identifier_t SenderID, identifier_t ReceiverID) const
+	{
+		if(GlobalMessageQueueThread::IsLinkedMessage(Routing, SenderID, ReceiverID))
+			return 0;
 
-			testQueueHandle.RegisterQueue(testQueue);
+		return this->GetShardIndex(ReceiverID);
+	}
+
+	atomic<size_t> &GlobalMessageQueueThread::GetRoutedMessages(identifier_t ReceiverID)
+	{
+		static_assert(GlobalMessageQueueThread::RoutedMessageBuckets == 64, "ERROR GlobalMessageQueueThread::GetRoutedMessages(): Bucket index must use the top 6 bits");
+
+		// Take the top bits, the shard index uses the middle ones
+		return this->_RoutedMessages[GlobalMessageQueueThread::MixQueueKey(ReceiverID) >> 58];
+	}
+
+	void GlobalMessageQueueThread::PropagateMessageToQueues(msg_struct_t &Message, void *ExtraData)
+	{
+		auto &propagation = *reinterpret_cast<propagation_state_t*>(ExtraData);
+		auto *const pClass = propagation.Router;
+
+		const identifier_t senderID = Message.Get<MessageSenderIDNum>();
+		const identifier_t receiverID = Message.Get<MessageReceiverIDNum>();
+
+		// Direct messages to this receiver may follow once this function returned
+		const routed_message_release_t routedMessage(pClass->GetRoutedMessages(receiverID));
+
+		// Registrations publish a new snapshot instead of blocking this thread. The snapshot stays announced while messages are waiting, so that it is only reloaded after a change
+		const routing_snapshot_t *const routing = pClass->LoadRouting(propagation.Reader);
+
+		// Store all queues that should receive the message
+		auto &queueReceivers = propagation.Receivers;
+		queueReceivers.clear();
+
+#ifdef DEBUG
+		std::cout << "Propagating message type: " << Message.Get<MessageDataNum>().PrintType() << "\n";
+#endif
+
+		// New stamp for this message, queues added to queueReceivers are marked with it
+		++propagation.PropagationStamp;
+		if(propagation.RouteStamps.size() < routing->QueueRoutes.size())
+			propagation.RouteStamps.resize(routing->QueueRoutes.size(), 0);
+
+		// Send to receiver queue
+		const auto *const receiverQueue = GlobalMessageQueueThread::FindQueueRoute(*routing, receiverID.MessageQueueID, receiverID.ThreadID);
+		if(receiverQueue != nullptr)
+		{
+			GlobalMessageQueueThread::AddQueueRoute(propagation, *receiverQueue);
+			//(*receiverQueue)->HandleMessage(Message);
+
+#ifdef DEBUG
+			std::cout << "\tTo Receiver queue with QueueID " << receiverID.MessageQueueID << " and ThreadID " << receiverID.ThreadID << "\n";
+#endif
+		}
+
+		// Registration messages are only meant for the queue of their module
+		if(!(senderID == ModuleRegistrationID))
+		{
+			// Send to receiver linked queues
+			GlobalMessageQueueThread::AddLinkedQueues(propagation, *routing, receiverID, routing->ReceiverIDLinks);
+
+			// Send to sender linked queues
+			GlobalMessageQueueThread::AddLinkedQueues(propagation, *routing, senderID, routing->SenderIDLinks);
+		}
+
+		// Send to all receivers that require message. Only additional receivers get copies, the last one takes the message
+		if(!queueReceivers.empty())
+		{
+			for(size_t curReceiver = 0; curReceiver+1 < queueReceivers.size(); ++curReceiver)
+				queueReceivers[curReceiver]->HandleMessage(Message);
+
+			queueReceivers.back()->HandleMovedMessage(std::move(Message));
+		}
+
+		// Don't keep replaced snapshots from being freed while the router thread sleeps
+		const bool routerIdle = propagation.Thread != nullptr ? propagation.Thread->IsQueueEmpty() : pClass->IsQueueEmpty();
+		if(routerIdle)
+			GlobalMessageQueueThread::ReleaseRouting(propagation.Reader);
+	}
+
+	void GlobalMessageQueueThread::DiscardRoutedMessage(msg_struct_t &Message, void *ExtraData)
+	{
+		auto &propagation = *reinterpret_cast<propagation_state_t*>(ExtraData);
+		auto *const pClass = propagation.Router;
+
+		auto &routedMessages = pClass->GetRoutedMessages(Message.Get<MessageReceiverIDNum>());
+
+		// Queue registrations again at the end of the same router thread. They stay counted until they are propagated
+		if(Message.Get<MessageSenderIDNum>() == ModuleRegistrationID)
+		{
+			const queue_push_result_t pushResult = propagation.Thread != nullptr ?
+						propagation.Thread->ForcePushMessage(std::move(Message)) :
+						pClass->thread_multi_module_manager_t::ForcePushMessage(std::move(Message));
+
+			if(pushResult == QUEUE_PUSH_SUCCESS)
+				return;
+		}
+
+		routedMessages.fetch_sub(1, std::memory_order_release);
+	}
+
+	queue_push_result_t GlobalMessageQueueThread::CheckReceiverSaturation(queue_push_result_t PushResult, identifier_t ReceiverID, const routing_snapshot_t &Routing)
+	{
+		if(PushResult != QUEUE_PUSH_SUCCESS)
+			return PushResult;
+
+		const auto *const receiverQueue = GlobalMessageQueueThread::FindQueueRoute(Routing, ReceiverID.MessageQueueID, ReceiverID.ThreadID);
+		if(receiverQueue != nullptr)
+		{
+			auto *const pReceiverQueue = dynamic_cast<thread_multi_module_manager_t*>(receiverQueue->Queue.get());
+			if(pReceiverQueue != nullptr && pReceiverQueue->IsQueueSaturated())
+				PushResult = QUEUE_PUSH_TARGET_SATURATED;
+		}
+
+		return PushResult;
+	}
+
+	bool GlobalMessageQueueThread::IsLinkedMessage(const routing_snapshot_t &Routing, identifier_t SenderID, identifier_t ReceiverID)
+	{
+		return Routing.ReceiverIDLinks.Find(ReceiverID) != nullptr || Routing.SenderIDLinks.Find(SenderID) != nullptr ||
+				Routing.ReceiverIDLinks.IsLinkedModule(ReceiverID) || Routing.SenderIDLinks.IsLinkedModule(ReceiverID);
+	}
+
+	GlobalMessageQueueThread::routing_reader_t &GlobalMessageQueueThread::GetThreadReader() const
+	{
+		auto &threadReaders = GlobalMessageQueueThread::_ThreadReaders.Readers;
+		for(auto curEntry = threadReaders.begin(); curEntry != threadReaders.end();)
+		{
+			// Drop readers of destroyed routers, their address may be reused
+			if(curEntry->Reader.use_count() == 1)
+			{
+				curEntry = threadReaders.erase(curEntry);
+				continue;
+			}
+
+			if(curEntry->Router == this)
+				return *(curEntry->Reader);
+
+			++curEntry;
+		}
+
+		// First push of this thread. Take over the reader of an exited thread if possible
+		auto *const pClass = const_cast<GlobalMessageQueueThread*>(this);
+		shared_ptr<routing_reader_t> reader;
+
+		pClass->_RoutingLock.lock();
+
+		for(const auto &curReader : pClass->_ProducerReaders)
+		{
+			bool inUse = false;
+			if(curReader->InUse.compare_exchange_strong(inUse, true, std::memory_order_acquire))
+			{
+				reader = curReader;
+				break;
+			}
+		}
+
+		try
+		{
+			if(reader == nullptr)
+			{
+				reader = std::make_shared<routing_reader_t>();
+				pClass->_ProducerReaders.push_back(reader);
+			}
+
+			threadReaders.push_back(thread_routing_readers_t::entry_t{this, reader});
+		}
+		catch(...)
+		{
+			pClass->_RoutingLock.unlock();
+			throw;
+		}
+
+		pClass->_RoutingLock.unlock();
+
+		return *reader;
+	}
+
+	const GlobalMessageQueueThread::routing_snapshot_t *GlobalMessageQueueThread::LoadRouting(routing_reader_t &Reader) const
+	{
+		// Announce the version before loading its snapshot. A writer that replaces the snapshot afterwards sees the announcement and keeps it.
+		// If the version changed in between, the announcement may have come too late, so announce the new one
+		uint64_t routingVersion = this->_RoutingVersion.load();
+		for(;;)
+		{
+			if(Reader.PinnedVersion.load(std::memory_order_relaxed) != routingVersion)
+				Reader.PinnedVersion.store(routingVersion);
+
+			const uint64_t curVersion = this->_RoutingVersion.load();
+			if(curVersion == routingVersion)
+				break;
+
+			routingVersion = curVersion;
+		}
+
+		if(Reader.Routing == nullptr || Reader.RoutingVersion != routingVersion)
+		{
+			Reader.Routing = this->_Routing.load();
+			Reader.RoutingVersion = routingVersion;
+		}
+
+		return Reader.Routing;
+	}
+
+	void GlobalMessageQueueThread::ReleaseRouting(routing_reader_t &Reader)
+	{
+		Reader.PinnedVersion.store(0, std::memory_order_release);
+	}
+
+	unique_ptr<GlobalMessageQueueThread::routing_snapshot_t> GlobalMessageQueueThread::CopyRoutingNoLock() const
+	{
+		// Only writers replace the snapshot, so it can't be freed while _RoutingLock is held
+		return unique_ptr<routing_snapshot_t>(new routing_snapshot_t(*(this->_Routing.load(std::memory_order_relaxed))));
+	}
+
+	void GlobalMessageQueueThread::PublishRoutingNoLock(unique_ptr<routing_snapshot_t> &&Routing)
+	{
+		// Number the routes so that the propagating threads can mark them in their RouteStamps
+		size_t routeIndex = 0;
+		for(auto &curRoute : Routing->QueueRoutes)
+			curRoute.second.RouteIndex = routeIndex++;
+
+		// Make room first, so that the old snapshot is never lost
+		this->_RetiredRoutings.reserve(this->_RetiredRoutings.size()+1);
+
+		const routing_snapshot_t *const oldRouting = this->_Routing.exchange(Routing.release());
+		const uint64_t retiredVersion = this->_RoutingVersion.fetch_add(1) + 1;
+
+		this->_RetiredRoutings.push_back(retired_routing_t{unique_ptr<const routing_snapshot_t>(oldRouting), retiredVersion});
+
+		this->ReclaimRoutingsNoLock();
+	}
+
+	void GlobalMessageQueueThread::ReclaimRoutingsNoLock()
+	{
+		// Find the oldest version a reader still announces
+		uint64_t oldestVersion = UINT64_MAX;
+		const auto checkReader = [&oldestVersion] (const routing_reader_t &Reader)
+		{
+			const uint64_t pinnedVersion = Reader.PinnedVersion.load();
+			if(pinnedVersion != 0 && pinnedVersion < oldestVersion)
+				oldestVersion = pinnedVersion;
+		};
+
+		checkReader(this->_Propagation.Reader);
+		for(const auto &curShard : this->_Shards)
+			checkReader(curShard->Propagation.Reader);
+		for(const auto &curReader : this->_ProducerReaders)
+			checkReader(*curReader);
+
+		// Freeing may release unregistered queues. This happens on the thread that changes the routing, never on a router thread
+		size_t numKept = 0;
+		for(size_t curRetired = 0; curRetired < this->_RetiredRoutings.size(); ++curRetired)
+		{
+			if(this->_RetiredRoutings[curRetired].RetiredVersion <= oldestVersion)
+				continue;
+
+			if(numKept != curRetired)
+				this->_RetiredRoutings[numKept] = std::move(this->_RetiredRoutings[curRetired]);
+
+			++numKept;
+		}
+
+		this->_RetiredRoutings.resize(numKept);
+	}
+
+	const GlobalMessageQueueThread::queue_route_t *GlobalMessageQueueThread::FindQueueRoute(const routing_snapshot_t &Routing, identifier_t::queue_id_t QueueID, identifier_t::thread_id_t MessageQueueThreadID)
+	{
+		const auto route = Routing.QueueRoutes.find(identifier_t::CreateQueueKey(QueueID, MessageQueueThreadID));
+		if(route == Routing.QueueRoutes.end())
+			return nullptr;
+
+		return &(route->second);
+	}
+
+	bool GlobalMessageQueueThread::AddQueueRoute(propagation_state_t &Propagation, const queue_route_t &Route)
+	{
+		auto &routeStamp = Propagation.RouteStamps[Route.RouteIndex];
+		if(routeStamp == Propagation.PropagationStamp)
+			return false;
+
+		routeStamp = Propagation.PropagationStamp;
+		Propagation.Receivers.push_back(Route.Queue.get());
+
+		return true;
+	}
+
+	void GlobalMessageQueueThread::AddLinkedQueues(propagation_state_t &Propagation, const routing_snapshot_t &Routing, identifier_t ID, const id_link_table_t &LinkedIDs)
+	{
+		// Send to receiver linked queues
+		const auto *const curLink = LinkedIDs.Find(ID);
+		if(curLink != nullptr)
+		{
+			for(const auto &linkID : *curLink)
+			{
+				// Send to linked queue
+				const auto *const linkedQueue = GlobalMessageQueueThread::FindQueueRoute(Routing, linkID.MessageQueueID, linkID.ThreadID);
+				if(linkedQueue != nullptr)
+				{
+					// Only add queues that don't have the message yet
+					if(GlobalMessageQueueThread::AddQueueRoute(Propagation, *linkedQueue))
+					{
+#ifdef DEBUG
+						std::cout << "\tTo linked queue with QueueID " << linkID.MessageQueueID << " and ThreadID " << linkID.ThreadID << "\n";
+#endif
+					}
+				}
+			}
+		}
+	}
+
+	void test()
+	{
+		GlobalMessageQueueThread testQueue;
+
+		thread_multi_module_message_t *pMsg = nullptr;
+
+		testQueue.PushMessage(*pMsg);
+	}
+}
+
+#include "error_exception.h"
+#include "dynamic_pointer.h"
+#include "string_thread_message.h"
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+namespace global_message_queue_thread
+{
+	using namespace error_exception;
+	using namespace dynamic_pointer;
+	using namespace silkstring_message;
+
+	using thread_queued::THREAD_PAUSED;
+	using thread_queued::THREAD_RUNNING;
+
+	static constexpr message_t::message_type_t MessageIntType = 0;
+
+	struct message_data_int_t : public message_id_thread_struct_t<1,1,0, MessageIntType, message_data_int_t>
+	{
+		int Data;
+		SharedDynamicPointer<void> Target;
+	};
+
+	static constexpr message_t::message_type_t MessageCharType = 1;
+
+	struct message_data_char_t : public message_id_thread_struct_t<1,1,0, MessageCharType, message_data_char_t>
+	{
+		char Data;
+		SharedDynamicPointer<void> Target;
+	};
+
+	template<identifier_t::queue_id_t QueueID, identifier_t::thread_id_t ThreadID>
+	struct TestQueueClasses
+	{
+		class TestQueue : public thread_multi_module_manager_t
+		{
+			public:
+				TestQueue()
+					: thread_multi_module_manager_t(QueueID, ThreadID, THREAD_PAUSED)
+				{}
+		};
+
+		template<identifier_t::module_id_t ModuleID>
+		class TestModuleClass : public thread_multi_module_t
+		{
+			public:
+				using msg_struct_t = thread_multi_module_t::msg_struct_t;
+
+				TestModuleClass()
+					: thread_multi_module_t(identifier_t(QueueID, ModuleID, ThreadID))
+				{}
+
+				void HandleMessage(msg_struct_t &Message) = 0;
+		};
+
+		//using msg_struct_t = thread_multi_module_t::msg_struct_t;
+
+		class TestModule1 : public TestModuleClass<1>
+		{
+			public:
+				//using msg_struct_t = typename TestModuleClass<1>::msg_struct_t;
+
+				TestModule1() = default;
+
+				void HandleMessage(thread_multi_module_t::msg_struct_t &Message);
+		};
+
+		class TestModule2 : public TestModuleClass<2>
+		{
+			public:
+				TestModule2() = default;
+
+				void HandleMessage(thread_multi_module_t::msg_struct_t &Message);
+		};
+	};
+
+	using TestQueueClasses10 = TestQueueClasses<1,0>;
+
+	template<>
+	void TestQueueClasses10::TestModule1::HandleMessage(msg_struct_t &Message)
+	{
+		if(message_data_int_t::CheckMessageDataType(Message))
+		{
+			auto *const pMessageData = message_data_int_t::GetMessageData(Message);
+
+			*(pMessageData->Target.Get<int>()) = pMessageData->Data;
+		}
+		else if(message_data_char_t::CheckMessageDataType(Message))
+		{
+			auto *const pMessageData = message_data_char_t::GetMessageData(Message);
+
+			*(pMessageData->Target.Get<char>()) = pMessageData->Data;
+		}
+	}
+
+	template<>
+	void TestQueueClasses10::TestModule2::HandleMessage(msg_struct_t &Message)
+	{
+		if(message_data_int_t::CheckMessageDataType(Message))
+		{
+			auto *const pMessageData = message_data_int_t::GetMessageData(Message);
+
+			*(pMessageData->Target.Get<int>()) = 0;
+		}
+		else if(message_data_char_t::CheckMessageDataType(Message))
+		{
+			auto *const pMessageData = message_data_char_t::GetMessageData(Message);
+
+			*(pMessageData->Target.Get<char>()) = 0;
+		}
+	}
+
+	static constexpr message_t::message_type_t MessageBenchType = 2;
+
+	/*!
+	 * \brief Payload that is not trivially copyable, so it is stored on the heap
+	 */
+	struct message_data_bench_t : public message_id_thread_struct_t<1,1,0, MessageBenchType, message_data_bench_t>
+	{
+		std::string Data;
+	};
+
+	class TestGlobalMessageQueueThread
+	{
+		public:
+			static bool Testing();
+
+			/*!
+			 * \brief Measure reference count operations and time per message for a single receiver and a linked receiver queue and print the results.
+			 * Reference count operations are only counted if DYNAMIC_POINTER_COUNT_REFERENCE_OPS is set to 1
+			 */
+			static void Benchmark();
+
+		private:
+			class CountModule : public thread_multi_module_t
+			{
+				public:
+					CountModule(identifier_t ModuleID)
+						: thread_multi_module_t(ModuleID)
+					{}
+
+					void HandleMessage(msg_struct_t &)
+					{
+						this->Count.fetch_add(1, std::memory_order_relaxed);
+					}
+
+					std::atomic<size_t> Count{0};
+			};
+
+			/*!
+			 * \brief Checks that the messages of each producer arrive in order. Data holds the producer index times ProducerMessages plus a sequence number
+			 */
+			class OrderModule : public thread_multi_module_t
+			{
+				public:
+					static constexpr int ProducerMessages = 10000;
+					static constexpr size_t NumProducers = 4;
+
+					OrderModule(identifier_t ModuleID)
+						: thread_multi_module_t(ModuleID)
+					{}
+
+					void HandleMessage(msg_struct_t &Message)
+					{
+						const int data = message_data_int_t::GetMessageData(Message)->Data;
+						const size_t producer = static_cast<size_t>(data / ProducerMessages);
+
+						if(producer >= NumProducers || data % ProducerMessages != this->NextData[producer])
+							this->OutOfOrder = true;
+						else
+							++this->NextData[producer];
+
+						this->Count.fetch_add(1, std::memory_order_relaxed);
+					}
+
+					int NextData[NumProducers] = {};
+					std::atomic<bool> OutOfOrder{false};
+					std::atomic<size_t> Count{0};
+			};
+
+			/*!
+			 * \brief Registration, delivery, linking and unregistration
+			 */
+			static bool TestRouting();
+
+			/*!
+			 * \brief Messages pushed before an unregistration still reach the module
+			 */
+			static bool TestOrderedUnregistration();
+
+			/*!
+			 * \brief A module ID can be registered again while the unregistration of the previous module is still queued
+			 */
+			static bool TestReregistration();
+
+			/*!
+			 * \brief Unregistrations reach the module queue even if the router thread and the module queue are full
+			 */
+			static bool TestUnregistrationOverflow();
+
+			/*!
+			 * \brief Registrations publish new routing snapshots and leave old ones unchanged
+			 */
+			static bool TestRoutingSnapshots();
+
+			/*!
+			 * \brief Delayed, cancelled and periodic messages
+			 */
+			static bool TestTimedMessages();
+
+			/*!
+			 * \brief Distribution of receivers over several router threads
+			 */
+			static bool TestSharding();
+
+			/*!
+			 * \brief Linked modules receive copies and their own messages in push order when the receivers are served by different router threads
+			 */
+			static bool TestShardedLinks();
+
+			/*!
+			 * \brief Linked traffic is routed by the first router thread only, unlinked traffic by the router thread of its receiver
+			 */
+			static bool TestShardedLinkTraffic();
+
+			/*!
+			 * \brief Concurrent producers deliver directly while messages to another receiver wait in the router thread
+			 */
+			static bool TestDirectDelivery();
+
+			/*!
+			 * \brief Direct messages to a linked module don't overtake copies of messages to the module it is linked to
+			 */
+			static bool TestLinkedDirectDelivery();
+
+			/*!
+			 * \brief Messages a full router thread discards don't keep their receiver on the router path
+			 */
+			static bool TestDroppedRoutedMessages();
+
+			/*!
+			 * \brief Tests that producers learn about full receivers on both push paths
+			 */
+			static bool TestReceiverSaturation();
+
+			/*!
+			 * \brief Wait until Router and Queue handled all pushed messages
+			 */
+			static bool WaitForDelivery(GlobalMessageQueueThread &Router, thread_multi_module_manager_t &Queue);
+
+			/*!
+			 * \brief Wait until Module handled Count messages. Returns false after 5 seconds
+			 */
+			static bool WaitForCount(const CountModule &Module, size_t Count);
+
+			static void MeasureDelivery(bool Linked, size_t NumMessages, double &ReferenceOps, double &Nanoseconds);
+	};
+
+	bool TestGlobalMessageQueueThread::Testing()
+	{
+		return TestGlobalMessageQueueThread::TestRoutingSnapshots() &&
+			   TestGlobalMessageQueueThread::TestTimedMessages() &&
+			   TestGlobalMessageQueueThread::TestSharding() &&
+			   TestGlobalMessageQueueThread::TestShardedLinks() &&
+			   TestGlobalMessageQueueThread::TestShardedLinkTraffic() &&
+			   TestGlobalMessageQueueThread::TestDirectDelivery() &&
+			   TestGlobalMessageQueueThread::TestLinkedDirectDelivery() &&
+			   TestGlobalMessageQueueThread::TestDroppedRoutedMessages() &&
+			   TestGlobalMessageQueueThread::TestReceiverSaturation() &&
+			   TestGlobalMessageQueueThread::TestRouting() &&
+			   TestGlobalMessageQueueThread::TestOrderedUnregistration() &&
+			   TestGlobalMessageQueueThread::TestReregistration() &&
+			   TestGlobalMessageQueueThread::TestUnregistrationOverflow();
+	}
+
+	bool TestGlobalMessageQueueThread::TestRouting()
+	{
+		try
+		{
+			GlobalMessageQueueThread testQueueHandle;
+
+			testQueueHandle.SetThreadState(THREAD_PAUSED);
+
+			auto testQueue = shared_ptr<TestQueueClasses10::TestQueue>(new TestQueueClasses10::TestQueue());
+			auto testQueueModule1 = shared_ptr<TestQueueClasses10::TestModule1>(new TestQueueClasses10::TestModule1());
+			auto testQueueModule2 = shared_ptr<TestQueueClasses10::TestModule2>(new TestQueueClasses10::TestModule2());
+
+			testQueueHandle.RegisterQueue(testQueue);
 			testQueueHandle.RegisterModule(testQueueModule1, id_vector_t(), id_vector_t());
 			testQueueHandle.RegisterModule(testQueueModule2, id_vector_t(), id_vector_t());
 
-			auto testNumber1 = 2;
-			SharedDynamicPointer<void> pTestInt(new int(0));
-			message_data_int_t testIntData;
-			testIntData.Data = testNumber1;
-			testIntData.Target = pTestInt;
+			auto testNumber1 = 2;
+			SharedDynamicPointer<void> pTestInt(new int(0));
+			message_data_int_t testIntData;
+			testIntData.Data = testNumber1;
+			testIntData.Target = pTestInt;
+
+			// Test first module
+			testQueueHandle.PushMessage(message_data_int_t::CreateMessageFromSender(identifier_t(0,0,0), message_data_int_t(testIntData)));
+
+			testQueueHandle.SetThreadState(THREAD_RUNNING);
+			testQueue->SetThreadState(THREAD_RUNNING);
+
+			// Wait for message to be sent to module
+			if(!TestGlobalMessageQueueThread::WaitForDelivery(testQueueHandle, *testQueue))
+				return 0;
+
+			if(*(pTestInt.Get<int>()) != testNumber1)
+				return 0;
+
+			// Test 2nd module
+			testIntData.Data = 0;
+			testIntData.Target = pTestInt;
+			testQueueHandle.PushMessage(message_data_int_t::CreateMessageToReceiver(testQueueModule2->GetID(), message_data_int_t(testIntData)));
+
+			// Wait for message to be sent to module
+			if(!TestGlobalMessageQueueThread::WaitForDelivery(testQueueHandle, *testQueue))
+				return 0;
+
+			if(*(pTestInt.Get<int>()) != 0)
+				return 0;
+
+			// Test direct delivery, which must not need the global thread
+			testQueueHandle.SetThreadState(THREAD_PAUSED);
+
+			testIntData.Data = testNumber1;
+			testIntData.Target = pTestInt;
+			if(testQueueHandle.PushMessageDirect(message_data_int_t::CreateMessageToReceiver(testQueueModule1->GetID(), message_data_int_t(testIntData))) != QUEUE_PUSH_SUCCESS)
+				return 0;
+
+			// Wait for message to be sent to module. The global thread is paused
+			if(!testQueue->WaitForDrain())
+				return 0;
+
+			if(*(pTestInt.Get<int>()) != testNumber1)
+				return 0;
+
+			// Direct messages must not overtake messages still waiting in the global queue
+			testIntData.Data = 0;
+			testQueueHandle.PushMessage(message_data_int_t::CreateMessageToReceiver(testQueueModule1->GetID(), message_data_int_t(testIntData)));
+
+			testIntData.Data = testNumber1+1;
+			testQueueHandle.PushMessageDirect(message_data_int_t::CreateMessageToReceiver(testQueueModule1->GetID(), message_data_int_t(testIntData)));
+
+			if(!testQueue->WaitForDrain() || *(pTestInt.Get<int>()) != testNumber1)
+				return 0;
+
+			testQueueHandle.SetThreadState(THREAD_RUNNING);
+
+			// Wait for messages to be sent to module
+			if(!TestGlobalMessageQueueThread::WaitForDelivery(testQueueHandle, *testQueue))
+				return 0;
+
+			if(*(pTestInt.Get<int>()) != testNumber1+1)
+				return 0;
+
+			// Test Receiver Linking
+			const auto testReceiverID = identifier_t(testQueue->GetID().MessageQueueID, 5, testQueue->GetID().ThreadID);
+			testQueueHandle.AddReceiverLink(testReceiverID, testQueueModule1->GetID());
+
+			testIntData.Data = testNumber1;
+			testIntData.Target = pTestInt;
+			testQueueHandle.PushMessage(message_data_int_t::CreateMessageToReceiver(testReceiverID, message_data_int_t(testIntData)));
+
+			// Wait for message to be sent to module
+			if(!TestGlobalMessageQueueThread::WaitForDelivery(testQueueHandle, *testQueue))
+				return 0;
+
+			if(*(pTestInt.Get<int>()) != testNumber1)
+				return 0;
+
+			// Test Sender Linking
+			const auto testSenderID = identifier_t(testQueue->GetID().MessageQueueID, 6, testQueue->GetID().ThreadID);
+			testQueueHandle.AddSendLink(testSenderID, testQueueModule2->GetID());
+
+			testIntData.Data = testNumber1;
+			testIntData.Target = pTestInt;
+			testQueueHandle.PushMessage(message_data_int_t::CreateMessageFromSender(testSenderID, message_data_int_t(testIntData)));
+
+			// Wait for message to be sent to module
+			if(!TestGlobalMessageQueueThread::WaitForDelivery(testQueueHandle, *testQueue))
+				return 0;
+
+			if(*(pTestInt.Get<int>()) != 0)
+				return 0;
+
+			// Test unregistering
+			auto testUnregisterModule = testQueueHandle.UnregisterModule(testQueueModule1->GetID());
+			if(testUnregisterModule != testQueueModule1)
+				return 0;
+
+			*(pTestInt.Get<int>()) = 0;
+			testIntData.Data = testNumber1;
+			testIntData.Target = pTestInt;
+			testQueueHandle.PushMessage(message_data_int_t::CreateMessageFromSender(identifier_t(0,0,0), message_data_int_t(testIntData)));
+
+			// Wait for message to be sent to module
+			if(!TestGlobalMessageQueueThread::WaitForDelivery(testQueueHandle, *testQueue))
+				return 0;
+
+			// Check that module really was unregistered
+			if(*(pTestInt.Get<int>()) == testNumber1)
+				return 0;
+
+			// Test queue Unregistering
+			auto testUnregisterQueue = testQueueHandle.UnregisterQueue(testQueue);
+			if(testUnregisterQueue != testQueue)
+				return 0;
+
+			// Check that queue really was unregistered
+			*(pTestInt.Get<int>()) = testNumber1;
+			testIntData.Data = 0;
+			testIntData.Target = pTestInt;
+			testQueueHandle.PushMessage(message_data_int_t::CreateMessageToReceiver(testQueueModule2->GetID(), message_data_int_t(testIntData)));
+
+			// Wait for message to be dropped
+			if(!testQueueHandle.WaitForDrain())
+				return 0;
+
+			// Check that queue really was unregistered
+			if(*(pTestInt.Get<int>()) == 0)
+				return 0;
+
+			return 1;
+		}
+		catch(Exception &)
+		{
+			return 0;
+		}
+	}
+
+	bool TestGlobalMessageQueueThread::TestOrderedUnregistration()
+	{
+		try
+		{
+			GlobalMessageQueueThread testQueueHandle;
+
+			auto testQueue = shared_ptr<TestQueueClasses<5,0>::TestQueue>(new TestQueueClasses<5,0>::TestQueue());
+			auto testModule = shared_ptr<CountModule>(new CountModule(identifier_t(5,1,0)));
+
+			testQueueHandle.RegisterQueue(testQueue);
+			testQueueHandle.RegisterModule(testModule, id_vector_t(), id_vector_t());
+
+			// The queue thread is paused, so the first message is still waiting when the module is unregistered
+			testQueueHandle.PushMessage(message_data_int_t::CreateMessageToReceiver(testModule->GetID(), message_data_int_t()));
+			if(testQueueHandle.UnregisterModule(testModule->GetID()) != testModule)
+				return 0;
+
+			testQueueHandle.PushMessage(message_data_int_t::CreateMessageToReceiver(testModule->GetID(), message_data_int_t()));
+
+			testQueue->SetThreadState(THREAD_RUNNING);
+			if(!TestGlobalMessageQueueThread::WaitForDelivery(testQueueHandle, *testQueue) || testModule->Count != 1)
+				return 0;
+
+			return 1;
+		}
+		catch(Exception &)
+		{
+			return 0;
+		}
+	}
+
+	bool TestGlobalMessageQueueThread::TestReregistration()
+	{
+		try
+		{
+			GlobalMessageQueueThread testQueueHandle;
+
+			auto testQueue = shared_ptr<TestQueueClasses<14,0>::TestQueue>(new TestQueueClasses<14,0>::TestQueue());
+			auto testModule1 = shared_ptr<CountModule>(new CountModule(identifier_t(14,1,0)));
+			auto testModule2 = shared_ptr<CountModule>(new CountModule(identifier_t(14,1,0)));
+			auto testModule3 = shared_ptr<CountModule>(new CountModule(identifier_t(14,1,0)));
+			const identifier_t testLinkID(14,2,0);
+
+			testQueueHandle.RegisterQueue(testQueue);
+			testQueueHandle.RegisterModule(testModule1, id_vector_t(), id_vector_t());
+
+			// The queue thread is paused, so the unregistration of the first module is still queued when the second one is registered
+			testQueueHandle.PushMessage(message_data_int_t::CreateMessageToReceiver(testModule1->GetID(), message_data_int_t()));
+			if(testQueueHandle.UnregisterModule(testModule1->GetID()) != testModule1)
+				return 0;
+
+			testQueueHandle.RegisterModule(testModule2, id_vector_t(), id_vector_t());
+
+			// Neither the routing lock nor the links of the queue may stay locked
+			testQueueHandle.AddReceiverLink(testLinkID, testModule2->GetID());
+
+			testQueueHandle.PushMessage(message_data_int_t::CreateMessageToReceiver(testModule2->GetID(), message_data_int_t()));
+			testQueueHandle.PushMessage(message_data_int_t::CreateMessageToReceiver(testLinkID, message_data_int_t()));
+
+			testQueue->SetThreadState(THREAD_RUNNING);
+			if(!TestGlobalMessageQueueThread::WaitForDelivery(testQueueHandle, *testQueue))
+				return 0;
+
+			if(testModule1->Count != 1 || testModule2->Count != 2 || testQueue->GetModule(testModule2->GetID()) != testModule2)
+				return 0;
+
+			// A second registration of an ID that is still registered fails
+			bool registrationFailed = false;
+			try
+			{
+				testQueueHandle.RegisterModule(testModule3, id_vector_t(), id_vector_t());
+			}
+			catch(Exception &)
+			{
+				registrationFailed = true;
+			}
+
+			if(!registrationFailed)
+				return 0;
+
+			// A module that waits for the unregistration of its predecessor is dropped if it is unregistered as well
+			testQueue->SetThreadState(THREAD_PAUSED);
+
+			if(testQueueHandle.UnregisterModule(testModule2->GetID()) != testModule2)
+				return 0;
+
+			testQueueHandle.RegisterModule(testModule3, id_vector_t(), id_vector_t());
+			if(testQueueHandle.UnregisterModule(testModule3->GetID()) != testModule3)
+				return 0;
+
+			testQueue->SetThreadState(THREAD_RUNNING);
+			if(!TestGlobalMessageQueueThread::WaitForDelivery(testQueueHandle, *testQueue) || testQueue->GetModule(testModule3->GetID()) != nullptr)
+				return 0;
+
+			return 1;
+		}
+		catch(Exception &)
+		{
+			return 0;
+		}
+	}
+
+	bool TestGlobalMessageQueueThread::TestUnregistrationOverflow()
+	{
+		try
+		{
+			GlobalMessageQueueThread testQueueHandle;
+
+			auto testQueue = shared_ptr<TestQueueClasses<12,0>::TestQueue>(new TestQueueClasses<12,0>::TestQueue());
+			auto testModule1 = shared_ptr<CountModule>(new CountModule(identifier_t(12,1,0)));
+			auto testModule2 = shared_ptr<CountModule>(new CountModule(identifier_t(12,2,0)));
+
+			testQueueHandle.RegisterQueue(testQueue);
+			testQueueHandle.RegisterModule(testModule1, id_vector_t(), id_vector_t());
+			testQueueHandle.RegisterModule(testModule2, id_vector_t(), id_vector_t());
+
+			// The message fills the paused module queue, the unregistration is queued behind it anyway
+			testQueue->SetQueueLimit(1, thread_queued::QUEUE_OVERFLOW_REJECT);
+
+			testQueueHandle.PushMessage(message_data_int_t::CreateMessageToReceiver(testModule1->GetID(), message_data_int_t()));
+			if(testQueueHandle.UnregisterModule(testModule1->GetID()) != testModule1 || !testQueueHandle.WaitForDrain())
+				return 0;
+
+			if(testQueue->GetModule(testModule1->GetID()) != testModule1)
+				return 0;
+
+			testQueue->SetThreadState(THREAD_RUNNING);
+			if(!testQueue->WaitForDrain() || testModule1->Count != 1 || testQueue->GetModule(testModule1->GetID()) != nullptr)
+				return 0;
+
+			// A full router thread discards the unregistration to make room for a message, it is queued again
+			testQueueHandle.SetThreadState(THREAD_PAUSED);
+			testQueueHandle.SetQueueLimit(1, thread_queued::QUEUE_OVERFLOW_DROP_OLDEST);
+
+			if(testQueueHandle.UnregisterModule(testModule2->GetID()) != testModule2)
+				return 0;
+
+			if(testQueueHandle.PushMessage(message_data_int_t::CreateMessageToReceiver(testModule2->GetID(), message_data_int_t())) != QUEUE_PUSH_DROPPED_OLDEST)
+				return 0;
+
+			testQueueHandle.SetThreadState(THREAD_RUNNING);
+			if(!TestGlobalMessageQueueThread::WaitForDelivery(testQueueHandle, *testQueue) ||
+					testQueueHandle.GetRoutedMessages(testModule2->GetID()) != 0 || testQueue->GetModule(testModule2->GetID()) != nullptr)
+				return 0;
+
+			return 1;
+		}
+		catch(Exception &)
+		{
+			return 0;
+		}
+	}
+
+	bool TestGlobalMessageQueueThread::TestSharding()
+	{
+		try
+		{
+			GlobalMessageQueueThread testShardedHandle(4);
+			if(testShardedHandle.GetShardCount() != 4)
+				return 0;
+
+			// Connections only differ in their thread ID, they must still be spread over all router threads
+			vector_t<size_t> testShardReceivers(testShardedHandle.GetShardCount());
+			for(identifier_t::thread_id_t curThreadID = 0; curThreadID < 64; ++curThreadID)
+			{
+				const size_t shardIndex = testShardedHandle.GetShardIndex(identifier_t(StartQueueID+1, 0, curThreadID));
+				if(shardIndex >= testShardedHandle.GetShardCount() || shardIndex != testShardedHandle.GetShardIndex(identifier_t(StartQueueID+1, 1, curThreadID)))
+					return 0;
+
+				++testShardReceivers[shardIndex];
+			}
+
+			for(const auto numReceivers : testShardReceivers)
+			{
+				if(numReceivers == 0)
+					return 0;
+			}
+
+			// Receivers in queue 1 with thread ID 0 are served by the second router thread
+			auto testShardedQueue = shared_ptr<TestQueueClasses10::TestQueue>(new TestQueueClasses10::TestQueue());
+			auto testModule = shared_ptr<CountModule>(new CountModule(identifier_t(1,1,0)));
+			if(testShardedHandle.GetShardIndex(testModule->GetID()) != 1)
+				return 0;
+
+			testShardedHandle.RegisterQueue(testShardedQueue);
+			testShardedHandle.RegisterModule(testModule, id_vector_t(), id_vector_t());
+			testShardedQueue->SetThreadState(THREAD_RUNNING);
+			testShardedHandle.SetStatisticsEnabled(true);
+
+			vector_t<thread_multi_module_message_t> testMessages;
+			for(size_t curMessage = 0; curMessage < 3; ++curMessage)
+				testMessages.push_back(message_data_int_t::CreateMessageToReceiver(testModule->GetID(), message_data_int_t()));
+
+			if(testShardedHandle.PushMessages(std::make_move_iterator(testMessages.begin()), std::make_move_iterator(testMessages.end())) != testMessages.size())
+				return 0;
+
+			if(!TestGlobalMessageQueueThread::WaitForDelivery(testShardedHandle, *testShardedQueue) || testModule->Count != testMessages.size())
+				return 0;
+
+			// The statistics of the global queue include all router threads
+			if(testShardedHandle.GetShardStatistics(0).EnqueuedMessages != 0 || testShardedHandle.GetShardStatistics(1).EnqueuedMessages != testMessages.size() ||
+				testShardedHandle.GetQueueStatistics().EnqueuedMessages != testMessages.size())
+				return 0;
+
+			return 1;
+		}
+		catch(Exception &)
+		{
+			return 0;
+		}
+	}
+
+	bool TestGlobalMessageQueueThread::TestShardedLinks()
+	{
+		try
+		{
+			GlobalMessageQueueThread testShardedHandle(4);
+
+			auto testQueue = shared_ptr<TestQueueClasses<13,0>::TestQueue>(new TestQueueClasses<13,0>::TestQueue());
+			auto testLinkedQueue = shared_ptr<TestQueueClasses<15,0>::TestQueue>(new TestQueueClasses<15,0>::TestQueue());
+			auto testModule = shared_ptr<CountModule>(new CountModule(identifier_t(13,1,0)));
+			auto testLinkedModule = shared_ptr<OrderModule>(new OrderModule(identifier_t(15,1,0)));
+
+			// Without links, both receivers are served by different router threads that are not the first one
+			const size_t testLinkedShard = testShardedHandle.GetShardIndex(testLinkedModule->GetID());
+			if(testLinkedShard == 0 || testShardedHandle.GetShardIndex(testModule->GetID()) == testLinkedShard)
+				return 0;
+
+			testShardedHandle.RegisterQueue(testQueue);
+			testShardedHandle.RegisterQueue(testLinkedQueue);
+			testShardedHandle.RegisterModule(testModule, id_vector_t(), id_vector_t());
+			testShardedHandle.RegisterModule(testLinkedModule, id_vector_t(), id_vector_t{testModule->GetID()});
+			testQueue->SetThreadState(THREAD_RUNNING);
+			testLinkedQueue->SetThreadState(THREAD_RUNNING);
+
+			testShardedHandle.SetThreadState(THREAD_PAUSED);
+
+			message_data_int_t testData;
+			testData.Data = 0;
+			testShardedHandle.PushMessage(message_data_int_t::CreateMessageToReceiver(testModule->GetID(), message_data_int_t(testData)));
+
+			testData.Data = 1;
+			testShardedHandle.PushMessage(message_data_int_t::CreateMessageToReceiver(testLinkedModule->GetID(), message_data_int_t(testData)));
+
+			// The router thread of the linked module alone must not deliver the second message first
+			testShardedHandle._Shards[testLinkedShard-1]->Thread.SetThreadState(THREAD_RUNNING);
+			if(!testShardedHandle._Shards[testLinkedShard-1]->Thread.WaitForDrain() || !testLinkedQueue->WaitForDrain() || testLinkedModule->Count != 0)
+				return 0;
+
+			testShardedHandle.SetThreadState(THREAD_RUNNING);
+
+			if(!TestGlobalMessageQueueThread::WaitForDelivery(testShardedHandle, *testLinkedQueue) || !testQueue->WaitForDrain() ||
+					testLinkedModule->Count != 2 || testLinkedModule->OutOfOrder || testModule->Count != 1)
+				return 0;
+
+			// The unregistration follows the messages to the linked module on the first router thread
+			testShardedHandle.SetThreadState(THREAD_PAUSED);
+
+			testData.Data = 2;
+			testShardedHandle.PushMessage(message_data_int_t::CreateMessageToReceiver(testLinkedModule->GetID(), message_data_int_t(testData)));
+			if(testShardedHandle.UnregisterModule(testLinkedModule->GetID()) != testLinkedModule)
+				return 0;
+
+			testShardedHandle.SetThreadState(THREAD_RUNNING);
+
+			if(!TestGlobalMessageQueueThread::WaitForDelivery(testShardedHandle, *testLinkedQueue) ||
+					testLinkedModule->Count != 3 || testLinkedModule->OutOfOrder || testLinkedQueue->GetModule(testLinkedModule->GetID()) != nullptr)
+				return 0;
+
+			return 1;
+		}
+		catch(Exception &)
+		{
+			return 0;
+		}
+	}
+
+	bool TestGlobalMessageQueueThread::TestShardedLinkTraffic()
+	{
+		try
+		{
+			GlobalMessageQueueThread testShardedHandle(4);
+
+			auto testQueue = shared_ptr<TestQueueClasses<13,0>::TestQueue>(new TestQueueClasses<13,0>::TestQueue());
+			auto testLinkedQueue = shared_ptr<TestQueueClasses<15,0>::TestQueue>(new TestQueueClasses<15,0>::TestQueue());
+			auto testUnlinkedQueue = shared_ptr<TestQueueClasses10::TestQueue>(new TestQueueClasses10::TestQueue());
+			auto testModule = shared_ptr<CountModule>(new CountModule(identifier_t(13,1,0)));
+			auto testLinkedModule = shared_ptr<CountModule>(new CountModule(identifier_t(15,1,0)));
+			auto testUnlinkedModule = shared_ptr<CountModule>(new CountModule(identifier_t(1,1,0)));
+
+			// Without links, none of the receivers is served by the first router thread
+			const size_t testUnlinkedShard = testShardedHandle.GetShardIndex(testUnlinkedModule->GetID());
+			if(testShardedHandle.GetShardIndex(testModule->GetID()) == 0 || testShardedHandle.GetShardIndex(testLinkedModule->GetID()) == 0 || testUnlinkedShard == 0)
+				return 0;
+
+			testShardedHandle.RegisterQueue(testQueue);
+			testShardedHandle.RegisterQueue(testLinkedQueue);
+			testShardedHandle.RegisterQueue(testUnlinkedQueue);
+			testShardedHandle.RegisterModule(testModule, id_vector_t(), id_vector_t());
+			testShardedHandle.RegisterModule(testLinkedModule, id_vector_t(), id_vector_t{testModule->GetID()});
+			testShardedHandle.RegisterModule(testUnlinkedModule, id_vector_t(), id_vector_t());
+			testQueue->SetThreadState(THREAD_RUNNING);
+			testLinkedQueue->SetThreadState(THREAD_RUNNING);
+			testUnlinkedQueue->SetThreadState(THREAD_RUNNING);
+			testShardedHandle.SetStatisticsEnabled(true);
+
+			// Messages to the module that is copied to the linked module, messages to the linked module, and messages to the unlinked module
+			constexpr size_t testNumMessages = 8;
+			vector_t<thread_multi_module_message_t> testMessages;
+			for(size_t curMessage = 0; curMessage < testNumMessages; ++curMessage)
+			{
+				testMessages.push_back(message_data_int_t::CreateMessageToReceiver(testModule->GetID(), message_data_int_t()));
+				testMessages.push_back(message_data_int_t::CreateMessageToReceiver(testLinkedModule->GetID(), message_data_int_t()));
+				testMessages.push_back(message_data_int_t::CreateMessageToReceiver(testUnlinkedModule->GetID(), message_data_int_t()));
+			}
+
+			if(testShardedHandle.PushMessages(std::make_move_iterator(testMessages.begin()), std::make_move_iterator(testMessages.end())) != testMessages.size())
+				return 0;
+
+			if(!TestGlobalMessageQueueThread::WaitForDelivery(testShardedHandle, *testUnlinkedQueue) || !testQueue->WaitForDrain() || !testLinkedQueue->WaitForDrain() ||
+					!TestGlobalMessageQueueThread::WaitForCount(*testLinkedModule, 2*testNumMessages) || testModule->Count != testNumMessages || testUnlinkedModule->Count != testNumMessages)
+				return 0;
+
+			// All linked traffic passed the first router thread, the other router threads only saw the unlinked messages
+			for(size_t curShard = 0; curShard < testShardedHandle.GetShardCount(); ++curShard)
+			{
+				size_t expectedMessages = 0;
+				if(curShard == 0)
+					expectedMessages = 2*testNumMessages;
+				else if(curShard == testUnlinkedShard)
+					expectedMessages = testNumMessages;
+
+				if(testShardedHandle.GetShardStatistics(curShard).EnqueuedMessages != expectedMessages)
+					return 0;
+			}
+
+			return 1;
+		}
+		catch(Exception &)
+		{
+			return 0;
+		}
+	}
 
-			// Test first module
-			testQueueHandle.PushMessage(message_data_int_t::CreateMessageFromSender(identifier_t(0,0,0), message_data_int_t(testIntData)));
+	bool TestGlobalMessageQueueThread::TestDirectDelivery()
+	{
+		try
+		{
+			GlobalMessageQueueThread testQueueHandle;
+
+			auto testWaitingQueue = shared_ptr<TestQueueClasses<6,0>::TestQueue>(new TestQueueClasses<6,0>::TestQueue());
+			auto testDirectQueue = shared_ptr<TestQueueClasses<7,0>::TestQueue>(new TestQueueClasses<7,0>::TestQueue());
+			auto testWaitingModule = shared_ptr<OrderModule>(new OrderModule(identifier_t(6,1,0)));
+			auto testDirectModule = shared_ptr<OrderModule>(new OrderModule(identifier_t(7,1,0)));
+
+			// Ordering is tracked per receiver bucket, the receivers must not share one
+			if(&testQueueHandle.GetRoutedMessages(testWaitingModule->GetID()) == &testQueueHandle.GetRoutedMessages(testDirectModule->GetID()))
+				return 0;
+
+			testQueueHandle.RegisterQueue(testWaitingQueue);
+			testQueueHandle.RegisterQueue(testDirectQueue);
+			testQueueHandle.RegisterModule(testWaitingModule, id_vector_t(), id_vector_t());
+			testQueueHandle.RegisterModule(testDirectModule, id_vector_t(), id_vector_t());
+			testWaitingQueue->SetThreadState(THREAD_RUNNING);
+			testDirectQueue->SetThreadState(THREAD_RUNNING);
+
+			// Keep a message waiting in the paused router thread
+			testQueueHandle.SetThreadState(THREAD_PAUSED);
+
+			const auto createMessage = [] (identifier_t ReceiverID, size_t Producer, int Sequence)
+			{
+				message_data_int_t messageData;
+				messageData.Data = static_cast<int>(Producer) * OrderModule::ProducerMessages + Sequence;
+
+				return message_data_int_t::CreateMessageToReceiver(ReceiverID, std::move(messageData));
+			};
+
+			testQueueHandle.PushMessage(createMessage(testWaitingModule->GetID(), 0, 0));
+
+			// The other receiver has nothing waiting, so its producers don't need the router thread
+			std::atomic<bool> testDirectFailed{false};
+			vector_t<std::thread> testProducers;
+			for(size_t curProducer = 1; curProducer < OrderModule::NumProducers; ++curProducer)
+			{
+				testProducers.push_back(std::thread([&, curProducer] ()
+				{
+					for(int curMessage = 0; curMessage < OrderModule::ProducerMessages; ++curMessage)
+					{
+						if(testQueueHandle.PushMessageDirect(createMessage(testDirectModule->GetID(), curProducer, curMessage)) != QUEUE_PUSH_SUCCESS)
+							testDirectFailed = true;
+					}
+				}));
+			}
+
+			// Meanwhile, direct messages to the waiting receiver must queue up behind the first one
+			for(int curMessage = 1; curMessage < OrderModule::ProducerMessages; ++curMessage)
+				testQueueHandle.PushMessageDirect(createMessage(testWaitingModule->GetID(), 0, curMessage));
+
+			for(auto &curProducer : testProducers)
+				curProducer.join();
+
+			const size_t testDirectMessages = (OrderModule::NumProducers-1) * OrderModule::ProducerMessages;
+			if(testDirectFailed || !testDirectQueue->WaitForDrain() || testDirectModule->Count != testDirectMessages || testDirectModule->OutOfOrder)
+				return 0;
+
+			if(!testWaitingQueue->WaitForDrain() || testWaitingModule->Count != 0)
+				return 0;
 
 			testQueueHandle.SetThreadState(THREAD_RUNNING);
+
+			if(!TestGlobalMessageQueueThread::WaitForDelivery(testQueueHandle, *testWaitingQueue) ||
+				testWaitingModule->Count != static_cast<size_t>(OrderModule::ProducerMessages) || testWaitingModule->OutOfOrder)
+				return 0;
+
+			return 1;
+		}
+		catch(Exception &)
+		{
+			return 0;
+		}
+	}
+
+	bool TestGlobalMessageQueueThread::TestLinkedDirectDelivery()
+	{
+		try
+		{
+			GlobalMessageQueueThread testQueueHandle;
+
+			auto testQueue = shared_ptr<TestQueueClasses<9,0>::TestQueue>(new TestQueueClasses<9,0>::TestQueue());
+			auto testLinkedQueue = shared_ptr<TestQueueClasses<10,0>::TestQueue>(new TestQueueClasses<10,0>::TestQueue());
+			auto testModule = shared_ptr<CountModule>(new CountModule(identifier_t(9,1,0)));
+			auto testLinkedModule = shared_ptr<OrderModule>(new OrderModule(identifier_t(10,1,0)));
+
+			// The linked module must not see the counter of the other receiver
+			if(&testQueueHandle.GetRoutedMessages(testModule->GetID()) == &testQueueHandle.GetRoutedMessages(testLinkedModule->GetID()))
+				return 0;
+
+			testQueueHandle.RegisterQueue(testQueue);
+			testQueueHandle.RegisterQueue(testLinkedQueue);
+			testQueueHandle.RegisterModule(testModule, id_vector_t(), id_vector_t());
+			testQueueHandle.RegisterModule(testLinkedModule, id_vector_t(), id_vector_t{testModule->GetID()});
 			testQueue->SetThreadState(THREAD_RUNNING);
+			testLinkedQueue->SetThreadState(THREAD_RUNNING);
 
-			// Wait for message to be sent to module
-			thread_queued::SleepForMs(1000000);
+			// The copy for the linked module waits in the paused router thread
+			testQueueHandle.SetThreadState(THREAD_PAUSED);
 
-			if(*(pTestInt.Get<int>()) != testNumber1)
+			message_data_int_t testData;
+			testData.Data = 0;
+			testQueueHandle.PushMessage(message_data_int_t::CreateMessageToReceiver(testModule->GetID(), message_data_int_t(testData)));
+
+			testData.Data = 1;
+			testQueueHandle.PushMessageDirect(message_data_int_t::CreateMessageToReceiver(testLinkedModule->GetID(), message_data_int_t(testData)));
+
+			if(!testLinkedQueue->WaitForDrain() || testLinkedModule->Count != 0)
 				return 0;
 
-			// Test 2nd module
-			testIntData.Data = 0;
-			testIntData.Target = pTestInt;
-			testQueueHandle.PushMessage(message_data_int_t::CreateMessageToReceiver(testQueueModule2->GetID(), message_data_int_t(testIntData)));
+			testQueueHandle.SetThreadState(THREAD_RUNNING);
 
-			// Wait for message to be sent to module
-			thread_queued::SleepForMs(1000000);
+			if(!TestGlobalMessageQueueThread::WaitForDelivery(testQueueHandle, *testLinkedQueue) || !testQueue->WaitForDrain() ||
+					testLinkedModule->Count != 2 || testLinkedModule->OutOfOrder || testModule->Count != 1)
+				return 0;
 
-			if(*(pTestInt.Get<int>()) != 0)
+			return 1;
+		}
+		catch(Exception &)
+		{
+			return 0;
+		}
+	}
+
+	bool TestGlobalMessageQueueThread::TestDroppedRoutedMessages()
+	{
+		try
+		{
+			GlobalMessageQueueThread testQueueHandle;
+
+			auto testQueue = shared_ptr<TestQueueClasses<11,0>::TestQueue>(new TestQueueClasses<11,0>::TestQueue());
+			auto testModule = shared_ptr<CountModule>(new CountModule(identifier_t(11,1,0)));
+
+			testQueueHandle.RegisterQueue(testQueue);
+			testQueueHandle.RegisterModule(testModule, id_vector_t(), id_vector_t());
+			testQueue->SetThreadState(THREAD_RUNNING);
+
+			// The second message replaces the first one in the paused router thread
+			testQueueHandle.SetThreadState(THREAD_PAUSED);
+			testQueueHandle.SetQueueLimit(1, thread_queued::QUEUE_OVERFLOW_DROP_OLDEST);
+
+			const auto &testRoutedMessages = testQueueHandle.GetRoutedMessages(testModule->GetID());
+
+			if(testQueueHandle.PushMessage(message_data_int_t::CreateMessageToReceiver(testModule->GetID(), message_data_int_t())) != QUEUE_PUSH_SUCCESS ||
+					testQueueHandle.PushMessage(message_data_int_t::CreateMessageToReceiver(testModule->GetID(), message_data_int_t())) != QUEUE_PUSH_DROPPED_OLDEST ||
+					testRoutedMessages != 1)
 				return 0;
 
-			// Test Receiver Linking
-			const auto testReceiverID = identifier_t(testQueue->GetID().MessageQueueID, 5, testQueue->GetID().ThreadID);
-			testQueueHandle.AddReceiverLink(testReceiverID, testQueueModule1->GetID());
+			testQueueHandle.SetThreadState(THREAD_RUNNING);
+			if(!TestGlobalMessageQueueThread::WaitForDelivery(testQueueHandle, *testQueue) || testRoutedMessages != 0 || testModule->Count != 1)
+				return 0;
 
-			testIntData.Data = testNumber1;
-			testIntData.Target = pTestInt;
-			testQueueHandle.PushMessage(message_data_int_t::CreateMessageToReceiver(testReceiverID, message_data_int_t(testIntData)));
+			// Nothing waits for the receiver anymore, so direct messages don't need the paused router thread
+			testQueueHandle.SetThreadState(THREAD_PAUSED);
+			if(testQueueHandle.PushMessageDirect(message_data_int_t::CreateMessageToReceiver(testModule->GetID(), message_data_int_t())) != QUEUE_PUSH_SUCCESS ||
+					!testQueue->WaitForDrain() || testModule->Count != 2)
+				return 0;
 
-			// Wait for message to be sent to module
-			thread_queued::SleepForMs(1000000);
+			testQueueHandle.SetThreadState(THREAD_RUNNING);
 
-			if(*(pTestInt.Get<int>()) != testNumber1)
+			return 1;
+		}
+		catch(Exception &)
+		{
+			return 0;
+		}
+	}
+
+	bool TestGlobalMessageQueueThread::TestReceiverSaturation()
+	{
+		try
+		{
+			GlobalMessageQueueThread testQueueHandle;
+
+			auto testQueue = shared_ptr<TestQueueClasses<8,0>::TestQueue>(new TestQueueClasses<8,0>::TestQueue());
+			auto testModule = shared_ptr<CountModule>(new CountModule(identifier_t(8,1,0)));
+
+			testQueueHandle.RegisterQueue(testQueue);
+			testQueueHandle.RegisterModule(testModule, id_vector_t(), id_vector_t());
+
+			// The paused receiver fills up with the second message
+			testQueue->SetQueueLimit(2, thread_queued::QUEUE_OVERFLOW_REJECT);
+
+			if(testQueueHandle.PushMessageDirect(message_data_int_t::CreateMessageToReceiver(testModule->GetID(), message_data_int_t())) != QUEUE_PUSH_SUCCESS)
 				return 0;
 
-			// Test Sender Linking
-			const auto testSenderID = identifier_t(testQueue->GetID().MessageQueueID, 6, testQueue->GetID().ThreadID);
-			testQueueHandle.AddSendLink(testSenderID, testQueueModule2->GetID());
+			if(testQueueHandle.PushMessageDirect(message_data_int_t::CreateMessageToReceiver(testModule->GetID(), message_data_int_t())) != QUEUE_PUSH_TARGET_SATURATED)
+				return 0;
 
-			testIntData.Data = testNumber1;
-			testIntData.Target = pTestInt;
-			testQueueHandle.PushMessage(message_data_int_t::CreateMessageFromSender(testSenderID, message_data_int_t(testIntData)));
+			{
+				// The router path checks the receiver with the snapshot the producer already holds
+				const GlobalMessageQueueThread::routing_guard_t testGuard(testQueueHandle);
+				auto &testReader = testQueueHandle.GetThreadReader();
+				const auto testPinnedVersion = testReader.PinnedVersion.load();
 
-			// Wait for message to be sent to module
-			thread_queued::SleepForMs(1000000);
+				testQueueHandle.SetThreadState(THREAD_PAUSED);
 
-			if(*(pTestInt.Get<int>()) != 0)
+				if(testQueueHandle.PushMessage(message_data_int_t::CreateMessageToReceiver(testModule->GetID(), message_data_int_t())) != QUEUE_PUSH_TARGET_SATURATED)
+					return 0;
+
+				if(testReader.Routing != &(*testGuard) || testReader.PinnedVersion.load() != testPinnedVersion || testReader.GuardDepth != 1)
+					return 0;
+			}
+
+			// Nothing is saturated once the receiver drained
+			testQueue->SetThreadState(THREAD_RUNNING);
+			if(!testQueue->WaitForDrain())
 				return 0;
 
-			// Test unregistering
-			auto testUnregisterModule = testQueueHandle.UnregisterModule(testQueueModule1->GetID());
-			if(testUnregisterModule != testQueueModule1)
+			if(testQueueHandle.PushMessageDirect(message_data_int_t::CreateMessageToReceiver(testModule->GetID(), message_data_int_t())) != QUEUE_PUSH_SUCCESS)
 				return 0;
 
-			*(pTestInt.Get<int>()) = 0;
-			testIntData.Data = testNumber1;
-			testIntData.Target = pTestInt;
-			testQueueHandle.PushMessage(message_data_int_t::CreateMessageFromSender(identifier_t(0,0,0), message_data_int_t(testIntData)));
+			testQueueHandle.SetThreadState(THREAD_RUNNING);
+			if(!TestGlobalMessageQueueThread::WaitForDelivery(testQueueHandle, *testQueue) || testModule->Count != 4)
+				return 0;
 
-			// Wait for message to be sent to module
-			thread_queued::SleepForMs(1000000);
+			return 1;
+		}
+		catch(Exception &)
+		{
+			return 0;
+		}
+	}
 
-			// Check that module really was unregistered
-			if(*(pTestInt.Get<int>()) == testNumber1)
+	bool TestGlobalMessageQueueThread::WaitForDelivery(GlobalMessageQueueThread &Router, thread_multi_module_manager_t &Queue)
+	{
+		// Router threads only push to registered queues, so the queue is drained last
+		return Router.WaitForDrain() && Queue.WaitForDrain();
+	}
+
+	bool TestGlobalMessageQueueThread::TestRoutingSnapshots()
+	{
+		try
+		{
+			GlobalMessageQueueThread testQueueHandle;
+
+			auto testQueue = shared_ptr<TestQueueClasses<2,0>::TestQueue>(new TestQueueClasses<2,0>::TestQueue());
+			auto testModule = shared_ptr<CountModule>(new CountModule(identifier_t(2,1,0)));
+			const auto testQueueID = testQueue->GetID();
+			const auto testLinkID = identifier_t(2,5,0);
+
+			const auto *const testEmptyRouting = testQueueHandle._Routing.load();
+
+			{
+				// A pinned snapshot is kept after it was replaced
+				const GlobalMessageQueueThread::routing_guard_t testEmptyGuard(testQueueHandle);
+
+				testQueueHandle.RegisterQueue(testQueue);
+
+				if(&(*testEmptyGuard) != testEmptyRouting || testQueueHandle._RetiredRoutings.size() != 1 ||
+					GlobalMessageQueueThread::FindQueueRoute(*testEmptyGuard, testQueueID.MessageQueueID, testQueueID.ThreadID) != nullptr)
+					return 0;
+			}
+
+			// Check routing table
+			const auto *const testRouting = testQueueHandle._Routing.load();
+			const auto *const testRoute = GlobalMessageQueueThread::FindQueueRoute(*testRouting, testQueueID.MessageQueueID, testQueueID.ThreadID);
+			if(testRoute == nullptr || testRoute->Queue != testQueue || GlobalMessageQueueThread::FindQueueRoute(*testRouting, testQueueID.MessageQueueID, testQueueID.ThreadID+1) != nullptr)
 				return 0;
 
-			// Test queue Unregistering
-			auto testUnregisterQueue = testQueueHandle.UnregisterQueue(testQueue);
-			if(testUnregisterQueue != testQueue)
+			// Links are only added to the new snapshot. Nothing pins the replaced snapshots anymore, so they are freed
+			testQueueHandle.RegisterModule(testModule, id_vector_t(), id_vector_t({testLinkID}));
+
+			const auto *const testLinkedRouting = testQueueHandle._Routing.load();
+			if(testLinkedRouting->ReceiverIDLinks.Find(testLinkID) == nullptr || !testQueueHandle._RetiredRoutings.empty())
 				return 0;
 
-			// Check that queue really was unregistered
-			*(pTestInt.Get<int>()) = testNumber1;
-			testIntData.Data = 0;
-			testIntData.Target = pTestInt;
-			testQueueHandle.PushMessage(message_data_int_t::CreateMessageToReceiver(testQueueModule2->GetID(), message_data_int_t(testIntData)));
+			{
+				const GlobalMessageQueueThread::routing_guard_t testLinkedGuard(testQueueHandle);
 
-			// Wait for message to be sent to module
-			thread_queued::SleepForMs(1000000);
+				// Old snapshots keep their routes, new ones don't have the queue anymore
+				if(&(*testLinkedGuard) != testLinkedRouting || testQueueHandle.UnregisterQueue(testQueue) != testQueue)
+					return 0;
 
-			// Check that queue really was unregistered
-			if(*(pTestInt.Get<int>()) == 0)
+				const auto *const testStaleRoute = GlobalMessageQueueThread::FindQueueRoute(*testLinkedGuard, testQueueID.MessageQueueID, testQueueID.ThreadID);
+				if(testStaleRoute == nullptr ||
+					GlobalMessageQueueThread::FindQueueRoute(*testQueueHandle._Routing.load(), testQueueID.MessageQueueID, testQueueID.ThreadID) != nullptr)
+					return 0;
+
+				// Messages propagated with the old snapshot are counted once the queue doesn't accept them anymore
+				testQueue->SetMessageAcceptance(false);
+
+				auto testMessage = message_data_int_t::CreateMessageToReceiver(testModule->GetID(), message_data_int_t());
+				testStaleRoute->Queue->HandleMessage(testMessage);
+
+				if(testQueue->GetOverflowStats().NotAcceptedMessages != 1)
+					return 0;
+			}
+
+			// The replaced snapshot is released by the next routing change, which drops its reference to the queue
+			if(testQueue.use_count() != 2)
+				return 0;
+
+			testQueueHandle.AddReceiverLink(testLinkID, identifier_t(3,1,0));
+
+			if(testQueue.use_count() != 1 || !testQueueHandle._RetiredRoutings.empty())
+				return 0;
+
+			return 1;
+		}
+		catch(Exception &)
+		{
+			return 0;
+		}
+	}
+
+	bool TestGlobalMessageQueueThread::TestTimedMessages()
+	{
+		try
+		{
+			GlobalMessageQueueThread testQueueHandle;
+
+			auto testQueue = shared_ptr<TestQueueClasses<2,0>::TestQueue>(new TestQueueClasses<2,0>::TestQueue());
+			auto testModule = shared_ptr<CountModule>(new CountModule(identifier_t(2,1,0)));
+
+			testQueueHandle.RegisterQueue(testQueue);
+			testQueueHandle.RegisterModule(testModule, id_vector_t(), id_vector_t());
+			testQueue->SetThreadState(THREAD_RUNNING);
+
+			// Test delayed messages. The cancelled message would expire together with the first one
+			testQueueHandle.PushMessageAfter(timer_duration_t(50), message_data_int_t::CreateMessageToReceiver(testModule->GetID(), message_data_int_t()));
+
+			const auto cancelTimerID = testQueueHandle.PushMessageAfter(timer_duration_t(50), message_data_int_t::CreateMessageToReceiver(testModule->GetID(), message_data_int_t()));
+			if(!testQueueHandle.CancelTimedMessage(cancelTimerID) || testQueueHandle.CancelTimedMessage(cancelTimerID) || testModule->Count != 0)
+				return 0;
+
+			if(!TestGlobalMessageQueueThread::WaitForCount(*testModule, 1) || !testQueueHandle.WaitForDrain() || !testQueue->WaitForDrain() || testModule->Count != 1)
+				return 0;
+
+			// Test periodic messages
+			const auto periodicTimerID = testQueueHandle.PushMessagePeriodic(timer_duration_t(10), message_data_int_t::CreateMessageToReceiver(testModule->GetID(), message_data_int_t()));
+			if(!TestGlobalMessageQueueThread::WaitForCount(*testModule, 4))
+				return 0;
+
+			if(!testQueueHandle.CancelTimedMessage(periodicTimerID))
+				return 0;
+
+			// No more messages once the periodic message is stopped. Expirations the timer thread took out before the cancellation are delivered first
+			testQueueHandle._MessageTimers.WaitForExpirations();
+			if(testQueueHandle._MessageTimers.GetNumTimers() != 0 || !testQueueHandle.WaitForDrain() || !testQueue->WaitForDrain())
+				return 0;
+
+			const size_t stoppedCount = testModule->Count;
+			if(!testQueueHandle.WaitForDrain() || !testQueue->WaitForDrain() || testModule->Count != stoppedCount)
 				return 0;
 
 			return 1;
@@ -503,4 +2022,81 @@ namespace global_message_queue_thread
 			return 0;
 		}
 	}
+
+	bool TestGlobalMessageQueueThread::WaitForCount(const CountModule &Module, size_t Count)
+	{
+		for(size_t curWait = 0; curWait < 5000; ++curWait)
+		{
+			if(Module.Count >= Count)
+				return true;
+
+			thread_queued::SleepForMs(1000);
+		}
+
+		return Module.Count >= Count;
+	}
+
+	void TestGlobalMessageQueueThread::MeasureDelivery(bool Linked, size_t NumMessages, double &ReferenceOps, double &Nanoseconds)
+	{
+		GlobalMessageQueueThread testQueueHandle;
+
+		auto testQueue = shared_ptr<TestQueueClasses<3,0>::TestQueue>(new TestQueueClasses<3,0>::TestQueue());
+		auto testLinkedQueue = shared_ptr<TestQueueClasses<4,0>::TestQueue>(new TestQueueClasses<4,0>::TestQueue());
+		auto testModule = shared_ptr<CountModule>(new CountModule(identifier_t(3,1,0)));
+		auto testLinkedModule = shared_ptr<CountModule>(new CountModule(identifier_t(4,1,0)));
+
+		testQueueHandle.RegisterQueue(testQueue);
+		testQueueHandle.RegisterModule(testModule, id_vector_t(), id_vector_t());
+
+		if(Linked)
+		{
+			testQueueHandle.RegisterQueue(testLinkedQueue);
+			testQueueHandle.RegisterModule(testLinkedModule, id_vector_t(), id_vector_t({testModule->GetID()}));
+		}
+
+		testQueue->SetThreadState(THREAD_RUNNING);
+		testLinkedQueue->SetThreadState(THREAD_RUNNING);
+
+		// Wait for registrations
+		testQueueHandle.WaitForDrain();
+		testQueue->WaitForDrain();
+		testLinkedQueue->WaitForDrain();
+
+		message_data_bench_t testData;
+		testData.Data = "benchmark";
+
+		const size_t startOps = SharedDynamicPointer<void>::GetReferenceOpCount();
+		const auto startTime = std::chrono::steady_clock::now();
+
+		for(size_t curMessage = 0; curMessage < NumMessages; ++curMessage)
+			testQueueHandle.PushMessage(message_data_bench_t::CreateMessageToReceiver(testModule->GetID(), message_data_bench_t(testData)));
+
+		testQueueHandle.WaitForDrain();
+		testQueue->WaitForDrain();
+		testLinkedQueue->WaitForDrain();
+
+		const auto endTime = std::chrono::steady_clock::now();
+		const size_t endOps = SharedDynamicPointer<void>::GetReferenceOpCount();
+
+		ReferenceOps = static_cast<double>(endOps - startOps) / NumMessages;
+		Nanoseconds = std::chrono::duration<double, std::nano>(endTime - startTime).count() / NumMessages;
+	}
+
+	void TestGlobalMessageQueueThread::Benchmark()
+	{
+		static constexpr size_t numMessages = 100000;
+
+		if(!DynamicPointerCountReferenceOps)
+			std::cout << "Reference count operations are not counted, build with DYNAMIC_POINTER_COUNT_REFERENCE_OPS=1\n";
+
+		std::cout << "Receiver queues\tReference ops/message\tTime (ns/message)\n";
+
+		for(const bool linked : {false, true})
+		{
+			double referenceOps = 0, nanoseconds = 0;
+			TestGlobalMessageQueueThread::MeasureDelivery(linked, numMessages, referenceOps, nanoseconds);
+
+			std::cout << (linked ? 2 : 1) << "\t" << referenceOps << "\t" << nanoseconds << "\n";
+		}
+	}
 }
@@ -8,6 +8,12 @@
 
 #include "silkstring_message.h"
 #include "thread_queued.h"
+#include "timer_wheel.h"
+
+#include <unordered_map>
+#include <memory>
+#include <atomic>
+#include <array>
 
 #include "testing_class_declaration.h"
 #include "debug_flag.h"
@@ -22,15 +28,42 @@
  */
 namespace global_message_queue_thread
 {
+	using std::atomic;
 	using std::function;
 	using std::bind;
 	using std::mutex;
+	using std::lock_guard;
+	using std::unordered_map;
+	using std::shared_ptr;
+	using std::unique_ptr;
 
 	using thread_queued::ThreadQueued;
 	using thread_queued::thread_state_t;
 	using thread_queued::THREAD_PAUSED;
 	using thread_queued::THREAD_RUNNING;
 	using thread_queued::THREAD_STOPPED;
+	using thread_queued::queue_push_result_t;
+	using thread_queued::queue_overflow_policy_t;
+	using thread_queued::queue_overflow_stats_t;
+	using thread_queued::QUEUE_OVERFLOW_REJECT;
+	using thread_queued::QUEUE_PUSH_SUCCESS;
+	using thread_queued::QUEUE_PUSH_DROPPED_OLDEST;
+	using thread_queued::QUEUE_PUSH_TARGET_SATURATED;
+	using thread_queued::queue_lane_t;
+	using thread_queued::queue_lane_scheduling_t;
+	using thread_queued::queue_lane_weight_t;
+	using thread_queued::drain_timeout_t;
+	using thread_queued::InfiniteDrainTimeout;
+
+	using thread_scheduler::ThreadScheduler;
+
+	using timer_wheel::TimerWheel;
+	using timer_wheel::timer_id_t;
+	using timer_wheel::timer_duration_t;
+	using timer_wheel::InvalidTimerID;
+
+	using queue_statistics::queue_statistics_t;
+	using queue_statistics::latency_histogram_t;
 
 	using silkstring_message::message_ptr;
 	using silkstring_message::message_t;
@@ -56,6 +89,7 @@ namespace global_message_queue_thread
 	using silkstring_message::module_registration_message_t;
 	using silkstring_message::ModuleUnregistrationMessageType;
 	using silkstring_message::module_unregistration_message_t;
+	using silkstring_message::module_link_message_t;
 
 	using vector_t::vector_t;
 
@@ -63,6 +97,10 @@ namespace global_message_queue_thread
 
 	/*!
 	 * \brief The GlobalMessageQueueThread class
+	 *
+	 * Routes messages to the queue threads of their receivers. With several router threads, only messages between unlinked modules are spread over them.
+	 * Every message that involves a link, including the copies to linked modules, is routed by the first router thread, so linked and fan-out traffic
+	 * doesn't scale with the number of router threads. All router threads also read the same routing snapshot, and every change to it is serialized by one _RoutingLock
 	 */
 	class GlobalMessageQueueThread : protected thread_multi_module_manager_t
 	{
@@ -74,10 +112,18 @@ namespace global_message_queue_thread
 
 			static constexpr identifier_t::queue_id_t QueueID = StartQueueID + 0;
 
+			/*!
+			 * \brief Number of router threads if the startup setting doesn't select one
+			 */
+			static constexpr size_t DefaultShardCount = 1;
+
 			/*!
 			 * 	\brief Constructor
+			 * 	\param ShardCount Number of router threads. Messages are split between them by a hash of the queue key (queue ID and thread ID) of their receiver.
+			 * 	Messages that are copied to linked modules, and messages to linked modules, all pass the first router thread. Each destination receives
+			 * 	the messages of one producer in push order, as long as no links are added or removed in between
 			 */
-			GlobalMessageQueueThread();
+			explicit GlobalMessageQueueThread(size_t ShardCount = DefaultShardCount);
 
 			GlobalMessageQueueThread(const GlobalMessageQueueThread &S) = delete;
 			GlobalMessageQueueThread &operator=(const GlobalMessageQueueThread &S) = delete;
@@ -87,12 +133,14 @@ namespace global_message_queue_thread
 			~GlobalMessageQueueThread();
 
 			/*!
-			 * \brief Register a new message queue
+			 * \brief Register a new message queue. It is moved to the scheduler of the global queue, if there is one
 			 */
 			void RegisterQueue(const thread_multi_module_manager_shared_ptr_t &NewMessageQueue);
 
 			/*!
-			 * \brief Unregister an existing message queue
+			 * \brief Unregister an existing message queue. Messages that router threads still propagate with older routing snapshots are counted as not accepted if the queue doesn't accept messages anymore
+			 *
+			 * The older snapshots keep a reference to the queue until no thread reads them anymore. They are released by a later routing change or by the destructor, never by a router thread
 			 * \param MessageQueueID ID of queue to unregister
 			 * \return Returns pointer to unregisterd message queue
 			 */
@@ -101,6 +149,9 @@ namespace global_message_queue_thread
 
 			/*!
 			 * \brief Register a new Module. The ModuleID is checked to see which queue it belongs to
+			 *
+			 * If an earlier module with this ID was unregistered but its queue didn't handle that yet, NewModule is registered once the queue did. Until then
+			 * messages to the ID still reach the earlier module. Throws if a module with this ID is registered and not being unregistered
 			 * \param NewModule Module to register
 			 * \param Links Messages to other modules that should be sent to this module as well
 			 */
@@ -114,49 +165,547 @@ namespace global_message_queue_thread
 			void RegisterModule(const thread_multi_module_shared_ptr_t &NewModule, id_vector_t &&SendLinks, id_vector_t &&ReceiverLinks);
 
 			/*!
-			 * \brief Unregister a Module
+			 * \brief Unregister a Module. Its links are removed immediately, the module itself once its queue handled the messages pushed to it before.
+			 * Until its queue reaches the unregistration, the module keeps receiving messages, including ones pushed after this call.
+			 * The unregistration is not subject to the queue limits of the router threads and of the module queue. A module that still waits for the unregistration
+			 * of its predecessor, see RegisterModule(), is dropped without ever being registered
 			 * \param ModuleID ID of module to unregister
 			 * \return Returns pointer to unregistered module
 			 */
 			thread_multi_module_shared_ptr_t UnregisterModule(identifier_t ModuleID);
 
 			/*!
-			 * \brief Push Message to queues
+			 * \brief Send messages from SendID to ModuleID as well
+			 */
+			void AddSendLink(identifier_t SendID, identifier_t ModuleID);
+
+			/*!
+			 * \brief Send messages to ReceiverID to ModuleID as well
+			 */
+			void AddReceiverLink(identifier_t ReceiverID, identifier_t ModuleID);
+
+			/*!
+			 * \brief Push Message to queues. The lane is taken from the message type, see message_id_struct_t
 			 * \param Message Message to push
+			 * \return Returns QUEUE_PUSH_TARGET_SATURATED if the message was queued but the receiver queue is full, otherwise the result of pushing to the global queue
 			 */
-			void PushMessage(thread_multi_module_message_t Message);
+			queue_push_result_t PushMessage(thread_multi_module_message_t Message);
 
 			/*!
-			 * \brief Push Message to front of queues
+			 * \brief Push Message directly onto the receiver queue from the calling thread, without passing through the global thread
+			 *
+			 * Falls back to PushMessage() if the message needs link expansion, its receiver is linked to other modules, it is a registration,
+			 * it has no route, its receiver queue is full, or messages to its receiver are still waiting in a router thread. The latter keeps the order of messages from one producer to
+			 * one receiver. If called by a handler of the receiver queue, the message is handled by that thread once the handler returned,
+			 * see PushLocalMessage()
 			 * \param Message Message to push
+			 * \return Returns the result of pushing to the receiver queue, QUEUE_PUSH_TARGET_SATURATED if that queue is full now, or the result of PushMessage() when falling back
+			 */
+			queue_push_result_t PushMessageDirect(thread_multi_module_message_t Message);
+
+			/*!
+			 * \brief Push several messages at once. With a single router thread, the queue lock is only taken once. With several router threads, each message is pushed to its router thread separately
+			 * \param Begin Iterator to first message. Use move iterators to move messages into the queue
+			 * \param End Iterator past last message
+			 * \return Returns number of queued messages, including messages that replaced the oldest message of a full queue
+			 */
+			template<class Iterator>
+			size_t PushMessages(Iterator Begin, Iterator End)
+			{
+				// An unbounded queue takes all messages or none, so they can be counted before
+				if(this->_Shards.empty() && this->GetQueueLimit() == thread_queued::UnboundedQueueSize)
+				{
+					size_t numMessages = 0;
+					for(auto curMessage = Begin; curMessage != End; ++curMessage)
+					{
+						const thread_multi_module_message_t &message = *curMessage;
+						this->GetRoutedMessages(message.Get<MessageReceiverIDNum>()).fetch_add(1);
+						++numMessages;
+					}
+
+					const size_t numPushedMessages = this->thread_multi_module_manager_t::PushMessages(Begin, End);
+					if(numPushedMessages != numMessages)
+					{
+						for(auto curMessage = Begin; curMessage != End; ++curMessage)
+						{
+							const thread_multi_module_message_t &message = *curMessage;
+							this->GetRoutedMessages(message.Get<MessageReceiverIDNum>()).fetch_sub(1);
+						}
+					}
+
+					return numPushedMessages;
+				}
+
+				// Every message may belong to another router thread
+				size_t numMessages = 0;
+				for(; Begin != End; ++Begin)
+				{
+					const auto pushResult = this->PushMessageToShard(*Begin);
+					if(pushResult == QUEUE_PUSH_SUCCESS || pushResult == QUEUE_PUSH_DROPPED_OLDEST)
+						++numMessages;
+				}
+
+				return numMessages;
+			}
+
+			/*!
+			 * \brief Push Message once Delay has passed. Used for retries and timeouts instead of sleeping in a handler
+			 * \return Returns handle to cancel the message
+			 */
+			timer_id_t PushMessageAfter(timer_duration_t Delay, thread_multi_module_message_t Message);
+
+			/*!
+			 * \brief Push a copy of Message every Period, starting after the first Period. Used for polling
+			 * \return Returns handle to stop the messages
+			 */
+			timer_id_t PushMessagePeriodic(timer_duration_t Period, thread_multi_module_message_t Message);
+
+			/*!
+			 * \brief Stop a delayed or periodic message
+			 * \return Returns false if the message was already pushed or cancelled
 			 */
-			void PushMessageFront(thread_multi_module_message_t Message);
+			bool CancelTimedMessage(timer_id_t TimerID);
+
+			/*!
+			 * \brief Set the maximum number of messages propagated per queue lock acquisition
+			 */
+			void SetBatchSize(size_t BatchSize);
+
+			/*!
+			 * \brief Select how the lanes of messages waiting to be propagated are served
+			 */
+			void SetLaneScheduling(queue_lane_scheduling_t LaneScheduling);
+
+			/*!
+			 * \brief Set the number of messages of Lane propagated before the next lane is served
+			 */
+			void SetLaneWeight(queue_lane_t Lane, queue_lane_weight_t Weight);
+
+			/*!
+			 * \brief Limit the number of messages waiting to be propagated
+			 */
+			void SetQueueLimit(size_t MaxQueuedMessages, queue_overflow_policy_t OverflowPolicy = QUEUE_OVERFLOW_REJECT);
+
+			/*!
+			 * \brief Get counters of messages that didn't fit into the global queue
+			 */
+			queue_overflow_stats_t GetOverflowStats() const;
+
+			/*!
+			 * \brief Enable or disable statistics of the global queue and of all registered queues
+			 */
+			void SetStatisticsEnabled(bool Enabled);
+
+			/*!
+			 * \brief Get statistics of the global queue, summed over all router threads. See GetShardStatistics() for a single one
+			 */
+			queue_statistics_t GetQueueStatistics() const;
+
+			/*!
+			 * \brief Get number of router threads
+			 */
+			size_t GetShardCount() const;
+
+			/*!
+			 * \brief Get statistics of the router thread with index ShardIndex
+			 */
+			queue_statistics_t GetShardStatistics(size_t ShardIndex) const;
+
+			/*!
+			 * \brief Get statistics of a registered queue
+			 * \return Returns empty statistics if the queue isn't registered
+			 */
+			queue_statistics_t GetQueueStatistics(identifier_t::queue_id_t QueueID, identifier_t::thread_id_t MessageQueueThreadID);
+
+			/*!
+			 * \brief Get the handler execution times of a module in one of the registered queues
+			 * \return Returns an empty histogram if the module isn't registered
+			 */
+			latency_histogram_t GetModuleHandlerTime(identifier_t ModuleID);
+
+			/*!
+			 * \brief Block until all messages in the global queue were propagated
+			 * \param Timeout Maximum time to wait for each router thread
+			 * \return Returns false if the timeout expired or the thread was stopped first
+			 */
+			bool WaitForDrain(drain_timeout_t Timeout = InfiniteDrainTimeout);
+
+			/*!
+			 * \brief Handle the messages of the global queue and of all registered queues on the workers of Scheduler. Queues registered later use it as well. nullptr moves them back to dedicated threads
+			 *
+			 * The scheduler must outlive the queues or be replaced before it is destroyed
+			 */
+			void SetScheduler(ThreadScheduler *Scheduler);
 
 			/*!
 			 * \brief Change thread state
 			 */
 			void SetThreadState(thread_state_t ThreadState);
 
-		protected:
+		private:
 
-			msg_struct_t Pop();
+			/*!
+			 * \brief Delayed and periodic messages
+			 */
+			TimerWheel<thread_multi_module_message_t> _MessageTimers;
 
-		private:
+			/*!
+			 * \brief Pushes an expired timed message. Called on the timer thread
+			 */
+			static void PushTimedMessage(thread_multi_module_message_t &Message, void *ExtraData);
+
+			struct routing_snapshot_t;
+
+			/*!
+			 * \brief Announces which routing snapshot a thread reads. Replaced snapshots are only freed once no reader announces an older version
+			 */
+			struct routing_reader_t
+			{
+				/*!
+				 * \brief Value of _RoutingVersion the reader announced. 0 while the reader holds no snapshot
+				 */
+				atomic<uint64_t> PinnedVersion{0};
+
+				/*!
+				 * \brief Last loaded snapshot. Only used again while _RoutingVersion still equals RoutingVersion
+				 */
+				const routing_snapshot_t *Routing = nullptr;
+				uint64_t RoutingVersion = 0;
+
+				/*!
+				 * \brief Number of nested routing_guard_t of the producer thread
+				 */
+				size_t GuardDepth = 0;
+
+				/*!
+				 * \brief Cleared once the producer thread using the reader exited, so that another thread can take it over
+				 */
+				atomic<bool> InUse{true};
+			};
+
+			using shard_thread_t = ThreadQueued<identifier_t, identifier_t, message_t, message_ptr>;
+
+			/*!
+			 * \brief State of a router thread while it propagates messages
+			 */
+			struct propagation_state_t
+			{
+				explicit propagation_state_t(GlobalMessageQueueThread *_Router)
+					: Router(_Router)
+				{}
+
+				GlobalMessageQueueThread *Router;
+
+				/*!
+				 * \brief Value of PropagationStamp when each route was last added to a receiver list. Prevents duplicates without searching the list
+				 */
+				vector_t<uint64_t> RouteStamps;
+
+				/*!
+				 * \brief Incremented for every propagated message
+				 */
+				uint64_t PropagationStamp = 0;
+
+				/*!
+				 * \brief Receiver queues of the current message. Kept alive by Routing
+				 */
+				vector_t<thread_multi_module_t*> Receivers;
+
+				/*!
+				 * \brief Keeps the routing snapshot announced while messages are waiting. Released once the router thread runs out of messages
+				 */
+				routing_reader_t Reader;
+
+				/*!
+				 * \brief Queue of the router thread. nullptr for the global queue thread
+				 */
+				shard_thread_t *Thread = nullptr;
+			};
+
+			/*!
+			 * \brief Additional router thread. The global queue itself is the first one
+			 */
+			struct router_shard_t
+			{
+				propagation_state_t Propagation;
+
+				/*!
+				 * \brief Declared last, so that it is stopped before Propagation is destroyed
+				 */
+				shard_thread_t Thread;
+
+				router_shard_t(GlobalMessageQueueThread &Router);
+			};
+
+			/*!
+			 * \brief Propagation state of the global queue thread
+			 */
+			propagation_state_t _Propagation;
+
+			/*!
+			 * \brief Router threads after the first one. Receivers are assigned to router threads by a hash of their queue key, see SelectShardIndex()
+			 */
+			vector_t<unique_ptr<router_shard_t>> _Shards;
+
+			/*!
+			 * \brief Number of buckets of _RoutedMessages
+			 */
+			static constexpr size_t RoutedMessageBuckets = 64;
+
+			/*!
+			 * \brief Messages pushed to a router thread and not propagated yet, counted in buckets by the queue key of their receiver.
+			 * PushMessageDirect() only bypasses the router threads while the bucket of the receiver is empty
+			 */
+			std::array<atomic<size_t>, RoutedMessageBuckets> _RoutedMessages{};
+
+			/*!
+			 * \brief Removes a message from _RoutedMessages once it left the router thread, also if a receiver queue threw while taking it
+			 */
+			class routed_message_release_t
+			{
+				public:
+					routed_message_release_t(atomic<size_t> &RoutedMessages)
+						: _RoutedMessages(RoutedMessages)
+					{}
+
+					~routed_message_release_t()
+					{
+						this->_RoutedMessages.fetch_sub(1, std::memory_order_release);
+					}
+
+					routed_message_release_t(const routed_message_release_t &) = delete;
+					routed_message_release_t &operator=(const routed_message_release_t &) = delete;
+
+				private:
+					atomic<size_t> &_RoutedMessages;
+			};
+
+			/*!
+			 * \brief Push Message to the router thread of its receiver and count it in _RoutedMessages until it is propagated.
+			 * Registration messages are pushed even if the router thread is full
+			 */
+			queue_push_result_t PushMessageToShard(thread_multi_module_message_t Message);
+
+			/*!
+			 * \brief Push Message to the router thread with index ShardIndex. See PushMessageToShard()
+			 */
+			queue_push_result_t PushMessageToShard(thread_multi_module_message_t Message, size_t ShardIndex);
+
+			/*!
+			 * \brief Mix all bits of the queue key of ReceiverID. Connections share their queue ID and only differ in the thread ID, which sits in the upper bits of the key
+			 */
+			static uint64_t MixQueueKey(identifier_t ReceiverID);
+
+			/*!
+			 * \brief Index of the router thread that serves ReceiverID. All receivers of one queue share a router thread, so their messages stay in order
+			 */
+			size_t GetShardIndex(identifier_t ReceiverID) const;
+
+			/*!
+			 * \brief Index of the router thread for a message from SenderID to ReceiverID. Linked copies are made by the router thread that propagates
+			 * the original message, so messages that involve links all use the first router thread
+			 * \param Routing Snapshot the links are taken from
+			 */
+			size_t SelectShardIndex(const routing_snapshot_t &Routing, identifier_t SenderID, identifier_t ReceiverID) const;
+
+			/*!
+			 * \brief Counter of _RoutedMessages for ReceiverID
+			 */
+			atomic<size_t> &GetRoutedMessages(identifier_t ReceiverID);
 
 			/*!
 			 * \brief Propagates the Message to the corresponding threads
 			 * \param Message Message to propagate
+			 * \param ExtraData propagation_state_t of the router thread
 			 */
 			static void PropagateMessageToQueues(msg_struct_t &Message, void *ExtraData);
 
 			/*!
-			 * \brief Finds the Queue with QueueID. Doesn't lock _ModuleListLock
+			 * \brief Drop function of the router threads. Removes messages discarded by QUEUE_OVERFLOW_DROP_OLDEST from _RoutedMessages.
+			 * Registration messages must not be lost, they are queued again instead
+			 * \param ExtraData propagation_state_t of the router thread
+			 */
+			static void DiscardRoutedMessage(msg_struct_t &Message, void *ExtraData);
+
+			/*!
+			 * \brief Returns QUEUE_PUSH_TARGET_SATURATED if PushResult is a success and the queue of ReceiverID is full
+			 * \param Routing Snapshot the caller already holds
+			 */
+			static queue_push_result_t CheckReceiverSaturation(queue_push_result_t PushResult, identifier_t ReceiverID, const routing_snapshot_t &Routing);
+
+			/*!
+			 * \brief Check whether a message from SenderID to ReceiverID is copied to linked modules, or ReceiverID receives copies of messages to other modules.
+			 * Such messages must pass the router threads, so that they stay in order with the copies
+			 */
+			static bool IsLinkedMessage(const routing_snapshot_t &Routing, identifier_t SenderID, identifier_t ReceiverID);
+
+			/*!
+			 * \brief Entry of the routing table
+			 */
+			struct queue_route_t
+			{
+				module_shared_ptr_t Queue;
+
+				/*!
+				 * \brief Position of the route in the snapshot. Indexes _RouteStamps
+				 */
+				size_t RouteIndex = 0;
+			};
+
+			using queue_route_map_t = unordered_map<identifier_t::queue_key_t, queue_route_t>;
+
+			/*!
+			 * \brief Routing state. Published snapshots are never changed, so the propagating thread reads them without locks
+			 */
+			struct routing_snapshot_t
+			{
+				/*!
+				 * \brief Registered queues by queue key
+				 */
+				queue_route_map_t QueueRoutes;
+
+				id_link_table_t SenderIDLinks;
+				id_link_table_t ReceiverIDLinks;
+			};
+
+			/*!
+			 * \brief Snapshot that was replaced while readers might still use it
+			 */
+			struct retired_routing_t
+			{
+				unique_ptr<const routing_snapshot_t> Routing;
+
+				/*!
+				 * \brief Value of _RoutingVersion after the snapshot was replaced. Readers that announced this version or a later one don't use it anymore
+				 */
+				uint64_t RetiredVersion;
+			};
+
+			/*!
+			 * \brief Readers of one producer thread, one per router it pushed to
+			 */
+			struct thread_routing_readers_t
+			{
+				struct entry_t
+				{
+					const GlobalMessageQueueThread *Router;
+					shared_ptr<routing_reader_t> Reader;
+				};
+
+				vector_t<entry_t> Readers;
+
+				/*!
+				 * \brief Hands the readers back to their routers when the thread exits
+				 */
+				~thread_routing_readers_t();
+			};
+
+			/*!
+			 * \brief Pins the current routing snapshot for a producer thread while it is in scope
+			 */
+			class routing_guard_t
+			{
+				public:
+					explicit routing_guard_t(const GlobalMessageQueueThread &Router);
+					~routing_guard_t();
+
+					routing_guard_t(const routing_guard_t &S) = delete;
+					routing_guard_t &operator=(const routing_guard_t &S) = delete;
+
+					const routing_snapshot_t &operator*() const
+					{
+						return *(this->_Routing);
+					}
+
+					const routing_snapshot_t *operator->() const
+					{
+						return this->_Routing;
+					}
+
+				private:
+					routing_reader_t &_Reader;
+					const routing_snapshot_t *_Routing;
+			};
+
+			/*!
+			 * \brief Current routing snapshot. Replaced snapshots move to _RetiredRoutings
+			 */
+			atomic<const routing_snapshot_t*> _Routing;
+
+			/*!
+			 * \brief Incremented after each new snapshot is published. Starts at 1, readers announce 0 while they hold no snapshot
+			 */
+			atomic<uint64_t> _RoutingVersion{1};
+
+			/*!
+			 * \brief Serializes routing changes. Never taken by the propagating threads
+			 */
+			mutex _RoutingLock;
+
+			/*!
+			 * \brief Replaced snapshots that readers may still use. Requires _RoutingLock
+			 */
+			vector_t<retired_routing_t> _RetiredRoutings;
+
+			/*!
+			 * \brief Readers of all threads that pushed messages. Requires _RoutingLock
+			 */
+			vector_t<shared_ptr<routing_reader_t>> _ProducerReaders;
+
+			/*!
+			 * \brief Readers of the calling thread
+			 */
+			static thread_local thread_routing_readers_t _ThreadReaders;
+
+			/*!
+			 * \brief Get the reader of the calling thread. The first call of each thread registers one
+			 */
+			routing_reader_t &GetThreadReader() const;
+
+			/*!
+			 * \brief Announce the current routing version for Reader and return its snapshot. The snapshot is only reloaded if the version changed
+			 */
+			const routing_snapshot_t *LoadRouting(routing_reader_t &Reader) const;
+
+			/*!
+			 * \brief Stop announcing a version for Reader. Its snapshot must not be used anymore
+			 */
+			static void ReleaseRouting(routing_reader_t &Reader);
+
+			/*!
+			 * \brief Copy the current routing snapshot to modify it. Requires _RoutingLock
+			 */
+			unique_ptr<routing_snapshot_t> CopyRoutingNoLock() const;
+
+			/*!
+			 * \brief Replace the current routing snapshot and free the replaced ones no reader uses anymore. Requires _RoutingLock
+			 */
+			void PublishRoutingNoLock(unique_ptr<routing_snapshot_t> &&Routing);
+
+			/*!
+			 * \brief Free retired snapshots that no reader announces anymore. Requires _RoutingLock
+			 */
+			void ReclaimRoutingsNoLock();
+
+			/*!
+			 * \brief Finds the Queue with QueueID in Routing
 			 * \param QueueID ID of queue to find
-			 * \return Returns iterator to queue. End() if not found
+			 * \return Returns route to queue. nullptr if not found
+			 */
+			static const queue_route_t *FindQueueRoute(const routing_snapshot_t &Routing, identifier_t::queue_id_t QueueID, identifier_t::thread_id_t MessageQueueThreadID);
+
+			/*!
+			 * \brief Adds links to the queue of the linked module, which delivers the linked messages to it
+			 */
+			static void LinkModuleInQueue(const routing_snapshot_t &Routing, module_link_message_t &&Links);
+
+			/*!
+			 * \brief Adds Route to Queues unless it was already added for the current message
+			 * \return Returns false if the queue was already added
 			 */
-			module_list_t::iterator FindQueueNoLock(identifier_t::queue_id_t QueueID, identifier_t::thread_id_t MessageQueueThreadID);
+			static bool AddQueueRoute(propagation_state_t &Propagation, const queue_route_t &Route);
 
-			void AddLinkedQueues(vector_t<module_shared_ptr_t> &Queues, identifier_t ID, id_link_vector_t &LinkedIDs);
+			static void AddLinkedQueues(propagation_state_t &Propagation, const routing_snapshot_t &Routing, identifier_t ID, const id_link_table_t &LinkedIDs);
 
 			/*!
 			 * \brief Finds the link associated with a moduleQueueLinkNoLock
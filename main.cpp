@@ -20,6 +20,8 @@
 #include "protocol_module_connection_state.h"
 
 #include <iostream>
+#include <string>
+#include <cstdlib>
 
 using std::unique_ptr;
 using std::shared_ptr;
@@ -59,13 +61,18 @@ using namespace user_io_messages;
 
 int main(int argc, char *argv[])
 {
-	(void)argc;
-	(void)argv;
-
 	auto newCert = string_user_admin::UserCertAdmin::GenerateNewUserCertAdmin("HELLO", time(nullptr)+10000000);
 	newCert.GetMainStringUserID();
 
-	GlobalMessageQueueThread globalQueue;
+	// Number of router threads of the global queue. Protocol threads and all other queues are spread over them
+	size_t routerThreads = GlobalMessageQueueThread::DefaultShardCount;
+	for(int curArg = 1; curArg+1 < argc; ++curArg)
+	{
+		if(std::string(argv[curArg]) == "--router-threads" && std::atoi(argv[curArg+1]) > 0)
+			routerThreads = static_cast<size_t>(std::atoi(argv[curArg+1]));
+	}
+
+	GlobalMessageQueueThread globalQueue(routerThreads);
 
 	shared_ptr<StringThread> pStringThread(new StringThread(globalQueue));
 	StringThread::RegisterThread(globalQueue, pStringThread);
@@ -111,13 +118,15 @@ int main(int argc, char *argv[])
 	const auto clientThreadID = protManager.CreateNewInstance(std::move(clientCon), network_connection::CLIENT_SIDE);
 
 	protManager.RequestRead(clientThreadID);
+	protManager.RequestRead(serverThreadID);
+
+	// Request read every 5 seconds. Reads are pushed by the timer thread of the global queue
+	protManager.RequestPeriodicRead(serverThreadID, std::chrono::seconds(5));
+	protManager.RequestPeriodicRead(clientThreadID, std::chrono::seconds(5));
 
-	// Request read every second
+	// All work is done by the queue and timer threads. This loop only keeps main alive
 	while(1)
 	{
-		protManager.RequestRead(serverThreadID);
-		protManager.RequestRead(clientThreadID);
-
 		thread_queued::SleepForMs(1000*1000*5);
 	}
 }
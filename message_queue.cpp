@@ -17,7 +17,7 @@ namespace message_queue
 		{
 
 			MessageQueue<int, float> testQueue;
-			auto testInterface = testQueue.GetInterface();
+			auto &testInterface = testQueue.GetInterface();
 
 			if(testInterface.GetQueueSize() != 0)
 				return 0;
@@ -40,6 +40,39 @@ namespace message_queue
 			if(testQueue.Pop().Get<0>() != 5)
 				return 0;
 
+			// Popped nodes are reused, no allocations after warm-up
+			const size_t warmUpAllocations = testQueue.GetNodeAllocationCount();
+			if(warmUpAllocations != 3)
+				return 0;
+
+			for(int curMessage = 0; curMessage < 100; ++curMessage)
+			{
+				testQueue.Push(curMessage, testFloat);
+				testQueue.PushFront(curMessage, testFloat);
+				testQueue.Push(curMessage, testFloat);
+
+				if(testQueue.Pop().Get<0>() != curMessage)
+					return 0;
+
+				testQueue.Pop();
+				testQueue.Pop();
+			}
+
+			if(testQueue.GetNodeAllocationCount() != warmUpAllocations)
+				return 0;
+
+			// Nodes beyond spare limit are freed
+			testQueue.SetMaxSpareNodes(1);
+			testQueue.Push(1, testFloat);
+			testQueue.Push(2, testFloat);
+			testQueue.Pop();
+			testQueue.Pop();
+			testQueue.Push(3, testFloat);
+			testQueue.Push(4, testFloat);
+
+			if(testQueue.GetNodeAllocationCount() != warmUpAllocations+2)
+				return 0;
+
 			return 1;
 		}
 		catch(Exception&)
@@ -8,6 +8,7 @@
 
 #include <memory>
 #include <list>
+#include <iterator>
 #include "testing_class_declaration.h"
 
 /*!
@@ -141,8 +142,15 @@ namespace message_queue
 
 	class TestMessageQueue;
 
+	/*!
+	 * \brief Default number of list nodes a queue keeps for reuse
+	 */
+	static constexpr size_t DefaultMaxSpareNodes = 1024;
+
 	/*!
 	 * \brief Only provides access to the Push function to prevent accidental popping
+	 *
+	 * Popped list nodes are kept in a spare list and reused by the next push, so a queue in steady state doesn't allocate. Spare nodes hold moved-from messages
 	 */
 	template<class... Args>
 	class MessageQueueInterface
@@ -164,7 +172,7 @@ namespace message_queue
 			{
 				static_assert(template_convertible<FcnVariadic<FcnArgs...>, msg_struct_t>::value,"Can't call push without the same parameter as template parameter's class");
 
-				this->_Messages.push_back(std::forward<FcnVariadic<FcnArgs...>>(Message));
+				this->InsertMessage(this->_Messages.end(), std::forward<FcnVariadic<FcnArgs...>>(Message));
 			}
 
 			/*!
@@ -175,7 +183,7 @@ namespace message_queue
 			{
 				static_assert(template_convertible<message_struct_t<FcnArgs...>, msg_struct_t>::value,"Can't call push without the same parameter as template parameter's class");
 
-				this->_Messages.push_back(msg_struct_t(std::forward<FcnArgs>(MessageData)...));
+				this->InsertMessage(this->_Messages.end(), msg_struct_t(std::forward<FcnArgs>(MessageData)...));
 			}
 
 			/*!
@@ -186,7 +194,7 @@ namespace message_queue
 			{
 				static_assert(template_convertible<FcnVariadic<FcnArgs...>, msg_struct_t>::value,"Can't call push without the same parameter as template parameter's class");
 
-				this->_Messages.push_front(std::forward<FcnVariadic<FcnArgs...>>(Message));
+				this->InsertMessage(this->_Messages.begin(), std::forward<FcnVariadic<FcnArgs...>>(Message));
 			}
 
 			/*!
@@ -197,7 +205,7 @@ namespace message_queue
 			{
 				static_assert(template_convertible<message_struct_t<FcnArgs...>, msg_struct_t>::value,"Can't call push without the same parameter as template parameter's class");
 
-				this->_Messages.push_front(msg_struct_t(std::forward<FcnArgs>(MessageData)...));
+				this->InsertMessage(this->_Messages.begin(), msg_struct_t(std::forward<FcnArgs>(MessageData)...));
 			}
 
 			size_t GetQueueSize() const
@@ -205,12 +213,106 @@ namespace message_queue
 				return this->_Messages.size();
 			}
 
+			/*!
+			 * \brief Number of list nodes that were allocated by pushes. Stays constant once enough spare nodes exist
+			 */
+			size_t GetNodeAllocationCount() const
+			{
+				return this->_NodeAllocations;
+			}
+
+			/*!
+			 * \brief Set maximum number of spare nodes. Nodes beyond this are freed when popped
+			 */
+			void SetMaxSpareNodes(size_t MaxSpareNodes)
+			{
+				this->_MaxSpareNodes = MaxSpareNodes;
+
+				while(this->_SpareNodes.size() > this->_MaxSpareNodes)
+				{
+					this->_SpareNodes.pop_front();
+				}
+			}
+
 		protected:
 
+			using message_list_t = list<msg_struct_t>;
+
 			/*!
 			 * \brief List of all messages
 			 */
-			list<msg_struct_t> _Messages;
+			message_list_t _Messages;
+
+			/*!
+			 * \brief Nodes of popped messages, reused by pushes
+			 */
+			message_list_t _SpareNodes;
+
+			size_t _MaxSpareNodes = DefaultMaxSpareNodes;
+
+			/*!
+			 * \brief Number of nodes allocated because no spare node was available
+			 */
+			size_t _NodeAllocations = 0;
+
+			/*!
+			 * \brief Insert Message before Position. Reuses a spare node if available
+			 */
+			void InsertMessage(typename message_list_t::iterator Position, msg_struct_t &&Message)
+			{
+				if(this->_SpareNodes.empty())
+				{
+					this->_Messages.insert(Position, std::move(Message));
+					++this->_NodeAllocations;
+				}
+				else
+				{
+					this->_SpareNodes.front() = std::move(Message);
+					this->_Messages.splice(Position, this->_SpareNodes, this->_SpareNodes.begin());
+				}
+			}
+
+			/*!
+			 * \brief Move up to NumNodes spare nodes to the end of Nodes
+			 * \return Returns number of moved nodes
+			 */
+			size_t TakeSpareNodes(size_t NumNodes, message_list_t &Nodes)
+			{
+				if(NumNodes >= this->_SpareNodes.size())
+				{
+					const size_t numSpareNodes = this->_SpareNodes.size();
+					Nodes.splice(Nodes.end(), this->_SpareNodes);
+
+					return numSpareNodes;
+				}
+
+				auto lastNode = this->_SpareNodes.begin();
+				std::advance(lastNode, NumNodes);
+
+				Nodes.splice(Nodes.end(), this->_SpareNodes, this->_SpareNodes.begin(), lastNode);
+
+				return NumNodes;
+			}
+
+			/*!
+			 * \brief Move the nodes of popped messages from Nodes to the spare list. Nodes beyond _MaxSpareNodes are freed
+			 */
+			void RecycleNodes(message_list_t &Nodes)
+			{
+				const size_t freeSpareNodes = this->_SpareNodes.size() < this->_MaxSpareNodes ? this->_MaxSpareNodes - this->_SpareNodes.size() : 0;
+				if(Nodes.size() <= freeSpareNodes)
+				{
+					this->_SpareNodes.splice(this->_SpareNodes.end(), Nodes);
+				}
+				else
+				{
+					auto lastNode = Nodes.begin();
+					std::advance(lastNode, freeSpareNodes);
+
+					this->_SpareNodes.splice(this->_SpareNodes.end(), Nodes, Nodes.begin(), lastNode);
+					Nodes.clear();
+				}
+			}
 
 			// Prevent interfaces from copying or moving data, only MessageQueue can do that
 			MessageQueueInterface(const MessageQueueInterface &S) = default;
@@ -263,7 +365,11 @@ namespace message_queue
 			{
 				auto tmp = std::move(this->_Messages.front());
 
-				this->_Messages.pop_front();
+				// Keep node for next push
+				if(this->_SpareNodes.size() < this->_MaxSpareNodes)
+					this->_SpareNodes.splice(this->_SpareNodes.begin(), this->_Messages, this->_Messages.begin());
+				else
+					this->_Messages.pop_front();
 
 				return tmp;
 			}
@@ -13,68 +13,75 @@ namespace protocol_connection_module
 
 	void ProtocolConnectionModule::HandleMessage(msg_struct_t &Message)
 	{
-		// If messageType is ReceiveMessage, get data from connection
-		if(request_receive_t::CheckMessageDataType(Message, this->_ThreadMemory.ProtocolThreadID))//!messageType.IsSenderMessageType() && messageType.MessageType == request_receive_t::MessageType)
-		{
-			// Read data
-			this->HandleReceiveRequest();
-		}
-		else if(peer_data_t::CheckMessageDataType(Message, this->_ThreadMemory.ProtocolThreadID))
-		{
-			// Get peer data from message
-			auto &peerData = *(peer_data_t::GetMessageData(Message));
-			this->HandlePeerData(peerData);
-		}
+		using message_dispatch_t = message_dispatch_table_t<ProtocolConnectionModule,
+															message_handler_t<&ProtocolConnectionModule::HandleReceiveRequestMessage>,
+															message_handler_t<&ProtocolConnectionModule::HandlePeerData>>;
+
+		message_dispatch_t::HandleMessage(this, Message, this->_ThreadMemory.ProtocolThreadID);
+	}
+
+	void ProtocolConnectionModule::HandleReceiveRequestMessage(msg_struct_t &, request_receive_t &)
+	{
+		this->HandleReceiveRequest();
 	}
 
 	bool ProtocolConnectionModule::HandleReceiveRequest()
 	{
 		// Read data
-		auto tmpData = this->_Connection.ReceiveData();
-		return this->ParseReceivedData(tmpData);
+		return this->ParseReceivedData(this->_Connection.ReceiveData());
 	}
 
-	bool ProtocolConnectionModule::HandlePeerData(peer_data_t &PeerData)
+	bool ProtocolConnectionModule::HandlePeerData(msg_struct_t &Message, peer_data_t &PeerData)
 	{
-		// Get peer data from message
-		return this->ParseReceivedData(PeerData.PeerData);
+		// Take over the peer data, unless linked receivers share the message payload
+		if(Message.Get<MessageDataNum>().GetUseCount() == 1)
+			return this->ParseReceivedData(std::move(PeerData.PeerData));
+
+		return this->ParseReceivedData(protocol_vector_t(byte_vector_t(PeerData.PeerData)));
 	}
 
-	bool ProtocolConnectionModule::ParseReceivedData(protocol_vector_t &ReceivedData)
+	bool ProtocolConnectionModule::ParseReceivedData(protocol_vector_t &&ReceivedData)
 	{
-		// Parse data from start
-		ReceivedData.CurPos = ReceivedData.begin();
-
 		// Give data to modules
 		bool parseComplete = false;
 		if(!ReceivedData.empty())
 		{
+			// All sub-frames are views of the same buffer, so their data is not copied
+			const protocol_vector_view_t receivedView(std::make_shared<const protocol_vector_t>(std::move(ReceivedData)));
+			protocol_vector_view_t::size_type curPos = 0;
+
+			// Collect messages for all sub-frames and push them to the global queue at once
+			vector_type<thread_multi_module_message_t> parsedMessages;
+
 			// Parse data and send individual headers to the requested modules
 			do
 			{
-				const auto *const curHeader = ReceivedData.ParseVector<protocol_header_t>();
-				if(curHeader != nullptr &&
-					curHeader->Size >= sizeof(protocol_header_t))
+				protocol_header_t curHeader(EmptyModuleName, 0);
+				if(receivedView.ParseVector(curPos, curHeader) &&
+					curHeader.Size >= sizeof(protocol_header_t))
 				{
-					const auto dataSize = curHeader->Size - sizeof(protocol_header_t);
+					const auto dataSize = curHeader.Size - sizeof(protocol_header_t);
+
+					if(dataSize > receivedView.GetRestSize(curPos))
+					{
+						// Forward sub-frames that were parsed before the error
+						this->PushParsedMessages(parsedMessages);
 
-					if(dataSize > ReceivedData.GetRestSize())
 						throw Exception(ERROR_NUM, "ERROR ProtocolConnectionModule::HandleMessage(): Ill-formed header\n");
+					}
 
-					// Save data to message_ptr
-					auto tmpMessage = received_data_t::CreateMessageToReceiver(this->_ID, this->_ID.ThreadID, received_data_t(curHeader->Name, protocol_vector_t(ReceivedData.CurPos, ReceivedData.CurPos + dataSize)));
-					//message_ptr pData(new received_data_t{{}, protocol_vector_t(tmpData.CurPos, tmpData.CurPos + dataSize)});
-					//memcpy(pData.Get<protocol_vector_t::value_type>(), &(*tmpData.CurPos), dataSize);
-					ReceivedData.CurPos += dataSize;
+					// Save view of sub-frame to message_ptr. All receivers share the payload
+					auto tmpMessage = received_data_t::CreateMessageToReceiver(this->_ID, this->_ID.ThreadID, received_data_t(curHeader.Name, receivedView.GetSubView(curPos, dataSize)));
+					curPos += dataSize;
 
 					// Send message all modules that requested this header
-					auto curModuleIterator = this->_ThreadMemory.HeaderModuleMap.find(curHeader->Name);
+					auto curModuleIterator = this->_ThreadMemory.HeaderModuleMap.find(curHeader.Name);
 					while(curModuleIterator != this->_ThreadMemory.HeaderModuleMap.end() &&
-						  curModuleIterator->first == curHeader->Name)
+						  curModuleIterator->first == curHeader.Name)
 					{
 						// Set correct receiver
 						tmpMessage.Get<MessageReceiverIDNum>() = curModuleIterator->second;
-						this->_ThreadMemory.GlobalQueue->PushMessage(tmpMessage);
+						parsedMessages.push_back(tmpMessage);
 						//this->_ThreadMemory.ProtocolThreadQueue->PushMessage(curModuleIterator->second, this->_ID, ProtocolConnectionModuleSendingMessageType, pData);
 
 						parseComplete = true;
@@ -85,11 +92,21 @@ namespace protocol_connection_module
 				else
 					break;
 			}while(1);
+
+			this->PushParsedMessages(parsedMessages);
 		}
 
 		return parseComplete;
 	}
 
+	void ProtocolConnectionModule::PushParsedMessages(vector_type<thread_multi_module_message_t> &ParsedMessages)
+	{
+		if(!ParsedMessages.empty())
+			this->_ThreadMemory.GlobalQueue->PushMessages(std::make_move_iterator(ParsedMessages.begin()), std::make_move_iterator(ParsedMessages.end()));
+
+		ParsedMessages.clear();
+	}
+
 	void ProtocolConnectionModule::SendDataHandle(protocol_vector_t &Data)
 	{
 		this->_Connection.SendData(Data);
@@ -11,6 +11,7 @@
 #include "protocol_messages.h"
 #include "protocol_network_connection.h"
 #include "protocol_module_instantiator.h"
+#include "vector_t.h"
 
 /*!
  *  \brief Namespace for ProtocolConnectionModule class
@@ -24,6 +25,9 @@ namespace protocol_connection_module
 	using protocol_module_instantiator::ProtocolModuleInstantiator;
 
 	using protocol_data::protocol_header_t;
+
+	using vector_t::vector_type;
+	using vector_t::byte_vector_t;
 	using namespace protocol_messages;
 
 	class TestProtocolConnectionModule;
@@ -42,6 +46,11 @@ namespace protocol_connection_module
 
 			void HandleMessage(msg_struct_t &Parameters);
 
+			/*!
+			 * \brief Handle a request_receive_t message
+			 */
+			void HandleReceiveRequestMessage(msg_struct_t &Message, request_receive_t &Request);
+
 			/*!
 			 * \brief Handle a request to receive data
 			 */
@@ -50,13 +59,18 @@ namespace protocol_connection_module
 			/*!
 			 * \brief Simulate a receive
 			 */
-			bool HandlePeerData(peer_data_t &PeerData);
+			bool HandlePeerData(msg_struct_t &Message, peer_data_t &PeerData);
 
 			/*!
-			 * \brief Parse Received Data
+			 * \brief Parse Received Data. Takes over the data and delivers views of its sub-frames to the modules
 			 * \return Returns whether the received data could be parsed
 			 */
-			bool ParseReceivedData(protocol_vector_t &ReceivedData);
+			bool ParseReceivedData(protocol_vector_t &&ReceivedData);
+
+			/*!
+			 * \brief Push all parsed messages to the global queue at once
+			 */
+			void PushParsedMessages(vector_type<thread_multi_module_message_t> &ParsedMessages);
 
 			/*!
 			 * \brief Network Connection
@@ -17,21 +17,29 @@ namespace protocol_manager
 
 	protocol_thread_id_t ProtocolManager::CreateNewInstance(NetworkConnectionUniquePtr &&Connection, connection_side_t ConnectionSide)
 	{
-		const auto newThreadID = this->_NextFreeID++;
+		const auto newThreadID = this->_ConnectionIDs.Allocate();
 
-		// Take ownership of connection
-		ProtocolNetworkConnection newConnection(std::move(Connection), newThreadID);
-		this->_Connections.push_front(std::move(newConnection));
+		// IDs are dense, so the record vector only grows when a fresh ID is handed out
+		const auto recordIndex = ConnectionIDAllocator::GetIndex(newThreadID);
+		if(recordIndex >= this->_Connections.size())
+			this->_Connections.resize(recordIndex+1);
 
-		// Create new thread
-		auto pNewThread  = thread_instance_shared_ptr_t(new thread_instance_t(newThreadID, this->_Connections.front(), this->_GlobalMessageQueue, ConnectionSide));
-		this->_Threads.emplace(newThreadID, pNewThread);
+		auto &newRecord = this->_Connections[recordIndex];
+
+		// Take ownership of connection and create new thread. Both live in one instance, so routing snapshots that still hold the thread keep the connection alive too
+		auto pNewInstance = std::make_shared<connection_instance_t>();
+		pNewInstance->Connection.reset(new ProtocolNetworkConnection(std::move(Connection), newThreadID));
+		pNewInstance->Thread.reset(new thread_instance_t(newThreadID, *pNewInstance->Connection, this->_GlobalMessageQueue, ConnectionSide));
+
+		auto pNewThread = thread_instance_shared_ptr_t(pNewInstance, pNewInstance->Thread.get());
+		newRecord.Connection = pNewInstance->Connection.get();
+		newRecord.Thread = pNewThread;
 
 		// Register new thread with global queue
 		this->_GlobalMessageQueue.RegisterQueue(pNewThread);
 
 		// Create and register all modules
-		pNewThread->ExecuteModuleInstantiators(this->GetAllInstantionModules(), this->_Connections.front());
+		pNewThread->ExecuteModuleInstantiators(this->GetAllInstantionModules(), *newRecord.Connection);
 
 		// Send out start signal
 		auto tmpMessage = connection_state_change_request_t::CreateMessageFromSender(newThreadID, UnusedID, connection_state_change_request_t(protocol_messages::PROTOCOL_STARTED));
@@ -40,48 +48,40 @@ namespace protocol_manager
 		return newThreadID;
 	}
 
-	NetworkConnectionUniquePtr ProtocolManager::StopInstance(protocol_thread_id_t ConnectionID)
+	NetworkConnectionUniquePtr ProtocolManager::StopInstance(protocol_thread_id_t ConnectionID, drain_timeout_t DrainTimeout)
 	{
-		// Find connection
-		auto connectionInstance = this->_Connections.begin();
-		for(; connectionInstance != this->_Connections.end(); ++connectionInstance)
-		{
-			if(connectionInstance->GetID() == ConnectionID)
-				break;
-		}
+		// Find connection. If no connection was found, return nullptr
+		auto *const pRecord = this->FindConnection(ConnectionID);
+		if(pRecord == nullptr)
+			return nullptr;
 
-		// Find thread
-		auto threadInstance = this->_Threads.Find(ConnectionID);
-		if(threadInstance != this->_Threads.end())
+		// Stop periodic reads
+		if(pRecord->ReadTimer != InvalidTimerID)
 		{
-			// If thread was found, unregister from global queue and empty the thread queue
-			//const auto curID = threadInstance->second->GetID();
-			//this->_GlobalMessageQueue.UnregisterQueue(curID.MessageQueueID, curID.ThreadID);
-			this->_GlobalMessageQueue.UnregisterQueue(threadInstance->second);
+			this->_GlobalMessageQueue.CancelTimedMessage(pRecord->ReadTimer);
+			pRecord->ReadTimer = InvalidTimerID;
+		}
 
-			threadInstance->second->SetMessageAcceptance(0);
+		// Unregister thread from global queue and empty the thread queue. Both are no-ops if an earlier call already did it
+		this->_GlobalMessageQueue.UnregisterQueue(pRecord->Thread);
 
-			while(!threadInstance->second->IsQueueEmpty())
-			{}
+		pRecord->Thread->SetMessageAcceptance(0);
 
-			threadInstance->second->SetThreadState(thread_module_manager_multi_message::THREAD_PAUSED);
+		// A handler may still use the connection. Neither the connection nor the ID may be handed out before it returned
+		if(!pRecord->Thread->WaitForDrain(DrainTimeout))
+			throw Exception(ERROR_NUM, "ERROR ProtocolManager::StopInstance(): Connection thread didn't drain in time, instance is kept\n");
 
-			// Erase thread
-			this->_Threads.Unregister(threadInstance);
-		}
+		pRecord->Thread->SetThreadState(thread_module_manager_multi_message::THREAD_PAUSED);
 
-		// Erase connection instance and return Network Connection
-		if(connectionInstance != this->_Connections.end())
-		{
-			NetworkConnectionUniquePtr tmpPtr = connectionInstance->ReleaseOwnership();
+		// Return Network Connection. Dropping the record only releases this reference to the instance, the last routing snapshot holding the thread destroys it
+		NetworkConnectionUniquePtr tmpPtr = pRecord->Connection->ReleaseOwnership();
 
-			this->_Connections.erase(connectionInstance);
+		*pRecord = connection_record_t();
 
-			return tmpPtr;
-		}
+		// The slot is reused under a new generation, messages still addressed to this ID don't reach its next connection
+		this->_ConnectionIDs.Release(ConnectionID);
 
-		// If no connection was found, return nullptr
-		return nullptr;
+		return tmpPtr;
 	}
 
 	void ProtocolManager::RegisterModuleInstantiator(ProtocolModuleInstantiatorUniquePtr &&ModuleInstantiator)
@@ -121,10 +121,30 @@ namespace protocol_manager
 		this->_GlobalMessageQueue.PushMessage(request_receive_t::CreateMessageFromSender(ProtocolThreadID, UnusedID, request_receive_t()));
 	}
 
+	void ProtocolManager::RequestPeriodicRead(protocol_thread_id_t ProtocolThreadID, timer_duration_t Period)
+	{
+		auto *const pRecord = this->FindConnection(ProtocolThreadID);
+		if(pRecord == nullptr)
+			throw Exception(ERROR_NUM, "ERROR ProtocolManager::RequestPeriodicRead(): Connection not found");
+
+		if(pRecord->ReadTimer != InvalidTimerID)
+			this->_GlobalMessageQueue.CancelTimedMessage(pRecord->ReadTimer);
+
+		pRecord->ReadTimer = this->_GlobalMessageQueue.PushMessagePeriodic(Period, request_receive_t::CreateMessageFromSender(ProtocolThreadID, UnusedID, request_receive_t()));
+	}
+
 	const ProtocolManager::instantiator_vector_t &ProtocolManager::GetAllInstantionModules() const noexcept
 	{
 		return this->_ModuleInstantiators;
 	}
+
+	ProtocolManager::connection_record_t *ProtocolManager::FindConnection(protocol_thread_id_t ConnectionID) noexcept
+	{
+		if(!this->_ConnectionIDs.IsAllocated(ConnectionID))
+			return nullptr;
+
+		return &this->_Connections[ConnectionIDAllocator::GetIndex(ConnectionID)];
+	}
 }
 
 #include "network_dummy_connection.h"
@@ -173,6 +193,47 @@ namespace protocol_manager
 			if(pRetVal.get() != pTestPtr)
 				return 0;
 
+			// Stopped instance is gone, and its ID isn't handed to the next connection
+			if(testManager.StopInstance(testID) != nullptr || testManager.FindConnection(testID) != nullptr)
+				return 0;
+
+			const auto testNextID = testManager.CreateNewInstance(std::move(pRetVal), network_connection::SERVER_SIDE);
+			if(testNextID == testID || testManager.FindConnection(testNextID) == nullptr)
+				return 0;
+
+			// An instance whose thread doesn't drain in time keeps its connection and ID
+			testManager.FindConnection(testNextID)->Thread->SetThreadState(thread_module_manager_multi_message::THREAD_PAUSED);
+			testManager.RequestRead(testNextID);
+			if(!testQueue.WaitForDrain())
+				return 0;
+
+			bool stopFailed = false;
+			try
+			{
+				testManager.StopInstance(testNextID, std::chrono::milliseconds(1));
+			}
+			catch(Exception&)
+			{
+				stopFailed = true;
+			}
+
+			if(!stopFailed || testManager.FindConnection(testNextID) == nullptr)
+				return 0;
+
+			testManager.FindConnection(testNextID)->Thread->SetThreadState(thread_module_manager_multi_message::THREAD_RUNNING);
+
+						// A routing snapshot may still hold the thread after the instance stopped. Thread and connection must stay alive until it lets go
+			auto testSnapshotThread = testManager.FindConnection(testNextID)->Thread;
+
+			pRetVal = testManager.StopInstance(testNextID);
+			if(pRetVal.get() != pTestPtr)
+				return 0;
+
+			if(testSnapshotThread->GetMemory().ProtocolThreadID != testNextID)
+				return 0;
+
+			testSnapshotThread.reset();
+
 			// ProtocolModuleInstantiatorUniquePtr UnregisterModule(identifier_t::module_id_t ModuleID)
 			auto testUnregister = testManager.UnregisterModule(moduleID);
 			if(testUnregister.get() != pTestInstanciatorPtr)
@@ -8,7 +8,7 @@
 #include "global_message_queue_thread.h"
 
 #include "protocol_data.h"
-#include "protocol_map.h"
+#include "connection_id_allocator.h"
 #include "silkstring_message.h"
 #include "protocol_network_connection.h"
 #include "vector_t.h"
@@ -23,15 +23,15 @@
  */
 namespace protocol_manager
 {
-	using std::list;
 	using std::shared_ptr;
+	using std::unique_ptr;
 
 	using network_connection::NetworkConnectionUniquePtr;
 
 	using protocol_data::protocol_thread_id_t;
 	using protocol_network_connection::ProtocolNetworkConnection;
 
-	using protocol_map::ProtocolMap;
+	using connection_id_allocator::ConnectionIDAllocator;
 
 	using protocol_thread::ProtocolThread;
 	using protocol_thread::ProtocolThreadSharedPtr;
@@ -42,11 +42,20 @@ namespace protocol_manager
 	using protocol_module_instantiator::ProtocolModuleInstantiatorUniquePtr;
 
 	using global_message_queue_thread::GlobalMessageQueueThread;
+	using global_message_queue_thread::drain_timeout_t;
+	using global_message_queue_thread::timer_id_t;
+	using global_message_queue_thread::timer_duration_t;
+	using global_message_queue_thread::InvalidTimerID;
 
 	using network_connection::connection_side_t;
 
 	using vector_t::vector_type;
 
+	/*!
+	 * \brief Default time StopInstance() waits for the queue of a connection thread to drain
+	 */
+	static constexpr drain_timeout_t ProtocolThreadDrainTimeout = std::chrono::seconds(5);
+
 	class TestProtocolManager;
 
 	/*!
@@ -54,12 +63,44 @@ namespace protocol_manager
 	 */
 	class ProtocolManager
 	{
-			using connection_list_t = list<ProtocolNetworkConnection>;
-
 			using thread_instance_t = ProtocolThread;
 			using thread_instance_shared_ptr_t = ProtocolThreadSharedPtr;
 
-			using thread_map_t = ProtocolMap<protocol_thread_id_t, thread_instance_shared_ptr_t>;
+			/*!
+			 * \brief Connection and the thread that works on it. Shared by the record and all routing snapshots that still hold the thread, see CreateNewInstance()
+			 */
+			struct connection_instance_t
+			{
+				unique_ptr<ProtocolNetworkConnection> Connection;
+
+				/*!
+				 * \brief Declared after Connection, so it is destroyed before the connection it references
+				 */
+				unique_ptr<thread_instance_t> Thread;
+			};
+
+			/*!
+			 * \brief Everything that belongs to one connection. Empty if no connection uses the ID
+			 */
+			struct connection_record_t
+			{
+				/*!
+				 * \brief Network connection. Owned by the instance that Thread points into, so it lives as long as the thread
+				 */
+				ProtocolNetworkConnection *Connection = nullptr;
+
+				/*!
+				 * \brief Thread of the connection. Shares ownership of the whole connection_instance_t
+				 */
+				thread_instance_shared_ptr_t Thread;
+
+				/*!
+				 * \brief Timer of periodic reads
+				 */
+				timer_id_t ReadTimer = InvalidTimerID;
+			};
+
+			using connection_record_vector_t = vector_type<connection_record_t>;
 
 			using instantiator_vector_t = protocol_thread::instantiator_vector_t;
 
@@ -79,8 +120,14 @@ namespace protocol_manager
 
 			/*!
 			 * \brief Stops an Instance and returns pointer to network connection
+			 *
+			 * Throws if the connection thread doesn't drain within DrainTimeout, e.g. because a handler is stuck. The instance then keeps its connection and its ID,
+			 * and its thread keeps handling the queued messages without accepting new ones. Call StopInstance() again to wait once more
+			 * \param ConnectionID ID of connection to stop
+			 * \param DrainTimeout Maximum time to wait until the connection thread handled its queued messages and no handler runs anymore
+			 * \return Returns nullptr if no connection with this ID is running
 			 */
-			NetworkConnectionUniquePtr StopInstance(protocol_thread_id_t ConnectionID);
+			NetworkConnectionUniquePtr StopInstance(protocol_thread_id_t ConnectionID, drain_timeout_t DrainTimeout = ProtocolThreadDrainTimeout);
 
 			/*!
 			 * \brief RegisterModule Registers a new module
@@ -100,6 +147,11 @@ namespace protocol_manager
 			 */
 			void RequestRead(protocol_thread_id_t ProtocolThreadID);
 
+			/*!
+			 * \brief Request a read from one connection every Period until the instance is stopped. Replaces a previous periodic read of the connection
+			 */
+			void RequestPeriodicRead(protocol_thread_id_t ProtocolThreadID, timer_duration_t Period);
+
 			/*!
 			 * \brief Access all registered instantiation modules
 			 */
@@ -120,18 +172,24 @@ namespace protocol_manager
 			GlobalMessageQueueThread &_GlobalMessageQueue;
 
 			/*!
-			 * \brief All Threads mapped to their respective IDs
+			 * \brief Hands out connection IDs. A stopped connection's slot gets a new generation when it is reused
 			 */
-			thread_map_t _Threads;
+			ConnectionIDAllocator _ConnectionIDs;
 
-			protocol_thread_id_t _NextFreeID = 1;
+			/*!
+			 * \brief Connections, indexed by ConnectionIDAllocator::GetIndex() of their IDs
+			 */
+			connection_record_vector_t _Connections;
 
 			instantiator_vector_t _ModuleInstantiators;
 
 			/*!
-			 * \brief Store connections
+			 * \brief Find record of a running connection
+			 * \return Returns nullptr if ID doesn't belong to a running connection
 			 */
-			connection_list_t _Connections;
+			connection_record_t *FindConnection(protocol_thread_id_t ConnectionID) noexcept;
+
+			friend class TestProtocolManager;
 	};
 
 	using ProtocolManagerSharedPtr = ProtocolManager::ProtocolManagerSharedPtr;
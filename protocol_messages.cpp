@@ -78,8 +78,8 @@ namespace protocol_messages
 		: IDToVerify(_IDToVerify)
 	{}
 
-	received_data_t::received_data_t(protocol_header_name_t _DataType, protocol_vector_t _ReceivedData)
-		: DataType(_DataType), ReceivedData(_ReceivedData)
+	received_data_t::received_data_t(protocol_header_name_t _DataType, protocol_vector_view_t _ReceivedData)
+		: DataType(_DataType), ReceivedData(std::move(_ReceivedData))
 	{}
 
 	peer_data_t::peer_data_t(protocol_vector_t &&_PeerData)
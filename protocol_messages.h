@@ -13,6 +13,8 @@
 
 #include "protocol_data.h"
 
+#include <map>
+
 /*!
  *  \brief Namespace for protocol_messages class
  */
@@ -29,6 +31,7 @@ namespace protocol_messages
 	using protocol_data::protocol_header_name_t;
 	using protocol_data::EmptyModuleName;
 	using protocol_vector::protocol_vector_t;
+	using protocol_vector::protocol_vector_view_t;
 
 	using network_connection::connection_side_t;
 	using network_connection::CLIENT_SIDE;
@@ -68,38 +71,30 @@ namespace protocol_messages
 
 	static constexpr message_t::message_type_t ProtocolConnectionModuleReceivedDataMessageType	= DefaultMessageType + 0;
 	/*!
-	 * \brief Struct for propagating data received from peer to appropriate modules
+	 * \brief Struct for propagating data received from peer to appropriate modules. All modules that receive the same sub-frame share one message, and all sub-frames of a read share one buffer
 	 */
 	struct received_data_t : public message_id_struct_t<ProtocolQueueID, ProtocolConnectionModuleID, ProtocolConnectionModuleReceivedDataMessageType, received_data_t>
 	{
 		protocol_header_name_t DataType;
-		protocol_vector_t ReceivedData;
-
-		template<class T>
-		T *CheckAndParseData(protocol_header_name_t TypeHeaderName)
-		{
-			if(this->DataType == TypeHeaderName)
-			{
-				auto tmpIterator = this->ReceivedData.begin();
-				return this->ReceivedData.ParseVector<T>(tmpIterator);
-			}
-
-			return nullptr;
-		}
+		protocol_vector_view_t ReceivedData;
 
+		/*!
+		 * \brief Copies the start of the received data to Data if it has the header TypeHeaderName
+		 * \return Returns false if the header doesn't match or the data is too short
+		 */
 		template<class T>
-		const T *CheckAndParseData(protocol_header_name_t TypeHeaderName) const
+		bool CheckAndParseData(protocol_header_name_t TypeHeaderName, T &Data) const
 		{
 			if(this->DataType == TypeHeaderName)
 			{
-				auto tmpIterator = this->ReceivedData.begin();
-				return this->ReceivedData.ParseVector<T>(tmpIterator);
+				protocol_vector_view_t::size_type tmpPosition = 0;
+				return this->ReceivedData.ParseVector(tmpPosition, Data);
 			}
 
-			return nullptr;
+			return false;
 		}
 
-		received_data_t(protocol_header_name_t _DataType, protocol_vector_t _ReceivedData);
+		received_data_t(protocol_header_name_t _DataType, protocol_vector_view_t _ReceivedData);
 	};
 
 	static constexpr message_t::message_type_t ProtocolConnectionModuleRequestReceiveMessageType	= DefaultMessageType + 1;
@@ -162,7 +157,7 @@ namespace protocol_messages
 	static constexpr protocol_header_name_t ProtocolConnectionStateChangeRequestHeader{{{'S', 'T', 'A'}}};	
 	static constexpr message_t::message_type_t ProtocolConnectionStateModuleStateChangeRequestMessageType = DefaultMessageType;
 	static module_message_connection_t ProtocolChangeStateConnection(ProtocolConnectionStateModuleID, ProtocolConnectionStateModuleStateChangeRequestMessageType, ProtocolConnectionStateChangeRequestHeader);
-	struct connection_state_change_request_t : public message_id_struct_t<ProtocolQueueID, ProtocolConnectionStateModuleID, ProtocolConnectionStateModuleStateChangeRequestMessageType, connection_state_change_request_t>
+	struct connection_state_change_request_t : public message_id_struct_t<ProtocolQueueID, ProtocolConnectionStateModuleID, ProtocolConnectionStateModuleStateChangeRequestMessageType, connection_state_change_request_t, QUEUE_LANE_CONTROL>
 	{
 		protocol_state_t NewState;
 
@@ -179,7 +174,7 @@ namespace protocol_messages
 	/*!
 	 * \brief Used to inform modules of a change in the connection state
 	 */
-	struct connection_state_change_distribution_t : public message_id_struct_t<ProtocolQueueID, ProtocolConnectionStateChangeInformerID, ProtocolConnectionStateChangeInformerMessageType, connection_state_change_distribution_t>
+	struct connection_state_change_distribution_t : public message_id_struct_t<ProtocolQueueID, ProtocolConnectionStateChangeInformerID, ProtocolConnectionStateChangeInformerMessageType, connection_state_change_distribution_t, QUEUE_LANE_CONTROL>
 	{
 		protocol_state_t UpdatedState;
 
@@ -215,7 +210,7 @@ namespace protocol_messages
 	{};
 
 	static constexpr message_t::message_type_t ProtocolTLSConnectionHandshakeCompletedMessageType = DefaultMessageType + 4;
-	struct tls_handshake_completed_t : public message_id_struct_t<ProtocolQueueID, ProtocolTLSConnectionModuleID, ProtocolTLSConnectionHandshakeCompletedMessageType, tls_handshake_completed_t>
+	struct tls_handshake_completed_t : public message_id_struct_t<ProtocolQueueID, ProtocolTLSConnectionModuleID, ProtocolTLSConnectionHandshakeCompletedMessageType, tls_handshake_completed_t, QUEUE_LANE_CONTROL>
 	{
 		bool Success;
 
@@ -224,5 +219,23 @@ namespace protocol_messages
 	// ~TLS messages -------------------------------------------------------------------------------
 } // namespace protocol_messages
 
+namespace dynamic_pointer
+{
+	/*!
+	 *	\brief Large payloads that are created for every transfer come from their pools
+	 */
+	template<>
+	struct dynamic_pointer_pooled_t<protocol_messages::received_data_t>
+	{
+		static constexpr bool value = true;
+	};
+
+	template<>
+	struct dynamic_pointer_pooled_t<protocol_messages::peer_data_t>
+	{
+		static constexpr bool value = true;
+	};
+} // namespace dynamic_pointer
+
 
 #endif // PROTOCOL_MESSAGES_H
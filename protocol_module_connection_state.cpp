@@ -22,21 +22,21 @@ namespace protocol_module_connection_state
 		if(senderID.ModuleID == ProtocolConnectionModuleID && messageType == message_t(received_data_t::MessageType, 1))
 		{
 			const auto &dataHeader = received_data_t::GetMessageData(Message)->DataType;
-			auto &pDataVector = received_data_t::GetMessageData(Message)->ReceivedData;
+			const auto &dataView = received_data_t::GetMessageData(Message)->ReceivedData;
 
 			if(dataHeader != ProtocolConnectionStateChangeRequestHeader)
 				throw Exception(ERROR_NUM, "ERROR ProtocolModuleConnectionState::HandleMessage(): Message received by peer has incorrect header\n");
 
-			pDataVector.CurPos = pDataVector.begin();
-			const auto *const pReceivedState = pDataVector.ParseVector<connection_state_change_request_t>();
-			if(pReceivedState == nullptr)
+			protocol_vector_view_t::size_type dataPosition = 0;
+			connection_state_change_request_t receivedState(PROTOCOL_UNDEFINED);
+			if(!dataView.ParseVector(dataPosition, receivedState))
 				throw Exception(ERROR_NUM, "ERROR ProtocolModuleConnectionState::HandleMessage(): Message received by peer is ill-formed\n");
 
 #ifdef DEBUG
-			std::cout << "Received state change from peer to: " << pReceivedState->NewState << "\n";
+			std::cout << "Received state change from peer to: " << receivedState.NewState << "\n";
 #endif
 
-			this->OnPeerStateChange(pReceivedState->NewState);
+			this->OnPeerStateChange(receivedState.NewState);
 		}
 		else if(connection_state_change_request_t::CheckMessageDataType(Message, this->_Memory.ProtocolThreadID))
 		{
@@ -353,7 +353,7 @@ namespace protocol_module_connection_state
 	void ProtocolModuleConnectionState::SendInternalStateChangeMessage()
 	{
 		auto tmpMessage = connection_state_change_distribution_t::CreateMessageToReceiver(identifier_t(ProtocolQueueID, ProtocolConnectionStateChangeInformerID, this->_Memory.ProtocolThreadID), this->_Memory.ProtocolThreadID, {this->_Memory.State});
-		this->_Memory.GlobalQueue->PushMessage(std::move(tmpMessage));
+		this->_Memory.GlobalQueue->PushMessageDirect(std::move(tmpMessage));
 	}
 
 	void ProtocolModuleConnectionState::SendExternalStateChangeMessage()
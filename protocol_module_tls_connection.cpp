@@ -32,68 +32,81 @@ namespace protocol_module_tls_connection
 
 	void ProtocolModuleTLSConnection::HandleMessage(msg_struct_t &Message)
 	{
-		if(received_data_t::CheckMessageDataType(Message, this->_Memory.ProtocolThreadID))
-		{
-			// Handle data received from peer
-			assert(received_data_t::GetMessageData(Message)->DataType == ProtocolTLSConnectionReadDataUpdateHeaderName);
+		// Not verified yet: this file doesn't compile (TLSReadWriteTransferTime and the TLS authentication messages are missing), so this table has never been type-checked or run
+		using message_dispatch_t = message_dispatch_table_t<ProtocolModuleTLSConnection,
+															message_handler_t<&ProtocolModuleTLSConnection::HandleReceivedData>,
+															message_handler_t<&ProtocolModuleTLSConnection::HandleWriteDataUpdated>,
+															message_handler_t<&ProtocolModuleTLSConnection::HandleInputDataUpdate>,
+															message_handler_t<&ProtocolModuleTLSConnection::HandleOutputDataUpdated>,
+															message_handler_t<&ProtocolModuleTLSConnection::HandleStateDistribution>,
+															message_handler_t<&ProtocolModuleTLSConnection::HandleHandshakeCompleted>>;
+
+		message_dispatch_t::HandleMessage(this, Message, this->_Memory.ProtocolThreadID);
+	}
 
-			if(received_data_t::GetMessageData(Message)->DataType == ProtocolTLSConnectionReadDataUpdateHeaderName)
-			{
-				// Copy data sent by peer to read buffer
-				ProtocolModuleTLSConnection::CopyDataToBufferEnd(received_data_t::GetMessageData(Message)->ReceivedData, this->_ReadBuffer, this->_BuffersLock);
-			}
-		}
-		else if(tls_write_data_updated_t::CheckMessageDataType(Message, this->_Memory.ProtocolThreadID))
-		{
-			// Send encrypted data to peer
-			this->_Memory.SendHandle.SendData(ProtocolTLSConnectionReadDataUpdateConnection, ProtocolModuleTLSConnection::MoveDataFromBuffer(this->_WriteBuffer, this->_BuffersLock));
-		}
-		else if(tls_input_data_update_t::CheckMessageDataType(Message, this->_Memory.ProtocolThreadID))
-		{
-			// Handle encryption requests
+	void ProtocolModuleTLSConnection::HandleReceivedData(msg_struct_t &, received_data_t &ReceivedData)
+	{
+		// Handle data received from peer
+		assert(ReceivedData.DataType == ProtocolTLSConnectionReadDataUpdateHeaderName);
 
-			// Copy data to input buffer
-			const auto *const pData = tls_input_data_update_t::GetMessageData(Message);
-			ProtocolModuleTLSConnection::CopyDataToBufferEnd(*pData, this->_InputBuffer, this->_BuffersLock);
-		}
-		else if(tls_output_data_updated_t::CheckMessageDataType(Message, this->_Memory.ProtocolThreadID))
-		{			
-			// Send decrypted data to appropriate module for processing
-			this->_Memory.GlobalQueue->PushMessage(peer_data_t::CreateMessageToReceiver(this->GetID(), this->_Memory.ProtocolThreadID, peer_data_t(ProtocolModuleTLSConnection::MoveDataFromBuffer(this->_InputBuffer, this->_BuffersLock))));
-		}
-		else if(connection_state_change_distribution_t::CheckMessageDataType(Message, this->_Memory.ProtocolThreadID))
+		if(ReceivedData.DataType == ProtocolTLSConnectionReadDataUpdateHeaderName)
 		{
-			this->HandleStateUpdate(connection_state_change_distribution_t::GetMessageData(Message)->UpdatedState);
+			// Copy data sent by peer to read buffer
+			ProtocolModuleTLSConnection::CopyDataToBufferEnd(ReceivedData.ReceivedData, this->_ReadBuffer, this->_BuffersLock);
 		}
-		else if(tls_handshake_completed_t::CheckMessageDataType(Message, this->_Memory.ProtocolThreadID))
-		{
-			// Handle handshake success/fail
-			const auto *const pData = tls_handshake_completed_t::GetMessageDataConst(Message);
+	}
+
+	void ProtocolModuleTLSConnection::HandleWriteDataUpdated(msg_struct_t &, tls_write_data_updated_t &)
+	{
+		// Send encrypted data to peer
+		this->_Memory.SendHandle.SendData(ProtocolTLSConnectionReadDataUpdateConnection, ProtocolModuleTLSConnection::MoveDataFromBuffer(this->_WriteBuffer, this->_BuffersLock));
+	}
+
+	void ProtocolModuleTLSConnection::HandleInputDataUpdate(msg_struct_t &, tls_input_data_update_t &InputData)
+	{
+		// Handle encryption requests
+
+		// Copy data to input buffer
+		ProtocolModuleTLSConnection::CopyDataToBufferEnd(InputData, this->_InputBuffer, this->_BuffersLock);
+	}
+
+	void ProtocolModuleTLSConnection::HandleOutputDataUpdated(msg_struct_t &, tls_output_data_updated_t &)
+	{
+		// Send decrypted data to appropriate module for processing
+		this->_Memory.GlobalQueue->PushMessageDirect(peer_data_t::CreateMessageToReceiver(this->GetID(), this->_Memory.ProtocolThreadID, peer_data_t(ProtocolModuleTLSConnection::MoveDataFromBuffer(this->_InputBuffer, this->_BuffersLock))));
+	}
+
+	void ProtocolModuleTLSConnection::HandleStateDistribution(msg_struct_t &, connection_state_change_distribution_t &StateDistribution)
+	{
+		this->HandleStateUpdate(StateDistribution.UpdatedState);
+	}
 
-			protocol_state_t nextState;
-			if(!pData->Success)
+	void ProtocolModuleTLSConnection::HandleHandshakeCompleted(msg_struct_t &, tls_handshake_completed_t &HandshakeCompleted)
+	{
+		// Handle handshake success/fail
+		protocol_state_t nextState;
+		if(!HandshakeCompleted.Success)
+		{
+			this->_HandshakeAttempts++;
+			if(this->_HandshakeAttempts < this->_Memory.MaximumTLSHandshakeAttempts)
 			{
-				this->_HandshakeAttempts++;
-				if(this->_HandshakeAttempts < this->_Memory.MaximumTLSHandshakeAttempts)
-				{
-					// Retry handshake
-					this->_HandshakeState = TLS_HANDSHAKE_PERFORM;
+				// Retry handshake
+				this->_HandshakeState = TLS_HANDSHAKE_PERFORM;
 
-					return;
-				}
-				else
-				{
-					nextState = PROTOCOL_TLS_HANDSHAKE_FAILED;
-				}
+				return;
 			}
 			else
 			{
-				nextState = PROTOCOL_SECURE_CONNECTION_STATE;
+				nextState = PROTOCOL_TLS_HANDSHAKE_FAILED;
 			}
-
-			// Request state change
-			this->_Memory.GlobalQueue->PushMessage(connection_state_change_request_t::CreateMessageFromSender(this->_Memory.ProtocolThreadID, this->GetID(), {nextState}));
 		}
+		else
+		{
+			nextState = PROTOCOL_SECURE_CONNECTION_STATE;
+		}
+
+		// Request state change
+		this->_Memory.GlobalQueue->PushMessageDirect(connection_state_change_request_t::CreateMessageFromSender(this->_Memory.ProtocolThreadID, this->GetID(), {nextState}));
 	}
 
 	void ProtocolModuleTLSConnection::HandleStateUpdate(protocol_state_t UpdatedState)
@@ -137,6 +150,17 @@ namespace protocol_module_tls_connection
 		BufferLock.unlock();
 	}
 
+	void ProtocolModuleTLSConnection::CopyDataToBufferEnd(const protocol_vector_view_t &Data, protocol_vector_t &Buffer, mutex &BufferLock)
+	{
+		BufferLock.lock();
+
+		// Copy data to buffer
+		Buffer.reserve(Buffer.size()+Data.size());
+		Buffer.insert(Buffer.end(), Data.begin(), Data.end());
+
+		BufferLock.unlock();
+	}
+
 	protocol_vector_t ProtocolModuleTLSConnection::MoveDataFromBuffer(protocol_vector_t &Buffer, mutex &BufferLock)
 	{
 		BufferLock.lock();
@@ -218,7 +242,7 @@ namespace protocol_module_tls_connection
 
 		// Push message that new data is in write buffer
 		if(writeSize > 0)
-			this->_GlobalQueue.PushMessage(tls_write_data_updated_t::CreateMessageToReceiver(this->_Module->GetID(), this->_Module->GetID().ThreadID, tls_write_data_updated_t()));
+			this->_GlobalQueue.PushMessageDirect(tls_write_data_updated_t::CreateMessageToReceiver(this->_Module->GetID(), this->_Module->GetID().ThreadID, tls_write_data_updated_t()));
 
 		return writeSize;
 	}
@@ -294,7 +318,7 @@ namespace protocol_module_tls_connection
 
 					// Inform that new data is available
 					if(readSize > 0)
-						Module->_Memory.GlobalQueue->PushMessage(tls_output_data_updated_t::CreateMessageToReceiver(Module->GetID(), Module->GetID().ThreadID, tls_output_data_updated_t()));
+						Module->_Memory.GlobalQueue->PushMessageDirect(tls_output_data_updated_t::CreateMessageToReceiver(Module->GetID(), Module->GetID().ThreadID, tls_output_data_updated_t()));
 				}
 
 				Module->_BuffersLock.unlock();
@@ -195,6 +195,33 @@ namespace protocol_module_tls_connection
 			 */
 			thread_t			_TLSThread;
 
+			/*!
+			 * \brief Copy data sent by peer to read buffer
+			 */
+			void HandleReceivedData(msg_struct_t &Message, received_data_t &ReceivedData);
+
+			/*!
+			 * \brief Send encrypted data to peer
+			 */
+			void HandleWriteDataUpdated(msg_struct_t &Message, tls_write_data_updated_t &WriteDataUpdated);
+
+			/*!
+			 * \brief Copy data that should be encrypted to input buffer
+			 */
+			void HandleInputDataUpdate(msg_struct_t &Message, tls_input_data_update_t &InputData);
+
+			/*!
+			 * \brief Send decrypted data to appropriate module for processing
+			 */
+			void HandleOutputDataUpdated(msg_struct_t &Message, tls_output_data_updated_t &OutputDataUpdated);
+
+			void HandleStateDistribution(msg_struct_t &Message, connection_state_change_distribution_t &StateDistribution);
+
+			/*!
+			 * \brief Retry a failed handshake or request the next connection state
+			 */
+			void HandleHandshakeCompleted(msg_struct_t &Message, tls_handshake_completed_t &HandshakeCompleted);
+
 			/*!
 			 * \brief HandleStateChangeRequest
 			 */
@@ -208,6 +235,11 @@ namespace protocol_module_tls_connection
 			 */
 			static void CopyDataToBufferEnd(const protocol_vector_t &Data, protocol_vector_t &Buffer, mutex &BufferLock);
 
+			/*!
+			 * \brief Copies data received from peer to end of Buffer
+			 */
+			static void CopyDataToBufferEnd(const protocol_vector_view_t &Data, protocol_vector_t &Buffer, mutex &BufferLock);
+
 			/*!
 			 * \brief Move Data From Buffer
 			 * \param Buffer Buffer to move data from
@@ -14,6 +14,8 @@
 #include "global_message_queue_thread.h"
 #include "string_thread_message.h"
 
+#include <map>
+
 /*!
  *  \brief Namespace for ProtocolThreadMemory class
  */
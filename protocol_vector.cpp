@@ -28,4 +28,105 @@ namespace protocol_vector
 	protocol_vector_t::protocol_vector_t(byte_vector_t::size_type VectorSize)
 		: byte_vector_t(VectorSize)
 	{}
+
+	protocol_vector_view_t::protocol_vector_view_t(shared_ptr<const protocol_vector_t> Buffer)
+		: _Buffer(std::move(Buffer))
+	{
+		if(this->_Buffer != nullptr)
+			this->_Size = this->_Buffer->size();
+	}
+
+	protocol_vector_view_t::protocol_vector_view_t(shared_ptr<const protocol_vector_t> Buffer, size_type Offset, size_type Size)
+		: _Buffer(std::move(Buffer)), _Offset(Offset), _Size(Size)
+	{
+		assert(this->_Buffer != nullptr ? Offset <= this->_Buffer->size() && Size <= this->_Buffer->size()-Offset : Offset == 0 && Size == 0);
+	}
+
+	protocol_vector_view_t protocol_vector_view_t::GetSubView(size_type Offset, size_type Size) const
+	{
+		assert(Offset <= this->_Size && Size <= this->_Size-Offset);
+
+		return protocol_vector_view_t(this->_Buffer, this->_Offset+Offset, Size);
+	}
+
+	const byte_t *protocol_vector_view_t::data() const
+	{
+		if(this->_Buffer == nullptr)
+			return nullptr;
+
+		return this->_Buffer->data() + this->_Offset;
+	}
+
+	protocol_vector_view_t::size_type protocol_vector_view_t::size() const
+	{
+		return this->_Size;
+	}
+
+	bool protocol_vector_view_t::empty() const
+	{
+		return this->_Size == 0;
+	}
+
+	const byte_t *protocol_vector_view_t::begin() const
+	{
+		return this->data();
+	}
+
+	const byte_t *protocol_vector_view_t::end() const
+	{
+		return this->data() + this->_Size;
+	}
+
+	protocol_vector_view_t::size_type protocol_vector_view_t::GetRestSize(size_type Position) const
+	{
+		assert(Position <= this->_Size);
+
+		return this->_Size-Position;
+	}
+}
+
+namespace protocol_vector
+{
+	class TestProtocolVector
+	{
+		public:
+			static bool Testing();
+	};
+
+	bool TestProtocolVector::Testing()
+	{
+		protocol_vector_t testData(byte_vector_t{'a', 'b', 'c', 'd', 'e'});
+		const byte_t *const pTestData = testData.data();
+
+		// View takes over buffer without copying
+		const protocol_vector_view_t testView(std::make_shared<const protocol_vector_t>(std::move(testData)));
+		if(testView.data() != pTestData || testView.size() != 5)
+			return 0;
+
+		// Sub-views share buffer
+		const auto testSubView = testView.GetSubView(1, 3);
+		const auto testSubSubView = testSubView.GetSubView(1, 2);
+		if(testSubView.data() != pTestData+1 || testSubView.size() != 3 || testSubSubView.data() != pTestData+2 || *(testSubSubView.end()-1) != 'd')
+			return 0;
+
+		protocol_vector_view_t::size_type testPosition = 0;
+		byte_t testBytes[2] = {0, 0};
+		if(!testSubView.ParseVector(testPosition, testBytes) || testBytes[0] != 'b' || testBytes[1] != 'c' || testPosition != 2 || testSubView.GetRestSize(testPosition) != 1)
+			return 0;
+
+		if(testSubView.ParseVector(testPosition, testBytes) || testPosition != 2)
+			return 0;
+
+		// Values at unaligned offsets are copied out
+		uint32_t testValue = 0;
+		testPosition = 0;
+		if(!testView.GetSubView(1, 4).ParseVector(testPosition, testValue) || memcmp(&testValue, pTestData+1, sizeof(testValue)) != 0)
+			return 0;
+
+		const protocol_vector_view_t testEmptyView;
+		if(!testEmptyView.empty() || testEmptyView.begin() != testEmptyView.end())
+			return 0;
+
+		return 1;
+	}
 }
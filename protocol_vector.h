@@ -8,11 +8,17 @@
 
 #include "vector_t.h"
 
+#include <cstring>
+#include <memory>
+#include <type_traits>
+
 /*!
  *  \brief Namespace for p class
  */
 namespace protocol_vector
 {
+	using std::shared_ptr;
+
 	using vector_t::byte_t;
 	using vector_t::byte_vector_t;
 
@@ -64,6 +70,75 @@ namespace protocol_vector
 			return this->ParseVector<T>(this->CurPos);
 		}
 	};
+
+	/*!
+	 * \brief Read-only view of a part of a shared protocol_vector_t. The buffer is not changed anymore once it is shared, so copies of a view share the data instead of copying it
+	 */
+	class protocol_vector_view_t
+	{
+		public:
+			using size_type = protocol_vector_size_t;
+
+			/*!
+			 * \brief Constructor for an empty view
+			 */
+			protocol_vector_view_t() = default;
+
+			/*!
+			 * \brief Constructor for a view of the whole buffer
+			 */
+			explicit protocol_vector_view_t(shared_ptr<const protocol_vector_t> Buffer);
+
+			/*!
+			 * \brief Constructor
+			 * \param Buffer Shared buffer
+			 * \param Offset Start of view in Buffer
+			 * \param Size Size of view. Offset+Size must not exceed the buffer
+			 */
+			protocol_vector_view_t(shared_ptr<const protocol_vector_t> Buffer, size_type Offset, size_type Size);
+
+			/*!
+			 * \brief Creates a view of a part of this view that shares the same buffer
+			 * \param Offset Start of new view, relative to the start of this view
+			 * \param Size Size of new view
+			 */
+			protocol_vector_view_t GetSubView(size_type Offset, size_type Size) const;
+
+			const byte_t *data() const;
+			size_type size() const;
+			bool empty() const;
+
+			const byte_t *begin() const;
+			const byte_t *end() const;
+
+			/*!
+			 * \brief Gets remaining view size from Position to end()
+			 */
+			size_type GetRestSize(size_type Position) const;
+
+			/*!
+			 * \brief Copies a T from Position to Data and advances Position. Views start at any offset of the shared buffer, so T is copied instead of being accessed in place
+			 * \return Returns false if not enough data is left
+			 */
+			template<class T>
+			bool ParseVector(size_type &Position, T &Data) const
+			{
+				static_assert(std::is_trivially_copyable<T>::value, "ERROR protocol_vector_view_t::ParseVector(): T must be trivially copyable");
+
+				if(this->GetRestSize(Position) < sizeof(T))
+					return false;
+
+				memcpy(&Data, this->data() + Position, sizeof(T));
+				Position += sizeof(T);
+
+				return true;
+			}
+
+		private:
+			shared_ptr<const protocol_vector_t> _Buffer;
+			size_type _Offset = 0;
+			size_type _Size = 0;
+	};
 } // namespace protocol_vector
 
 
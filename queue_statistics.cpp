@@ -0,0 +1,158 @@
+#include "queue_statistics.h"
+
+namespace queue_statistics
+{
+	histogram_micro_s_t latency_histogram_t::GetPercentileMicroS(double Percentile) const
+	{
+		if(this->NumSamples == 0)
+			return 0;
+
+		// Number of samples that must be below the returned value
+		auto requiredSamples = static_cast<size_t>(Percentile/100 * this->NumSamples + 0.5);
+		if(requiredSamples == 0)
+			requiredSamples = 1;
+
+		size_t countedSamples = 0;
+		for(size_t curBucket = 0; curBucket < LatencyHistogramBuckets-1; ++curBucket)
+		{
+			countedSamples += this->Buckets[curBucket];
+			if(countedSamples >= requiredSamples)
+			{
+				const histogram_micro_s_t bucketLimit = (static_cast<histogram_micro_s_t>(1) << curBucket);
+				return bucketLimit < this->MaxMicroS ? bucketLimit : this->MaxMicroS;
+			}
+		}
+
+		return this->MaxMicroS;
+	}
+
+	void latency_histogram_t::Add(const latency_histogram_t &S)
+	{
+		for(size_t curBucket = 0; curBucket < LatencyHistogramBuckets; ++curBucket)
+			this->Buckets[curBucket] += S.Buckets[curBucket];
+
+		this->NumSamples += S.NumSamples;
+		this->TotalMicroS += S.TotalMicroS;
+
+		if(S.MaxMicroS > this->MaxMicroS)
+			this->MaxMicroS = S.MaxMicroS;
+	}
+
+	LatencyHistogram::LatencyHistogram(const LatencyHistogram &S)
+	{
+		*this = S;
+	}
+
+	LatencyHistogram &LatencyHistogram::operator=(const LatencyHistogram &S)
+	{
+		for(size_t curBucket = 0; curBucket < LatencyHistogramBuckets; ++curBucket)
+			this->_Buckets[curBucket].store(S._Buckets[curBucket].load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+		this->_NumSamples.store(S._NumSamples.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		this->_TotalMicroS.store(S._TotalMicroS.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		this->_MaxMicroS.store(S._MaxMicroS.load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+		return *this;
+	}
+
+	latency_histogram_t LatencyHistogram::GetSnapshot() const
+	{
+		latency_histogram_t snapshot;
+
+		for(size_t curBucket = 0; curBucket < LatencyHistogramBuckets; ++curBucket)
+			snapshot.Buckets[curBucket] = this->_Buckets[curBucket].load(std::memory_order_relaxed);
+
+		snapshot.NumSamples = this->_NumSamples.load(std::memory_order_relaxed);
+		snapshot.TotalMicroS = this->_TotalMicroS.load(std::memory_order_relaxed);
+		snapshot.MaxMicroS = this->_MaxMicroS.load(std::memory_order_relaxed);
+
+		return snapshot;
+	}
+
+	void LatencyHistogram::Reset()
+	{
+		for(auto &curBucket : this->_Buckets)
+			curBucket.store(0, std::memory_order_relaxed);
+
+		this->_NumSamples.store(0, std::memory_order_relaxed);
+		this->_TotalMicroS.store(0, std::memory_order_relaxed);
+		this->_MaxMicroS.store(0, std::memory_order_relaxed);
+	}
+
+	double queue_statistics_t::GetEnqueueRate() const
+	{
+		const double seconds = std::chrono::duration<double>(this->Period).count();
+
+		return seconds > 0 ? this->EnqueuedMessages / seconds : 0;
+	}
+
+	double queue_statistics_t::GetDequeueRate() const
+	{
+		const double seconds = std::chrono::duration<double>(this->Period).count();
+
+		return seconds > 0 ? this->DequeuedMessages / seconds : 0;
+	}
+
+	void queue_statistics_t::Add(const queue_statistics_t &S)
+	{
+		this->EnqueuedMessages += S.EnqueuedMessages;
+		this->DequeuedMessages += S.DequeuedMessages;
+		this->QueueDepth += S.QueueDepth;
+		this->MaxQueueDepth += S.MaxQueueDepth;
+
+		if(S.Period > this->Period)
+			this->Period = S.Period;
+
+		this->SojournTime.Add(S.SojournTime);
+	}
+
+	class TestQueueStatistics
+	{
+		public:
+			static bool Testing();
+	};
+
+	bool TestQueueStatistics::Testing()
+	{
+		if(LatencyHistogram::GetBucket(0) != 0 ||
+				LatencyHistogram::GetBucket(1) != 1 ||
+				LatencyHistogram::GetBucket(3) != 2 ||
+				LatencyHistogram::GetBucket(1000) != 10 ||
+				LatencyHistogram::GetBucket(~static_cast<histogram_micro_s_t>(0)) != LatencyHistogramBuckets-1)
+			return 0;
+
+		LatencyHistogram testHistogram;
+		for(unsigned int curSample = 0; curSample < 99; ++curSample)
+			testHistogram.Record(std::chrono::microseconds(3));
+
+		testHistogram.Record(std::chrono::milliseconds(5));
+
+		const auto snapshot = testHistogram.GetSnapshot();
+		if(snapshot.NumSamples != 100 || snapshot.Buckets[2] != 99 || snapshot.MaxMicroS != 5000)
+			return 0;
+
+		if(snapshot.GetPercentileMicroS(50) != 4 || snapshot.GetPercentileMicroS(100) != 5000)
+			return 0;
+
+		// Combined statistics count the samples of both
+		queue_statistics_t testStats;
+		testStats.EnqueuedMessages = 2;
+		testStats.SojournTime = snapshot;
+
+		queue_statistics_t testOtherStats;
+		testOtherStats.EnqueuedMessages = 3;
+		testOtherStats.SojournTime.Buckets[2] = 1;
+		testOtherStats.SojournTime.NumSamples = 1;
+		testOtherStats.SojournTime.MaxMicroS = 3;
+
+		testStats.Add(testOtherStats);
+		if(testStats.EnqueuedMessages != 5 || testStats.SojournTime.NumSamples != 101 || testStats.SojournTime.Buckets[2] != 100 || testStats.SojournTime.MaxMicroS != 5000)
+			return 0;
+
+		testHistogram.Reset();
+		if(testHistogram.GetSnapshot().NumSamples != 0)
+			return 0;
+
+		return 1;
+	}
+} // namespace queue_statistics
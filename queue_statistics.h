@@ -0,0 +1,180 @@
+#ifndef QUEUE_STATISTICS_H
+#define QUEUE_STATISTICS_H
+
+/*! \file queue_statistics.h
+ *  \brief Header for LatencyHistogram class and queue statistics
+ */
+
+
+#include "testing_class_declaration.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+/*!
+ *  \brief Namespace for LatencyHistogram class and queue statistics
+ */
+namespace queue_statistics
+{
+	using std::atomic;
+
+	/*!
+	 * \brief Monotonic clock used to timestamp queued messages
+	 */
+	using queue_clock_t = std::chrono::steady_clock;
+	using queue_timestamp_t = queue_clock_t::time_point;
+	using queue_duration_t = queue_clock_t::duration;
+
+	using histogram_micro_s_t = uint64_t;
+
+	/*!
+	 * \brief Number of histogram buckets. Bucket 0 counts durations below 1us, bucket N counts durations in [2^(N-1), 2^N) us. The last bucket also counts all longer durations
+	 */
+	static constexpr size_t LatencyHistogramBuckets = 32;
+
+	class TestQueueStatistics;
+
+	/*!
+	 * \brief Copy of a LatencyHistogram
+	 */
+	struct latency_histogram_t
+	{
+		size_t Buckets[LatencyHistogramBuckets] = {};
+
+		size_t NumSamples = 0;
+		histogram_micro_s_t TotalMicroS = 0;
+		histogram_micro_s_t MaxMicroS = 0;
+
+		histogram_micro_s_t GetMeanMicroS() const
+		{
+			return this->NumSamples > 0 ? this->TotalMicroS / this->NumSamples : 0;
+		}
+
+		/*!
+		 * \brief Get an upper bound for the given percentile
+		 * \param Percentile Percentile between 0 and 100
+		 * \return Returns upper limit of the bucket that contains the percentile, or MaxMicroS if that is smaller
+		 */
+		histogram_micro_s_t GetPercentileMicroS(double Percentile) const;
+
+		/*!
+		 * \brief Add the samples of S
+		 */
+		void Add(const latency_histogram_t &S);
+	};
+
+	/*!
+	 * \brief Histogram of durations with logarithmic buckets. Can be recorded and read by different threads
+	 */
+	class LatencyHistogram
+	{
+		public:
+			LatencyHistogram() = default;
+
+			/*!
+			 * \brief Copies the current counters. Samples recorded concurrently may be lost
+			 */
+			LatencyHistogram(const LatencyHistogram &S);
+			LatencyHistogram &operator=(const LatencyHistogram &S);
+
+			/*!
+			 * \brief Add Duration to the histogram
+			 */
+			void Record(const queue_duration_t Duration)
+			{
+				const auto microS = static_cast<histogram_micro_s_t>(std::chrono::duration_cast<std::chrono::microseconds>(Duration).count());
+
+				this->_Buckets[LatencyHistogram::GetBucket(microS)].fetch_add(1, std::memory_order_relaxed);
+
+				this->_NumSamples.fetch_add(1, std::memory_order_relaxed);
+				this->_TotalMicroS.fetch_add(microS, std::memory_order_relaxed);
+
+				histogram_micro_s_t maxMicroS = this->_MaxMicroS.load(std::memory_order_relaxed);
+				while(microS > maxMicroS && !this->_MaxMicroS.compare_exchange_weak(maxMicroS, microS, std::memory_order_relaxed))
+				{}
+			}
+
+			latency_histogram_t GetSnapshot() const;
+
+			void Reset();
+
+			/*!
+			 * \brief Get the bucket that counts MicroS
+			 */
+			static size_t GetBucket(histogram_micro_s_t MicroS)
+			{
+				size_t bucket = 0;
+				while(MicroS > 0 && bucket < LatencyHistogramBuckets-1)
+				{
+					MicroS >>= 1;
+					++bucket;
+				}
+
+				return bucket;
+			}
+
+		private:
+
+			atomic<size_t>				_Buckets[LatencyHistogramBuckets] = {};
+
+			atomic<size_t>				_NumSamples = 0;
+			atomic<histogram_micro_s_t>	_TotalMicroS = 0;
+			atomic<histogram_micro_s_t>	_MaxMicroS = 0;
+
+			friend class TestQueueStatistics;
+
+			template<class U>
+			friend class ::TestingClass;
+	};
+
+	/*!
+	 * \brief Statistics of a queue since they were enabled
+	 */
+	struct queue_statistics_t
+	{
+		/*!
+		 *	\brief Number of messages pushed while statistics were enabled
+		 */
+		size_t EnqueuedMessages = 0;
+
+		/*!
+		 *	\brief Number of these messages that were handled or dropped
+		 */
+		size_t DequeuedMessages = 0;
+
+		/*!
+		 *	\brief Number of timestamped messages in the queue and the maximum since statistics were enabled. Messages pushed while statistics were disabled aren't counted
+		 */
+		size_t QueueDepth = 0;
+		size_t MaxQueueDepth = 0;
+
+		/*!
+		 *	\brief Time since statistics were enabled
+		 */
+		queue_duration_t Period = queue_duration_t::zero();
+
+		/*!
+		 *	\brief Time between push and start of the message handler
+		 */
+		latency_histogram_t SojournTime;
+
+		/*!
+		 * \brief Pushed messages per second
+		 */
+		double GetEnqueueRate() const;
+
+		/*!
+		 * \brief Handled or dropped messages per second
+		 */
+		double GetDequeueRate() const;
+
+		/*!
+		 * \brief Add the statistics of another queue, e.g. to combine several threads that serve one queue. MaxQueueDepth becomes the sum of both maxima, an upper bound for the combined depth. Period is the longer one
+		 */
+		void Add(const queue_statistics_t &S);
+	};
+} // namespace queue_statistics
+
+
+#endif // QUEUE_STATISTICS_H
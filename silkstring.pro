@@ -34,7 +34,10 @@ SOURCES += main.cpp \
     map_type.cpp \
     message_queue.cpp \
     thread_message_queue.cpp \
+    queue_statistics.cpp \
     thread_function.cpp \
+    thread_scheduler.cpp \
+    timer_wheel.cpp \
     thread_queued.cpp \
     thread_module_manager.cpp \
     thread_module_manager_multi_message.cpp \
@@ -43,7 +46,9 @@ SOURCES += main.cpp \
     protocol_thread.cpp \
     testvariadic.cpp \
     dynamic_pointer.cpp \
+    dynamic_pointer_pool.cpp \
     protocol_module_instantiator.cpp \
+    connection_id_allocator.cpp \
     protocol_manager.cpp \
     user_manager.cpp \
     user_io_thread.cpp \
@@ -103,7 +108,10 @@ HEADERS += \
     map_type.h \
     message_queue.h \
     thread_message_queue.h \
+    queue_statistics.h \
     thread_function.h \
+    thread_scheduler.h \
+    timer_wheel.h \
     thread_queued.h \
     thread_module_manager.h \
     thread_module_manager_multi_message.h \
@@ -112,7 +120,9 @@ HEADERS += \
     protocol_thread.h \
     testvariadic.h \
     dynamic_pointer.h \
+    dynamic_pointer_pool.h \
     protocol_module_instantiator.h \
+    connection_id_allocator.h \
     protocol_manager.h \
     user_manager.h \
     user_io_thread.h \
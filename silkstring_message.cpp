@@ -1,8 +1,12 @@
 #include "silkstring_message.h"
 #include "user_io_messages.h"
+#include "error_exception.h"
 
 namespace silkstring_message
 {
+	using error_exception::Exception;
+	using error_exception::ERROR_NUM;
+
 //	template<identifier_t::queue_id_t _QueueID, identifier_t::module_id_t _ModuleID, const message_t &_MessageType, class T>
 //	constexpr decltype(_QueueID) message_id_struct_t<_QueueID, _ModuleID, _MessageType, T>::QueueID;
 
@@ -19,8 +23,37 @@ namespace silkstring_message
 //	constexpr identifier_t message_id_thread_struct_t<_QueueID, _ModuleID, _ThreadID, _MessageType, T>::ID;
 
 	thread_multi_module_manager_t::thread_multi_module_manager_t(identifier_t::queue_id_t QueueID, identifier_t::thread_id_t ThreadID, thread_queued::thread_state_t ThreadState)
-		: thread_multi_module_manager_type(ThreadState), thread_multi_module_t(identifier_t(QueueID, DefaultQueueModuleID, ThreadID))
-	{}
+		: thread_multi_module_manager_type(thread_queued::THREAD_PAUSED), thread_multi_module_t(identifier_t(QueueID, DefaultQueueModuleID, ThreadID))
+	{
+		this->SetMessageFunction(&thread_multi_module_manager_t::QueuedMessageCallback);
+		this->SetDropFunction(&thread_multi_module_manager_t::DiscardQueuedMessage);
+		this->SetThreadState(ThreadState);
+	}
+
+	thread_multi_module_shared_ptr_t thread_multi_module_manager_t::AnnounceUnregistration(identifier_t ModuleID)
+	{
+		lock_guard<mutex> registrationLock(this->_RegistrationLock);
+
+		auto registeredModule = this->GetModule(ModuleID);
+		if(registeredModule != nullptr)
+			++(this->_PendingUnregistrations[ModuleID]);
+
+		return registeredModule;
+	}
+
+	thread_multi_module_shared_ptr_t thread_multi_module_manager_t::CancelDeferredRegistration(identifier_t ModuleID)
+	{
+		lock_guard<mutex> registrationLock(this->_RegistrationLock);
+
+		auto deferredRegistration = this->_DeferredRegistrations.find(ModuleID);
+		if(deferredRegistration == this->_DeferredRegistrations.end() || deferredRegistration->second.ModuleToRegister == nullptr)
+			return nullptr;
+
+		auto deferredModule = std::move(deferredRegistration->second.ModuleToRegister);
+		this->_DeferredRegistrations.erase(deferredRegistration);
+
+		return deferredModule;
+	}
 
 	void thread_multi_module_manager_t::HandleMessage(msg_struct_t &Message)
 	{
@@ -30,30 +63,146 @@ namespace silkstring_message
 			if(module_registration_message_t::CheckMessageDataType(Message))
 			{
 				// Register module
-				const auto *const pMessage = module_registration_message_t::GetMessageData(Message);
-				this->Register(pMessage->ModuleToRegister, pMessage->SenderLinkIDs, pMessage->ReceiverLinkIDs);
+				this->HandleRegistration(*module_registration_message_t::GetMessageData(Message));
 			}
 			else if(Message.Get<MessageTypeNum>() == message_t(ModuleUnregistrationMessageType, 0))
 			{
-				// Unregister module
-				const auto *const pMessage = module_unregistration_message_t::GetMessageData(Message);
-				auto retVal = this->Unregister(pMessage->ModuleID);
-				if(pMessage->ppReturnValue != nullptr)
-					*pMessage->ppReturnValue = retVal;
+				// Unregister module once the messages queued before were handled. A queue that doesn't accept messages anymore won't handle any, so unregister it now
+				if(this->module_manager_t::ForcePushMessage(Message) == thread_queued::QUEUE_PUSH_NOT_ACCEPTED)
+					this->HandleUnregistration(module_unregistration_message_t::GetMessageData(Message)->ModuleID);
+			}
+			else if(module_link_message_t::CheckMessageDataType(Message))
+			{
+				// Link module
+				this->HandleLink(*module_link_message_t::GetMessageData(Message));
 			}
 		}
 		else	// Else just push message to modules
 			this->module_manager_t::PushMessage(Message);
 	}
 
+	void thread_multi_module_manager_t::HandleRegistration(module_registration_message_t &Registration)
+	{
+		const identifier_t moduleID = Registration.ModuleToRegister->GetID();
+
+		lock_guard<mutex> registrationLock(this->_RegistrationLock);
+
+		if(this->_PendingUnregistrations.find(moduleID) == this->_PendingUnregistrations.end())
+		{
+			this->Register(Registration.ModuleToRegister, Registration.SenderLinkIDs, Registration.ReceiverLinkIDs);
+			return;
+		}
+
+		// The earlier module with this ID is still registered until its unregistration is handled
+		auto &deferredRegistration = this->_DeferredRegistrations[moduleID];
+		if(deferredRegistration.ModuleToRegister != nullptr)
+			throw Exception(ERROR_NUM, "ERROR thread_multi_module_manager_t::HandleRegistration(): Element with this ID already exists\n");
+
+		deferredRegistration.ModuleToRegister = Registration.ModuleToRegister;
+		deferredRegistration.SenderLinkIDs.insert(deferredRegistration.SenderLinkIDs.end(), Registration.SenderLinkIDs.begin(), Registration.SenderLinkIDs.end());
+		deferredRegistration.ReceiverLinkIDs.insert(deferredRegistration.ReceiverLinkIDs.end(), Registration.ReceiverLinkIDs.begin(), Registration.ReceiverLinkIDs.end());
+	}
+
+	void thread_multi_module_manager_t::HandleUnregistration(identifier_t ModuleID)
+	{
+		lock_guard<mutex> registrationLock(this->_RegistrationLock);
+
+		this->Unregister(ModuleID);
+
+		auto pendingUnregistration = this->_PendingUnregistrations.find(ModuleID);
+		if(pendingUnregistration == this->_PendingUnregistrations.end() || --(pendingUnregistration->second) > 0)
+			return;
+
+		this->_PendingUnregistrations.erase(pendingUnregistration);
+
+		// Perform what was held back for the next module with this ID
+		auto deferredRegistration = this->_DeferredRegistrations.find(ModuleID);
+		if(deferredRegistration == this->_DeferredRegistrations.end())
+			return;
+
+		const deferred_registration_t registration = std::move(deferredRegistration->second);
+		this->_DeferredRegistrations.erase(deferredRegistration);
+
+		if(registration.ModuleToRegister != nullptr)
+		{
+			this->Register(registration.ModuleToRegister, registration.SenderLinkIDs, registration.ReceiverLinkIDs);
+			return;
+		}
+
+		for(const auto &curID : registration.SenderLinkIDs)
+			this->AddSendLink(curID, ModuleID);
+
+		for(const auto &curID : registration.ReceiverLinkIDs)
+			this->AddReceiverLink(curID, ModuleID);
+	}
+
+	void thread_multi_module_manager_t::HandleLink(module_link_message_t &Links)
+	{
+		lock_guard<mutex> registrationLock(this->_RegistrationLock);
+
+		// Links of the next module with this ID must not be removed by the pending unregistration
+		if(this->_PendingUnregistrations.find(Links.ModuleID) != this->_PendingUnregistrations.end())
+		{
+			auto &deferredRegistration = this->_DeferredRegistrations[Links.ModuleID];
+			deferredRegistration.SenderLinkIDs.insert(deferredRegistration.SenderLinkIDs.end(), Links.SenderLinkIDs.begin(), Links.SenderLinkIDs.end());
+			deferredRegistration.ReceiverLinkIDs.insert(deferredRegistration.ReceiverLinkIDs.end(), Links.ReceiverLinkIDs.begin(), Links.ReceiverLinkIDs.end());
+
+			return;
+		}
+
+		for(const auto &curID : Links.SenderLinkIDs)
+			this->AddSendLink(curID, Links.ModuleID);
+
+		for(const auto &curID : Links.ReceiverLinkIDs)
+			this->AddReceiverLink(curID, Links.ModuleID);
+	}
+
+	void thread_multi_module_manager_t::HandleMovedMessage(msg_struct_t &&Message)
+	{
+		if(Message.Get<MessageSenderIDNum>() == ModuleRegistrationID)
+			this->HandleMessage(Message);
+		else
+			this->module_manager_t::PushMessage(std::move(Message));
+	}
+
+	void thread_multi_module_manager_t::QueuedMessageCallback(msg_struct_t &Message, void *ExtraData)
+	{
+		if(Message.Get<MessageSenderIDNum>() == ModuleRegistrationID && Message.Get<MessageTypeNum>() == message_t(ModuleUnregistrationMessageType, 0))
+		{
+			auto *const pClass = static_cast<thread_multi_module_manager_t*>(reinterpret_cast<thread_multi_module_manager_type*>(ExtraData));
+
+			const auto *const pMessage = module_unregistration_message_t::GetMessageData(Message);
+			pClass->HandleUnregistration(pMessage->ModuleID);
+		}
+		else
+			thread_multi_module_manager_type::MessageCallback(Message, ExtraData);
+	}
+
+	void thread_multi_module_manager_t::DiscardQueuedMessage(msg_struct_t &Message, void *ExtraData)
+	{
+		// Unregistrations must not be lost, queue them again
+		if(Message.Get<MessageSenderIDNum>() == ModuleRegistrationID && Message.Get<MessageTypeNum>() == message_t(ModuleUnregistrationMessageType, 0))
+		{
+			auto *const pClass = static_cast<thread_multi_module_manager_t*>(reinterpret_cast<thread_multi_module_manager_type*>(ExtraData));
+
+			pClass->HandleMessage(Message);
+		}
+	}
+
 	module_registration_message_t::module_registration_message_t(thread_multi_module_shared_ptr_t _ModuleToRegister, id_vector_t &&_SenderIDLinks, id_vector_t &&_RecevierIDLinks)
 		: ModuleToRegister(_ModuleToRegister),
 		  SenderLinkIDs(std::move(_SenderIDLinks)),
 		  ReceiverLinkIDs(std::move(_RecevierIDLinks))
 	{}
 
-	module_unregistration_message_t::module_unregistration_message_t(identifier_t _ModuleID, thread_multi_module_shared_ptr_t *_ppReturnValue)
-		: ModuleID(_ModuleID), ppReturnValue(_ppReturnValue)
+	module_unregistration_message_t::module_unregistration_message_t(identifier_t _ModuleID)
+		: ModuleID(_ModuleID)
+	{}
+
+	module_link_message_t::module_link_message_t(identifier_t _ModuleID, id_vector_t &&_SenderLinkIDs, id_vector_t &&_ReceiverLinkIDs)
+		: ModuleID(_ModuleID),
+		  SenderLinkIDs(std::move(_SenderLinkIDs)),
+		  ReceiverLinkIDs(std::move(_ReceiverLinkIDs))
 	{}
 
 	void test()
@@ -65,4 +214,111 @@ namespace silkstring_message
 		//testQueue.HandleMessage(testMsg);
 
 	}
+
+	struct test_dispatch_first_t : public message_id_struct_t<1, 1, DefaultMessageType + 0, test_dispatch_first_t>
+	{
+		int Data;
+	};
+
+	// Same type number as test_dispatch_first_t, but owned by another module
+	struct test_dispatch_other_module_t : public message_id_struct_t<1, 2, DefaultMessageType + 0, test_dispatch_other_module_t>
+	{
+		int Data;
+	};
+
+	// Payload with its own heap buffer, like the data handed to ProtocolModuleTLSConnection
+	struct test_dispatch_buffer_t : public message_id_struct_t<1, 1, DefaultMessageType + 2, test_dispatch_buffer_t>
+	{
+		std::vector<uint8_t> Data;
+	};
+
+	struct test_dispatch_fixed_thread_t : public message_id_thread_struct_t<1, 1, 3, DefaultMessageType + 5, test_dispatch_fixed_thread_t>
+	{
+		int Data;
+	};
+
+	class TestMessageDispatchTable
+	{
+		public:
+			static bool Testing();
+
+		private:
+			int _HandledFirst = 0;
+			int _HandledOtherModule = 0;
+			int _HandledFixedThread = 0;
+			std::vector<uint8_t> _HandledBuffer;
+			const test_dispatch_buffer_t *_pHandledBufferMessage = nullptr;
+
+			void HandleFirst(thread_multi_module_message_t &, test_dispatch_first_t &Data)
+			{
+				this->_HandledFirst = Data.Data;
+			}
+
+			void HandleOtherModule(thread_multi_module_message_t &, test_dispatch_other_module_t &Data)
+			{
+				this->_HandledOtherModule = Data.Data;
+			}
+
+			void HandleBuffer(thread_multi_module_message_t &, test_dispatch_buffer_t &Data)
+			{
+				this->_pHandledBufferMessage = &Data;
+				this->_HandledBuffer = std::move(Data.Data);
+			}
+
+			void HandleFixedThread(thread_multi_module_message_t &, test_dispatch_fixed_thread_t &Data)
+			{
+				this->_HandledFixedThread = Data.Data;
+			}
+	};
+
+	bool TestMessageDispatchTable::Testing()
+	{
+		using test_dispatch_table_t = message_dispatch_table_t<TestMessageDispatchTable,
+																message_handler_t<&TestMessageDispatchTable::HandleFixedThread>,
+																message_handler_t<&TestMessageDispatchTable::HandleOtherModule>,
+																message_handler_t<&TestMessageDispatchTable::HandleBuffer>,
+																message_handler_t<&TestMessageDispatchTable::HandleFirst>>;
+
+		constexpr identifier_t::thread_id_t testThreadID = 2;
+
+		TestMessageDispatchTable testModule;
+
+		// Message types sharing a type number are told apart by their owner
+		auto testMessage = test_dispatch_first_t::CreateMessageFromSender(testThreadID, UnusedID, test_dispatch_first_t{{}, 1});
+		if(!test_dispatch_table_t::HandleMessage(&testModule, testMessage, testThreadID) || testModule._HandledFirst != 1 || testModule._HandledOtherModule != 0)
+			return 0;
+
+		testMessage = test_dispatch_other_module_t::CreateMessageFromSender(testThreadID, UnusedID, test_dispatch_other_module_t{{}, 2});
+		if(!test_dispatch_table_t::HandleMessage(&testModule, testMessage, testThreadID) || testModule._HandledFirst != 1 || testModule._HandledOtherModule != 2)
+			return 0;
+
+		// Wrong thread
+		testMessage = test_dispatch_first_t::CreateMessageFromSender(testThreadID+1, UnusedID, test_dispatch_first_t{{}, 3});
+		if(test_dispatch_table_t::HandleMessage(&testModule, testMessage, testThreadID) || testModule._HandledFirst != 1)
+			return 0;
+
+		// Fixed thread types ignore the thread of the module
+		testMessage = test_dispatch_fixed_thread_t::CreateMessageFromSender(UnusedID, test_dispatch_fixed_thread_t{{}, 4});
+		if(!test_dispatch_table_t::HandleMessage(&testModule, testMessage, testThreadID) || testModule._HandledFixedThread != 4)
+			return 0;
+
+		// Handlers get the typed data stored in the message, not a copy
+		testMessage = test_dispatch_buffer_t::CreateMessageFromSender(testThreadID, UnusedID, test_dispatch_buffer_t{{}, {1, 2, 3}});
+		if(!test_dispatch_table_t::HandleMessage(&testModule, testMessage, testThreadID) ||
+				testModule._pHandledBufferMessage != test_dispatch_buffer_t::GetMessageDataConst(testMessage) ||
+				testModule._HandledBuffer != std::vector<uint8_t>{1, 2, 3} ||
+				!test_dispatch_buffer_t::GetMessageDataConst(testMessage)->Data.empty())
+			return 0;
+
+		// Type numbers between and outside of the handled ones
+		testMessage = thread_multi_module_message_t(identifier_t(1, 1, testThreadID), UnusedID, message_t(DefaultMessageType + 3), message_ptr(new int(0)));
+		if(test_dispatch_table_t::HandleMessage(&testModule, testMessage, testThreadID))
+			return 0;
+
+		testMessage = thread_multi_module_message_t(identifier_t(1, 1, testThreadID), UnusedID, message_t(DefaultMessageType + 6), message_ptr(new int(0)));
+		if(test_dispatch_table_t::HandleMessage(&testModule, testMessage, testThreadID))
+			return 0;
+
+		return 1;
+	}
 }
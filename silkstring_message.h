@@ -9,6 +9,11 @@
 #include "thread_module_manager_multi_message.h"
 #include "dynamic_pointer.h"
 
+#include <array>
+#include <type_traits>
+#include <mutex>
+#include <unordered_map>
+
 /*!
  *  \brief Namespace for SilkstringMessage class
  */
@@ -16,26 +21,45 @@ namespace silkstring_message
 {
 	using std::array;
 	using std::shared_ptr;
+	using std::mutex;
+	using std::lock_guard;
+	using std::unique_lock;
+	using std::unordered_map;
 
 	using dynamic_pointer::SharedDynamicPointer;
 
 	using thread_module_manager_multi_message::ThreadModuleManagerMultiMessage;
 
+	using thread_queued::queue_lane_t;
+	using thread_queued::QUEUE_LANE_CONTROL;
+	using thread_queued::QUEUE_LANE_HIGH;
+	using thread_queued::QUEUE_LANE_DEFAULT;
+	using thread_queued::QUEUE_LANE_BULK;
+
 	using message_list_size_t = size_t;
 
 	/*!
-	 *	\brief Identifier Type used by all modules
+	 *	\brief Identifier Type used by all modules. Packs a 16 bit queue ID, a 16 bit module ID and a 32 bit thread ID into 64 bits
 	 */
 	struct identifier_t
 	{
-		using type = uint32_t;
-		using queue_id_t = uint8_t;
-		using thread_id_t = uint8_t;
+		using type = uint64_t;
+		using queue_id_t = uint16_t;
 		using module_id_t = uint16_t;
 
-		type MessageQueueID	: 8;
+		/*!
+		 * \brief Thread ID. Protocol connections use it as connection ID, so it must hold one ID per concurrent connection
+		 */
+		using thread_id_t = uint32_t;
+
+		/*!
+		 * \brief Packed queue and thread ID. Identifies the queue a module belongs to
+		 */
+		using queue_key_t = uint64_t;
+
+		type MessageQueueID	: 16;
 		type ModuleID		: 16;
-		type ThreadID		: 8;
+		type ThreadID		: 32;
 
 		constexpr identifier_t()
 			: MessageQueueID(0), ModuleID(0), ThreadID(0)
@@ -50,7 +74,36 @@ namespace silkstring_message
 			//if(*(reinterpret_cast<const type *>(this)) == *(reinterpret_cast<const type*>(&S)))
 			return *((const type*)this) == *((const type*)&S);
 		}
+
+		static constexpr queue_key_t CreateQueueKey(queue_id_t QueueID, thread_id_t ThreadID)
+		{
+			return static_cast<queue_key_t>((static_cast<queue_key_t>(ThreadID) << 16) | QueueID);
+		}
+
+		constexpr queue_key_t GetQueueKey() const
+		{
+			return CreateQueueKey(MessageQueueID, ThreadID);
+		}
 	};
+} // namespace silkstring_message
+
+namespace std
+{
+	/*!
+	 *	\brief Hash of identifier_t, used to index modules
+	 */
+	template<>
+	struct hash<silkstring_message::identifier_t>
+	{
+		size_t operator()(const silkstring_message::identifier_t &ID) const noexcept
+		{
+			return *((const silkstring_message::identifier_t::type*)&ID);
+		}
+	};
+} // namespace std
+
+namespace silkstring_message
+{
 
 	/*!
 	 *	\brief Identify message type
@@ -69,6 +122,11 @@ namespace silkstring_message
 		 */
 		owner_t MessageTypeOwner;
 
+		/*!
+		 * \brief Queue lane of the message. Not part of the message type
+		 */
+		queue_lane_t Lane;
+
 		/*!
 		 * \brief Message Type
 		 */
@@ -79,8 +137,8 @@ namespace silkstring_message
 			return MessageTypeOwner == SenderOwner;
 		}
 
-		explicit constexpr message_t(message_type_t _MessageType, bool _SenderOwner = ReceiverOwner)
-			: MessageTypeOwner(_SenderOwner), MessageType(_MessageType)
+		explicit constexpr message_t(message_type_t _MessageType, bool _SenderOwner = ReceiverOwner, queue_lane_t _Lane = QUEUE_LANE_DEFAULT)
+			: MessageTypeOwner(_SenderOwner), Lane(_Lane), MessageType(_MessageType)
 		{}
 
 		constexpr bool operator==(const message_t &S) const
@@ -103,7 +161,33 @@ namespace silkstring_message
 	static constexpr message_queue::variadic_counter_t MessageSenderIDNum = 1;
 	static constexpr message_queue::variadic_counter_t MessageTypeNum = 2;
 	static constexpr message_queue::variadic_counter_t MessageDataNum = 3;
+} // namespace silkstring_message
 
+namespace thread_queued
+{
+	/*!
+	 *	\brief Messages are queued in the lane stored in their message_t
+	 */
+	template<>
+	struct queue_lane_selector_t<message_struct_t<silkstring_message::identifier_t, silkstring_message::identifier_t, silkstring_message::message_t, silkstring_message::message_ptr>>
+	{
+		using msg_struct_t = message_struct_t<silkstring_message::identifier_t, silkstring_message::identifier_t, silkstring_message::message_t, silkstring_message::message_ptr>;
+
+		static queue_lane_t GetLane(const msg_struct_t &Message)
+		{
+			return Message.Get<silkstring_message::MessageTypeNum>().Lane;
+		}
+
+		template<class FcnReceiverID, class FcnSenderID, class FcnMessageData>
+		static queue_lane_t GetLane(const FcnReceiverID &, const FcnSenderID &, const silkstring_message::message_t &MessageType, const FcnMessageData &)
+		{
+			return MessageType.Lane;
+		}
+	};
+} // namespace thread_queued
+
+namespace silkstring_message
+{
 	static constexpr message_t::message_type_t DefaultMessageType = 0;
 	static constexpr message_t::message_type_t UnusedMessageType = -1;
 	static constexpr message_t UnusedMessage(UnusedMessageType, 1);
@@ -124,6 +208,9 @@ namespace silkstring_message
 	using thread_multi_module_t = thread_multi_module_manager_type::module_t;
 	using thread_multi_module_shared_ptr_t = thread_multi_module_manager_type::module_shared_ptr_t;
 
+	struct module_registration_message_t;
+	struct module_link_message_t;
+
 	/*!
 	 *	\brief Module manager that runs a separate thread to handle messages. Can be included into GlobalMessageQueueThread as a module
 	 */
@@ -136,10 +223,74 @@ namespace silkstring_message
 
 			thread_multi_module_manager_t(identifier_t::queue_id_t QueueID, identifier_t::thread_id_t ThreadID = DefaultThreadID, thread_queued::thread_state_t ThreadState = thread_queued::THREAD_RUNNING);
 
+			/*!
+			 *	\brief Announce an unregistration message for ModuleID before it is sent. Registrations and links of ModuleID are held back until this queue handled it
+			 *	\return Returns the registered module, or nullptr if no module with this ID is registered. Nothing is announced in that case
+			 */
+			thread_multi_module_shared_ptr_t AnnounceUnregistration(identifier_t ModuleID);
+
+			/*!
+			 *	\brief Drop the registration of ModuleID that waits for an announced unregistration, together with its held back links
+			 *	\return Returns the dropped module, or nullptr if no registration of ModuleID is held back
+			 */
+			thread_multi_module_shared_ptr_t CancelDeferredRegistration(identifier_t ModuleID);
+
 		private:
 
+			/*!
+			 *	\brief Registration and links of a module that wait for the unregistration of an earlier module with the same ID
+			 */
+			struct deferred_registration_t
+			{
+				thread_multi_module_shared_ptr_t ModuleToRegister;
+				id_vector_t SenderLinkIDs;
+				id_vector_t ReceiverLinkIDs;
+			};
+
+			/*!
+			 *	\brief Lock for _PendingUnregistrations and _DeferredRegistrations
+			 */
+			mutex _RegistrationLock;
+
+			/*!
+			 *	\brief Number of announced unregistrations per module ID that this queue didn't handle yet
+			 */
+			unordered_map<identifier_t, size_t> _PendingUnregistrations;
+
+			unordered_map<identifier_t, deferred_registration_t> _DeferredRegistrations;
+
 			void HandleMessage(msg_struct_t &Message);
 
+			/*!
+			 *	\brief Register the module, or hold it back if an unregistration of its ID is still pending
+			 */
+			void HandleRegistration(module_registration_message_t &Registration);
+
+			/*!
+			 *	\brief Unregister the module. Once no unregistration of its ID is pending anymore, a held back registration of that ID is performed
+			 */
+			void HandleUnregistration(identifier_t ModuleID);
+
+			/*!
+			 *	\brief Link the module, or hold the links back if an unregistration of its ID is still pending
+			 */
+			void HandleLink(module_link_message_t &Links);
+
+			/*!
+			 *	\brief Queues Message without copying it
+			 */
+			void HandleMovedMessage(msg_struct_t &&Message);
+
+			/*!
+			 *	\brief Handles queued unregistrations on the queue thread, passes all other messages to the modules
+			 */
+			static void QueuedMessageCallback(msg_struct_t &Message, void *ExtraData);
+
+			/*!
+			 *	\brief Queues unregistrations discarded by QUEUE_OVERFLOW_DROP_OLDEST again
+			 */
+			static void DiscardQueuedMessage(msg_struct_t &Message, void *ExtraData);
+
 			template<class U>
 			friend class ::TestingClass;
 	};
@@ -192,7 +343,10 @@ namespace silkstring_message
 	template<typename BaseClass, typename module_fcn_t<BaseClass>::type* ...Functions>
 	constexpr typename thread_multi_module_fcn_t<BaseClass, Functions...>::fcn_array_t thread_multi_module_fcn_t<BaseClass, Functions...>::_FcnArray;
 
-	template<identifier_t::queue_id_t _QueueID, identifier_t::module_id_t _ModuleID, message_t::message_type_t _MessageType, class T>
+	/*!
+	 *	\brief Message type of module _ModuleID. Messages created with CreateMessageFromSender() and CreateMessageToReceiver() are queued in _Lane
+	 */
+	template<identifier_t::queue_id_t _QueueID, identifier_t::module_id_t _ModuleID, message_t::message_type_t _MessageType, class T, queue_lane_t _Lane = QUEUE_LANE_DEFAULT>
 	struct message_id_struct_t
 	{
 		using data_t = T;
@@ -200,6 +354,7 @@ namespace silkstring_message
 		static constexpr decltype(_QueueID) QueueID = _QueueID;
 		static constexpr decltype(_ModuleID) ModuleID = _ModuleID;
 		static constexpr decltype(_MessageType) MessageType = _MessageType;
+		static constexpr decltype(_Lane) Lane = _Lane;
 
 		static constexpr identifier_t CreateID(identifier_t::thread_id_t ThreadID)
 		{
@@ -208,22 +363,22 @@ namespace silkstring_message
 
 		static inline thread_multi_module_message_t CreateMessageFromSender(identifier_t::thread_id_t ReceiverThreadID, identifier_t SenderID, T *MemData)
 		{
-			return thread_multi_module_message_t{CreateID(ReceiverThreadID), SenderID, message_t(_MessageType, message_t::ReceiverOwner), message_ptr(MemData)};
+			return thread_multi_module_message_t{CreateID(ReceiverThreadID), SenderID, message_t(_MessageType, message_t::ReceiverOwner, _Lane), message_ptr(MemData)};
 		}
 
 		static inline thread_multi_module_message_t CreateMessageFromSender(identifier_t::thread_id_t ReceiverThreadID, identifier_t SenderID, T &&Data)
 		{
-			return CreateMessageFromSender(ReceiverThreadID, SenderID, new T(std::move(Data)));
+			return thread_multi_module_message_t{CreateID(ReceiverThreadID), SenderID, message_t(_MessageType, message_t::ReceiverOwner, _Lane), message_ptr::Create<T>(std::move(Data))};
 		}
 
 		static inline thread_multi_module_message_t CreateMessageToReceiver(identifier_t ReceiverID, identifier_t::thread_id_t SenderThreadID, T *MemData)
 		{
-			return thread_multi_module_message_t{ReceiverID, CreateID(SenderThreadID), message_t(_MessageType, message_t::SenderOwner), message_ptr(MemData)};
+			return thread_multi_module_message_t{ReceiverID, CreateID(SenderThreadID), message_t(_MessageType, message_t::SenderOwner, _Lane), message_ptr(MemData)};
 		}
 
 		static inline thread_multi_module_message_t CreateMessageToReceiver(identifier_t ReceiverID, identifier_t::thread_id_t SenderThreadID, T &&Data)
 		{
-			return CreateMessageToReceiver(ReceiverID, SenderThreadID, new T(std::move(Data)));
+			return thread_multi_module_message_t{ReceiverID, CreateID(SenderThreadID), message_t(_MessageType, message_t::SenderOwner, _Lane), message_ptr::Create<T>(std::move(Data))};
 		}
 
 		static inline T *GetMessageData(thread_multi_module_message_t &Data)
@@ -255,17 +410,20 @@ namespace silkstring_message
 		}
 	};
 
-	template<identifier_t::queue_id_t _QueueID, identifier_t::module_id_t _ModuleID, message_t::message_type_t _MessageType, class T>
-	constexpr decltype(_QueueID) message_id_struct_t<_QueueID, _ModuleID, _MessageType, T>::QueueID;
+	template<identifier_t::queue_id_t _QueueID, identifier_t::module_id_t _ModuleID, message_t::message_type_t _MessageType, class T, queue_lane_t _Lane>
+	constexpr decltype(_QueueID) message_id_struct_t<_QueueID, _ModuleID, _MessageType, T, _Lane>::QueueID;
 
-	template<identifier_t::queue_id_t _QueueID, identifier_t::module_id_t _ModuleID, message_t::message_type_t _MessageType, class T>
-	constexpr decltype(_ModuleID) message_id_struct_t<_QueueID, _ModuleID, _MessageType, T>::ModuleID;
+	template<identifier_t::queue_id_t _QueueID, identifier_t::module_id_t _ModuleID, message_t::message_type_t _MessageType, class T, queue_lane_t _Lane>
+	constexpr decltype(_ModuleID) message_id_struct_t<_QueueID, _ModuleID, _MessageType, T, _Lane>::ModuleID;
 
-	template<identifier_t::queue_id_t _QueueID, identifier_t::module_id_t _ModuleID, message_t::message_type_t _MessageType, class T>
-	constexpr decltype(_MessageType) message_id_struct_t<_QueueID, _ModuleID, _MessageType, T>::MessageType;
+	template<identifier_t::queue_id_t _QueueID, identifier_t::module_id_t _ModuleID, message_t::message_type_t _MessageType, class T, queue_lane_t _Lane>
+	constexpr decltype(_MessageType) message_id_struct_t<_QueueID, _ModuleID, _MessageType, T, _Lane>::MessageType;
 
-	template<identifier_t::queue_id_t _QueueID, identifier_t::module_id_t _ModuleID, identifier_t::thread_id_t _ThreadID, message_t::message_type_t _MessageType, class T>
-	struct message_id_thread_struct_t : public message_id_struct_t<_QueueID, _ModuleID, _MessageType, T>
+	template<identifier_t::queue_id_t _QueueID, identifier_t::module_id_t _ModuleID, message_t::message_type_t _MessageType, class T, queue_lane_t _Lane>
+	constexpr decltype(_Lane) message_id_struct_t<_QueueID, _ModuleID, _MessageType, T, _Lane>::Lane;
+
+	template<identifier_t::queue_id_t _QueueID, identifier_t::module_id_t _ModuleID, identifier_t::thread_id_t _ThreadID, message_t::message_type_t _MessageType, class T, queue_lane_t _Lane = QUEUE_LANE_DEFAULT>
+	struct message_id_thread_struct_t : public message_id_struct_t<_QueueID, _ModuleID, _MessageType, T, _Lane>
 	{
 		static constexpr decltype(_ThreadID) ThreadID = _ThreadID;
 		static constexpr identifier_t ID = identifier_t(_QueueID, _ModuleID, ThreadID);
@@ -278,35 +436,198 @@ namespace silkstring_message
 
 		static inline thread_multi_module_message_t CreateMessageFromSender(identifier_t SenderID, T *MemData)
 		{
-			return message_id_struct_t<_QueueID, _ModuleID, _MessageType, T>::CreateMessageFromSender(ThreadID, SenderID, MemData);
+			return message_id_struct_t<_QueueID, _ModuleID, _MessageType, T, _Lane>::CreateMessageFromSender(ThreadID, SenderID, MemData);
 		}
 
 		static inline thread_multi_module_message_t CreateMessageFromSender(identifier_t SenderID, T &&Data)
 		{
-			return CreateMessageFromSender(SenderID, new T(std::move(Data)));
+			return message_id_struct_t<_QueueID, _ModuleID, _MessageType, T, _Lane>::CreateMessageFromSender(ThreadID, SenderID, std::move(Data));
 		}
 
 		static inline thread_multi_module_message_t CreateMessageToReceiver(identifier_t ReceiverID, T *MemData)
 		{
-			return message_id_struct_t<_QueueID, _ModuleID, _MessageType, T>::CreateMessageToReceiver(ReceiverID, ThreadID, MemData);
+			return message_id_struct_t<_QueueID, _ModuleID, _MessageType, T, _Lane>::CreateMessageToReceiver(ReceiverID, ThreadID, MemData);
 		}
 
 		static inline thread_multi_module_message_t CreateMessageToReceiver(identifier_t ReceiverID, T &&Data)
 		{
-			return CreateMessageToReceiver(ReceiverID, new T(std::move(Data)));
+			return message_id_struct_t<_QueueID, _ModuleID, _MessageType, T, _Lane>::CreateMessageToReceiver(ReceiverID, ThreadID, std::move(Data));
 		}
 
 		static inline bool CheckMessageDataType(thread_multi_module_message_t &Data)
 		{
-			return message_id_struct_t<_QueueID, _ModuleID, _MessageType, T>::CheckMessageDataType(Data, ThreadID);
+			return message_id_struct_t<_QueueID, _ModuleID, _MessageType, T, _Lane>::CheckMessageDataType(Data, ThreadID);
+		}
+	};
+
+	template<identifier_t::queue_id_t _QueueID, identifier_t::module_id_t _ModuleID, identifier_t::thread_id_t _ThreadID, message_t::message_type_t _MessageType, class T, queue_lane_t _Lane>
+	constexpr decltype(_ThreadID) message_id_thread_struct_t<_QueueID, _ModuleID, _ThreadID, _MessageType, T, _Lane>::ThreadID;
+
+	template<identifier_t::queue_id_t _QueueID, identifier_t::module_id_t _ModuleID, identifier_t::thread_id_t _ThreadID, message_t::message_type_t _MessageType, class T, queue_lane_t _Lane>
+	constexpr identifier_t message_id_thread_struct_t<_QueueID, _ModuleID, _ThreadID, _MessageType, T, _Lane>::ID;
+
+	/*!
+	 *	\brief Fixed thread of MessageStruct. Message types derived from message_id_thread_struct_t always belong to their ThreadID
+	 */
+	template<class MessageStruct, class = void>
+	struct message_fixed_thread_t
+	{
+		static constexpr bool FixedThread = false;
+		static constexpr identifier_t::thread_id_t ThreadID = DefaultThreadID;
+	};
+
+	template<class MessageStruct>
+	struct message_fixed_thread_t<MessageStruct, std::void_t<decltype(MessageStruct::ThreadID)>>
+	{
+		static constexpr bool FixedThread = true;
+		static constexpr identifier_t::thread_id_t ThreadID = MessageStruct::ThreadID;
+	};
+
+	/*!
+	 *	\brief Entry of message_dispatch_table_t. Identifies one message type and the function that handles it
+	 */
+	template<class BaseClass>
+	struct message_dispatch_entry_t
+	{
+		using handle_fcn_t = void(BaseClass *Class, thread_multi_module_message_t &Message);
+
+		message_t::message_type_t MessageType;
+		identifier_t::queue_id_t QueueID;
+		identifier_t::module_id_t ModuleID;
+		bool FixedThread;
+		identifier_t::thread_id_t ThreadID;
+
+		handle_fcn_t *Handle;
+
+		/*!
+		 * \brief Check whether OwnerID owns this message type. ModuleThreadID is used for message types without fixed thread
+		 */
+		bool IsOwner(const identifier_t &OwnerID, identifier_t::thread_id_t ModuleThreadID) const
+		{
+			return OwnerID == identifier_t(this->QueueID, this->ModuleID, this->FixedThread ? this->ThreadID : ModuleThreadID);
+		}
+
+		template<size_t NumEntries>
+		static constexpr array<message_dispatch_entry_t, NumEntries> SortByMessageType(array<message_dispatch_entry_t, NumEntries> Entries)
+		{
+			for(size_t curEntry = 1; curEntry < NumEntries; ++curEntry)
+			{
+				for(size_t curPos = curEntry; curPos > 0 && Entries[curPos-1].MessageType > Entries[curPos].MessageType; --curPos)
+				{
+					const auto tmpEntry = Entries[curPos];
+					Entries[curPos] = Entries[curPos-1];
+					Entries[curPos-1] = tmpEntry;
+				}
+			}
+
+			return Entries;
+		}
+
+		/*!
+		 * \brief Get the position of the first entry of every message type between the smallest and the largest one. Entries must be sorted
+		 */
+		template<size_t NumSlots, size_t NumEntries>
+		static constexpr array<size_t, NumSlots+1> CreateSlots(const array<message_dispatch_entry_t, NumEntries> &Entries)
+		{
+			array<size_t, NumSlots+1> slots{};
+
+			size_t curEntry = 0;
+			for(size_t curSlot = 0; curSlot <= NumSlots; ++curSlot)
+			{
+				while(curEntry < NumEntries && static_cast<size_t>(Entries[curEntry].MessageType - Entries[0].MessageType) < curSlot)
+					++curEntry;
+
+				slots[curSlot] = curEntry;
+			}
+
+			return slots;
 		}
 	};
 
-	template<identifier_t::queue_id_t _QueueID, identifier_t::module_id_t _ModuleID, identifier_t::thread_id_t _ThreadID, message_t::message_type_t _MessageType, class T>
-	constexpr decltype(_ThreadID) message_id_thread_struct_t<_QueueID, _ModuleID, _ThreadID, _MessageType, T>::ThreadID;
+	/*!
+	 *	\brief Handler of the message type MessageStruct. Declared with the member function that gets the message and its typed data, e.g. message_handler_t<&Module::HandleData>. Return values are ignored
+	 */
+	template<auto Handler>
+	struct message_handler_t;
+
+	template<class ReturnType, class BaseClass, class MessageStruct, ReturnType (BaseClass::*Handler)(thread_multi_module_message_t &, MessageStruct &)>
+	struct message_handler_t<Handler>
+	{
+		using base_class_t = BaseClass;
 
-	template<identifier_t::queue_id_t _QueueID, identifier_t::module_id_t _ModuleID, identifier_t::thread_id_t _ThreadID, message_t::message_type_t _MessageType, class T>
-	constexpr identifier_t message_id_thread_struct_t<_QueueID, _ModuleID, _ThreadID, _MessageType, T>::ID;
+		static void Handle(BaseClass *Class, thread_multi_module_message_t &Message)
+		{
+			(Class->*Handler)(Message, *(MessageStruct::GetMessageData(Message)));
+		}
+
+		static constexpr message_dispatch_entry_t<BaseClass> Entry = {MessageStruct::MessageType, MessageStruct::QueueID, MessageStruct::ModuleID,
+																	  message_fixed_thread_t<MessageStruct>::FixedThread, message_fixed_thread_t<MessageStruct>::ThreadID,
+																	  &message_handler_t::Handle};
+	};
+
+	template<class ReturnType, class BaseClass, class MessageStruct, ReturnType (BaseClass::*Handler)(thread_multi_module_message_t &, MessageStruct &)>
+	constexpr message_dispatch_entry_t<BaseClass> message_handler_t<Handler>::Entry;
+
+	/*!
+	 *	\brief Calls the handler of a message in constant time. The handled message types are listed as message_handler_t. The message type indexes a table
+	 *	of entries built at compile time. Only message types of different modules that share a type number are compared with each other
+	 */
+	template<class BaseClass, class ...Handlers>
+	class message_dispatch_table_t
+	{
+			static_assert(sizeof...(Handlers) > 0, "ERROR message_dispatch_table_t: At least one handler required");
+			static_assert((std::is_same<typename Handlers::base_class_t, BaseClass>::value && ...), "ERROR message_dispatch_table_t: Handlers must be members of BaseClass");
+
+			using entry_t = message_dispatch_entry_t<BaseClass>;
+			using entry_array_t = array<entry_t, sizeof...(Handlers)>;
+
+			static constexpr entry_array_t _Entries = entry_t::SortByMessageType(entry_array_t{Handlers::Entry...});
+
+			static constexpr message_t::message_type_t _MinMessageType = _Entries.front().MessageType;
+			static constexpr size_t _NumSlots = static_cast<size_t>(_Entries.back().MessageType - _MinMessageType) + 1;
+
+			using slot_array_t = array<size_t, _NumSlots+1>;
+
+			/*!
+			 * \brief Entries of message type _MinMessageType+i are _Entries[_Slots[i]] to _Entries[_Slots[i+1]-1]
+			 */
+			static constexpr slot_array_t _Slots = entry_t::template CreateSlots<_NumSlots>(_Entries);
+
+		public:
+
+			/*!
+			 * \brief Pass Message to the handler of its type
+			 * \param ThreadID Thread of the module for message types without fixed thread
+			 * \return Returns false if no handler was found
+			 */
+			static bool HandleMessage(BaseClass *Class, thread_multi_module_message_t &Message, identifier_t::thread_id_t ThreadID = DefaultThreadID)
+			{
+				const auto &messageType = Message.Get<MessageTypeNum>();
+
+				const size_t curSlot = static_cast<size_t>(messageType.MessageType - _MinMessageType);
+				if(messageType.MessageType < _MinMessageType || curSlot >= _NumSlots)
+					return false;
+
+				const auto &ownerID = messageType.IsSenderMessageType() ? Message.Get<MessageSenderIDNum>() : Message.Get<MessageReceiverIDNum>();
+
+				for(size_t curEntry = _Slots[curSlot]; curEntry < _Slots[curSlot+1]; ++curEntry)
+				{
+					if(_Entries[curEntry].IsOwner(ownerID, ThreadID))
+					{
+						_Entries[curEntry].Handle(Class, Message);
+						return true;
+					}
+				}
+
+				return false;
+			}
+	};
+
+	template<class BaseClass, class ...Handlers>
+	constexpr typename message_dispatch_table_t<BaseClass, Handlers...>::entry_array_t message_dispatch_table_t<BaseClass, Handlers...>::_Entries;
+
+	template<class BaseClass, class ...Handlers>
+	constexpr typename message_dispatch_table_t<BaseClass, Handlers...>::slot_array_t message_dispatch_table_t<BaseClass, Handlers...>::_Slots;
 
 	/*!
 	 * \brief ID for sending a module registration message
@@ -323,18 +644,27 @@ namespace silkstring_message
 	};
 
 	static constexpr message_t::message_type_t ModuleUnregistrationMessageType = DefaultMessageType + 1;
+	/*!
+	 * \brief Removes a module from its queue. The queue thread handles it in order, so messages queued before it still reach the module
+	 */
 	struct module_unregistration_message_t : public message_id_thread_struct_t<ModuleRegistrationID.MessageQueueID, ModuleRegistrationID.ModuleID, ModuleRegistrationID.ThreadID, ModuleUnregistrationMessageType, module_unregistration_message_t>
 	{
 		identifier_t ModuleID;
 
-		/*!
-		 * \brief Once the module is unregistered, it is stored here so that it can be retrieved.
-		 *
-		 * You should know what you're doing if you're using this (aka, keep the pointer valid)
-		 */
-		thread_multi_module_shared_ptr_t *ppReturnValue = nullptr;
+		explicit module_unregistration_message_t(identifier_t _ModuleID);
+	};
+
+	static constexpr message_t::message_type_t ModuleLinkMessageType = DefaultMessageType + 2;
+	/*!
+	 * \brief Links IDs to an already registered module in its queue
+	 */
+	struct module_link_message_t : public message_id_thread_struct_t<ModuleRegistrationID.MessageQueueID, ModuleRegistrationID.ModuleID, ModuleRegistrationID.ThreadID, ModuleLinkMessageType, module_link_message_t>
+	{
+		identifier_t ModuleID;
+		id_vector_t SenderLinkIDs;
+		id_vector_t ReceiverLinkIDs;
 
-		explicit module_unregistration_message_t(identifier_t _ModuleID, thread_multi_module_shared_ptr_t *_ppReturnValue = nullptr);
+		module_link_message_t(identifier_t _ModuleID, id_vector_t &&_SenderLinkIDs, id_vector_t &&_ReceiverLinkIDs);
 	};
 
 	//  -------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
@@ -9,26 +9,19 @@ namespace string_thread
 
 	void StringThreadModuleRequests::HandleMessage(msg_struct_t &Message)
 	{
-		if(user_storage_request_t::CheckMessageDataType(Message))
-		{
-			// Handle request for an ID
-			this->HandleUserStorageRequest(Message);
-		}
-		else if(registration_message_t::CheckMessageDataType(Message))
-		{
-			// Handle registration request
-			const auto *const pData = registration_message_t::GetMessageData(Message);
+		using message_dispatch_t = message_dispatch_table_t<StringThreadModuleRequests,
+															message_handler_t<&StringThreadModuleRequests::HandleUserStorageRequest>,
+															message_handler_t<&StringThreadModuleRequests::HandleRegistration>,
+															message_handler_t<&StringThreadModuleRequests::HandleTLSCredentialsRequest>,
+															message_handler_t<&StringThreadModuleRequests::HandleModificationRequest>>;
 
-			this->_Memory.UserStorage.RegisterNewUser(pData->NewID);
-		}
-		else if(tls_credentials_request_t::CheckMessageDataType(Message))
-		{
-			this->HandleTLSCredentialsRequest(Message);
-		}
-		else if(string_user_modification_t::CheckMessageDataType(Message))
-		{
-			this->HandleModificationRequest(*(string_user_modification_t::GetMessageData(Message)));
-		}
+		message_dispatch_t::HandleMessage(this, Message);
+	}
+
+	void StringThreadModuleRequests::HandleRegistration(msg_struct_t &, registration_message_t &Registration)
+	{
+		// Handle registration request
+		this->_Memory.UserStorage.RegisterNewUser(Registration.NewID);
 	}
 
 	void StringThreadModuleRequests::RegisterModule(GlobalMessageQueueThread &GlobalQueue, const StringThreadModuleRequestsSharedPtr &Module)
@@ -41,7 +34,7 @@ namespace string_thread
 		GlobalQueue.RegisterModule(Module, id_vector_t(), std::move(linkedReceiverIDs));
 	}
 
-	void StringThreadModuleRequests::HandleModificationRequest(string_user_modification_t &ModificationRequest)
+	void StringThreadModuleRequests::HandleModificationRequest(msg_struct_t &, string_user_modification_t &ModificationRequest)
 	{
 		assert(ModificationRequest.ModificationData.Get<0>() != nullptr);
 
@@ -84,14 +77,13 @@ namespace string_thread
 		}
 	}
 
-	void StringThreadModuleRequests::HandleUserStorageRequest(msg_struct_t &Message)
+	void StringThreadModuleRequests::HandleUserStorageRequest(msg_struct_t &Message, user_storage_request_t &Request)
 	{
-		auto &request = (*user_storage_request_t::GetMessageData(Message));
-		switch(request.RequestData.GetTypeNumber())
+		switch(Request.RequestData.GetTypeNumber())
 		{
 			case PEER_AUTHENTICATION:
 			{
-				auto *const pData = request.RequestData.Get<PEER_AUTHENTICATION>();
+				auto *const pData = Request.RequestData.Get<PEER_AUTHENTICATION>();
 
 				// Find ID for authentication
 				bool requestGranted = false;
@@ -102,8 +94,8 @@ namespace string_thread
 				const StringUserAdmin *const pUserAdmin = &(this->_Memory.UserStorage.GetUserAdmins().front());
 				if(pUserAdmin != nullptr)
 				{
-					request.UserStorage->AddNewUserAdmin(StringUserAdmin(*pUserAdmin));
-					StringThreadModuleRequests::AddIssuerCertificateChain(*(request.UserStorage), this->_Memory.UserStorage, pUserAdmin);
+					Request.UserStorage->AddNewUserAdmin(StringUserAdmin(*pUserAdmin));
+					StringThreadModuleRequests::AddIssuerCertificateChain(*(Request.UserStorage), this->_Memory.UserStorage, pUserAdmin);
 
 					requestGranted = true;
 				}
@@ -111,22 +103,22 @@ namespace string_thread
 					requestGranted = false;
 
 				// Send answer
-				this->_Memory.GlobalQueue->PushMessage(user_storage_answer_t::CreateMessageToReceiver(Message.Get<MessageSenderIDNum>(), user_storage_answer_t(std::move(request.UserStorage), std::move(request), requestGranted)));
+				this->_Memory.GlobalQueue->PushMessage(user_storage_answer_t::CreateMessageToReceiver(Message.Get<MessageSenderIDNum>(), user_storage_answer_t(std::move(Request.UserStorage), std::move(Request), requestGranted)));
 
 				break;
 			}
 
 			case PEER_VERIFICATION:
 			{
-				auto *const pData = request.RequestData.Get<PEER_VERIFICATION>();
+				auto *const pData = Request.RequestData.Get<PEER_VERIFICATION>();
 
 				// Find ID that should be verified
 				bool requestGranted = false;
 				const auto *const pUser = this->_Memory.UserStorage.FindUserEverywhere(pData->PeerID);
 				if(pUser != nullptr)
 				{
-					request.UserStorage->AddNewUser(StringUser(*pUser));
-					StringThreadModuleRequests::AddIssuerCertificateChain(*(request.UserStorage), this->_Memory.UserStorage, pUser);
+					Request.UserStorage->AddNewUser(StringUser(*pUser));
+					StringThreadModuleRequests::AddIssuerCertificateChain(*(Request.UserStorage), this->_Memory.UserStorage, pUser);
 
 					requestGranted = true;
 				}
@@ -134,7 +126,7 @@ namespace string_thread
 					requestGranted = false;
 
 				// Send answer
-				this->_Memory.GlobalQueue->PushMessage(user_storage_answer_t::CreateMessageToReceiver(Message.Get<MessageSenderIDNum>(), user_storage_answer_t(std::move(request.UserStorage), std::move(request), requestGranted)));
+				this->_Memory.GlobalQueue->PushMessage(user_storage_answer_t::CreateMessageToReceiver(Message.Get<MessageSenderIDNum>(), user_storage_answer_t(std::move(Request.UserStorage), std::move(Request), requestGranted)));
 
 				break;
 			}
@@ -144,14 +136,12 @@ namespace string_thread
 		}
 	}
 
-	void StringThreadModuleRequests::HandleTLSCredentialsRequest(msg_struct_t &RequestMessage)
+	void StringThreadModuleRequests::HandleTLSCredentialsRequest(msg_struct_t &RequestMessage, tls_credentials_request_t &Request)
 	{
-		auto *const pData = tls_credentials_request_t::GetMessageData(RequestMessage);
-
-		// Get old credentials if supplied, or create a new one
-		TLSCertificateCredentials credentials = (pData == nullptr ? TLSCertificateCredentials() : std::move(*(pData->Credentials.release())));
+		// Get old credentials
+		TLSCertificateCredentials credentials = std::move(*(Request.Credentials.release()));
 
-		if(pData->RequestReason == PEER_AUTHENTICATION)
+		if(Request.RequestReason == PEER_AUTHENTICATION)
 		{
 			// Find suitable certificate to authenticate with peer
 			// TODO: More than test
@@ -173,11 +163,11 @@ namespace string_thread
 			auto tmpMessage = tls_credentials_answer_t::CreateMessageToReceiver(RequestMessage.Get<MessageSenderIDNum>(), tls_credentials_answer_t(std::move(credentials), extra_data_t((int*)nullptr), true));
 			this->_Memory.GlobalQueue->PushMessage(std::move(tmpMessage));
 		}
-		else if(pData->RequestReason == PEER_VERIFICATION)
+		else if(Request.RequestReason == PEER_VERIFICATION)
 		{
-			assert(pData->RequestData.Get<void>() != nullptr);
+			assert(Request.RequestData.Get<void>() != nullptr);
 
-			const auto *const pCerts = pData->RequestData.Get<string_user_id_and_certs>();
+			const auto *const pCerts = Request.RequestData.Get<string_user_id_and_certs>();
 
 			user_cert_id_vector_t validatableCerts;
 			for(const auto &curUserCertID : pCerts->UserCertIDs)
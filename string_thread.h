@@ -50,9 +50,9 @@ namespace string_thread
 
 			static void RegisterModule(GlobalMessageQueueThread &GlobalQueue, const StringThreadModuleRequestsSharedPtr &Module);
 
-			void HandleModificationRequest(string_user_modification_t &ModificationRequest);
+			void HandleModificationRequest(msg_struct_t &Message, string_user_modification_t &ModificationRequest);
 
-			void HandleUserStorageRequest(msg_struct_t &Request);
+			void HandleUserStorageRequest(msg_struct_t &Message, user_storage_request_t &Request);
 
 		private:
 
@@ -60,7 +60,12 @@ namespace string_thread
 
 			//user_admin_request_t HandleRequest(const user_admin_request_t &Request);
 
-			void HandleTLSCredentialsRequest(msg_struct_t &RequestMessage);
+			void HandleTLSCredentialsRequest(msg_struct_t &RequestMessage, tls_credentials_request_t &Request);
+
+			/*!
+			 * \brief Register a new StringUser
+			 */
+			void HandleRegistration(msg_struct_t &Message, registration_message_t &Registration);
 
 			/*!
 			 * \brief Add all issuers to a given storage
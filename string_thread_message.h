@@ -247,5 +247,17 @@ namespace string_thread_messages
 
 } // namespace string_message
 
+namespace dynamic_pointer
+{
+	/*!
+	 *	\brief Large payloads that are created for every transfer come from their pools
+	 */
+	template<>
+	struct dynamic_pointer_pooled_t<string_thread_messages::user_storage_answer_t>
+	{
+		static constexpr bool value = true;
+	};
+} // namespace dynamic_pointer
+
 
 #endif // STRING_THREAD_MESSAGES_H
@@ -1,7 +1,10 @@
 #include "thread_message_queue.h"
+#include "error_exception.h"
 
 namespace thread_message_queue
 {
+	using namespace error_exception;
+
 	int Mtest()
 	{
 		ThreadMessageQueue<int> test;
@@ -15,4 +18,44 @@ namespace thread_message_queue
 
 		return 1;
 	}
+
+	class TestThreadMessageQueue
+	{
+		public:
+			static bool Testing();
+	};
+
+	bool TestThreadMessageQueue::Testing()
+	{
+		try
+		{
+			ThreadMessageQueue<int> testQueue;
+
+			int testSum = 0;
+			const auto sumMessage = [&testSum] (ThreadMessageQueue<int>::msg_struct_t &Message) { testSum += Message.Get<0>(); };
+
+			// Batches reuse nodes of previous batches
+			for(int curRound = 0; curRound < 100; ++curRound)
+			{
+				const int testBatch[] = {1, 2, 3, 4};
+				testQueue.PushRange(std::begin(testBatch), std::end(testBatch));
+
+				testQueue.PopMessages(3, sumMessage);
+				testQueue.PopMessages(1, sumMessage);
+			}
+
+			if(testSum != 100*10 || testQueue.GetQueueSize() != 0)
+				return 0;
+
+			// Last batch is only recycled by the next PopMessages() call, so two rounds of nodes exist
+			if(testQueue.GetNodeAllocationCount() > 8)
+				return 0;
+
+			return 1;
+		}
+		catch(Exception &)
+		{
+			return 0;
+		}
+	}
 }
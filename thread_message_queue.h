@@ -9,6 +9,7 @@
 #include "message_queue.h"
 #include "testing_class_declaration.h"
 #include <mutex>
+#include <iterator>
 
 /*!
  *  \brief Namespace for ThreadMessageQueue class
@@ -140,6 +141,103 @@ namespace thread_message_queue
 				return tmp;
 			}
 
+			/*!
+			 * \brief Push several messages. List nodes are taken from the spare list or created outside the lock, then spliced in under a second short lock
+			 * \param Begin Forward iterator to first message. Use move iterators to move messages into the queue
+			 * \param End Iterator past last message
+			 */
+			template<class Iterator>
+			void PushRange(Iterator Begin, Iterator End)
+			{
+				size_t numMessages = 0;
+				for(auto curMessage = Begin; curMessage != End; ++curMessage)
+					++numMessages;
+
+				typename message_queue_t::message_list_t newMessages;
+
+				this->_QueueLock.lock();
+
+				const size_t numSpareNodes = this->TakeSpareNodes(numMessages, newMessages);
+
+				this->_QueueLock.unlock();
+
+				// Fill spare nodes and create missing ones before locking again
+				auto curNode = newMessages.begin();
+				for(; Begin != End; ++Begin)
+				{
+					if(curNode != newMessages.end())
+					{
+						*curNode = msg_struct_t(*Begin);
+						++curNode;
+					}
+					else
+						newMessages.push_back(msg_struct_t(*Begin));
+				}
+
+				this->_QueueLock.lock();
+
+				this->_NodeAllocations += numMessages - numSpareNodes;
+				this->_Messages.splice(this->_Messages.end(), newMessages);
+
+				this->_QueueLock.unlock();
+			}
+
+			/*!
+			 * \brief Take NumMessages messages out of the queue with one lock acquisition and handle them outside the lock
+			 * \param NumMessages Number of messages to pop. The queue must contain at least this many messages
+			 * \param Handler Called with each popped message
+			 */
+			template<class MessageHandler>
+			void PopMessages(size_t NumMessages, MessageHandler &&Handler)
+			{
+				this->_QueueLock.lock();
+
+				// Nodes of the last batch can be reused now
+				this->RecycleNodes(this->_PoppedMessages);
+
+				if(NumMessages >= this->_Messages.size())
+				{
+					// Swap out entire queue
+					this->_PoppedMessages.swap(this->_Messages);
+				}
+				else
+				{
+					auto lastMessage = this->_Messages.begin();
+					std::advance(lastMessage, NumMessages);
+
+					this->_PoppedMessages.splice(this->_PoppedMessages.end(), this->_Messages, this->_Messages.begin(), lastMessage);
+				}
+
+				this->_QueueLock.unlock();
+
+				for(auto &curNode : this->_PoppedMessages)
+				{
+					// Move message out of node so that it is destroyed after handling
+					auto curMessage = std::move(curNode);
+					Handler(curMessage);
+				}
+			}
+
+			size_t GetNodeAllocationCount()
+			{
+				this->_QueueLock.lock();
+
+				const size_t nodeAllocations = message_queue_t::GetNodeAllocationCount();
+
+				this->_QueueLock.unlock();
+
+				return nodeAllocations;
+			}
+
+			void SetMaxSpareNodes(size_t MaxSpareNodes)
+			{
+				this->_QueueLock.lock();
+
+				message_queue_t::SetMaxSpareNodes(MaxSpareNodes);
+
+				this->_QueueLock.unlock();
+			}
+
 		public:
 
 			// Should not be used lightly because some messages may get lost
@@ -178,6 +276,11 @@ namespace thread_message_queue
 			 */
 			mutex _QueueLock;
 
+			/*!
+			 * \brief Nodes of the last batch taken by PopMessages(). Only accessed by the popping thread, recycled on the next call
+			 */
+			typename message_queue_t::message_list_t _PoppedMessages;
+
 			template<class U>
 			friend class ::TestingClass;
 	};
@@ -1,5 +1,8 @@
 #include "thread_module_manager.h"
 
+#include <chrono>
+#include <iostream>
+
 namespace thread_module_manager
 {
 	class TestModule : public ThreadModule<int, char>
@@ -36,4 +39,106 @@ namespace thread_module_manager
 
 		return 1;
 	}
+
+	class TestThreadModuleManager
+	{
+		public:
+			static bool Testing();
+
+			/*!
+			 * \brief Measure dispatch time for 1 to 4096 registered modules and print the results
+			 */
+			static void Benchmark();
+
+		private:
+			using test_manager_t = ThreadModuleManager<int, int>;
+
+			class CountModule : public test_manager_t::module_t
+			{
+				public:
+					CountModule(int ID)
+						: test_manager_t::module_t(ID)
+					{}
+
+					void HandleMessage(msg_struct_t &NewData)
+					{
+						this->Count += NewData.Get<1>();
+					}
+
+					size_t Count = 0;
+			};
+
+			static double MeasureDispatch(size_t NumModules, size_t NumMessages);
+	};
+
+	bool TestThreadModuleManager::Testing()
+	{
+		test_manager_t testManager(THREAD_PAUSED);
+
+		auto testModule1 = std::make_shared<CountModule>(1);
+		auto testModule2 = std::make_shared<CountModule>(2);
+
+		testManager.Register(testModule1);
+		testManager.Register(testModule2);
+
+		// Duplicate IDs are rejected
+		try
+		{
+			testManager.Register(std::make_shared<CountModule>(2));
+			return 0;
+		}
+		catch(Exception &)
+		{}
+
+		test_manager_t::msg_struct_t testMessage(2, 5);
+		testManager.PropagateMessageToModule(testMessage, 2);
+		if(testModule1->Count != 0 || testModule2->Count != 5)
+			return 0;
+
+		// Unregistered modules don't receive messages anymore, the others keep their index
+		if(testManager.Unregister(1) != testModule1 || testManager.Unregister(1) != nullptr)
+			return 0;
+
+		testManager.PropagateMessageToModule(testMessage, 1);
+		testManager.PropagateMessageToModule(testMessage, 2);
+		if(testModule1->Count != 0 || testModule2->Count != 10)
+			return 0;
+
+		// Index is moved with the modules
+		test_manager_t movedManager(std::move(testManager));
+		movedManager.PropagateMessageToModule(testMessage, 2);
+		if(testModule2->Count != 15 || movedManager.GetModulesNoLock().size() != 1)
+			return 0;
+
+		return 1;
+	}
+
+	double TestThreadModuleManager::MeasureDispatch(size_t NumModules, size_t NumMessages)
+	{
+		test_manager_t testManager(THREAD_PAUSED);
+
+		for(size_t curModule = 0; curModule < NumModules; ++curModule)
+			testManager.Register(std::make_shared<CountModule>(static_cast<int>(curModule)));
+
+		test_manager_t::msg_struct_t testMessage(0, 1);
+
+		const auto startTime = std::chrono::steady_clock::now();
+
+		for(size_t curMessage = 0; curMessage < NumMessages; ++curMessage)
+			testManager.PropagateMessageToModuleNoLock(testMessage, static_cast<int>(curMessage % NumModules));
+
+		const auto endTime = std::chrono::steady_clock::now();
+
+		return std::chrono::duration<double, std::nano>(endTime - startTime).count() / NumMessages;
+	}
+
+	void TestThreadModuleManager::Benchmark()
+	{
+		static constexpr size_t numMessages = 1000000;
+
+		std::cout << "Modules\tDispatch (ns/message)\n";
+
+		for(size_t numModules = 1; numModules <= 4096; numModules *= 4)
+			std::cout << numModules << "\t" << TestThreadModuleManager::MeasureDispatch(numModules, numMessages) << "\n";
+	}
 }
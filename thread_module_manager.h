@@ -10,6 +10,7 @@
 #include "error_exception.h"
 
 #include <list>
+#include <unordered_map>
 #include <memory>
 #include <functional>
 #include <assert.h>
@@ -22,6 +23,7 @@ namespace thread_module_manager
 	using std::shared_ptr;
 
 	using std::list;
+	using std::unordered_map;
 	using std::mutex;
 
 	using std::atomic;
@@ -37,6 +39,23 @@ namespace thread_module_manager
 	using thread_queued::THREAD_PAUSED;
 	using thread_queued::THREAD_RUNNING;
 	using thread_queued::THREAD_STOPPED;
+	using thread_queued::queue_push_result_t;
+	using thread_queued::queue_overflow_policy_t;
+	using thread_queued::queue_overflow_stats_t;
+	using thread_queued::QUEUE_OVERFLOW_REJECT;
+	using thread_queued::queue_lane_t;
+	using thread_queued::queue_lane_scheduling_t;
+	using thread_queued::queue_lane_weight_t;
+	using thread_queued::drain_timeout_t;
+	using thread_queued::InfiniteDrainTimeout;
+
+	using thread_scheduler::ThreadScheduler;
+
+	using queue_statistics::queue_clock_t;
+	using queue_statistics::queue_duration_t;
+	using queue_statistics::queue_statistics_t;
+	using queue_statistics::latency_histogram_t;
+	using queue_statistics::LatencyHistogram;
 
 	/*!
 	 * \brief Module that can be registered with the manager
@@ -64,11 +83,32 @@ namespace thread_module_manager
 
 			virtual void HandleMessage(msg_struct_t &Parameters) = 0;
 
+			/*!
+			 * \brief Handle a message that the caller no longer needs. Modules that store messages override this to take them without a copy
+			 */
+			virtual void HandleMovedMessage(msg_struct_t &&Parameters)
+			{
+				this->HandleMessage(Parameters);
+			}
+
 			const Identifier &GetID() const
 			{
 				return this->_ID;
 			}
 
+			/*!
+			 * \brief Add the execution time of HandleMessage(). Recorded by the manager while its queue statistics are enabled
+			 */
+			void RecordHandlerTime(const queue_duration_t HandlerTime)
+			{
+				this->_HandlerTime.Record(HandlerTime);
+			}
+
+			latency_histogram_t GetHandlerTime() const
+			{
+				return this->_HandlerTime.GetSnapshot();
+			}
+
 		protected:
 
 			/*!
@@ -76,6 +116,11 @@ namespace thread_module_manager
 			 */
 			Identifier _ID;
 
+			/*!
+			 * \brief Execution times of HandleMessage()
+			 */
+			LatencyHistogram _HandlerTime;
+
 			template<class U>
 			friend class ::TestingClass;
 	};
@@ -83,6 +128,8 @@ namespace thread_module_manager
 	template<class Identifier, class ...ModuleParameters>
 	using ThreadModuleSharedPtr = shared_ptr<ThreadModule<Identifier, ModuleParameters...>>;
 
+	class TestThreadModuleManager;
+
 	/*!
 	 * \brief The ThreadModuleManager class
 	 */
@@ -111,13 +158,19 @@ namespace thread_module_manager
 
 			using module_list_t = list<module_shared_ptr_t>;
 
+			/*!
+			 * \brief Position of each module in _Modules by ID. Identifier must be hashable with std::hash
+			 */
+			using module_index_t = unordered_map<Identifier, typename module_list_t::iterator>;
+
 			/*!
 			 * 	\brief Constructor
 			 */
 			ThreadModuleManager(thread_state_t ThreadState = THREAD_RUNNING)
 				: thread_t(&ThreadModuleManager::MessageCallback, this, THREAD_PAUSED),
 				  _ModuleListLock(),
-				  _Modules()
+				  _Modules(),
+				  _ModuleIndex()
 				  //_MessageCallbackFcn(bind(&ThreadModuleManager::MessageCallback, std::placeholders::_1, std::placeholders::_2))
 			{
 				//this->SetMessageFunction(const_cast<const function<callback_fcn_t>&>(_MessageCallbackFcn).template target<callback_fcn_t>());
@@ -147,13 +200,17 @@ namespace thread_module_manager
 
 				// Check if any modules were added before lock
 				if(this->_Modules.empty())
+				{
 					this->_Modules = std::move(S._Modules);
+					this->RebuildModuleIndexNoLock();
+				}
 				else
 				{
 					// If yes, save the new mocules
 					auto tmpList = std::move(this->_Modules);
 
 					this->_Modules = std::move(S._Modules);
+					this->RebuildModuleIndexNoLock();
 
 					// Reregister these elements
 					for(const auto &curModule : tmpList)
@@ -162,6 +219,9 @@ namespace thread_module_manager
 					}
 				}
 
+				S._ModuleIndex.clear();
+
+				S._ModuleListLock.unlock();
 				this->_ModuleListLock.unlock();
 
 				// Move thread
@@ -187,14 +247,13 @@ namespace thread_module_manager
 			~ThreadModuleManager()
 			{
 				// Stop thread before deleting module vector
-				this->~thread_t();
-
-				// Wait for thread to complete
-				this->Wait();
+				this->ShutdownThread();
 
 				// Erase modules
 				this->_ModuleListLock.lock();
 
+				this->_ModuleIndex.clear();
+
 				auto curModuleIterator = this->_Modules.begin();
 				while(curModuleIterator != this->_Modules.end())
 				{
@@ -222,18 +281,15 @@ namespace thread_module_manager
 				// Lock list
 				this->_ModuleListLock.lock();
 
-				// Check whether module with this ID already exists
-				for(auto curIterator = this->_Modules.begin(); curIterator != this->_Modules.end(); ++curIterator)
+				// Check whether module with this ID exists
+				auto moduleEntry = this->_ModuleIndex.find(IDToUnregister);
+				if(moduleEntry != this->_ModuleIndex.end())
 				{
-					if((*curIterator)->GetID() == IDToUnregister)
-					{
-						// Store shared ptr
-						retVal = *curIterator;
-
-						this->_Modules.erase(curIterator);
+					// Store shared ptr
+					retVal = *(moduleEntry->second);
 
-						break;
-					}
+					this->_Modules.erase(moduleEntry->second);
+					this->_ModuleIndex.erase(moduleEntry);
 				}
 
 				// Unlock list
@@ -242,36 +298,49 @@ namespace thread_module_manager
 				return retVal;
 			}
 
-			template<class FcnIdentifier, class ...FcnModuleParameters>
-			void PushMessage(FcnIdentifier &&ID, FcnModuleParameters &&...Data)
+			typename module_list_t::value_type GetModule(const Identifier &ModuleID)
 			{
-				static_cast<thread_t &>(*this).PushMessage(std::forward<FcnIdentifier>(ID), std::forward<FcnModuleParameters>(Data)...);
-			}
+				// Lock list
+				this->_ModuleListLock.lock();
 
-			template<class FcnMessageStruct>
-			void PushMessage(FcnMessageStruct &&Message)
-			{
-				static_assert(message_queue::template_convertible<FcnMessageStruct, msg_struct_t>::value,
-							  "ERROR ThreadModuleManager::PushMessage(): Function Argument must match template parameter");
+				// Find correct element
+				auto tmpPtr = this->GetModuleNoLock(ModuleID);
 
-				static_cast<thread_t &>(*this).PushMessage(std::forward<FcnMessageStruct>(Message));
+				// Unlock list
+				this->_ModuleListLock.unlock();
+
+				return tmpPtr;
 			}
 
 			template<class FcnIdentifier, class ...FcnModuleParameters>
-			void PushMessageFront(FcnIdentifier &&ID, FcnModuleParameters &&...Data)
+			queue_push_result_t PushMessage(FcnIdentifier &&ID, FcnModuleParameters &&...Data)
 			{
-				static_cast<thread_t &>(*this).PushMessageFront(std::forward<FcnIdentifier>(ID), std::forward<FcnModuleParameters>(Data)...);
+				return static_cast<thread_t &>(*this).PushMessage(std::forward<FcnIdentifier>(ID), std::forward<FcnModuleParameters>(Data)...);
 			}
 
 			template<class FcnMessageStruct>
-			void PushMessageFront(FcnMessageStruct &&Message)
+			queue_push_result_t PushMessage(FcnMessageStruct &&Message)
 			{
 				static_assert(message_queue::template_convertible<FcnMessageStruct, msg_struct_t>::value,
 							  "ERROR ThreadModuleManager::PushMessage(): Function Argument must match template parameter");
 
-				static_cast<thread_t &>(*this).PushMessageFront(std::forward<FcnMessageStruct>(Message));
+				return static_cast<thread_t &>(*this).PushMessage(std::forward<FcnMessageStruct>(Message));
 			}
 
+			/*!
+			 * \brief Push Message even if the queue is full. See ThreadQueuedType::ForcePushMessage()
+			 */
+			template<class FcnMessageStruct>
+			queue_push_result_t ForcePushMessage(FcnMessageStruct &&Message)
+			{
+				return static_cast<thread_t &>(*this).ForcePushMessage(std::forward<FcnMessageStruct>(Message));
+			}
+
+			template<class Iterator>
+			size_t PushMessages(Iterator Begin, Iterator End)
+			{
+				return static_cast<thread_t &>(*this).PushMessages(Begin, End);
+			}
 
 			void SetThreadState(thread_state_t ThreadState)
 			{
@@ -283,11 +352,98 @@ namespace thread_module_manager
 				return thread_t::IsQueueEmpty();
 			}
 
+			bool IsDrained() const
+			{
+				return thread_t::IsDrained();
+			}
+
 			void SetMessageAcceptance(bool AllowNewMessages)
 			{
 				this->thread_t::SetMessageAcceptance(AllowNewMessages);
 			}
 
+			/*!
+			 * \brief Block until all queued messages were handled by the modules
+			 * \return Returns false if the timeout expired or the thread was stopped first
+			 */
+			bool WaitForDrain(drain_timeout_t Timeout = InfiniteDrainTimeout)
+			{
+				return this->thread_t::WaitForDrain(Timeout);
+			}
+
+			/*!
+			 * \brief Handle messages on the workers of Scheduler instead of a dedicated thread. nullptr restarts the dedicated thread
+			 */
+			void SetScheduler(ThreadScheduler *Scheduler)
+			{
+				this->thread_t::SetScheduler(Scheduler);
+			}
+
+			ThreadScheduler *GetScheduler() const
+			{
+				return this->thread_t::GetScheduler();
+			}
+
+			void SetQueueLimit(size_t MaxQueuedMessages, queue_overflow_policy_t OverflowPolicy = QUEUE_OVERFLOW_REJECT)
+			{
+				this->thread_t::SetQueueLimit(MaxQueuedMessages, OverflowPolicy);
+			}
+
+			void SetBatchSize(size_t BatchSize)
+			{
+				this->thread_t::SetBatchSize(BatchSize);
+			}
+
+			void SetLaneScheduling(queue_lane_scheduling_t LaneScheduling)
+			{
+				this->thread_t::SetLaneScheduling(LaneScheduling);
+			}
+
+			void SetLaneWeight(queue_lane_t Lane, queue_lane_weight_t Weight)
+			{
+				this->thread_t::SetLaneWeight(Lane, Weight);
+			}
+
+			bool IsQueueSaturated() const
+			{
+				return this->thread_t::IsQueueSaturated();
+			}
+
+			/*!
+			 * \brief Enable queue statistics and the handler time histograms of all modules
+			 */
+			void SetStatisticsEnabled(bool Enabled)
+			{
+				this->thread_t::SetStatisticsEnabled(Enabled);
+			}
+
+			bool IsStatisticsEnabled() const
+			{
+				return this->thread_t::IsStatisticsEnabled();
+			}
+
+			queue_statistics_t GetQueueStatistics() const
+			{
+				return this->thread_t::GetQueueStatistics();
+			}
+
+			/*!
+			 * \brief Get the handler execution times of module ModuleID. Empty if the module isn't registered
+			 */
+			latency_histogram_t GetModuleHandlerTime(const Identifier &ModuleID)
+			{
+				const auto module = this->GetModule(ModuleID);
+				if(module == nullptr)
+					return latency_histogram_t();
+
+				return module->GetHandlerTime();
+			}
+
+			queue_overflow_stats_t GetOverflowStats() const
+			{
+				return this->thread_t::GetOverflowStats();
+			}
+
 			bool GetMessageAcceptance() const
 			{
 				return this->thread_t::GetMessageAcceptance();
@@ -310,6 +466,11 @@ namespace thread_module_manager
 			 */
 			module_list_t				_Modules;
 
+			/*!
+			 * \brief Index of _Modules. Makes finding the module of a message independent of the number of modules
+			 */
+			module_index_t				_ModuleIndex;
+
 			/*!
 			 * \brief Pointer to function that handles message callbacks
 			 */
@@ -339,49 +500,51 @@ namespace thread_module_manager
 
 			void PropagateMessageToModuleNoLock(msg_struct_t &MessageData, const Identifier &ModuleID)
 			{
-				// Find module
-				auto tmpPtr = this->GetModuleNoLock(ModuleID);
+				// Find module. The list keeps it alive while the lock is held, so no reference is taken
+				auto *const pModule = this->FindModuleNoLock(ModuleID);
 
 				// Handle message
-				if(tmpPtr != nullptr)
-					HandleModuleData(tmpPtr, MessageData);
+				if(pModule != nullptr)
+					HandleModuleData(*pModule, MessageData);
 			}
 
-			typename module_list_t::value_type GetModule(const Identifier &ModuleID)
+			typename module_list_t::value_type GetModuleNoLock(const Identifier &ModuleID)
 			{
-				// Lock list
-				this->_ModuleListLock.lock();
-
 				// Find correct element
-				auto tmpPtr = this->GetModuleNoLock(ModuleID);
+				const auto moduleEntry = this->_ModuleIndex.find(ModuleID);
+				if(moduleEntry != this->_ModuleIndex.end())
+					return *(moduleEntry->second);
 
-				// Unlock list
-				this->_ModuleListLock.unlock();
+				return nullptr;
+			}
 
-				return tmpPtr;
+			/*!
+			 * \brief Find module without taking a reference. Only valid while _ModuleListLock is held
+			 */
+			module_t *FindModuleNoLock(const Identifier &ModuleID)
+			{
+				const auto moduleEntry = this->_ModuleIndex.find(ModuleID);
+				if(moduleEntry != this->_ModuleIndex.end())
+					return moduleEntry->second->get();
+
+				return nullptr;
 			}
 
-			typename module_list_t::value_type GetModuleNoLock(const Identifier &ModuleID)
+			void HandleModuleData(module_t &Module, msg_struct_t &MessageData)
 			{
-				// Find correct element
-				for(const auto &curModule : this->_Modules)
+				if(!this->thread_t::IsStatisticsEnabled())
 				{
-					if(curModule->GetID() == ModuleID)
-					{
-						// Store module pointer in temporary variable
-						return curModule;
+					// Handle message
+					Module.HandleMessage(MessageData);
 
-						break;
-					}
+					return;
 				}
 
-				return nullptr;
-			}
+				const auto handlerStart = queue_clock_t::now();
 
-			void HandleModuleData(typename module_list_t::value_type &Module, msg_struct_t &MessageData)
-			{
-				// Handle message
-				Module->HandleMessage(MessageData);
+				Module.HandleMessage(MessageData);
+
+				Module.RecordHandlerTime(queue_clock_t::now() - handlerStart);
 			}
 
 		private:
@@ -389,23 +552,31 @@ namespace thread_module_manager
 			void RegisterNoLock(const module_shared_ptr_t &NewModule)
 			{
 				// Check whether module with this ID already exists
-				for(const auto &curModule : this->_Modules)
+				if(this->_ModuleIndex.find(NewModule->GetID()) != this->_ModuleIndex.end())
 				{
-					if(curModule->GetID() == NewModule->GetID())
-					{
-						// Unlock list
-						this->_ModuleListLock.unlock();
+					// Unlock list
+					this->_ModuleListLock.unlock();
 
-						throw Exception(ERROR_NUM, "ERROR ThreadModuleManager::Register(): Element with this ID already exists\n");
-					}
+					throw Exception(ERROR_NUM, "ERROR ThreadModuleManager::Register(): Element with this ID already exists\n");
 				}
 
 				// Add Module if not yet registered
 				this->_Modules.push_back(NewModule);
+				this->_ModuleIndex.emplace(NewModule->GetID(), std::prev(this->_Modules.end()));
+			}
+
+			void RebuildModuleIndexNoLock()
+			{
+				this->_ModuleIndex.clear();
+
+				for(auto curIterator = this->_Modules.begin(); curIterator != this->_Modules.end(); ++curIterator)
+					this->_ModuleIndex.emplace((*curIterator)->GetID(), curIterator);
 			}
 
 			template<class U>
 			friend class ::TestingClass;
+
+			friend class TestThreadModuleManager;
 	};
 } // namespace thread_module_manager
 
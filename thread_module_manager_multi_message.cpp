@@ -32,4 +32,130 @@ namespace thread_module_manager_multi_message
 
 		return 1;
 	}
+
+	class TestModuleIDLinkTable
+	{
+		public:
+			static bool Testing();
+	};
+
+	bool TestModuleIDLinkTable::Testing()
+	{
+		using test_table_t = module_id_link_table_t<int>;
+
+		test_table_t testLinks;
+		if(!testLinks.empty() || testLinks.Find(1) != nullptr)
+			return 0;
+
+		// Links are deduplicated and keep their order
+		if(!testLinks.Link(1, 10) || !testLinks.Link(1, 11) || testLinks.Link(1, 10) || !testLinks.Link(2, 10))
+			return 0;
+
+		const auto *const testFanOut = testLinks.Find(1);
+		if(testFanOut == nullptr || *testFanOut != test_table_t::id_vector_t{10, 11})
+			return 0;
+
+		// Linked modules can be looked up without knowing the sending ID
+		if(!testLinks.IsLinkedModule(10) || !testLinks.IsLinkedModule(11) || testLinks.IsLinkedModule(1))
+			return 0;
+
+		// Unlinked IDs are removed from all fan-outs, empty fan-outs are erased
+		testLinks.UnlinkModule(10);
+		if(testLinks.Find(2) != nullptr || *testLinks.Find(1) != test_table_t::id_vector_t{11} || testLinks.IsLinkedModule(10))
+			return 0;
+
+		test_table_t otherLinks;
+		otherLinks.Link(1, 11);
+		otherLinks.Link(1, 12);
+		otherLinks.Link(3, 13);
+
+		testLinks.Merge(otherLinks);
+		if(*testLinks.Find(1) != test_table_t::id_vector_t{11, 12} || *testLinks.Find(3) != test_table_t::id_vector_t{13} || !testLinks.IsLinkedModule(13))
+			return 0;
+
+		return 1;
+	}
+
+	class TestLocalMessages
+	{
+		public:
+			static bool Testing();
+
+		private:
+			using test_manager_t = ThreadModuleManagerMultiMessage<int, int>;
+
+			/*!
+			 * \brief Records the handled values. Forwards value 1 to module 2 and value 2 to module 3
+			 */
+			class TestModule : public test_manager_t::module_t
+			{
+				public:
+					TestModule(int ModuleID, test_manager_t &Manager, vector_type<int> &HandledValues)
+						: test_manager_t::module_t(ModuleID),
+						  _Manager(Manager),
+						  _HandledValues(HandledValues)
+					{}
+
+					void HandleMessage(msg_struct_t &NewData)
+					{
+						const auto value = NewData.Get<2>();
+						if(value < 3)
+						{
+							test_manager_t::msg_struct_t localMessage(this->GetID()+1, this->GetID(), value+1);
+							if(!this->_Manager.PushLocalMessage(localMessage))
+								this->_HandledValues.push_back(-1);
+						}
+
+						this->_HandledValues.push_back(value);
+					}
+
+				private:
+					test_manager_t &_Manager;
+					vector_type<int> &_HandledValues;
+			};
+	};
+
+	bool TestLocalMessages::Testing()
+	{
+		vector_type<int> handledValues;
+
+		test_manager_t testManager;
+		for(int curModuleID = 1; curModuleID <= 3; ++curModuleID)
+			testManager.Register(shared_ptr<TestModule>(new TestModule(curModuleID, testManager, handledValues)));
+
+		// Only handlers of the manager may deliver locally
+		test_manager_t::msg_struct_t testMessage(1, 0, 1);
+		if(testManager.PushLocalMessage(testMessage))
+			return 0;
+
+		testManager.PushMessage(std::move(testMessage));
+		if(!testManager.WaitForDrain())
+			return 0;
+
+		// Local messages are handled after the sending handler returned
+		if(handledValues != vector_type<int>{1, 2, 3})
+			return 0;
+
+		// Claimed messages of the same batch that weren't handled yet must not be overtaken
+		handledValues.clear();
+		testManager.SetThreadState(THREAD_PAUSED);
+		testManager.SetBatchSize(2);
+		testManager.PushMessage(test_manager_t::msg_struct_t(1, 0, 1));
+		testManager.PushMessage(test_manager_t::msg_struct_t(3, 0, 10));
+		testManager.SetThreadState(THREAD_RUNNING);
+
+		if(!testManager.WaitForDrain() || handledValues != vector_type<int>{-1, 1, 10})
+			return 0;
+
+		// Deferred messages count towards the queue limit. Once it is reached, they must be pushed normally
+		handledValues.clear();
+		testManager.SetBatchSize(1);
+		testManager.SetQueueLimit(2, thread_queued::QUEUE_OVERFLOW_REJECT);
+		testManager.PushMessage(test_manager_t::msg_struct_t(1, 0, 1));
+
+		if(!testManager.WaitForDrain() || handledValues != vector_type<int>{1, -1, 2})
+			return 0;
+
+		return 1;
+	}
 }
@@ -10,13 +10,23 @@
 #include "thread_module_manager.h"
 #include "vector_t.h"
 
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
 /*!
  *  \brief Namespace for ThreadModuleManagerMultiMessage class
  */
 namespace thread_module_manager_multi_message
 {
 	using std::mutex;
+	using std::lock_guard;
 	using std::shared_ptr;
+	using std::unordered_map;
+	using std::unordered_set;
+	using std::atomic;
 
 	using vector_t::vector_type;
 
@@ -29,6 +39,7 @@ namespace thread_module_manager_multi_message
 	using thread_module_manager::THREAD_PAUSED;
 	using thread_module_manager::THREAD_RUNNING;
 	using thread_module_manager::THREAD_STOPPED;
+	using thread_module_manager::queue_push_result_t;
 
 	template<class ...MessageParameters>
 	using message_shared_ptr_t = shared_ptr<message_struct_t<MessageParameters...>>;
@@ -63,22 +74,112 @@ namespace thread_module_manager_multi_message
 		{}
 	};
 
+	/*!
+	 * \brief Hashed link table. Stores the deduplicated fan-out of each sending ID, so that resolving the links of a message is one lookup. The fan-out is only changed when links are added or removed
+	 */
 	template<class Identifier>
-	using module_id_link_vector_type = vector_type<module_id_link_t<Identifier>>;
-
-	template<class Identifier>
-	struct module_id_link_vector_t : public module_id_link_vector_type<Identifier>
+	class module_id_link_table_t
 	{
-		typename module_id_link_vector_t::iterator Find(const Identifier &SendID)
-		{
-			for(auto curIterator = module_id_link_vector_t::begin(); curIterator != module_id_link_vector_t::end(); ++curIterator)
+		public:
+			using id_vector_t = module_id_vector_t<Identifier>;
+			using id_link_t = module_id_link_t<Identifier>;
+
+			/*!
+			 * \brief Get the IDs linked to SendID
+			 * \return Returns nullptr if SendID has no links
+			 */
+			const id_link_t *Find(const Identifier &SendID) const
 			{
-				if(curIterator->SendID == SendID)
-					return curIterator;
+				const auto curLink = this->_Links.find(SendID);
+				if(curLink == this->_Links.end())
+					return nullptr;
+
+				return &(curLink->second);
 			}
 
-			return module_id_link_vector_t::end();
-		}
+			/*!
+			 * \brief Check whether ModuleID is linked to any sending ID
+			 */
+			bool IsLinkedModule(const Identifier &ModuleID) const
+			{
+				return this->_LinkedModules.find(ModuleID) != this->_LinkedModules.end();
+			}
+
+			/*!
+			 * \brief Link ModuleID to SendID
+			 * \return Returns false if they were already linked
+			 */
+			bool Link(const Identifier &SendID, const Identifier &ModuleID)
+			{
+				auto curLink = this->_Links.find(SendID);
+				if(curLink == this->_Links.end())
+				{
+					this->_Links.emplace(SendID, id_link_t(SendID, id_vector_t{ModuleID}));
+					this->_LinkedModules.insert(ModuleID);
+					return true;
+				}
+
+				if(curLink->second.Find(ModuleID) != curLink->second.end())
+					return false;
+
+				curLink->second.push_back(ModuleID);
+				this->_LinkedModules.insert(ModuleID);
+				return true;
+			}
+
+			/*!
+			 * \brief Remove ModuleID from all links. Sending IDs without links are erased
+			 */
+			void UnlinkModule(const Identifier &ModuleID)
+			{
+				for(auto curLink = this->_Links.begin(); curLink != this->_Links.end();)
+				{
+					auto &linkedIDs = curLink->second;
+					linkedIDs.erase(std::remove(linkedIDs.begin(), linkedIDs.end(), ModuleID), linkedIDs.end());
+
+					if(linkedIDs.empty())
+						curLink = this->_Links.erase(curLink);
+					else
+						++curLink;
+				}
+
+				this->_LinkedModules.erase(ModuleID);
+			}
+
+			/*!
+			 * \brief Add all links of OtherLinks
+			 */
+			void Merge(const module_id_link_table_t &OtherLinks)
+			{
+				for(const auto &curLink : OtherLinks._Links)
+				{
+					for(const auto &curModuleID : curLink.second)
+						this->Link(curLink.first, curModuleID);
+				}
+			}
+
+			bool empty() const
+			{
+				return this->_Links.empty();
+			}
+
+			void clear()
+			{
+				this->_Links.clear();
+				this->_LinkedModules.clear();
+			}
+
+		private:
+
+			/*!
+			 * \brief Linked IDs by sending ID. Identifier must be hashable with std::hash
+			 */
+			unordered_map<Identifier, id_link_t> _Links;
+
+			/*!
+			 * \brief All IDs that appear in _Links
+			 */
+			unordered_set<Identifier> _LinkedModules;
 	};
 
 	/*!
@@ -106,7 +207,7 @@ namespace thread_module_manager_multi_message
 
 			using id_vector_t = typename id_link_t::id_vector_t;
 
-			using id_link_vector_t = module_id_link_vector_t<Identifier>;
+			using id_link_table_t = module_id_link_table_t<Identifier>;
 
 			/*!
 			 * 	\brief Constructor
@@ -162,37 +263,31 @@ namespace thread_module_manager_multi_message
 			~ThreadModuleManagerMultiMessage()
 			{
 				// Stop thread before deleting Link list
-				this->~module_manager_t();
+				this->ShutdownThread();
 			}
 
 			void AddSendLink(const Identifier &SendID, const Identifier &ModuleID)
 			{
 				// Lock vector
-				this->_LockLinks.lock();
+				lock_guard<mutex> linkLock(this->_LockLinks);
 
 				// Link this ID
 				ThreadModuleManagerMultiMessage::LinkIDsNoLock(this->_SenderIDLinks, SendID, ModuleID);
-
-				// Unlock vector
-				this->_LockLinks.unlock();
 			}
 
 			void AddReceiverLink(const Identifier &ReceiverID, const Identifier &ModuleID)
 			{
 				// Lock vector
-				this->_LockLinks.lock();
+				lock_guard<mutex> linkLock(this->_LockLinks);
 
 				// Link this ID
 				ThreadModuleManagerMultiMessage::LinkIDsNoLock(this->_ReceiverIDLinks, ReceiverID, ModuleID);
-
-				// Unlock vector
-				this->_LockLinks.unlock();
 			}
 
 			void Register(const module_shared_ptr_t &NewModule, const id_vector_t SendIDs, const id_vector_t ReceiverIDs)
 			{
-				// Lock vector
-				this->_LockLinks.lock();
+				// Lock vector. Released as well if the module ID is already registered
+				lock_guard<mutex> linkLock(this->_LockLinks);
 
 				this->Register(NewModule);
 
@@ -207,9 +302,6 @@ namespace thread_module_manager_multi_message
 				{
 					ThreadModuleManagerMultiMessage::LinkIDsNoLock(this->_ReceiverIDLinks, curID, NewModule->GetID());
 				}
-
-				// Unlock vector
-				this->_LockLinks.unlock();
 			}
 
 			void Register(const module_shared_ptr_t &NewModule)
@@ -220,7 +312,7 @@ namespace thread_module_manager_multi_message
 			module_shared_ptr_t Unregister(const Identifier &ModuleID)
 			{
 				// Lock vector
-				this->_LockLinks.lock();
+				lock_guard<mutex> linkLock(this->_LockLinks);
 
 				// Store return value
 				const auto retValue = this->module_manager_t::Unregister(ModuleID);
@@ -228,42 +320,64 @@ namespace thread_module_manager_multi_message
 				// Unlink module
 				UnlinkModuleNoLock(ModuleID);
 
-				// Unlock vector
-				this->_LockLinks.unlock();
-
 				return retValue;
 			}
 
 			template<class FcnMessageStruct>
-			void PushMessage(FcnMessageStruct &&MessageStruct)
+			queue_push_result_t PushMessage(FcnMessageStruct &&MessageStruct)
 			{
-				this->module_manager_t::PushMessage(std::forward<FcnMessageStruct>(MessageStruct));
+				return this->module_manager_t::PushMessage(std::forward<FcnMessageStruct>(MessageStruct));
 			}
 
 			template<class FcnIdentifier1, class FcnIdentifier2, class ...FcnMessageParameters>
-			void PushMessage(FcnIdentifier1 &&ReceiveID, FcnIdentifier2 &&SendID, FcnMessageParameters &&...Data)
+			queue_push_result_t PushMessage(FcnIdentifier1 &&ReceiveID, FcnIdentifier2 &&SendID, FcnMessageParameters &&...Data)
 			{
 				// Move message parameters into shared pointer
 				//auto tmpPtr = module_extra_message_shared_ptr_t(new module_extra_message_t(std::forward<FcnMessageParameters>(Data)...));
 
 				// Push message
-				this->module_manager_t::PushMessage(std::forward<FcnIdentifier1>(ReceiveID), std::forward<FcnIdentifier2>(SendID), std::forward<FcnMessageParameters>(Data)...);
+				return this->module_manager_t::PushMessage(std::forward<FcnIdentifier1>(ReceiveID), std::forward<FcnIdentifier2>(SendID), std::forward<FcnMessageParameters>(Data)...);
 			}
 
-			template<class FcnMessageStruct>
-			void PushMessageFront(FcnMessageStruct &&MessageStruct)
+			/*!
+			 * \brief Deliver Message to a module of this manager once the running handler returned, without passing through the queue
+			 *
+			 * Only possible from a handler of this manager, for receivers registered or linked here, and while no pushed message could be overtaken,
+			 * including messages of the current batch that weren't handled yet. Deferred messages take a slot of the queue until they were handled,
+			 * so they count towards its limit. Deferred messages are handled before the next queued message
+			 * \param Message Message to deliver. Moved from if delivery was accepted
+			 * \return Returns false if Message must be pushed normally. This is the case if the queue is full, so that the overflow policy applies
+			 */
+			bool PushLocalMessage(msg_struct_t &Message)
 			{
-				this->module_manager_t::PushMessageFront(std::forward<FcnMessageStruct>(MessageStruct));
-			}
+				if(this->_DispatchThread != std::this_thread::get_id())
+					return false;
 
-			template<class FcnIdentifier1, class FcnIdentifier2, class ...FcnMessageParameters>
-			void PushMessageFront(FcnIdentifier1 &&ReceiveID, FcnIdentifier2 &&SendID, FcnMessageParameters &&...Data)
-			{
-				// Move message parameters into shared pointer
-				//auto tmpPtr = module_extra_message_shared_ptr_t(new module_extra_message_t(std::forward<FcnMessageParameters>(Data)...));
+				// Apart from the running handler's message, every slot must belong to a deferred message
+				if(this->GetUnhandledMessages() != 1 + this->_ReservedLocalMessages)
+					return false;
 
-				// Push message
-				this->module_manager_t::PushMessageFront(std::forward<FcnIdentifier1>(ReceiveID), std::forward<FcnIdentifier2>(SendID), std::forward<FcnMessageParameters>(Data)...);
+				// The dispatching thread holds both locks while a handler runs
+				const auto &receiverID = Message.template Get<_ParamReceiveIDNumber>();
+				if(this->FindModuleNoLock(receiverID) == nullptr && this->_ReceiverIDLinks.Find(receiverID) == nullptr)
+					return false;
+
+				if(!this->ReserveUnqueuedMessage())
+					return false;
+
+				try
+				{
+					this->_LocalMessages.push_back(std::move(Message));
+				}
+				catch(...)
+				{
+					this->ReleaseUnqueuedMessage();
+					throw;
+				}
+
+				++this->_ReservedLocalMessages;
+
+				return true;
 			}
 
 			void UnlinkModuleNoLock(const Identifier &ModuleIDToUnlink)
@@ -277,41 +391,43 @@ namespace thread_module_manager_multi_message
 			/*!
 			 * \brief Links between Sended IDs and the receiving module's IDs
 			 */
-			id_link_vector_t	_SenderIDLinks;
+			id_link_table_t		_SenderIDLinks;
 
 			/*!
 			 * \brief Links between Receiver ID and other receiving module's IDs
 			 */
-			id_link_vector_t	_ReceiverIDLinks;
+			id_link_table_t		_ReceiverIDLinks;
 
 			/*!
 			 * \brief Lock the links vector
 			 */
 			mutex				_LockLinks;
 
-			static void LinkIDsNoLock(id_link_vector_t &IDLinks, const Identifier &SendID, const Identifier &ModuleID)
+			static void LinkIDsNoLock(id_link_table_t &IDLinks, const Identifier &SendID, const Identifier &ModuleID)
 			{
-				// Link module ID to all SendIDs that are requested
-				auto curSendIterator = IDLinks.Find(SendID);
-
-				// Add to vector if not yet present
-				if(curSendIterator == IDLinks.end())
-				{
-					IDLinks.push_back(id_link_t(SendID, id_vector_t{ModuleID}));
-				}
-				else
-				{
-					auto curModuleIterator = curSendIterator->Find(ModuleID);
-					if(curModuleIterator == curSendIterator->end())
-					{
-						// Add module ID if not yet present
-						curSendIterator->push_back(ModuleID);
-					}
-				}
+				// Add module ID if not yet present
+				IDLinks.Link(SendID, ModuleID);
 			}
 
 		private:
 
+			/*!
+			 * \brief Thread that is currently running a handler of this manager
+			 */
+			atomic<std::thread::id> _DispatchThread{};
+
+			/*!
+			 * \brief Messages between modules of this manager, see PushLocalMessage(). Only accessed by the dispatching thread
+			 */
+			vector_type<msg_struct_t> _LocalMessages;
+
+			/*!
+			 * \brief Number of deferred messages that still hold a queue slot. Only accessed by the dispatching thread
+			 */
+			size_t _ReservedLocalMessages = 0;
+
+		protected:
+
 			/*!
 			 * \brief Function that handles a message
 			 * \param MessageData Data of message
@@ -323,36 +439,62 @@ namespace thread_module_manager_multi_message
 				// Lock Links
 				pClass->_LockLinks.lock();
 
+				pClass->_DispatchThread = std::this_thread::get_id();
+
+				pClass->PropagateMessageNoLock(MessageData);
+
+				// Handle messages the modules sent each other. Handlers may add more
+				for(size_t curLocalMessage = 0; curLocalMessage < pClass->_LocalMessages.size(); ++curLocalMessage)
+				{
+					auto localMessage = std::move(pClass->_LocalMessages[curLocalMessage]);
+					pClass->PropagateMessageNoLock(localMessage);
+
+					--pClass->_ReservedLocalMessages;
+					pClass->ReleaseUnqueuedMessage();
+				}
+
+				pClass->_LocalMessages.clear();
+
+				pClass->_DispatchThread = std::thread::id();
+
+				// Unlock list
+				pClass->_LockLinks.unlock();
+			}
+
+		private:
+
+			/*!
+			 * \brief Send message to its receiver and all linked modules. _LockLinks must be held
+			 */
+			void PropagateMessageNoLock(msg_struct_t &MessageData)
+			{
 				// Send message data to Receiver module
-				pClass->module_manager_t::PropagateMessageToModule(MessageData, MessageData.template Get<pClass->_ParamReceiveIDNumber>());
+				this->module_manager_t::PropagateMessageToModule(MessageData, MessageData.template Get<_ParamReceiveIDNumber>());
 
 				// Get all ModuleIDs linked to this send ID
-				auto receiverIDIterator = pClass->_ReceiverIDLinks.Find(MessageData.template Get<pClass->_ParamReceiveIDNumber>());
-				if(receiverIDIterator != pClass->_ReceiverIDLinks.end())
+				const auto *const receiverIDLinks = this->_ReceiverIDLinks.Find(MessageData.template Get<_ParamReceiveIDNumber>());
+				if(receiverIDLinks != nullptr)
 				{
-					for(auto &curID : *receiverIDIterator)
+					for(const auto &curID : *receiverIDLinks)
 					{
 						// Send message data to module
-						pClass->module_manager_t::PropagateMessageToModule(MessageData, curID);
+						this->module_manager_t::PropagateMessageToModule(MessageData, curID);
 					}
 				}
 
 				// Get all ModuleIDs linked to this send ID
-				auto sendIDIterator = pClass->_SenderIDLinks.Find(MessageData.template Get<pClass->_ParamSendIDNumber>());
-				if(sendIDIterator != pClass->_SenderIDLinks.end())
+				const auto *const sendIDLinks = this->_SenderIDLinks.Find(MessageData.template Get<_ParamSendIDNumber>());
+				if(sendIDLinks != nullptr)
 				{
-					for(auto &curID : *sendIDIterator)
+					for(const auto &curID : *sendIDLinks)
 					{
 						// Send message data to module
-						pClass->module_manager_t::PropagateMessageToModule(MessageData, curID);
+						this->module_manager_t::PropagateMessageToModule(MessageData, curID);
 					}
 				}
-
-				// Unlock list
-				pClass->_LockLinks.unlock();
 			}
 
-			static void MoveLinksNoLock(id_link_vector_t &CurLinks, id_link_vector_t &OtherLinks)
+			static void MoveLinksNoLock(id_link_table_t &CurLinks, id_link_table_t &OtherLinks)
 			{
 				// Check if links were added before lock
 				if(CurLinks.empty())
@@ -361,58 +503,15 @@ namespace thread_module_manager_multi_message
 				}
 				else
 				{
-					auto tmpIDLinks = std::move(CurLinks);
-
-					CurLinks = std::move(OtherLinks);
-
-					for(const auto &curIDLink : tmpIDLinks)
-					{
-						// Check if it exists already
-						auto curLinkIterator = tmpIDLinks.Find(curIDLink.SendID);
-
-						if(curLinkIterator != tmpIDLinks.end())
-							CurLinks.push_back(curIDLink);
-						else
-						{
-							// If they exist, check if modules already registered
-							for(const auto &curModuleID : curIDLink)
-							{
-								auto curModuleIterator = curLinkIterator->Find(curModuleID);
-
-								// If not, register it
-								if(curModuleIterator == curLinkIterator->end())
-									curLinkIterator->push_back(curModuleID);
-							}
-						}
-					}
+					CurLinks.Merge(OtherLinks);
 				}
+
+				OtherLinks.clear();
 			}
 
-			static void UnlinkModuleNoLock(id_link_vector_t &IDLinks, const Identifier &ModuleIDToUnlink)
+			static void UnlinkModuleNoLock(id_link_table_t &IDLinks, const Identifier &ModuleIDToUnlink)
 			{
-				for(auto idIterator = IDLinks.begin(); idIterator != IDLinks.end(); ++idIterator)
-				{
-					// Continue Finding the moduleID until all elements are erased
-					// NOTE: This is inefficient, but easily readable. Maybe change it later
-					do
-					{
-						auto moduleIDIterator = idIterator->Find(ModuleIDToUnlink);
-
-						if(moduleIDIterator != idIterator->end())
-						{
-							 idIterator->erase(moduleIDIterator);
-						}
-						else
-						{
-							break;
-						}
-					}
-					while(1);
-
-					// If empty, erase ID
-					if(idIterator->empty())
-						idIterator = IDLinks.erase(idIterator) - 1;
-				}
+				IDLinks.UnlinkModule(ModuleIDToUnlink);
 			}
 
 			template<class U>
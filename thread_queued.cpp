@@ -1,4 +1,8 @@
 #include "thread_queued.h"
+#include "error_exception.h"
+
+#include <vector>
+#include <memory>
 
 namespace thread_queued
 {	
@@ -27,4 +31,513 @@ namespace thread_queued
 
 		return  1;
 	}
+
+	using test_lane_message_t = message_struct_t<int, queue_lane_t>;
+
+	/*!
+	 * \brief Test messages carry their lane as second parameter
+	 */
+	template<>
+	struct queue_lane_selector_t<test_lane_message_t>
+	{
+		static queue_lane_t GetLane(const test_lane_message_t &Message)
+		{
+			return Message.Get<1>();
+		}
+
+		static queue_lane_t GetLane(const int &, const queue_lane_t &Lane)
+		{
+			return Lane;
+		}
+	};
+
+	class TestThreadQueued
+	{
+		public:
+			static bool Testing();
+
+		private:
+			static void CountMessage(message_struct_t<int> &Message, void *Counter);
+			static void RecordMessage(test_lane_message_t &Message, void *Messages);
+			static void SlowCountMessage(message_struct_t<int> &Message, void *Counter);
+			static void ExclusiveCountMessage(message_struct_t<int> &Message, void *Counter);
+			static void LatchedCountMessage(message_struct_t<int> &Message, void *Counter);
+			static void UncountMessage(message_struct_t<int> &Message, void *Counter);
+
+			/*!
+			 * \brief Maximum time a test waits for a queue. Only reached if the test fails
+			 */
+			static constexpr drain_timeout_t TestTimeout = std::chrono::seconds(10);
+
+			/*!
+			 * \brief Counter that detects concurrent handlers
+			 */
+			struct test_exclusive_counter_t
+			{
+				atomic<int> ActiveHandlers;
+				atomic<int> Counter;
+				atomic<bool> Overlapped;
+			};
+
+			/*!
+			 * \brief Counter whose handler waits until the test releases a message
+			 */
+			struct test_latch_counter_t
+			{
+				atomic<int> Permits;
+				atomic<int> StartedHandlers;
+				atomic<int> Counter;
+			};
+
+			/*!
+			 * \brief Waits until Condition returns true. Returns false if TestTimeout passed first
+			 */
+			template<class ConditionFcn>
+			static bool WaitForCondition(ConditionFcn Condition);
+
+			static bool TestLanes();
+			static bool TestStatistics();
+			static bool TestDrain();
+			static bool TestBatchLimit();
+			static bool TestDropFunction();
+			static bool TestForcePush();
+			static bool TestScheduler();
+	};
+
+	void TestThreadQueued::CountMessage(message_struct_t<int> &Message, void *Counter)
+	{
+		*static_cast<atomic<int>*>(Counter) += Message.Get<0>();
+	}
+
+	void TestThreadQueued::SlowCountMessage(message_struct_t<int> &Message, void *Counter)
+	{
+		SleepForMs(5000);
+
+		*static_cast<atomic<int>*>(Counter) += Message.Get<0>();
+	}
+
+	void TestThreadQueued::ExclusiveCountMessage(message_struct_t<int> &Message, void *Counter)
+	{
+		auto *const testCounter = static_cast<test_exclusive_counter_t*>(Counter);
+
+		if(++testCounter->ActiveHandlers != 1)
+			testCounter->Overlapped = true;
+
+		testCounter->Counter += Message.Get<0>();
+
+		testCounter->ActiveHandlers--;
+	}
+
+	void TestThreadQueued::UncountMessage(message_struct_t<int> &Message, void *Counter)
+	{
+		*static_cast<atomic<int>*>(Counter) -= Message.Get<0>();
+	}
+
+	void TestThreadQueued::LatchedCountMessage(message_struct_t<int> &Message, void *Counter)
+	{
+		auto *const testCounter = static_cast<test_latch_counter_t*>(Counter);
+
+		++testCounter->StartedHandlers;
+
+		// Only one handler runs at a time, no other thread takes permits
+		while(testCounter->Permits == 0)
+			SleepForMs(100);
+
+		--testCounter->Permits;
+		testCounter->Counter += Message.Get<0>();
+	}
+
+	template<class ConditionFcn>
+	bool TestThreadQueued::WaitForCondition(ConditionFcn Condition)
+	{
+		const auto deadline = std::chrono::steady_clock::now() + TestTimeout;
+		while(!Condition())
+		{
+			if(std::chrono::steady_clock::now() > deadline)
+				return false;
+
+			SleepForMs(100);
+		}
+
+		return true;
+	}
+
+	void TestThreadQueued::RecordMessage(test_lane_message_t &Message, void *Messages)
+	{
+		static_cast<std::vector<int>*>(Messages)->push_back(Message.Get<0>());
+	}
+
+	bool TestThreadQueued::TestLanes()
+	{
+		std::vector<int> handledMessages;
+
+		ThreadQueued<int, queue_lane_t> testQueue(&TestThreadQueued::RecordMessage, &handledMessages, THREAD_PAUSED);
+
+		// Strict scheduling handles control messages first, order within a lane is kept
+		testQueue.SetLaneScheduling(QUEUE_LANES_STRICT);
+		for(int curMessage = 0; curMessage < 4; ++curMessage)
+		{
+			testQueue.PushMessage(10+curMessage, QUEUE_LANE_BULK);
+			testQueue.PushMessage(curMessage, QUEUE_LANE_CONTROL);
+		}
+
+		testQueue.SetThreadState(THREAD_RUNNING);
+		if(!testQueue.WaitForDrain(TestTimeout) || handledMessages != std::vector<int>{0, 1, 2, 3, 10, 11, 12, 13})
+			return 0;
+
+		// Weighted scheduling alternates between lanes according to their weights
+		testQueue.SetThreadState(THREAD_PAUSED);
+		testQueue.SetLaneScheduling(QUEUE_LANES_WEIGHTED);
+		testQueue.SetLaneWeight(QUEUE_LANE_CONTROL, 2);
+		testQueue.SetLaneWeight(QUEUE_LANE_BULK, 1);
+		handledMessages.clear();
+
+		std::vector<test_lane_message_t> testBatch;
+		for(int curMessage = 0; curMessage < 4; ++curMessage)
+		{
+			testBatch.push_back(test_lane_message_t(10+curMessage, QUEUE_LANE_BULK));
+			testBatch.push_back(test_lane_message_t(curMessage, QUEUE_LANE_CONTROL));
+		}
+
+		if(testQueue.PushMessages(testBatch.begin(), testBatch.end()) != testBatch.size())
+			return 0;
+
+		testQueue.SetThreadState(THREAD_RUNNING);
+		if(!testQueue.WaitForDrain(TestTimeout) || handledMessages != std::vector<int>{0, 1, 10, 2, 3, 11, 12, 13})
+			return 0;
+
+		// Drop oldest discards messages of the least important lane first
+		testQueue.SetThreadState(THREAD_PAUSED);
+		testQueue.SetQueueLimit(2, QUEUE_OVERFLOW_DROP_OLDEST);
+		handledMessages.clear();
+
+		testQueue.PushMessage(20, QUEUE_LANE_BULK);
+		testQueue.PushMessage(1, QUEUE_LANE_CONTROL);
+		if(testQueue.PushMessage(2, QUEUE_LANE_CONTROL) != QUEUE_PUSH_DROPPED_OLDEST || !testQueue.IsLaneEmpty(QUEUE_LANE_BULK))
+			return 0;
+
+		testQueue.SetThreadState(THREAD_RUNNING);
+		if(!testQueue.WaitForDrain(TestTimeout) || handledMessages != std::vector<int>{1, 2})
+			return 0;
+
+		return 1;
+	}
+
+	bool TestThreadQueued::Testing()
+	{
+		try
+		{
+			atomic<int> testCounter(0);
+
+			ThreadQueued<int> testQueue(&TestThreadQueued::CountMessage, &testCounter, THREAD_PAUSED, 1, THREAD_WAIT_BLOCKING);
+
+			// Paused thread must not process messages
+			testQueue.PushMessage(1);
+			if(testQueue.WaitForDrain(drain_timeout_t(10000)) || testCounter != 0 || testQueue.IsQueueEmpty())
+				return 0;
+
+			// Resuming must wake the parked thread
+			testQueue.SetThreadState(THREAD_RUNNING);
+			if(!testQueue.WaitForDrain(TestTimeout) || testCounter != 1 || !testQueue.IsQueueEmpty())
+				return 0;
+
+			// Pushing must wake the parked thread
+			testQueue.PushMessage(2);
+			if(!testQueue.WaitForDrain(TestTimeout) || testCounter != 3)
+				return 0;
+
+			// Same for spinning mode
+			testQueue.SetWaitMode(THREAD_WAIT_SPIN_BLOCKING, 10);
+			testQueue.PushMessage(3);
+			if(!testQueue.WaitForDrain(TestTimeout) || testCounter != 6)
+				return 0;
+
+			// Bounded queue rejects messages once full
+			testQueue.SetThreadState(THREAD_PAUSED);
+			testQueue.SetQueueLimit(2, QUEUE_OVERFLOW_REJECT);
+			testCounter = 0;
+
+			if(testQueue.PushMessage(1) != QUEUE_PUSH_SUCCESS ||
+					testQueue.PushMessage(2) != QUEUE_PUSH_SUCCESS ||
+					!testQueue.IsQueueSaturated() ||
+					testQueue.PushMessage(4) != QUEUE_PUSH_REJECTED)
+				return 0;
+
+			// Drop newest discards the pushed message
+			testQueue.SetQueueLimit(2, QUEUE_OVERFLOW_DROP_NEWEST);
+			if(testQueue.PushMessage(8) != QUEUE_PUSH_DROPPED_NEWEST)
+				return 0;
+
+			// Drop oldest discards the first message
+			testQueue.SetQueueLimit(2, QUEUE_OVERFLOW_DROP_OLDEST);
+			if(testQueue.PushMessage(16) != QUEUE_PUSH_DROPPED_OLDEST)
+				return 0;
+
+			testQueue.SetThreadState(THREAD_RUNNING);
+			if(!testQueue.WaitForDrain(TestTimeout) || testCounter != 2+16 || testQueue.IsQueueSaturated())
+				return 0;
+
+			const auto overflowStats = testQueue.GetOverflowStats();
+			if(overflowStats.RejectedMessages != 1 || overflowStats.DroppedNewestMessages != 1 || overflowStats.DroppedOldestMessages != 1)
+				return 0;
+
+			// Blocked producer continues once the thread frees a slot
+			testQueue.SetThreadState(THREAD_PAUSED);
+			testQueue.SetQueueLimit(1, QUEUE_OVERFLOW_BLOCK);
+			testCounter = 0;
+
+			testQueue.PushMessage(1);
+			std::thread blockedProducer([&testQueue]() { testQueue.PushMessage(2); });
+
+			if(!TestThreadQueued::WaitForCondition([&testQueue]() { return testQueue.GetOverflowStats().BlockedPushes == 1; }) || testCounter != 0)
+			{
+				testQueue.SetThreadState(THREAD_RUNNING);
+				blockedProducer.join();
+				return 0;
+			}
+
+			testQueue.SetThreadState(THREAD_RUNNING);
+			blockedProducer.join();
+			if(!testQueue.WaitForDrain(TestTimeout) || testCounter != 3)
+				return 0;
+
+			// Batched push and drain
+			testQueue.SetQueueLimit(UnboundedQueueSize);
+			testQueue.SetBatchSize(4);
+			testQueue.SetThreadState(THREAD_PAUSED);
+			testCounter = 0;
+
+			std::vector<message_struct_t<int>> testBatch;
+			for(int curMessage = 1; curMessage <= 10; ++curMessage)
+				testBatch.push_back(message_struct_t<int>(curMessage));
+
+			if(testQueue.PushMessages(testBatch.begin(), testBatch.end()) != 10)
+				return 0;
+
+			testQueue.SetThreadState(THREAD_RUNNING);
+			if(!testQueue.WaitForDrain(TestTimeout) || testCounter != 55 || !testQueue.IsQueueEmpty())
+				return 0;
+
+			return TestThreadQueued::TestLanes() && TestThreadQueued::TestStatistics() && TestThreadQueued::TestDrain() && TestThreadQueued::TestBatchLimit() && TestThreadQueued::TestDropFunction() && TestThreadQueued::TestForcePush() && TestThreadQueued::TestScheduler();
+		}
+		catch(error_exception::Exception &)
+		{
+			return 0;
+		}
+	}
+
+	bool TestThreadQueued::TestStatistics()
+	{
+		atomic<int> testCounter(0);
+
+		ThreadQueued<int> testQueue(&TestThreadQueued::CountMessage, &testCounter, THREAD_PAUSED);
+
+		// Messages pushed without statistics aren't counted
+		testQueue.PushMessage(1);
+		testQueue.SetStatisticsEnabled(true);
+
+		testQueue.PushMessage(2);
+
+		std::vector<message_struct_t<int>> testBatch{message_struct_t<int>(3), message_struct_t<int>(4)};
+		testQueue.PushMessages(testBatch.begin(), testBatch.end());
+
+		auto stats = testQueue.GetQueueStatistics();
+		if(stats.EnqueuedMessages != 3 || stats.QueueDepth != 3 || stats.MaxQueueDepth != 3 || stats.DequeuedMessages != 0)
+			return 0;
+
+		// Let the messages wait for at least 10ms
+		SleepForMs(10000);
+		testQueue.SetThreadState(THREAD_RUNNING);
+		if(!testQueue.WaitForDrain(TestTimeout))
+			return 0;
+
+		stats = testQueue.GetQueueStatistics();
+		if(testCounter != 10 || stats.DequeuedMessages != 3 || stats.QueueDepth != 0 || stats.MaxQueueDepth != 3)
+			return 0;
+
+		// All timestamped messages waited while the thread was paused
+		if(stats.SojournTime.NumSamples != 3 || stats.SojournTime.MaxMicroS < 10000 || stats.GetDequeueRate() <= 0)
+			return 0;
+
+		return 1;
+	}
+
+	bool TestThreadQueued::TestDrain()
+	{
+		atomic<int> testCounter(0);
+
+		ThreadQueued<int> testQueue(&TestThreadQueued::SlowCountMessage, &testCounter, THREAD_PAUSED);
+
+		// Paused thread doesn't drain the queue
+		testQueue.PushMessage(1);
+		testQueue.PushMessage(2);
+		if(testQueue.WaitForDrain(drain_timeout_t(10000)))
+			return 0;
+
+		// Drain waits for the last handler to return
+		testQueue.SetThreadState(THREAD_RUNNING);
+		if(!testQueue.WaitForDrain(TestTimeout) || testCounter != 3)
+			return 0;
+
+		// Drained queue returns immediately
+		if(!testQueue.WaitForDrain(drain_timeout_t(0)))
+			return 0;
+
+		// Stopped thread can't drain
+		testQueue.SetThreadState(THREAD_PAUSED);
+		testQueue.PushMessage(4);
+		testQueue.StopThread();
+		if(testQueue.WaitForDrain(TestTimeout))
+			return 0;
+
+		return 1;
+	}
+
+	bool TestThreadQueued::TestBatchLimit()
+	{
+		test_latch_counter_t testCounter{{0}, {0}, {0}};
+
+		ThreadQueued<int> testQueue(&TestThreadQueued::LatchedCountMessage, &testCounter, THREAD_PAUSED);
+		testQueue.SetBatchSize(4);
+		testQueue.SetQueueLimit(4, QUEUE_OVERFLOW_REJECT);
+
+		for(int curMessage = 0; curMessage < 4; ++curMessage)
+			testQueue.PushMessage(1);
+
+		// Claimed messages of the running batch still hold their slots. The first handler waits for a permit
+		testQueue.SetThreadState(THREAD_RUNNING);
+		bool testResult = TestThreadQueued::WaitForCondition([&testCounter]() { return testCounter.StartedHandlers == 1; }) &&
+				testQueue.PushMessage(1) == QUEUE_PUSH_REJECTED;
+
+		// Each handled message frees its slot
+		testCounter.Permits = 1;
+		testResult = testResult && TestThreadQueued::WaitForCondition([&testCounter]() { return testCounter.Counter == 1; }) &&
+				testQueue.PushMessage(1) == QUEUE_PUSH_SUCCESS;
+
+		// Let the remaining handlers finish, also if the test failed, so that the queue thread can be stopped
+		testCounter.Permits = 1000;
+		if(!testResult || !testQueue.WaitForDrain(TestTimeout) || testCounter.Counter != 5)
+			return 0;
+
+		return 1;
+	}
+
+	bool TestThreadQueued::TestDropFunction()
+	{
+		atomic<int> testCounter(0);
+
+		ThreadQueued<int> testQueue(&TestThreadQueued::CountMessage, &testCounter, THREAD_PAUSED);
+		testQueue.SetDropFunction(&TestThreadQueued::UncountMessage);
+		testQueue.SetQueueLimit(2, QUEUE_OVERFLOW_DROP_OLDEST);
+
+		// Discarded messages are passed to the drop function
+		if(testQueue.PushMessage(1) != QUEUE_PUSH_SUCCESS || testQueue.PushMessage(2) != QUEUE_PUSH_SUCCESS ||
+				testQueue.PushMessage(4) != QUEUE_PUSH_DROPPED_OLDEST || testCounter != -1)
+			return 0;
+
+		testQueue.SetThreadState(THREAD_RUNNING);
+		if(!testQueue.WaitForDrain(TestTimeout) || testCounter != -1+2+4)
+			return 0;
+
+		return 1;
+	}
+
+	bool TestThreadQueued::TestForcePush()
+	{
+		atomic<int> testCounter(0);
+
+		ThreadQueued<int> testQueue(&TestThreadQueued::CountMessage, &testCounter, THREAD_PAUSED);
+		testQueue.SetDropFunction(&TestThreadQueued::UncountMessage);
+		testQueue.SetQueueLimit(1, QUEUE_OVERFLOW_REJECT);
+
+		// Forced messages ignore the limit
+		if(testQueue.PushMessage(1) != QUEUE_PUSH_SUCCESS ||
+				testQueue.PushMessage(2) != QUEUE_PUSH_REJECTED ||
+				testQueue.ForcePushMessage(message_struct_t<int>(4)) != QUEUE_PUSH_SUCCESS)
+			return 0;
+
+		// They still count as queued, so the next message pushed to the full queue replaces the oldest one
+		testQueue.SetQueueLimit(2, QUEUE_OVERFLOW_DROP_OLDEST);
+		if(testQueue.PushMessage(8) != QUEUE_PUSH_DROPPED_OLDEST || testCounter != -1)
+			return 0;
+
+		testQueue.SetThreadState(THREAD_RUNNING);
+		if(!testQueue.WaitForDrain(TestTimeout) || testCounter != -1+4+8)
+			return 0;
+
+		// Queues that don't accept messages don't take forced messages either
+		testQueue.SetMessageAcceptance(false);
+		if(testQueue.ForcePushMessage(message_struct_t<int>(16)) != QUEUE_PUSH_NOT_ACCEPTED)
+			return 0;
+
+		return 1;
+	}
+
+	bool TestThreadQueued::TestScheduler()
+	{
+		thread_scheduler::thread_scheduler_options_t testOptions;
+		testOptions.NumWorkers = 2;
+
+		ThreadScheduler testScheduler(testOptions);
+
+		static constexpr size_t numQueues = 4;
+		test_exclusive_counter_t testCounters[numQueues] = {};
+		std::vector<std::unique_ptr<ThreadQueued<int>>> testQueues;
+
+		for(size_t curQueue = 0; curQueue < numQueues; ++curQueue)
+		{
+			testQueues.emplace_back(new ThreadQueued<int>(&TestThreadQueued::ExclusiveCountMessage, &testCounters[curQueue]));
+			testQueues.back()->SetScheduler(&testScheduler);
+		}
+
+		// More queues than workers, each queue is only handled by one worker at a time
+		for(unsigned int curMessage = 0; curMessage < 1000; ++curMessage)
+		{
+			for(auto &curQueue : testQueues)
+				curQueue->PushMessage(1);
+		}
+
+		for(size_t curQueue = 0; curQueue < numQueues; ++curQueue)
+		{
+			if(!testQueues[curQueue]->WaitForDrain(TestTimeout) || testCounters[curQueue].Counter != 1000 || testCounters[curQueue].Overlapped)
+				return 0;
+		}
+
+		// Paused queues aren't scheduled
+		testQueues[0]->SetThreadState(THREAD_PAUSED);
+		testQueues[0]->PushMessage(1);
+		if(testQueues[0]->WaitForDrain(drain_timeout_t(10000)))
+			return 0;
+
+		testQueues[0]->SetThreadState(THREAD_RUNNING);
+		if(!testQueues[0]->WaitForDrain(TestTimeout) || testCounters[0].Counter != 1001)
+			return 0;
+
+		// Switch back to a dedicated thread
+		testQueues[1]->SetScheduler(nullptr);
+		testQueues[1]->PushMessage(1);
+		if(!testQueues[1]->WaitForDrain(TestTimeout) || testCounters[1].Counter != 1001 || testQueues[1]->GetScheduler() != nullptr)
+			return 0;
+
+		// Queues must be destroyed before the scheduler
+		testQueues.clear();
+
+		// Destroying a scheduler with a pending queue task runs the task, so the queue can still leave the scheduler
+		test_exclusive_counter_t testStoppedCounter = {};
+		ThreadQueued<int> testStoppedQueue(&TestThreadQueued::ExclusiveCountMessage, &testStoppedCounter);
+		{
+			testOptions.NumWorkers = 1;
+			ThreadScheduler testStoppedScheduler(testOptions);
+
+			testStoppedQueue.SetScheduler(&testStoppedScheduler);
+			for(unsigned int curMessage = 0; curMessage < 1000; ++curMessage)
+				testStoppedQueue.PushMessage(1);
+		}
+
+		testStoppedQueue.SetScheduler(nullptr);
+		if(!testStoppedQueue.WaitForDrain(TestTimeout) || testStoppedCounter.Counter != 1000)
+			return 0;
+
+		return 1;
+	}
 }
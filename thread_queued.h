@@ -8,12 +8,19 @@
 
 #include "thread_message_queue.h"
 #include "thread_function.h"
+#include "thread_scheduler.h"
+#include "queue_statistics.h"
 #include "debug_flag.h"
 #include "testing_class_declaration.h"
 
 #include <atomic>
 #include <thread>
 #include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <type_traits>
+#include <iterator>
+#include <cstdint>
 #include <assert.h>
 
 #ifdef DEBUG
@@ -30,7 +37,18 @@ namespace thread_queued
 
 	using thread_function::ThreadFunction;
 
+	using thread_scheduler::ThreadScheduler;
+	using thread_scheduler::scheduler_task_t;
+
+	using queue_statistics::queue_clock_t;
+	using queue_statistics::queue_timestamp_t;
+	using queue_statistics::queue_statistics_t;
+	using queue_statistics::LatencyHistogram;
+
 	using std::atomic;
+	using std::mutex;
+	using std::unique_lock;
+	using std::condition_variable;
 
 	using std::this_thread::sleep_for;
 	using std::chrono::duration;
@@ -45,12 +63,225 @@ namespace thread_queued
 		THREAD_STOPPED
 	};
 
+	/*!
+	 * \brief How the queue thread waits while there are no messages to process
+	 */
+	enum thread_wait_mode_t
+	{
+		/*!
+		 *	\brief Poll the queue and sleep for the set sleep time between checks
+		 */
+		THREAD_WAIT_SLEEP,
+
+		/*!
+		 *	\brief Park the thread until a message is pushed or the thread state changes
+		 */
+		THREAD_WAIT_BLOCKING,
+
+		/*!
+		 *	\brief Check the queue a set number of times before parking the thread. Used for latency-critical queues
+		 */
+		THREAD_WAIT_SPIN_BLOCKING
+	};
+
+	/*!
+	 * \brief Default number of queue checks before a THREAD_WAIT_SPIN_BLOCKING thread is parked
+	 */
+	static constexpr unsigned int DefaultWaitSpinCount = 1000;
+
+	/*!
+	 * \brief Maximum number of batches a queue handles on a scheduler worker before the worker serves other queues
+	 */
+	static constexpr size_t ScheduledTaskBatches = 16;
+
+	/*!
+	 * \brief Timeout of WaitForDrain()
+	 */
+	using drain_timeout_t = std::chrono::microseconds;
+
+	/*!
+	 * \brief Makes WaitForDrain() wait until the queue is drained
+	 */
+	static constexpr drain_timeout_t InfiniteDrainTimeout = drain_timeout_t::max();
+
+	/*!
+	 * \brief Maximum queue size that means the queue is unbounded
+	 */
+	static constexpr size_t UnboundedQueueSize = 0;
+
+	/*!
+	 * \brief Default number of messages the thread takes out of the queue at once
+	 */
+	static constexpr size_t DefaultQueueBatchSize = 1;
+
+	/*!
+	 * \brief Priority lanes of a queue. Each lane is a separate queue, lower lanes are served first or more often depending on queue_lane_scheduling_t
+	 */
+	enum queue_lane_t : uint8_t
+	{
+		/*!
+		 *	\brief Control messages such as module registration, connection state changes and handshake results
+		 */
+		QUEUE_LANE_CONTROL,
+
+		QUEUE_LANE_HIGH,
+
+		/*!
+		 *	\brief Lane of messages that don't select one
+		 */
+		QUEUE_LANE_DEFAULT,
+
+		/*!
+		 *	\brief Bulk data that may wait behind everything else
+		 */
+		QUEUE_LANE_BULK,
+
+		/*!
+		 *	\brief Number of lanes
+		 */
+		QUEUE_LANE_NUM
+	};
+
+	/*!
+	 * \brief How the thread chooses the lane to take the next batch from
+	 */
+	enum queue_lane_scheduling_t
+	{
+		/*!
+		 *	\brief Always take messages from the lowest non-empty lane. Traffic on lower lanes can starve higher lanes
+		 */
+		QUEUE_LANES_STRICT,
+
+		/*!
+		 *	\brief Weighted round robin. A lane handles up to its weight in messages before the next non-empty lane is served
+		 */
+		QUEUE_LANES_WEIGHTED
+	};
+
+	using queue_lane_weight_t = unsigned int;
+
+	/*!
+	 * \brief Default lane weights for QUEUE_LANES_WEIGHTED. Control messages wait for at most 7 other messages
+	 */
+	static constexpr queue_lane_weight_t DefaultQueueLaneWeights[QUEUE_LANE_NUM] = {8, 4, 2, 1};
+
+	/*!
+	 * \brief Selects the lane of a pushed message. Specialize this for message structures that carry their lane
+	 *
+	 * GetLane() is called either with the pushed message structure or with the message parameters given to PushMessage()
+	 */
+	template<class MessageStruct>
+	struct queue_lane_selector_t
+	{
+		template<class ...FcnArgs>
+		static constexpr queue_lane_t GetLane(const FcnArgs &...)
+		{
+			return QUEUE_LANE_DEFAULT;
+		}
+	};
+
+	/*!
+	 * \brief What happens to a pushed message if a bounded queue is full
+	 */
+	enum queue_overflow_policy_t
+	{
+		/*!
+		 *	\brief Block the producer until the consumer frees a slot. Don't use this on queues the consumer pushes to itself
+		 */
+		QUEUE_OVERFLOW_BLOCK,
+
+		/*!
+		 *	\brief Don't queue the message and return QUEUE_PUSH_REJECTED to the producer
+		 */
+		QUEUE_OVERFLOW_REJECT,
+
+		/*!
+		 *	\brief Discard the oldest message of the lowest priority lane that holds messages, to make room for the new one. This isn't the oldest message of the whole queue.
+		 *	Messages in higher priority lanes are only discarded when all lower priority lanes are empty, so a full queue that only holds control messages discards the oldest of them
+		 */
+		QUEUE_OVERFLOW_DROP_OLDEST,
+
+		/*!
+		 *	\brief Silently discard the new message
+		 */
+		QUEUE_OVERFLOW_DROP_NEWEST
+	};
+
+	/*!
+	 * \brief Result of pushing a message
+	 */
+	enum queue_push_result_t
+	{
+		/*!
+		 *	\brief Message was queued
+		 */
+		QUEUE_PUSH_SUCCESS,
+
+		/*!
+		 *	\brief Message was queued, the oldest message was discarded
+		 */
+		QUEUE_PUSH_DROPPED_OLDEST,
+
+		/*!
+		 *	\brief Queue was full, message was discarded
+		 */
+		QUEUE_PUSH_DROPPED_NEWEST,
+
+		/*!
+		 *	\brief Queue was full, message was not queued
+		 */
+		QUEUE_PUSH_REJECTED,
+
+		/*!
+		 *	\brief Queue currently doesn't accept messages
+		 */
+		QUEUE_PUSH_NOT_ACCEPTED,
+
+		/*!
+		 *	\brief Message was queued, but the queue it is forwarded to is full. Returned by routing queues
+		 */
+		QUEUE_PUSH_TARGET_SATURATED
+	};
+
+	/*!
+	 * \brief Counters of messages that didn't fit into a bounded queue
+	 */
+	struct queue_overflow_stats_t
+	{
+		size_t RejectedMessages = 0;
+		size_t DroppedOldestMessages = 0;
+		size_t DroppedNewestMessages = 0;
+
+		/*!
+		 *	\brief Number of pushes that had to wait for a free slot
+		 */
+		size_t BlockedPushes = 0;
+
+		/*!
+		 *	\brief Messages discarded because the queue didn't accept messages anymore, e.g. after it was unregistered
+		 */
+		size_t NotAcceptedMessages = 0;
+	};
+
+	/*!
+	 * \brief Whether threads other than the queue thread may pop from MessageQueueType. Used to discard messages on overflow
+	 */
+	template<template<class...> class MessageQueueType>
+	struct queue_allows_concurrent_pop : std::true_type
+	{};
+
 	/*!
 	 * \brief The ThreadQueued class
 	 * Warning: Can't use references as MessageParameters. Use pointers instead (See ThreadFunction for explanation)
+	 *
+	 * MessageQueueType selects the queue backend. It must provide the interface of ThreadMessageQueue (Push, PushRange, Pop, PopMessages, GetQueueSize and move assignment) and allow one popping thread concurrent to multiple pushing threads.
+	 * Each of the QUEUE_LANE_NUM priority lanes uses its own backend queue. The lane of a message is chosen by queue_lane_selector_t.
+	 * Queued messages carry a push timestamp in front of their parameters. It is only set while statistics are enabled
+	 *
+	 * Messages are handled by a dedicated thread, or by the workers of a ThreadScheduler after SetScheduler() was called. On a scheduler, the queue is a task that is only executed by one worker at a time
 	 */
-	template<class... MessageParameters>
-	class ThreadQueued : protected ThreadMessageQueue<MessageParameters...>
+	template<template<class...> class MessageQueueType, class... MessageParameters>
+	class ThreadQueuedType
 	{
 		public:
 			using msg_struct_t = message_struct_t<MessageParameters...>;
@@ -59,48 +290,71 @@ namespace thread_queued
 			using message_fcn_t = void(msg_struct_t &, void *);
 
 		private:
-			using message_queue_t = ThreadMessageQueue<MessageParameters...>;
+			/*!
+			 *	\brief Structure of queued message. Derived from msg_struct_t
+			 */
+			using queued_msg_struct_t = message_struct_t<queue_timestamp_t, MessageParameters...>;
+
+			using message_queue_t = MessageQueueType<queue_timestamp_t, MessageParameters...>;
+			using lane_selector_t = queue_lane_selector_t<msg_struct_t>;
 
 			using sleep_type = unsigned int;
 			using sleep_t = atomic<sleep_type>;
 
+			using spin_type = unsigned int;
+			using spin_t = atomic<spin_type>;
+
+			using wait_mode_t = atomic<thread_wait_mode_t>;
+
 			using state_t = atomic<thread_state_t>;
-			using thread_fcn_t = void(ThreadQueued<MessageParameters...> *const);
-			using thread_t = ThreadFunction<thread_fcn_t, void, ThreadQueued<MessageParameters...> *const>;
+			using thread_fcn_t = void(ThreadQueuedType *const);
+			using thread_t = ThreadFunction<thread_fcn_t, void, ThreadQueuedType *const>;
 
 		public:
 
 			/*!
 			 *	\brief Constructor
 			 */
-			ThreadQueued(message_fcn_t *const MessageCallback, void *ExtraData = nullptr, const thread_state_t ThreadState = THREAD_RUNNING, const sleep_type SleepMicroS = 1)
-				: message_queue_t(),
-				  _MessageFcn(MessageCallback),
+			ThreadQueuedType(message_fcn_t *const MessageCallback, void *ExtraData = nullptr, const thread_state_t ThreadState = THREAD_RUNNING, const sleep_type SleepMicroS = 1, const thread_wait_mode_t WaitMode = THREAD_WAIT_BLOCKING)
+				: _MessageFcn(MessageCallback),
 				  _ExtraData(ExtraData),
 				  _AcceptMessages(true),
 				  _State(ThreadState),
 				  _SleepMicroS(SleepMicroS),
+				  _WaitMode(WaitMode),
 				  _Thread(ThreadMessageFunction, this)
 			{}
 
-			ThreadQueued(const ThreadQueued &S) = delete;
+			ThreadQueuedType(const ThreadQueuedType &S) = delete;
 
-			ThreadQueued(ThreadQueued &&S)
-				: message_queue_t(),
-				  _MessageFcn(nullptr),
+			ThreadQueuedType(ThreadQueuedType &&S)
+				: _MessageFcn(nullptr),
 				  _ExtraData(std::move(S._ExtraData)),
 				  _AcceptMessages(static_cast<bool>(S._AcceptMessages)),
 				  _State(THREAD_PAUSED),
 				  _SleepMicroS(static_cast<sleep_type>(S._SleepMicroS)),
+				  _WaitMode(static_cast<thread_wait_mode_t>(S._WaitMode)),
+				  _SpinCount(static_cast<spin_type>(S._SpinCount)),
+				  _LaneScheduling(static_cast<queue_lane_scheduling_t>(S._LaneScheduling)),
+				  _MaxQueuedMessages(static_cast<size_t>(S._MaxQueuedMessages)),
+				  _OverflowPolicy(static_cast<queue_overflow_policy_t>(S._OverflowPolicy)),
+				  _BatchSize(static_cast<size_t>(S._BatchSize)),
 				  _Thread(ThreadMessageFunction, this)
 			{
 				auto tmpState = S.GetThreadState();
 
 				// Pause this thread
 				S.SetThreadState(THREAD_PAUSED);
+				S.ClaimScheduledTask();
 
-				static_cast<message_queue_t&>(*this) = std::move(static_cast<message_queue_t&>(S));
+				this->MoveLanes(S);
+				this->MoveStatistics(S);
+				this->_ReservedMessages = S._ReservedMessages.exchange(0);
 				this->_MessageFcn = std::move(S._MessageFcn);
+				this->_DropFcn = S._DropFcn;
+
+				S.ReleaseScheduledTask();
+				this->SetScheduler(S._Scheduler);
 
 				// Set same state as S
 				this->SetThreadState(tmpState);
@@ -109,77 +363,160 @@ namespace thread_queued
 				//S.SetThreadState(THREAD_STOPPED);
 			}
 
-			ThreadQueued &operator=(const ThreadQueued &S) = delete;
+			ThreadQueuedType &operator=(const ThreadQueuedType &S) = delete;
 
-			~ThreadQueued()
+			~ThreadQueuedType()
 			{
-				// Empty queue if thread still running
-				if(this->_State == THREAD_RUNNING)
-				{
-					// Accept no more messages
-					this->SetMessageAcceptance(false);
-
-					// Wait for all messages to be processes
-					while(!this->IsQueueEmpty())
-					{}
-				}
-
-				// Stop thread
-				this->StopThread();
+				this->ShutdownThread();
 			}
 
 			template<class ...FcnArgs>
-			void PushMessage(FcnArgs &&...MessageData)
+			queue_push_result_t PushMessage(FcnArgs &&...MessageData)
 			{
 				static_assert(sizeof...(FcnArgs) == sizeof...(MessageParameters),
 							  "ERROR ThreadedQueue::PushMessage(): Number of arguments must match number of parameters");
 
-				static_assert(message_queue::template_convertible<typename ThreadQueued<FcnArgs...>::msg_struct_t, msg_struct_t>::value,
+				static_assert(message_queue::template_convertible<message_struct_t<FcnArgs...>, msg_struct_t>::value,
 							  "ERROR ThreadedQueue::PushMessage(): Function Arguments must match template parameters");
 
-				assert(this->_AcceptMessages == true);
+				if(this->_AcceptMessages == false)
+				{
+					this->_NotAcceptedMessages++;
+					return QUEUE_PUSH_NOT_ACCEPTED;
+				}
+
+				const auto pushResult = this->ReserveMessageSlot();
+				if(pushResult == QUEUE_PUSH_REJECTED || pushResult == QUEUE_PUSH_DROPPED_NEWEST)
+					return pushResult;
+
+				const queue_lane_t lane = ThreadQueuedType::SelectLane(MessageData...);
 
-				if(this->_AcceptMessages == true)
-					static_cast<message_queue_t&>(*this).Push(std::forward<FcnArgs>(MessageData)...);
+				this->_LaneQueues[lane].Push(queued_msg_struct_t(this->GetPushTimestamp(1), std::forward<FcnArgs>(MessageData)...));
+
+				this->OnMessagePushed(lane);
+
+				return pushResult;
 			}
 
 			template<class FcnArg>
-			void PushMessage(FcnArg &&Message)
+			queue_push_result_t PushMessage(FcnArg &&Message)
 			{
 				static_assert(message_queue::template_convertible<FcnArg, msg_struct_t>::value,
 							  "ERROR ThreadedQueue::PushMessage(): Function Argument must match template parameter");
 
-				assert(this->_AcceptMessages == true);
+				if(this->_AcceptMessages == false)
+				{
+					this->_NotAcceptedMessages++;
+					return QUEUE_PUSH_NOT_ACCEPTED;
+				}
 
-				if(this->_AcceptMessages == true)
-					static_cast<message_queue_t&>(*this).Push(std::forward<FcnArg>(Message));
-			}
+				const auto pushResult = this->ReserveMessageSlot();
+				if(pushResult == QUEUE_PUSH_REJECTED || pushResult == QUEUE_PUSH_DROPPED_NEWEST)
+					return pushResult;
 
-			template<class ...FcnArgs>
-			void PushMessageFront(FcnArgs &&...MessageData)
-			{
-				static_assert(sizeof...(FcnArgs) == sizeof...(MessageParameters),
-							  "ERROR ThreadedQueue::PushMessage(): Number of arguments must match number of parameters");
+				const queue_lane_t lane = ThreadQueuedType::SelectLane(Message);
 
-				static_assert(message_queue::template_convertible<typename ThreadQueued<FcnArgs...>::msg_struct_t, msg_struct_t>::value,
-							  "ERROR ThreadedQueue::PushMessage(): Function Arguments must match template parameters");
+				this->_LaneQueues[lane].Push(queued_msg_struct_t(this->GetPushTimestamp(1), std::forward<FcnArg>(Message)));
 
-				assert(this->_AcceptMessages == true);
+				this->OnMessagePushed(lane);
 
-				if(this->_AcceptMessages == true)
-					static_cast<message_queue_t&>(*this).PushFront(std::forward<FcnArgs>(MessageData)...);
+				return pushResult;
 			}
 
+			/*!
+			 * \brief Push Message even if the queue is full. Only meant for control messages that must not be lost. QUEUE_OVERFLOW_DROP_OLDEST may still discard it later, see SetDropFunction()
+			 * \return Returns QUEUE_PUSH_SUCCESS, or QUEUE_PUSH_NOT_ACCEPTED if the queue doesn't accept messages
+			 */
 			template<class FcnArg>
-			void PushMessageFront(FcnArg &&Message)
+			queue_push_result_t ForcePushMessage(FcnArg &&Message)
 			{
 				static_assert(message_queue::template_convertible<FcnArg, msg_struct_t>::value,
-							  "ERROR ThreadedQueue::PushMessage(): Function Argument must match template parameter");
+							  "ERROR ThreadedQueue::ForcePushMessage(): Function Argument must match template parameter");
+
+				if(this->_AcceptMessages == false)
+				{
+					this->_NotAcceptedMessages++;
+					return QUEUE_PUSH_NOT_ACCEPTED;
+				}
+
+				// Take a slot beyond the limit. Producers of a full queue keep applying the overflow policy until the thread caught up
+				this->_ReservedMessages++;
+
+				const queue_lane_t lane = ThreadQueuedType::SelectLane(Message);
+
+				this->_LaneQueues[lane].Push(queued_msg_struct_t(this->GetPushTimestamp(1), std::forward<FcnArg>(Message)));
+
+				this->OnMessagePushed(lane);
+
+				return QUEUE_PUSH_SUCCESS;
+			}
+
+			/*!
+			 * \brief Push several messages at once. Unbounded queues only take the queue lock and wake the thread once
+			 * \param Begin Iterator to first message. Use move iterators to move messages into the queue
+			 * \param End Iterator past last message
+			 * \return Returns number of messages that were queued. Bounded queues apply the overflow policy to each message
+			 */
+			template<class Iterator>
+			size_t PushMessages(Iterator Begin, Iterator End)
+			{
+				static_assert(message_queue::template_convertible<decltype(*Begin), msg_struct_t>::value,
+							  "ERROR ThreadedQueue::PushMessages(): Iterator must point to messages");
+
+				if(this->_AcceptMessages == false)
+				{
+					size_t numMessages = 0;
+					for(; Begin != End; ++Begin)
+						++numMessages;
+
+					this->_NotAcceptedMessages += numMessages;
+
+					return 0;
+				}
+
+				if(this->_MaxQueuedMessages != UnboundedQueueSize)
+				{
+					size_t numPushedMessages = 0;
+					for(; Begin != End; ++Begin)
+					{
+						const auto pushResult = this->PushMessage(*Begin);
+						if(pushResult == QUEUE_PUSH_SUCCESS || pushResult == QUEUE_PUSH_DROPPED_OLDEST)
+							++numPushedMessages;
+					}
+
+					return numPushedMessages;
+				}
+
+				size_t numPushedMessages = 0;
+				while(Begin != End)
+				{
+					// Push each run of messages that share a lane with one lock acquisition
+					const queue_lane_t lane = ThreadQueuedType::SelectLane(*Begin);
+
+					Iterator runEnd = Begin;
+					size_t runSize = 0;
+					do
+					{
+						++runEnd;
+						++runSize;
+					}
+					while(runEnd != End && ThreadQueuedType::SelectLane(*runEnd) == lane);
+
+					this->_ReservedMessages += runSize;
+
+					const queue_timestamp_t timestamp = this->GetPushTimestamp(runSize);
+					this->_LaneQueues[lane].PushRange(timestamp_iterator_t<Iterator>{Begin, timestamp}, timestamp_iterator_t<Iterator>{runEnd, timestamp});
 
-				assert(this->_AcceptMessages == true);
+					this->_LaneMessages[lane] += runSize;
 
-				if(this->_AcceptMessages == true)
-					static_cast<message_queue_t&>(*this).PushFront(std::forward<FcnArg>(Message));
+					numPushedMessages += runSize;
+					Begin = runEnd;
+				}
+
+				if(numPushedMessages > 0)
+					this->WakeParkedThread();
+
+				return numPushedMessages;
 			}
 
 			void SetSleepTime(const sleep_type MicroS)
@@ -187,9 +524,105 @@ namespace thread_queued
 				this->_SleepMicroS = MicroS;
 			}
 
+			/*!
+			 * \brief Select how the thread waits for new messages
+			 * \param WaitMode Wait mode to use
+			 * \param SpinCount Number of queue checks before parking. Only used by THREAD_WAIT_SPIN_BLOCKING
+			 */
+			void SetWaitMode(const thread_wait_mode_t WaitMode, const spin_type SpinCount = DefaultWaitSpinCount)
+			{
+				this->_SpinCount = SpinCount;
+				this->_WaitMode = WaitMode;
+
+				// Wake thread so that it uses the new mode
+				this->WakeThreadForStateChange();
+			}
+
+			thread_wait_mode_t GetWaitMode() const
+			{
+				return this->_WaitMode;
+			}
+
+			/*!
+			 * \brief Set the maximum number of messages the thread takes out of the queue at once. The queue is only locked once per batch
+			 */
+			void SetBatchSize(const size_t BatchSize)
+			{
+				this->_BatchSize = BatchSize > 0 ? BatchSize : 1;
+			}
+
+			size_t GetBatchSize() const
+			{
+				return this->_BatchSize;
+			}
+
+			/*!
+			 * \brief Select how the thread chooses the lane to take messages from
+			 */
+			void SetLaneScheduling(const queue_lane_scheduling_t LaneScheduling)
+			{
+				this->_LaneScheduling = LaneScheduling;
+			}
+
+			queue_lane_scheduling_t GetLaneScheduling() const
+			{
+				return this->_LaneScheduling;
+			}
+
+			/*!
+			 * \brief Set the number of messages Lane may handle before the next lane is served. Only used by QUEUE_LANES_WEIGHTED
+			 */
+			void SetLaneWeight(const queue_lane_t Lane, const queue_lane_weight_t Weight)
+			{
+				assert(Lane < QUEUE_LANE_NUM);
+
+				this->_LaneWeights[Lane] = Weight > 0 ? Weight : 1;
+			}
+
+			queue_lane_weight_t GetLaneWeight(const queue_lane_t Lane) const
+			{
+				assert(Lane < QUEUE_LANE_NUM);
+
+				return this->_LaneWeights[Lane];
+			}
+
+			/*!
+			 * \brief Handle messages on the workers of Scheduler instead of the dedicated thread. nullptr restarts the dedicated thread
+			 *
+			 * Waits until a running task of the previous scheduler returned. Must not be called by the message handler of this queue. The scheduler must outlive the queue or be replaced before it is destroyed
+			 */
+			void SetScheduler(ThreadScheduler *const Scheduler)
+			{
+				// No task may run while the dedicated thread is started or stopped
+				this->ClaimScheduledTask();
+
+				ThreadScheduler *const prevScheduler = this->_Scheduler.exchange(Scheduler);
+				if(prevScheduler == nullptr && Scheduler != nullptr)
+				{
+					// Dedicated thread ends once it sees the scheduler
+					this->WakeThreadForStateChange();
+					this->Wait();
+				}
+				else if(prevScheduler != nullptr && Scheduler == nullptr && this->_State != THREAD_STOPPED)
+					this->_Thread(this);
+
+				this->ReleaseScheduledTask();
+
+				// Handle messages that were pushed in the meantime
+				this->WakeThreadForStateChange();
+			}
+
+			ThreadScheduler *GetScheduler() const
+			{
+				return this->_Scheduler;
+			}
+
 			void SetThreadState(thread_state_t NewState)
 			{
 				this->_State = NewState;
+
+				// Parked thread must react to pause/stop/resume
+				this->WakeThreadForStateChange();
 			}
 
 			thread_state_t GetThreadState() const
@@ -200,7 +633,7 @@ namespace thread_queued
 			void RestartThread()
 			{
 				// Stop if still running
-				this->_State = THREAD_STOPPED;
+				this->SetThreadState(THREAD_STOPPED);
 
 				// Wait for it to complete
 				this->Wait();
@@ -208,8 +641,11 @@ namespace thread_queued
 				// Set running state for next start
 				this->_State = THREAD_RUNNING;
 
-				// Start a new thread
-				this->_Thread = thread_t(ThreadMessageFunction, this);
+				// Start a new thread. Scheduled queues continue on the scheduler
+				if(this->_Scheduler == nullptr)
+					this->_Thread(this);
+				else
+					this->WakeThreadForStateChange();
 			}
 
 			void StopThread()
@@ -217,6 +653,34 @@ namespace thread_queued
 				this->SetThreadState(THREAD_STOPPED);
 			}
 
+			/*!
+			 * \brief Handle the remaining messages if the thread is running, then stop it and wait until no message is handled anymore. Used by derived classes to stop the thread before their members are destroyed
+			 */
+			void ShutdownThread()
+			{
+				// Empty queue if thread still running
+				if(this->_State == THREAD_RUNNING)
+				{
+					// Accept no more messages
+					this->SetMessageAcceptance(false);
+
+					// Wait for all messages to be processes
+					this->WaitForDrain();
+				}
+
+				// Stop thread
+				this->StopThread();
+
+				// Wait for the scheduled task to return. Release it again, ShutdownThread() may be called more than once
+				this->ClaimScheduledTask();
+				this->_Scheduler = nullptr;
+				this->ReleaseScheduledTask();
+
+				// Moved-from queues have no thread
+				if(this->_Thread.valid())
+					this->Wait();
+			}
+
 			void Wait()
 			{
 				this->_Thread.Wait();
@@ -232,9 +696,22 @@ namespace thread_queued
 				this->_ExtraData = ExtraData;
 			}
 
+			/*!
+			 * \brief Set function that is called with each message discarded by QUEUE_OVERFLOW_DROP_OLDEST. It gets the same extra data as the message function.
+			 * The discarded message is the oldest one of the lowest priority non-empty lane, so it may be newer than messages in higher priority lanes, and it is a control message if
+			 * only QUEUE_LANE_CONTROL holds messages. Called by the pushing thread, or by the queue thread if the backend only allows it to pop. nullptr disables it
+			 */
+			void SetDropFunction(message_fcn_t *DropFunction)
+			{
+				this->_DropFcn = DropFunction;
+			}
+
 			void SetMessageAcceptance(bool AllowNewMessages)
 			{
 				this->_AcceptMessages = AllowNewMessages;
+
+				// Blocked producers give up if messages are no longer accepted
+				this->WakeBlockedProducers();
 			}
 
 			bool GetMessageAcceptance() const
@@ -244,43 +721,246 @@ namespace thread_queued
 
 			bool IsQueueEmpty() const
 			{
-				if(this->GetQueueSize() > 0)
-					return false;
+				for(const auto &laneMessages : this->_LaneMessages)
+				{
+					if(laneMessages > 0)
+						return false;
+				}
 
 				return true;
 			}
 
-		public:
+			/*!
+			 * \brief Number of pushed messages whose handler hasn't returned yet, including claimed messages of the current batch and the one being handled
+			 */
+			size_t GetUnhandledMessages() const
+			{
+				return this->_ReservedMessages;
+			}
 
-			ThreadQueued &operator=(ThreadQueued &&S)
+			/*!
+			 * \brief Take a slot for a message that the queue thread handles itself without queueing it. It counts towards the queue limit like a pushed message
+			 * \return Returns false if the queue is full. The message must then be pushed normally, which applies the overflow policy
+			 */
+			bool ReserveUnqueuedMessage()
 			{
-				auto tmpState = S.GetThreadState();
+				return this->TryReserveMessageSlot();
+			}
 
-				// Pause this thread
-				S.SetThreadState(THREAD_PAUSED);
-				this->SetThreadState(THREAD_PAUSED);
+			/*!
+			 * \brief Free the slot taken by ReserveUnqueuedMessage() once the message was handled
+			 */
+			void ReleaseUnqueuedMessage()
+			{
+				this->ReleaseMessageSlots(1);
+			}
 
-				static_cast<message_queue_t&>(*this) = std::move(static_cast<message_queue_t&>(S));
-				this->_MessageFcn = std::move(S._MessageFcn);
+			/*!
+			 * \brief Check whether all reserved messages were handled and all dropped messages discarded
+			 */
+			bool IsDrained() const
+			{
+				if(this->_ReservedMessages > 0 || this->_HandlingMessages)
+					return false;
 
-				this->_ExtraData = std::move(S._ExtraData);
+				for(const auto &pendingDrops : this->_PendingDrops)
+				{
+					if(pendingDrops > 0)
+						return false;
+				}
 
-				this->_AcceptMessages = static_cast<bool>(S._AcceptMessages);
+				return true;
+			}
 
-				// Set same state as S
-				this->SetThreadState(tmpState);
+			/*!
+			 * \brief Block until every pushed message was handled and the handler returned. Messages pushed while waiting are waited for as well
+			 *
+			 * Must not be called by the queue thread itself. Call SetMessageAcceptance(false) before to make sure the queue drains
+			 * \param Timeout Maximum time to wait. InfiniteDrainTimeout waits until the queue is drained
+			 * \return Returns false if the timeout expired or the thread was stopped before the queue drained
+			 */
+			bool WaitForDrain(const drain_timeout_t Timeout = InfiniteDrainTimeout)
+			{
+				unique_lock<mutex> drainLock(this->_DrainLock);
 
-				// Stop thread S (done in destructor)
-				//S.SetThreadState(THREAD_STOPPED);
+				// Set before checking the queue, so that no wakeup can be lost (see WakeDrainWaiters())
+				this->_DrainWaiters++;
 
-				return *this;
-			}
+				const bool waitIndefinitely = (Timeout == InfiniteDrainTimeout);
+				const auto deadline = waitIndefinitely ? queue_clock_t::time_point::max() : queue_clock_t::now() + Timeout;
 
-		private:
+				bool isDrained;
+				while(!(isDrained = this->IsDrained()) && this->_State != THREAD_STOPPED)
+				{
+					if(waitIndefinitely)
+						this->_DrainCondition.wait(drainLock);
+					else if(this->_DrainCondition.wait_until(drainLock, deadline) == std::cv_status::timeout)
+					{
+						isDrained = this->IsDrained();
+						break;
+					}
+				}
 
-			message_fcn_t		*_MessageFcn;
+				this->_DrainWaiters--;
 
-			void					*_ExtraData = nullptr;
+				return isDrained;
+			}
+
+			bool IsLaneEmpty(const queue_lane_t Lane) const
+			{
+				assert(Lane < QUEUE_LANE_NUM);
+
+				return this->_LaneMessages[Lane] == 0;
+			}
+
+			/*!
+			 * \brief Limit the number of queued messages
+			 * \param MaxQueuedMessages Maximum number of messages in queue, including messages of the current batch whose handlers haven't returned yet. UnboundedQueueSize removes the limit
+			 * \param OverflowPolicy What to do with pushed messages once the queue is full
+			 */
+			void SetQueueLimit(const size_t MaxQueuedMessages, const queue_overflow_policy_t OverflowPolicy = QUEUE_OVERFLOW_REJECT)
+			{
+				this->_OverflowPolicy = OverflowPolicy;
+				this->_MaxQueuedMessages = MaxQueuedMessages;
+
+				// Blocked producers must check the new limit
+				this->WakeBlockedProducers();
+			}
+
+			size_t GetQueueLimit() const
+			{
+				return this->_MaxQueuedMessages;
+			}
+
+			queue_overflow_policy_t GetOverflowPolicy() const
+			{
+				return this->_OverflowPolicy;
+			}
+
+			/*!
+			 * \brief Check whether a bounded queue is full
+			 */
+			bool IsQueueSaturated() const
+			{
+				const size_t maxQueuedMessages = this->_MaxQueuedMessages;
+
+				return maxQueuedMessages != UnboundedQueueSize && this->_ReservedMessages >= maxQueuedMessages;
+			}
+
+			queue_overflow_stats_t GetOverflowStats() const
+			{
+				queue_overflow_stats_t stats;
+
+				stats.RejectedMessages = this->_RejectedMessages;
+				stats.DroppedOldestMessages = this->_DroppedOldestMessages;
+				stats.DroppedNewestMessages = this->_DroppedNewestMessages;
+				stats.BlockedPushes = this->_BlockedPushes;
+				stats.NotAcceptedMessages = this->_NotAcceptedMessages;
+
+				return stats;
+			}
+
+			/*!
+			 * \brief Enable or disable queue statistics. Enabling resets them, except for the current queue depth
+			 *
+			 * While enabled, pushed messages are timestamped and counted, and the sojourn time of each message is recorded before it is handled
+			 */
+			void SetStatisticsEnabled(const bool Enabled)
+			{
+				if(Enabled && !this->_StatisticsEnabled)
+				{
+					this->_StatisticsStart = queue_clock_t::now();
+					this->_DequeuedMessagesStart = static_cast<size_t>(this->_DequeuedMessages);
+					this->_EnqueuedMessagesStart = static_cast<size_t>(this->_EnqueuedMessages);
+					this->_MaxQueueDepth = this->_EnqueuedMessagesStart - this->_DequeuedMessagesStart;
+					this->_SojournTime.Reset();
+				}
+
+				this->_StatisticsEnabled = Enabled;
+			}
+
+			bool IsStatisticsEnabled() const
+			{
+				return this->_StatisticsEnabled;
+			}
+
+			/*!
+			 * \brief Get statistics of messages pushed while statistics were enabled
+			 */
+			queue_statistics_t GetQueueStatistics() const
+			{
+				queue_statistics_t stats;
+
+				// Read dequeue count first so that the depth can't underflow
+				const size_t dequeuedMessages = this->_DequeuedMessages;
+				const size_t enqueuedMessages = this->_EnqueuedMessages;
+
+				stats.DequeuedMessages = dequeuedMessages - this->_DequeuedMessagesStart;
+				stats.EnqueuedMessages = enqueuedMessages - this->_EnqueuedMessagesStart;
+				stats.QueueDepth = enqueuedMessages - dequeuedMessages;
+				stats.MaxQueueDepth = this->_MaxQueueDepth;
+
+				if(this->_StatisticsEnabled)
+					stats.Period = queue_clock_t::now() - static_cast<queue_timestamp_t>(this->_StatisticsStart);
+
+				stats.SojournTime = this->_SojournTime.GetSnapshot();
+
+				return stats;
+			}
+
+		public:
+
+			ThreadQueuedType &operator=(ThreadQueuedType &&S)
+			{
+				auto tmpState = S.GetThreadState();
+
+				// Pause this thread
+				S.SetThreadState(THREAD_PAUSED);
+				this->SetThreadState(THREAD_PAUSED);
+				S.ClaimScheduledTask();
+				this->ClaimScheduledTask();
+
+				this->MoveLanes(S);
+				this->MoveStatistics(S);
+				this->_ReservedMessages = S._ReservedMessages.exchange(0);
+				this->_MessageFcn = std::move(S._MessageFcn);
+				this->_DropFcn = S._DropFcn;
+
+				this->_ExtraData = std::move(S._ExtraData);
+
+				this->_AcceptMessages = static_cast<bool>(S._AcceptMessages);
+
+				this->_WaitMode = static_cast<thread_wait_mode_t>(S._WaitMode);
+				this->_SpinCount = static_cast<spin_type>(S._SpinCount);
+
+				this->_MaxQueuedMessages = static_cast<size_t>(S._MaxQueuedMessages);
+				this->_OverflowPolicy = static_cast<queue_overflow_policy_t>(S._OverflowPolicy);
+				this->_BatchSize = static_cast<size_t>(S._BatchSize);
+				this->_LaneScheduling = static_cast<queue_lane_scheduling_t>(S._LaneScheduling);
+
+				S.ReleaseScheduledTask();
+				this->ReleaseScheduledTask();
+				this->SetScheduler(S._Scheduler);
+
+				// Set same state as S
+				this->SetThreadState(tmpState);
+
+				// Stop thread S (done in destructor)
+				//S.SetThreadState(THREAD_STOPPED);
+
+				return *this;
+			}
+
+		private:
+
+			message_fcn_t		*_MessageFcn;
+
+			/*!
+			 * \brief Called with messages discarded by QUEUE_OVERFLOW_DROP_OLDEST. May be nullptr
+			 */
+			message_fcn_t		*_DropFcn = nullptr;
+
+			void					*_ExtraData = nullptr;
 
 			/*!
 			 * \brief Allow new messages to be accepted into queue
@@ -291,30 +971,751 @@ namespace thread_queued
 
 			sleep_t					_SleepMicroS = 1;
 
+			/*!
+			 * \brief How the thread waits for new messages
+			 */
+			wait_mode_t				_WaitMode = THREAD_WAIT_BLOCKING;
+
+			/*!
+			 * \brief Number of queue checks before parking in THREAD_WAIT_SPIN_BLOCKING mode
+			 */
+			spin_t					_SpinCount = DefaultWaitSpinCount;
+
+			/*!
+			 * \brief One message queue per priority lane
+			 */
+			message_queue_t			_LaneQueues[QUEUE_LANE_NUM];
+
+			/*!
+			 * \brief Number of messages per lane that were pushed and not yet popped. Only incremented after a push completed, so a positive value guarantees a message can be popped
+			 */
+			atomic<size_t>			_LaneMessages[QUEUE_LANE_NUM] = {};
+
+			atomic<queue_lane_scheduling_t>	_LaneScheduling = QUEUE_LANES_WEIGHTED;
+
+			atomic<queue_lane_weight_t>	_LaneWeights[QUEUE_LANE_NUM] = {DefaultQueueLaneWeights[QUEUE_LANE_CONTROL], DefaultQueueLaneWeights[QUEUE_LANE_HIGH], DefaultQueueLaneWeights[QUEUE_LANE_DEFAULT], DefaultQueueLaneWeights[QUEUE_LANE_BULK]};
+
+			/*!
+			 * \brief Lane that is currently served by QUEUE_LANES_WEIGHTED and the number of messages it may still handle. Only accessed by the thread
+			 */
+			queue_lane_t			_CurLane = static_cast<queue_lane_t>(QUEUE_LANE_NUM-1);
+			size_t					_CurLaneCredit = 0;
+
+			/*!
+			 * \brief Set while the thread waits on _WakeCondition. Producers only notify if this is set
+			 */
+			atomic<bool>			_ThreadParked = false;
+
+			/*!
+			 * \brief Lock for _WakeCondition
+			 */
+			mutex					_WakeLock;
+
+			/*!
+			 * \brief Signaled on new messages and state changes
+			 */
+			condition_variable		_WakeCondition;
+
+			/*!
+			 * \brief Maximum number of messages in queue. UnboundedQueueSize if there is no limit
+			 */
+			atomic<size_t>			_MaxQueuedMessages = UnboundedQueueSize;
+
+			atomic<queue_overflow_policy_t>	_OverflowPolicy = QUEUE_OVERFLOW_REJECT;
+
+			/*!
+			 * \brief Maximum number of messages popped at once
+			 */
+			atomic<size_t>			_BatchSize = DefaultQueueBatchSize;
+
+			/*!
+			 * \brief Number of messages that producers reserved a slot for and the thread hasn't yet taken out. Incremented before a push, so it is used to enforce _MaxQueuedMessages and to detect a drained queue
+			 */
+			atomic<size_t>			_ReservedMessages = 0;
+
+			/*!
+			 * \brief Number of messages per lane that were dropped by QUEUE_OVERFLOW_DROP_OLDEST and must be discarded by the thread. Only used if producers can't pop themselves
+			 */
+			atomic<size_t>			_PendingDrops[QUEUE_LANE_NUM] = {};
+
+			/*!
+			 * \brief Timestamp and count pushed messages
+			 */
+			atomic<bool>			_StatisticsEnabled = false;
+
+			atomic<queue_timestamp_t>	_StatisticsStart = queue_timestamp_t();
+
+			/*!
+			 * \brief Number of timestamped messages that were pushed, and that were handled or dropped
+			 */
+			atomic<size_t>			_EnqueuedMessages = 0;
+			atomic<size_t>			_DequeuedMessages = 0;
+
+			/*!
+			 * \brief Counters at the time statistics were enabled
+			 */
+			atomic<size_t>			_EnqueuedMessagesStart = 0;
+			atomic<size_t>			_DequeuedMessagesStart = 0;
+
+			atomic<size_t>			_MaxQueueDepth = 0;
+
+			/*!
+			 * \brief Time between push and handling of timestamped messages
+			 */
+			LatencyHistogram		_SojournTime;
+
+			atomic<size_t>			_RejectedMessages = 0;
+			atomic<size_t>			_DroppedOldestMessages = 0;
+			atomic<size_t>			_DroppedNewestMessages = 0;
+			atomic<size_t>			_BlockedPushes = 0;
+			atomic<size_t>			_NotAcceptedMessages = 0;
+
+			/*!
+			 * \brief Number of producers waiting on _SpaceCondition. The thread only notifies if this is positive
+			 */
+			atomic<size_t>			_BlockedProducers = 0;
+
+			/*!
+			 * \brief Lock for _SpaceCondition
+			 */
+			mutex					_SpaceLock;
+
+			/*!
+			 * \brief Signaled when a slot in a full queue was freed
+			 */
+			condition_variable		_SpaceCondition;
+
+			/*!
+			 * \brief Set while the thread handles a batch of messages whose slots were already released
+			 */
+			atomic<bool>			_HandlingMessages = false;
+
+			/*!
+			 * \brief Number of threads waiting on _DrainCondition. The thread only notifies if this is positive
+			 */
+			atomic<size_t>			_DrainWaiters = 0;
+
+			/*!
+			 * \brief Lock for _DrainCondition
+			 */
+			mutex					_DrainLock;
+
+			/*!
+			 * \brief Signaled when the thread finished a batch or discarded dropped messages, and when the thread state changes
+			 */
+			condition_variable		_DrainCondition;
+
+			/*!
+			 * \brief Scheduler whose workers handle the messages. nullptr if the dedicated thread handles them
+			 */
+			atomic<ThreadScheduler*>	_Scheduler = nullptr;
+
+			/*!
+			 * \brief Set from scheduling the task of this queue until the task returns without rescheduling itself. Ensures only one worker handles messages at a time
+			 */
+			atomic<bool>			_TaskScheduled = false;
+
 			thread_t				_Thread;
 
-			static void ThreadMessageFunction(ThreadQueued *const ThreadData)
+			/*!
+			 * \brief Get the lane of a message from lane_selector_t
+			 */
+			template<class ...FcnArgs>
+			static queue_lane_t SelectLane(const FcnArgs &...MessageData)
 			{
-#ifdef DEBUG
-				std::cout << "Starting queue thread function\n";
-#endif
+				const queue_lane_t lane = lane_selector_t::GetLane(MessageData...);
 
-				// Check if thread should be stopped
-				while(ThreadData->_State != THREAD_STOPPED)
+				assert(lane < QUEUE_LANE_NUM);
+
+				return lane < QUEUE_LANE_NUM ? lane : QUEUE_LANE_DEFAULT;
+			}
+
+			/*!
+			 * \brief Iterator that adds a push timestamp to the messages of another iterator. Used to push ranges into the lane queues
+			 */
+			template<class Iterator>
+			struct timestamp_iterator_t
+			{
+				Iterator Position;
+				queue_timestamp_t Timestamp;
+
+				queued_msg_struct_t operator*() const
 				{
-					// Check if a message is in queue and thread is not paused
-					if(ThreadData->_State != THREAD_PAUSED && static_cast<message_queue_t&>(*ThreadData).GetQueueSize() > 0)
+					return queued_msg_struct_t(this->Timestamp, *this->Position);
+				}
+
+				timestamp_iterator_t &operator++()
+				{
+					++this->Position;
+					return *this;
+				}
+
+				bool operator!=(const timestamp_iterator_t &S) const
+				{
+					return this->Position != S.Position;
+				}
+			};
+
+			/*!
+			 * \brief Get the timestamp for NumMessages messages that are about to be pushed and count them. Returns an empty timestamp if statistics are disabled
+			 */
+			queue_timestamp_t GetPushTimestamp(const size_t NumMessages)
+			{
+				if(!this->_StatisticsEnabled)
+					return queue_timestamp_t();
+
+				const size_t queueDepth = (this->_EnqueuedMessages += NumMessages) - this->_DequeuedMessages;
+
+				size_t maxQueueDepth = this->_MaxQueueDepth;
+				while(queueDepth > maxQueueDepth && !this->_MaxQueueDepth.compare_exchange_weak(maxQueueDepth, queueDepth))
+				{}
+
+				return queue_clock_t::now();
+			}
+
+			/*!
+			 * \brief Count a message that leaves the queue. Records the sojourn time if it is about to be handled
+			 */
+			void OnMessageDequeued(const queued_msg_struct_t &Message, const bool Handled)
+			{
+				const queue_timestamp_t &pushTime = Message.template Get<0>();
+				if(pushTime == queue_timestamp_t())
+					return;
+
+				if(Handled)
+					this->_SojournTime.Record(queue_clock_t::now() - pushTime);
+
+				this->_DequeuedMessages++;
+			}
+
+			/*!
+			 * \brief Move statistics counters of S to this queue. Both threads must be paused
+			 */
+			void MoveStatistics(ThreadQueuedType &S)
+			{
+				this->_StatisticsEnabled = static_cast<bool>(S._StatisticsEnabled);
+				this->_StatisticsStart = static_cast<queue_timestamp_t>(S._StatisticsStart);
+				this->_EnqueuedMessages = S._EnqueuedMessages.exchange(0);
+				this->_DequeuedMessages = S._DequeuedMessages.exchange(0);
+				this->_EnqueuedMessagesStart = S._EnqueuedMessagesStart.exchange(0);
+				this->_DequeuedMessagesStart = S._DequeuedMessagesStart.exchange(0);
+				this->_MaxQueueDepth = S._MaxQueueDepth.exchange(0);
+				this->_SojournTime = S._SojournTime;
+			}
+
+			/*!
+			 * \brief Called after a message was added to the queue of Lane
+			 */
+			void OnMessagePushed(const queue_lane_t Lane)
+			{
+				this->_LaneMessages[Lane]++;
+
+				this->WakeParkedThread();
+			}
+
+			/*!
+			 * \brief Move the queued messages and lane settings of S to this queue. Both threads must be paused
+			 */
+			void MoveLanes(ThreadQueuedType &S)
+			{
+				for(unsigned int curLane = 0; curLane < QUEUE_LANE_NUM; ++curLane)
+				{
+					this->_LaneQueues[curLane] = std::move(S._LaneQueues[curLane]);
+					this->_LaneMessages[curLane] = S._LaneMessages[curLane].exchange(0);
+					this->_PendingDrops[curLane] = S._PendingDrops[curLane].exchange(0);
+					this->_LaneWeights[curLane] = static_cast<queue_lane_weight_t>(S._LaneWeights[curLane]);
+				}
+			}
+
+			/*!
+			 * \brief Notify the thread if it is parked
+			 */
+			void WakeParkedThread()
+			{
+				if(this->_Scheduler != nullptr)
+				{
+					this->ScheduleTask();
+					return;
+				}
+
+				// Only take the wake lock if the thread is parked. _ThreadParked is set before the parked thread checks _LaneMessages and _PendingDrops, so no wakeup can be lost
+				if(this->_ThreadParked)
+				{
+					this->_WakeLock.lock();
+					this->_WakeLock.unlock();
+
+					this->_WakeCondition.notify_one();
+				}
+			}
+
+			/*!
+			 * \brief Wake a parked thread after _State or _WaitMode were changed
+			 */
+			void WakeThreadForStateChange()
+			{
+				this->_WakeLock.lock();
+				this->_WakeLock.unlock();
+
+				this->_WakeCondition.notify_all();
+
+				// Scheduled queues resume on a worker
+				if(this->_Scheduler != nullptr && this->HasPendingWork())
+					this->ScheduleTask();
+
+				// Blocked producers and drain waiters give up if the thread was stopped
+				this->WakeBlockedProducers();
+				this->WakeDrainWaiters();
+			}
+
+			/*!
+			 * \brief Schedule the task of this queue unless it is already scheduled or running
+			 */
+			void ScheduleTask()
+			{
+				if(this->_State != THREAD_RUNNING || this->_TaskScheduled || this->_TaskScheduled.exchange(true))
+					return;
+
+				// Read the scheduler after claiming the task, SetScheduler() only changes it while holding the task
+				ThreadScheduler *const scheduler = this->_Scheduler;
+				if(scheduler == nullptr)
+				{
+					this->ReleaseScheduledTask();
+					return;
+				}
+
+				scheduler->Schedule(scheduler_task_t{&ThreadQueuedType::RunScheduledTask, this});
+			}
+
+			/*!
+			 * \brief Wait until the task of this queue isn't scheduled or running and keep it from being scheduled until ReleaseScheduledTask() is called
+			 */
+			void ClaimScheduledTask()
+			{
+				unique_lock<mutex> drainLock(this->_DrainLock);
+
+				this->_DrainWaiters++;
+
+				while(this->_TaskScheduled.exchange(true))
+				{
+					this->_DrainCondition.wait(drainLock);
+				}
+
+				this->_DrainWaiters--;
+			}
+
+			void ReleaseScheduledTask()
+			{
+				unique_lock<mutex> drainLock(this->_DrainLock);
+
+				this->_TaskScheduled = false;
+
+				if(this->_DrainWaiters > 0)
+					this->_DrainCondition.notify_all();
+			}
+
+			/*!
+			 * \brief Task executed by a scheduler worker. Handles up to ScheduledTaskBatches batches, then reschedules itself if messages are left
+			 */
+			static void RunScheduledTask(void *TaskData)
+			{
+				auto *const threadData = static_cast<ThreadQueuedType*>(TaskData);
+
+				for(size_t curBatch = 0; curBatch < ScheduledTaskBatches && threadData->_State == THREAD_RUNNING; ++curBatch)
+				{
+					if(!threadData->HandleNextBatch())
+						break;
+				}
+
+				// Release the task under the drain lock. The queue may be destroyed as soon as the lock is released, so it must not be accessed afterwards
+				unique_lock<mutex> drainLock(threadData->_DrainLock);
+
+				// Clear before checking for messages, so that a concurrent push either sees the cleared flag or is seen here
+				threadData->_TaskScheduled = false;
+
+				ThreadScheduler *const scheduler = threadData->_Scheduler;
+				if(scheduler != nullptr && threadData->_State == THREAD_RUNNING && threadData->HasPendingWork() && !threadData->_TaskScheduled.exchange(true))
+					scheduler->Schedule(scheduler_task_t{&ThreadQueuedType::RunScheduledTask, threadData});
+
+				if(threadData->_DrainWaiters > 0)
+					threadData->_DrainCondition.notify_all();
+			}
+
+			/*!
+			 * \brief Take up to MaxMessages messages out of the message count of Lane
+			 * \return Returns number of messages that can be popped from Lane
+			 */
+			size_t ClaimQueuedMessages(const queue_lane_t Lane, const size_t MaxMessages)
+			{
+				atomic<size_t> &laneMessages = this->_LaneMessages[Lane];
+
+				size_t queuedMessages = laneMessages;
+				while(queuedMessages > 0)
+				{
+					const size_t numMessages = queuedMessages < MaxMessages ? queuedMessages : MaxMessages;
+					if(laneMessages.compare_exchange_weak(queuedMessages, queuedMessages-numMessages))
+						return numMessages;
+				}
+
+				return 0;
+			}
+
+			/*!
+			 * \brief Take the oldest message of the lowest priority non-empty lane out of the queue count. Used to make room for a new message
+			 * \param Lane Set to the lane of the claimed message
+			 * \return Returns false if no message can be popped
+			 */
+			bool ClaimDroppableMessage(queue_lane_t &Lane)
+			{
+				for(unsigned int curLane = QUEUE_LANE_NUM; curLane > 0; --curLane)
+				{
+					if(this->ClaimQueuedMessages(static_cast<queue_lane_t>(curLane-1), 1) > 0)
+					{
+						Lane = static_cast<queue_lane_t>(curLane-1);
+						return true;
+					}
+				}
+
+				return false;
+			}
+
+			/*!
+			 * \brief Take the next batch of messages out of the queue count. Only called by the thread
+			 * \param Lane Set to the lane the messages must be popped from
+			 * \return Returns number of messages that can be popped from Lane
+			 */
+			size_t ClaimNextMessages(const size_t MaxMessages, queue_lane_t &Lane)
+			{
+				if(this->_LaneScheduling == QUEUE_LANES_STRICT)
+				{
+					for(unsigned int curLane = 0; curLane < QUEUE_LANE_NUM; ++curLane)
+					{
+						const size_t numMessages = this->ClaimQueuedMessages(static_cast<queue_lane_t>(curLane), MaxMessages);
+						if(numMessages > 0)
+						{
+							Lane = static_cast<queue_lane_t>(curLane);
+							return numMessages;
+						}
+					}
+
+					return 0;
+				}
+
+				// Serve current lane until its credit is used up or it is empty, then continue with the next lane. The current lane is checked again with new credit after all others were empty
+				for(unsigned int checkedLanes = 0; checkedLanes <= QUEUE_LANE_NUM; ++checkedLanes)
+				{
+					if(this->_CurLaneCredit > 0)
 					{
-						auto tmpMessage = static_cast<message_queue_t&>(*ThreadData).Pop();
-						ThreadData->_MessageFcn(tmpMessage, ThreadData->_ExtraData);
+						const size_t maxMessages = MaxMessages < this->_CurLaneCredit ? MaxMessages : this->_CurLaneCredit;
+						const size_t numMessages = this->ClaimQueuedMessages(this->_CurLane, maxMessages);
+						if(numMessages > 0)
+						{
+							this->_CurLaneCredit -= numMessages;
+
+							Lane = this->_CurLane;
+							return numMessages;
+						}
 					}
+
+					this->_CurLane = static_cast<queue_lane_t>((this->_CurLane+1) % QUEUE_LANE_NUM);
+					this->_CurLaneCredit = this->_LaneWeights[this->_CurLane];
+				}
+
+				return 0;
+			}
+
+			/*!
+			 * \brief Reserve a slot for a new message. Fails if the queue is full
+			 */
+			bool TryReserveMessageSlot()
+			{
+				const size_t maxQueuedMessages = this->_MaxQueuedMessages;
+				if(maxQueuedMessages == UnboundedQueueSize)
+				{
+					this->_ReservedMessages++;
+					return true;
+				}
+
+				size_t reservedMessages = this->_ReservedMessages;
+				do
+				{
+					if(reservedMessages >= maxQueuedMessages)
+						return false;
+				}
+				while(!this->_ReservedMessages.compare_exchange_weak(reservedMessages, reservedMessages+1));
+
+				return true;
+			}
+
+			/*!
+			 * \brief Reserve a slot for a new message and apply the overflow policy if the queue is full
+			 * \return Returns QUEUE_PUSH_REJECTED or QUEUE_PUSH_DROPPED_NEWEST if the message must not be pushed
+			 */
+			queue_push_result_t ReserveMessageSlot()
+			{
+				while(!this->TryReserveMessageSlot())
+				{
+					switch(static_cast<queue_overflow_policy_t>(this->_OverflowPolicy))
+					{
+						case QUEUE_OVERFLOW_BLOCK:
+							if(this->WaitForMessageSlot())
+								return QUEUE_PUSH_SUCCESS;
+
+							this->_RejectedMessages++;
+							return QUEUE_PUSH_REJECTED;
+
+						case QUEUE_OVERFLOW_REJECT:
+							this->_RejectedMessages++;
+							return QUEUE_PUSH_REJECTED;
+
+						case QUEUE_OVERFLOW_DROP_NEWEST:
+							this->_DroppedNewestMessages++;
+							return QUEUE_PUSH_DROPPED_NEWEST;
+
+						case QUEUE_OVERFLOW_DROP_OLDEST:
+							// Take over the slot of the oldest message of the least important lane
+							queue_lane_t dropLane;
+							if(this->ClaimDroppableMessage(dropLane))
+							{
+								this->DiscardClaimedMessage(dropLane);
+								this->_DroppedOldestMessages++;
+								return QUEUE_PUSH_DROPPED_OLDEST;
+							}
+
+							// All reserved messages are still being pushed or handled, try again
+							std::this_thread::yield();
+							break;
+					}
+				}
+
+				return QUEUE_PUSH_SUCCESS;
+			}
+
+			/*!
+			 * \brief Remove a message that was claimed with ClaimDroppableMessage() from the queue of Lane
+			 */
+			void DiscardClaimedMessage(const queue_lane_t Lane)
+			{
+				if(queue_allows_concurrent_pop<MessageQueueType>::value)
+				{
+					this->DropMessage(this->_LaneQueues[Lane].Pop());
+				}
+				else
+				{
+					// Only the thread may pop. It discards the message before popping the next one of this lane
+					this->_PendingDrops[Lane]++;
+					this->WakeParkedThread();
+				}
+			}
+
+			/*!
+			 * \brief Count a message discarded by QUEUE_OVERFLOW_DROP_OLDEST and pass it to the drop function
+			 */
+			void DropMessage(queued_msg_struct_t &&Message)
+			{
+				this->OnMessageDequeued(Message, false);
+
+				if(this->_DropFcn != nullptr)
+					this->_DropFcn(static_cast<msg_struct_t&>(Message), this->_ExtraData);
+			}
+
+			/*!
+			 * \brief Block until a slot was reserved. Returns false if the thread stopped, messages aren't accepted anymore or the policy changed
+			 */
+			bool WaitForMessageSlot()
+			{
+				this->_BlockedPushes++;
+
+				unique_lock<mutex> spaceLock(this->_SpaceLock);
+
+				// Set before checking for a free slot, so that no wakeup can be lost (see ReleaseMessageSlots())
+				this->_BlockedProducers++;
+
+				bool slotReserved = true;
+				while(!this->TryReserveMessageSlot())
+				{
+					if(this->_State == THREAD_STOPPED || !this->_AcceptMessages || this->_OverflowPolicy != QUEUE_OVERFLOW_BLOCK)
+					{
+						slotReserved = false;
+						break;
+					}
+
+					this->_SpaceCondition.wait(spaceLock);
+				}
+
+				this->_BlockedProducers--;
+
+				return slotReserved;
+			}
+
+			/*!
+			 * \brief Free the slots of popped messages and wake blocked producers
+			 */
+			void ReleaseMessageSlots(const size_t NumMessages)
+			{
+				this->_ReservedMessages -= NumMessages;
+
+				if(this->_BlockedProducers > 0)
+				{
+					this->_SpaceLock.lock();
+					this->_SpaceLock.unlock();
+
+					if(NumMessages == 1)
+						this->_SpaceCondition.notify_one();
 					else
+						this->_SpaceCondition.notify_all();
+				}
+			}
+
+			/*!
+			 * \brief Notify threads in WaitForDrain(). _DrainWaiters is incremented before waiters check the queue, so no wakeup can be lost
+			 */
+			void WakeDrainWaiters()
+			{
+				if(this->_DrainWaiters > 0)
+				{
+					this->_DrainLock.lock();
+					this->_DrainLock.unlock();
+
+					this->_DrainCondition.notify_all();
+				}
+			}
+
+			void WakeBlockedProducers()
+			{
+				this->_SpaceLock.lock();
+				this->_SpaceLock.unlock();
+
+				this->_SpaceCondition.notify_all();
+			}
+
+			/*!
+			 * \brief Check whether any lane has queued messages or messages to discard
+			 */
+			bool HasPendingWork() const
+			{
+				for(unsigned int curLane = 0; curLane < QUEUE_LANE_NUM; ++curLane)
+				{
+					if(this->_LaneMessages[curLane] > 0 || this->_PendingDrops[curLane] > 0)
+						return true;
+				}
+
+				return false;
+			}
+
+			/*!
+			 * \brief Check whether the thread has something to do
+			 */
+			bool IsWakeRequired() const
+			{
+				const thread_state_t curState = this->_State;
+
+				return curState == THREAD_STOPPED ||
+						this->_Scheduler != nullptr ||
+						this->_WaitMode == THREAD_WAIT_SLEEP ||
+						(curState == THREAD_RUNNING && this->HasPendingWork());
+			}
+
+			/*!
+			 * \brief Wait until a message was pushed or the thread state changed
+			 */
+			void WaitForMessage()
+			{
+				const thread_wait_mode_t waitMode = this->_WaitMode;
+
+				if(waitMode == THREAD_WAIT_SLEEP)
+				{
+					// If thread is paused or no message is in queue, sleep for the specified time
+					SleepForMs(this->_SleepMicroS);
+
+					return;
+				}
+
+				if(waitMode == THREAD_WAIT_SPIN_BLOCKING)
+				{
+					// Check for new messages a few times before parking
+					for(spin_type curSpin = this->_SpinCount; curSpin > 0; --curSpin)
 					{
-						// If thread is paused or no message is in queue, sleep for the specified time
-						SleepForMs(ThreadData->_SleepMicroS);
+						if(this->IsWakeRequired())
+							return;
+
+						std::this_thread::yield();
 					}
 				}
 
+				unique_lock<mutex> wakeLock(this->_WakeLock);
+
+				this->_ThreadParked = true;
+
+				while(!this->IsWakeRequired())
+				{
+					this->_WakeCondition.wait(wakeLock);
+				}
+
+				this->_ThreadParked = false;
+			}
+
+			/*!
+			 * \brief Discard dropped messages and handle the next batch. Only called by the thread or the scheduled task
+			 * \return Returns false if no message was queued
+			 */
+			bool HandleNextBatch()
+			{
+				// Discard messages that were dropped to make room for new ones
+				bool discardedMessages = false;
+				for(unsigned int curLane = 0; curLane < QUEUE_LANE_NUM; ++curLane)
+				{
+					for(; this->_PendingDrops[curLane] > 0; this->_PendingDrops[curLane]--)
+					{
+						this->DropMessage(this->_LaneQueues[curLane].Pop());
+						discardedMessages = true;
+					}
+				}
+
+				if(discardedMessages)
+					this->WakeDrainWaiters();
+
+				// Take a batch of messages out of the next lane and handle them. State changes take effect after the batch
+				queue_lane_t lane;
+				const size_t numMessages = this->ClaimNextMessages(this->_BatchSize, lane);
+				if(numMessages == 0)
+					return false;
+
+				// Set before the slots are released, so that WaitForDrain() also waits for the handler
+				this->_HandlingMessages = true;
+
+				// A message keeps its slot until its handler returned. Claimed messages of the batch therefore count towards the queue limit
+				this->_LaneQueues[lane].PopMessages(numMessages, [this] (queued_msg_struct_t &Message)
+				{
+					this->OnMessageDequeued(Message, true);
+
+					this->_MessageFcn(static_cast<msg_struct_t&>(Message), this->_ExtraData);
+
+					this->ReleaseMessageSlots(1);
+				});
+
+				this->_HandlingMessages = false;
+				this->WakeDrainWaiters();
+
+				return true;
+			}
+
+			static void ThreadMessageFunction(ThreadQueuedType *const ThreadData)
+			{
+#ifdef DEBUG
+				std::cout << "Starting queue thread function\n";
+#endif
+
+				// Check if thread should be stopped or hand over to a scheduler
+				while(ThreadData->_State != THREAD_STOPPED && ThreadData->_Scheduler == nullptr)
+				{
+					// Check if a message is in queue and thread is not paused
+					if(ThreadData->_State != THREAD_PAUSED && ThreadData->HandleNextBatch())
+						continue;
+
+					// If thread is paused or no message is in queue, wait until this changes
+					ThreadData->WaitForMessage();
+				}
+
 #ifdef DEBUG
 				std::cout << "Ending queue thread function\n";
 #endif
@@ -323,6 +1724,12 @@ namespace thread_queued
 			template<class U>
 			friend class ::TestingClass;
 	};
+
+	/*!
+	 * \brief Queued thread using a mutex protected message list
+	 */
+	template<class... MessageParameters>
+	using ThreadQueued = ThreadQueuedType<ThreadMessageQueue, MessageParameters...>;
 } // namespace thread_queued
 
 
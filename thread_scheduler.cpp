@@ -0,0 +1,284 @@
+#include "thread_scheduler.h"
+
+#include <thread>
+#include <chrono>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace thread_scheduler
+{
+	thread_local ThreadScheduler *ThreadScheduler::CurScheduler = nullptr;
+	thread_local size_t ThreadScheduler::CurWorker = 0;
+
+	ThreadScheduler::ThreadScheduler(const thread_scheduler_options_t &Options)
+		: _PinWorkers(Options.PinWorkers),
+		  _IdleSpinCount(Options.IdleSpinCount)
+	{
+		size_t numWorkers = Options.NumWorkers;
+		if(numWorkers == 0)
+			numWorkers = std::thread::hardware_concurrency();
+
+		if(numWorkers == 0)
+			numWorkers = 1;
+
+		// Create all deques before the first worker starts stealing
+		this->_Workers.reserve(numWorkers);
+		for(size_t curWorker = 0; curWorker < numWorkers; ++curWorker)
+			this->_Workers.emplace_back(new worker_t);
+
+		this->_WorkerThreads.reserve(numWorkers);
+		for(size_t curWorker = 0; curWorker < numWorkers; ++curWorker)
+			this->_WorkerThreads.emplace_back(&ThreadScheduler::WorkerFunction, this, curWorker);
+	}
+
+	ThreadScheduler::~ThreadScheduler()
+	{
+		this->_Stopping = true;
+
+		this->_IdleLock.lock();
+		this->_IdleLock.unlock();
+
+		this->_IdleCondition.notify_all();
+
+		for(const auto &curThread : this->_WorkerThreads)
+			curThread.Wait();
+
+		// Run the tasks that are still queued. Queues only clear their scheduled flag in their task, so ShutdownThread() and SetScheduler() would wait for a dropped task forever
+		while(this->_QueuedTasks > 0)
+		{
+			for(size_t curWorker = 0; curWorker < this->_Workers.size(); ++curWorker)
+			{
+				scheduler_task_t task;
+				while(this->PopTask(curWorker, task))
+					task.TaskFcn(task.TaskData);
+			}
+		}
+	}
+
+	void ThreadScheduler::Schedule(const scheduler_task_t &Task)
+	{
+		// Workers keep their own tasks local
+		const size_t worker = this->IsWorkerThread() ? ThreadScheduler::CurWorker : (this->_NextWorker++ % this->_Workers.size());
+
+		worker_t &curWorker = *(this->_Workers[worker]);
+
+		curWorker.TaskLock.lock();
+		curWorker.Tasks.push_back(Task);
+		curWorker.TaskLock.unlock();
+
+		this->_QueuedTasks++;
+
+		// Only take the idle lock if a worker is parked. _IdleWorkers is set before parked workers check _QueuedTasks, so no wakeup can be lost
+		if(this->_IdleWorkers > 0)
+		{
+			this->_IdleLock.lock();
+			this->_IdleLock.unlock();
+
+			this->_IdleCondition.notify_one();
+		}
+	}
+
+	bool ThreadScheduler::PopTask(const size_t Worker, scheduler_task_t &Task)
+	{
+		worker_t &curWorker = *(this->_Workers[Worker]);
+
+		unique_lock<mutex> taskLock(curWorker.TaskLock);
+
+		if(curWorker.Tasks.empty())
+			return false;
+
+		Task = curWorker.Tasks.front();
+		curWorker.Tasks.pop_front();
+
+		this->_QueuedTasks--;
+
+		return true;
+	}
+
+	bool ThreadScheduler::StealTask(const size_t Worker, scheduler_task_t &Task)
+	{
+		const size_t numWorkers = this->_Workers.size();
+		for(size_t curOffset = 1; curOffset < numWorkers; ++curOffset)
+		{
+			worker_t &victim = *(this->_Workers[(Worker + curOffset) % numWorkers]);
+
+			// Don't wait for busy deques, the owner or another thief is already taking tasks from them
+			unique_lock<mutex> taskLock(victim.TaskLock, std::try_to_lock);
+			if(!taskLock.owns_lock() || victim.Tasks.empty())
+				continue;
+
+			Task = victim.Tasks.back();
+			victim.Tasks.pop_back();
+
+			this->_QueuedTasks--;
+			this->_StolenTasks++;
+
+			return true;
+		}
+
+		return false;
+	}
+
+	void ThreadScheduler::WaitForTask()
+	{
+		unique_lock<mutex> idleLock(this->_IdleLock);
+
+		this->_IdleWorkers++;
+
+		while(this->_QueuedTasks == 0 && !this->_Stopping)
+		{
+			this->_IdleCondition.wait(idleLock);
+		}
+
+		this->_IdleWorkers--;
+	}
+
+	void ThreadScheduler::PinWorker(const size_t Worker)
+	{
+#ifdef __linux__
+		const unsigned int numCPUs = std::thread::hardware_concurrency();
+		if(numCPUs == 0)
+			return;
+
+		cpu_set_t cpuSet;
+		CPU_ZERO(&cpuSet);
+		CPU_SET(Worker % numCPUs, &cpuSet);
+
+		pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuSet);
+#else
+		(void) Worker;
+#endif
+	}
+
+	void ThreadScheduler::WorkerFunction(ThreadScheduler *const Scheduler, const size_t Worker)
+	{
+		ThreadScheduler::CurScheduler = Scheduler;
+		ThreadScheduler::CurWorker = Worker;
+
+		if(Scheduler->_PinWorkers)
+			ThreadScheduler::PinWorker(Worker);
+
+		unsigned int idleChecks = 0;
+		while(!Scheduler->_Stopping)
+		{
+			scheduler_task_t task;
+			if(Scheduler->PopTask(Worker, task) || Scheduler->StealTask(Worker, task))
+			{
+				task.TaskFcn(task.TaskData);
+
+				idleChecks = 0;
+				continue;
+			}
+
+			// Look for work a few times before parking. Tasks in busy deques are missed by StealTask(), so parking depends on _QueuedTasks
+			if(++idleChecks < Scheduler->_IdleSpinCount)
+			{
+				std::this_thread::yield();
+				continue;
+			}
+
+			Scheduler->WaitForTask();
+			idleChecks = 0;
+		}
+
+		ThreadScheduler::CurScheduler = nullptr;
+	}
+
+	class TestThreadScheduler
+	{
+		public:
+			static bool Testing();
+
+		private:
+			struct test_counter_t
+			{
+				ThreadScheduler *Scheduler;
+				atomic<size_t> Counter;
+			};
+
+			static void CountTask(void *Counter);
+			static void SpawnTask(void *Counter);
+			static void SlowCountTask(void *Counter);
+
+			static bool WaitForCount(const atomic<size_t> &Counter, size_t Count);
+	};
+
+	void TestThreadScheduler::CountTask(void *Counter)
+	{
+		static_cast<test_counter_t*>(Counter)->Counter++;
+	}
+
+	void TestThreadScheduler::SlowCountTask(void *Counter)
+	{
+		std::this_thread::sleep_for(std::chrono::microseconds(200));
+
+		static_cast<test_counter_t*>(Counter)->Counter++;
+	}
+
+	void TestThreadScheduler::SpawnTask(void *Counter)
+	{
+		auto *const testCounter = static_cast<test_counter_t*>(Counter);
+
+		// All subtasks are added to the deque of this worker, so that the others have to steal them
+		for(unsigned int curTask = 0; curTask < 100; ++curTask)
+			testCounter->Scheduler->Schedule(scheduler_task_t{&TestThreadScheduler::SlowCountTask, Counter});
+	}
+
+	bool TestThreadScheduler::WaitForCount(const atomic<size_t> &Counter, size_t Count)
+	{
+		const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+		while(Counter != Count)
+		{
+			if(std::chrono::steady_clock::now() > deadline)
+				return false;
+
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+
+		return true;
+	}
+
+	bool TestThreadScheduler::Testing()
+	{
+		thread_scheduler_options_t testOptions;
+		testOptions.NumWorkers = 4;
+
+		ThreadScheduler testScheduler(testOptions);
+		if(testScheduler.GetNumWorkers() != 4 || testScheduler.IsWorkerThread())
+			return 0;
+
+		// Tasks from outside are distributed to all workers
+		test_counter_t testCounter{&testScheduler, {0}};
+		for(unsigned int curTask = 0; curTask < 1000; ++curTask)
+			testScheduler.Schedule(scheduler_task_t{&TestThreadScheduler::CountTask, &testCounter});
+
+		if(!TestThreadScheduler::WaitForCount(testCounter.Counter, 1000))
+			return 0;
+
+		// Idle workers steal tasks scheduled by a busy worker
+		testCounter.Counter = 0;
+		testScheduler.Schedule(scheduler_task_t{&TestThreadScheduler::SpawnTask, &testCounter});
+
+		if(!TestThreadScheduler::WaitForCount(testCounter.Counter, 100) || testScheduler.GetStolenTasks() == 0)
+			return 0;
+
+		// Tasks that are still queued are run before the scheduler is destroyed
+		testCounter.Counter = 0;
+		{
+			testOptions.NumWorkers = 1;
+			ThreadScheduler testStoppedScheduler(testOptions);
+
+			testCounter.Scheduler = &testStoppedScheduler;
+			for(unsigned int curTask = 0; curTask < 100; ++curTask)
+				testStoppedScheduler.Schedule(scheduler_task_t{&TestThreadScheduler::SlowCountTask, &testCounter});
+		}
+
+		if(testCounter.Counter != 100)
+			return 0;
+
+		return 1;
+	}
+} // namespace thread_scheduler
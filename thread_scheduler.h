@@ -0,0 +1,214 @@
+#ifndef THREAD_SCHEDULER_H
+#define THREAD_SCHEDULER_H
+
+/*! \file thread_scheduler.h
+ *  \brief Header for ThreadScheduler class
+ */
+
+
+#include "thread_function.h"
+#include "testing_class_declaration.h"
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <memory>
+
+/*!
+ *  \brief Namespace for ThreadScheduler class
+ */
+namespace thread_scheduler
+{
+	using std::atomic;
+	using std::mutex;
+	using std::unique_lock;
+	using std::condition_variable;
+	using std::deque;
+	using std::vector;
+	using std::unique_ptr;
+
+	using thread_function::ThreadFunction;
+
+	class TestThreadScheduler;
+
+	/*!
+	 * \brief Function executed by a task. Receives the task data
+	 */
+	using task_fcn_t = void(void *);
+
+	/*!
+	 * \brief Task that is executed once by one of the workers
+	 */
+	struct scheduler_task_t
+	{
+		task_fcn_t *TaskFcn;
+		void *TaskData;
+	};
+
+	/*!
+	 * \brief Default number of steal attempts before an idle worker is parked
+	 */
+	static constexpr unsigned int DefaultIdleSpinCount = 64;
+
+	/*!
+	 * \brief Settings of a ThreadScheduler
+	 */
+	struct thread_scheduler_options_t
+	{
+		/*!
+		 *	\brief Number of worker threads. 0 starts one worker per hardware thread
+		 */
+		size_t NumWorkers = 0;
+
+		/*!
+		 *	\brief Pin worker N to CPU N modulo the number of hardware threads. Only supported on Linux
+		 */
+		bool PinWorkers = false;
+
+		/*!
+		 *	\brief Number of times an idle worker looks for work before it is parked
+		 */
+		unsigned int IdleSpinCount = DefaultIdleSpinCount;
+	};
+
+	/*!
+	 * \brief Fixed pool of worker threads that execute tasks. Each worker has its own task deque, idle workers steal tasks from the others
+	 *
+	 * Tasks scheduled by a worker are added to its own deque, tasks scheduled by other threads are distributed round robin. Workers take tasks from the front of their own deque and steal from the back of the others.
+	 * Tasks that are still queued when the scheduler is destroyed are executed by the destroying thread after the workers stopped
+	 */
+	class ThreadScheduler
+	{
+			using worker_fcn_t = void(ThreadScheduler *const, const size_t);
+			using worker_thread_t = ThreadFunction<worker_fcn_t, void, ThreadScheduler *const, const size_t>;
+
+		public:
+
+			/*!
+			 *	\brief Constructor. Starts the workers
+			 */
+			ThreadScheduler(const thread_scheduler_options_t &Options = thread_scheduler_options_t());
+
+			ThreadScheduler(const ThreadScheduler &S) = delete;
+			ThreadScheduler(ThreadScheduler &&S) = delete;
+
+			ThreadScheduler &operator=(const ThreadScheduler &S) = delete;
+			ThreadScheduler &operator=(ThreadScheduler &&S) = delete;
+
+			/*!
+			 *	\brief Destructor. Stops the workers after their current task, then runs the remaining tasks
+			 */
+			~ThreadScheduler();
+
+			/*!
+			 * \brief Queue a task for execution
+			 */
+			void Schedule(const scheduler_task_t &Task);
+
+			size_t GetNumWorkers() const
+			{
+				return this->_Workers.size();
+			}
+
+			/*!
+			 * \brief Get the number of tasks a worker took from the deque of another worker
+			 */
+			size_t GetStolenTasks() const
+			{
+				return this->_StolenTasks;
+			}
+
+			/*!
+			 * \brief Check whether the calling thread is one of the workers of this scheduler
+			 */
+			bool IsWorkerThread() const
+			{
+				return ThreadScheduler::CurScheduler == this;
+			}
+
+		private:
+
+			/*!
+			 * \brief Task deque of a worker
+			 */
+			struct worker_t
+			{
+				mutex				TaskLock;
+				deque<scheduler_task_t>	Tasks;
+			};
+
+			vector<unique_ptr<worker_t>>	_Workers;
+
+			vector<worker_thread_t>		_WorkerThreads;
+
+			const bool					_PinWorkers;
+			const unsigned int			_IdleSpinCount;
+
+			/*!
+			 * \brief Number of tasks in all deques. Only incremented after a task was added, so a positive value guarantees a task can be taken
+			 */
+			atomic<size_t>				_QueuedTasks = 0;
+
+			/*!
+			 * \brief Worker that receives the next task scheduled by a non-worker thread
+			 */
+			atomic<size_t>				_NextWorker = 0;
+
+			atomic<bool>				_Stopping = false;
+
+			atomic<size_t>				_StolenTasks = 0;
+
+			/*!
+			 * \brief Number of workers waiting on _IdleCondition. Schedule() only notifies if this is positive
+			 */
+			atomic<size_t>				_IdleWorkers = 0;
+
+			/*!
+			 * \brief Lock for _IdleCondition
+			 */
+			mutex						_IdleLock;
+
+			/*!
+			 * \brief Signaled when a task was scheduled or the scheduler stops
+			 */
+			condition_variable			_IdleCondition;
+
+			/*!
+			 * \brief Scheduler and worker index of the calling thread. nullptr for non-worker threads
+			 */
+			static thread_local ThreadScheduler	*CurScheduler;
+			static thread_local size_t			CurWorker;
+
+			/*!
+			 * \brief Take the oldest task of worker Worker
+			 */
+			bool PopTask(const size_t Worker, scheduler_task_t &Task);
+
+			/*!
+			 * \brief Take the newest task of another worker
+			 */
+			bool StealTask(const size_t Worker, scheduler_task_t &Task);
+
+			/*!
+			 * \brief Park the calling worker until a task was scheduled or the scheduler stops
+			 */
+			void WaitForTask();
+
+			/*!
+			 * \brief Pin the calling thread to the CPU of Worker
+			 */
+			static void PinWorker(const size_t Worker);
+
+			static void WorkerFunction(ThreadScheduler *const Scheduler, const size_t Worker);
+
+			friend class TestThreadScheduler;
+
+			template<class U>
+			friend class ::TestingClass;
+	};
+} // namespace thread_scheduler
+
+
+#endif // THREAD_SCHEDULER_H
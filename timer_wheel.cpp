@@ -0,0 +1,99 @@
+#include "timer_wheel.h"
+
+#include <thread>
+
+namespace timer_wheel
+{
+	class TestTimerWheel
+	{
+		public:
+			static bool Testing();
+
+		private:
+			using test_wheel_t = TimerWheel<int>;
+
+			static void CountTimer(int &Data, void *Counter);
+
+			/*!
+			 * \brief Check that the timers fire exactly at their tick, including those cascaded from higher wheels
+			 */
+			static bool TestCascade();
+	};
+
+	void TestTimerWheel::CountTimer(int &Data, void *Counter)
+	{
+		*static_cast<atomic<int>*>(Counter) += Data;
+	}
+
+	bool TestTimerWheel::TestCascade()
+	{
+		atomic<int> testCounter(0);
+		test_wheel_t testWheel(&TestTimerWheel::CountTimer, &testCounter);
+
+		// Drive the wheel manually
+		testWheel.Stop();
+		testWheel._CurTick = 0;
+
+		const test_wheel_t::tick_t testTicks[] = {1, 63, 64, 65, 4095, 4096, 4097, 300000, 20000000};
+		for(unsigned int curTimer = 0; curTimer < sizeof(testTicks)/sizeof(testTicks[0]); ++curTimer)
+			testWheel.AddTimerAtTick(testTicks[curTimer], 0, static_cast<int>(curTimer));
+
+		// Cancelled timer must not fire
+		const timer_id_t cancelID = testWheel.AddTimerAtTick(100, 0, -1);
+		if(!testWheel.CancelTimer(cancelID) || testWheel.CancelTimer(cancelID))
+			return 0;
+
+		vector<int> expiredTimers;
+		for(unsigned int curTimer = 0; curTimer < sizeof(testTicks)/sizeof(testTicks[0]); ++curTimer)
+		{
+			testWheel.AdvanceTo(testTicks[curTimer]-1, expiredTimers);
+			if(!expiredTimers.empty())
+				return 0;
+
+			testWheel.AdvanceTo(testTicks[curTimer], expiredTimers);
+			if(expiredTimers != vector<int>{static_cast<int>(curTimer)})
+				return 0;
+
+			expiredTimers.clear();
+		}
+
+		// Periodic timers are restarted
+		const timer_id_t periodicID = testWheel.AddTimerAtTick(testWheel._CurTick + 10, 100, 7);
+		testWheel.AdvanceTo(testWheel._CurTick + 1000, expiredTimers);
+		if(expiredTimers.size() != 10 || testWheel.GetNumTimers() != 1)
+			return 0;
+
+		if(!testWheel.CancelTimer(periodicID) || testWheel.GetNumTimers() != 0)
+			return 0;
+
+		return 1;
+	}
+
+	bool TestTimerWheel::Testing()
+	{
+		if(!TestTimerWheel::TestCascade())
+			return 0;
+
+		atomic<int> testCounter(0);
+		test_wheel_t testWheel(&TestTimerWheel::CountTimer, &testCounter);
+
+		testWheel.AddTimer(timer_duration_t(5), 1);
+		const timer_id_t cancelID = testWheel.AddTimer(timer_duration_t(5), 100);
+		const timer_id_t periodicID = testWheel.AddTimer(timer_duration_t(2), 10, timer_duration_t(2));
+
+		if(!testWheel.CancelTimer(cancelID))
+			return 0;
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+		if(!testWheel.CancelTimer(periodicID))
+			return 0;
+
+		// One shot timer fired once, periodic timer several times
+		const int firedCount = testCounter;
+		if(firedCount % 10 != 1 || firedCount < 31)
+			return 0;
+
+		return 1;
+	}
+} // namespace timer_wheel
@@ -0,0 +1,569 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+/*! \file timer_wheel.h
+ *  \brief Header for TimerWheel class
+ */
+
+
+#include "thread_function.h"
+#include "testing_class_declaration.h"
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <vector>
+#include <array>
+#include <optional>
+#include <cstdint>
+#include <limits>
+
+/*!
+ *  \brief Namespace for TimerWheel class
+ */
+namespace timer_wheel
+{
+	using std::atomic;
+	using std::mutex;
+	using std::unique_lock;
+	using std::condition_variable;
+	using std::vector;
+	using std::array;
+	using std::optional;
+
+	using thread_function::ThreadFunction;
+
+	class TestTimerWheel;
+
+	using timer_clock_t = std::chrono::steady_clock;
+
+	/*!
+	 * \brief Delay and period of timers. Timers are rounded up to whole ticks
+	 */
+	using timer_duration_t = std::chrono::milliseconds;
+
+	/*!
+	 * \brief Handle of a timer. Stays unique after the timer expired or was cancelled
+	 */
+	using timer_id_t = uint64_t;
+
+	/*!
+	 * \brief Handle that never belongs to a timer
+	 */
+	static constexpr timer_id_t InvalidTimerID = 0;
+
+	/*!
+	 * \brief Resolution of the timer wheel
+	 */
+	static constexpr timer_duration_t TimerWheelTick = timer_duration_t(1);
+
+	/*!
+	 * \brief Number of wheels and slots per wheel. Wheel N covers 64^(N+1) ticks, so four wheels cover about 4.6 hours. Longer timers are cascaded down several times
+	 */
+	static constexpr unsigned int TimerWheelLevels = 4;
+	static constexpr unsigned int TimerWheelSlotBits = 6;
+	static constexpr unsigned int TimerWheelSlots = 1 << TimerWheelSlotBits;
+
+	/*!
+	 * \brief Hierarchical timer wheel with its own timer thread. Calls the expiration function on the timer thread for each expired timer
+	 *
+	 * Adding and cancelling a timer is O(1). The timer thread only wakes up when a timer expires or a wheel must be cascaded
+	 */
+	template<class TimerData>
+	class TimerWheel
+	{
+		public:
+			using expire_fcn_t = void(TimerData &, void *);
+
+		private:
+			using tick_t = uint64_t;
+			using node_index_t = uint32_t;
+			using generation_t = uint32_t;
+
+			using thread_fcn_t = void(TimerWheel *const);
+			using thread_t = ThreadFunction<thread_fcn_t, void, TimerWheel *const>;
+
+			static constexpr node_index_t NoNode = std::numeric_limits<node_index_t>::max();
+			static constexpr tick_t NoTick = std::numeric_limits<tick_t>::max();
+
+			using slot_table_t = array<array<node_index_t, TimerWheelSlots>, TimerWheelLevels>;
+
+			/*!
+			 * \brief Timer in a wheel slot, or in the free list if Data is empty
+			 */
+			struct timer_node_t
+			{
+				optional<TimerData> Data;
+
+				tick_t ExpiryTick = 0;
+				tick_t PeriodTicks = 0;
+
+				/*!
+				 *	\brief Incremented each time the node is freed, so that stale handles don't match
+				 */
+				generation_t Generation = 1;
+
+				uint8_t Level = 0;
+				uint8_t Slot = 0;
+
+				node_index_t Prev = NoNode;
+				node_index_t Next = NoNode;
+			};
+
+		public:
+
+			/*!
+			 *	\brief Constructor. Starts the timer thread
+			 *	\param ExpireFcn Function that is called with the data of each expired timer
+			 *	\param ExtraData Passed to ExpireFcn
+			 */
+			TimerWheel(expire_fcn_t *const ExpireFcn, void *ExtraData = nullptr)
+				: _ExpireFcn(ExpireFcn),
+				  _ExtraData(ExtraData),
+				  _StartTime(timer_clock_t::now()),
+				  _Thread(&TimerWheel::ThreadTimerFunction, this)
+			{}
+
+			TimerWheel(const TimerWheel &S) = delete;
+			TimerWheel(TimerWheel &&S) = delete;
+
+			TimerWheel &operator=(const TimerWheel &S) = delete;
+			TimerWheel &operator=(TimerWheel &&S) = delete;
+
+			~TimerWheel()
+			{
+				this->Stop();
+			}
+
+			/*!
+			 * \brief Start a timer
+			 * \param Delay Time until the timer expires
+			 * \param Data Data that is passed to the expiration function
+			 * \param Period Time between expirations of a periodic timer. Zero for a timer that expires once
+			 * \return Returns handle to cancel the timer
+			 */
+			timer_id_t AddTimer(const timer_duration_t Delay, TimerData Data, const timer_duration_t Period = timer_duration_t::zero())
+			{
+				const tick_t expiryTick = this->GetCurrentTick() + TimerWheel::ConvertToTicks(Delay);
+
+				return this->AddTimerAtTick(expiryTick, TimerWheel::ConvertToTicks(Period), std::move(Data));
+			}
+
+			/*!
+			 * \brief Stop a timer. Periodic timers are stopped after the current expiration
+			 * \return Returns false if the timer already expired or was cancelled
+			 */
+			bool CancelTimer(const timer_id_t TimerID)
+			{
+				const node_index_t nodeIndex = static_cast<node_index_t>(TimerID & 0xFFFFFFFF) - 1;
+				const generation_t generation = static_cast<generation_t>(TimerID >> 32);
+
+				unique_lock<mutex> timerLock(this->_TimerLock);
+
+				if(TimerID == InvalidTimerID || nodeIndex >= this->_Nodes.size())
+					return false;
+
+				timer_node_t &node = this->_Nodes[nodeIndex];
+				if(node.Generation != generation || !node.Data)
+					return false;
+
+				this->UnlinkNode(nodeIndex);
+				this->FreeNode(nodeIndex);
+
+				return true;
+			}
+
+			/*!
+			 * \brief Number of running timers
+			 */
+			size_t GetNumTimers() const
+			{
+				return this->_NumTimers;
+			}
+
+			/*!
+			 * \brief Wait until the timer thread returned from the expiration functions of all timers that expired so far. Must not be called by an expiration function
+			 *
+			 * Once a timer was cancelled and this returned, its expiration function isn't called anymore
+			 */
+			void WaitForExpirations()
+			{
+				unique_lock<mutex> timerLock(this->_TimerLock);
+
+				while(this->_Expiring)
+				{
+					this->_ExpiredCondition.wait(timerLock);
+				}
+			}
+
+			/*!
+			 * \brief Stop the timer thread. Running timers don't expire anymore
+			 */
+			void Stop()
+			{
+				this->_TimerLock.lock();
+				this->_Stopping = true;
+				this->_TimerLock.unlock();
+
+				this->_TimerCondition.notify_all();
+
+				this->_Thread.Wait();
+			}
+
+		private:
+
+			expire_fcn_t *const		_ExpireFcn;
+			void *const				_ExtraData;
+
+			/*!
+			 * \brief Time of tick 0
+			 */
+			const timer_clock_t::time_point _StartTime;
+
+			/*!
+			 * \brief All nodes. Free nodes are linked through Next starting at _FreeNodes
+			 */
+			vector<timer_node_t>	_Nodes;
+			node_index_t			_FreeNodes = NoNode;
+
+			/*!
+			 * \brief First node of each slot
+			 */
+			slot_table_t			_Slots = TimerWheel::CreateEmptySlots();
+
+			/*!
+			 * \brief Bit N is set if slot N of the wheel isn't empty
+			 */
+			uint64_t				_OccupiedSlots[TimerWheelLevels] = {};
+
+			/*!
+			 * \brief Last processed tick
+			 */
+			tick_t					_CurTick = 0;
+
+			/*!
+			 * \brief Tick the timer thread sleeps until. New timers that expire earlier wake it
+			 */
+			tick_t					_WakeTick = NoTick;
+
+			atomic<size_t>			_NumTimers = 0;
+
+			bool					_Stopping = false;
+
+			/*!
+			 * \brief Set while the timer thread calls expiration functions
+			 */
+			bool					_Expiring = false;
+
+			/*!
+			 * \brief Protects the wheels and nodes
+			 */
+			mutex					_TimerLock;
+
+			/*!
+			 * \brief Signaled when a timer expires before _WakeTick or the wheel stops
+			 */
+			condition_variable		_TimerCondition;
+
+			/*!
+			 * \brief Signaled when the timer thread returned from the expiration functions
+			 */
+			condition_variable		_ExpiredCondition;
+
+			thread_t				_Thread;
+
+			static slot_table_t CreateEmptySlots()
+			{
+				slot_table_t emptySlots;
+				for(auto &curLevel : emptySlots)
+					curLevel.fill(NoNode);
+
+				return emptySlots;
+			}
+
+			static tick_t ConvertToTicks(const timer_duration_t Duration)
+			{
+				if(Duration <= timer_duration_t::zero())
+					return 0;
+
+				return static_cast<tick_t>((Duration.count() + TimerWheelTick.count() - 1) / TimerWheelTick.count());
+			}
+
+			tick_t GetCurrentTick() const
+			{
+				return static_cast<tick_t>(std::chrono::duration_cast<timer_duration_t>(timer_clock_t::now() - this->_StartTime).count() / TimerWheelTick.count());
+			}
+
+			timer_clock_t::time_point GetTickTime(const tick_t Tick) const
+			{
+				return this->_StartTime + TimerWheelTick * Tick;
+			}
+
+			timer_id_t AddTimerAtTick(tick_t ExpiryTick, const tick_t PeriodTicks, TimerData &&Data)
+			{
+				unique_lock<mutex> timerLock(this->_TimerLock);
+
+				// Timers expire at the earliest on the next processed tick
+				if(ExpiryTick <= this->_CurTick)
+					ExpiryTick = this->_CurTick + 1;
+
+				const node_index_t nodeIndex = this->AllocateNode();
+				timer_node_t &node = this->_Nodes[nodeIndex];
+
+				node.Data.emplace(std::move(Data));
+				node.ExpiryTick = ExpiryTick;
+				node.PeriodTicks = PeriodTicks;
+
+				this->LinkNode(nodeIndex);
+
+				const timer_id_t timerID = (static_cast<timer_id_t>(node.Generation) << 32) | (nodeIndex + 1);
+
+				// Wake the timer thread if it sleeps past the new timer
+				if(ExpiryTick < this->_WakeTick)
+				{
+					this->_WakeTick = ExpiryTick;
+
+					timerLock.unlock();
+					this->_TimerCondition.notify_one();
+				}
+
+				return timerID;
+			}
+
+			node_index_t AllocateNode()
+			{
+				this->_NumTimers++;
+
+				if(this->_FreeNodes != NoNode)
+				{
+					const node_index_t nodeIndex = this->_FreeNodes;
+					this->_FreeNodes = this->_Nodes[nodeIndex].Next;
+
+					return nodeIndex;
+				}
+
+				this->_Nodes.emplace_back();
+
+				return static_cast<node_index_t>(this->_Nodes.size() - 1);
+			}
+
+			void FreeNode(const node_index_t NodeIndex)
+			{
+				timer_node_t &node = this->_Nodes[NodeIndex];
+
+				node.Data.reset();
+				node.Generation++;
+
+				node.Prev = NoNode;
+				node.Next = this->_FreeNodes;
+				this->_FreeNodes = NodeIndex;
+
+				this->_NumTimers--;
+			}
+
+			/*!
+			 * \brief Add node to the slot that is processed at or before its expiry tick
+			 */
+			void LinkNode(const node_index_t NodeIndex)
+			{
+				timer_node_t &node = this->_Nodes[NodeIndex];
+
+				const tick_t maxDelta = (static_cast<tick_t>(1) << (TimerWheelSlotBits*TimerWheelLevels)) - 1;
+				const tick_t delta = node.ExpiryTick - this->_CurTick;
+
+				// Timers beyond the last wheel are placed at its end and cascaded down again later
+				const tick_t slotTick = delta <= maxDelta ? node.ExpiryTick : this->_CurTick + maxDelta;
+
+				unsigned int level = 0;
+				while(level < TimerWheelLevels-1 && (slotTick - this->_CurTick) >= (static_cast<tick_t>(1) << (TimerWheelSlotBits*(level+1))))
+					++level;
+
+				const unsigned int slot = (slotTick >> (TimerWheelSlotBits*level)) & (TimerWheelSlots-1);
+
+				node.Level = static_cast<uint8_t>(level);
+				node.Slot = static_cast<uint8_t>(slot);
+
+				node.Prev = NoNode;
+				node.Next = this->_Slots[level][slot];
+
+				if(node.Next != NoNode)
+					this->_Nodes[node.Next].Prev = NodeIndex;
+
+				this->_Slots[level][slot] = NodeIndex;
+				this->_OccupiedSlots[level] |= (static_cast<uint64_t>(1) << slot);
+			}
+
+			void UnlinkNode(const node_index_t NodeIndex)
+			{
+				timer_node_t &node = this->_Nodes[NodeIndex];
+
+				if(node.Prev != NoNode)
+					this->_Nodes[node.Prev].Next = node.Next;
+				else
+					this->_Slots[node.Level][node.Slot] = node.Next;
+
+				if(node.Next != NoNode)
+					this->_Nodes[node.Next].Prev = node.Prev;
+
+				if(this->_Slots[node.Level][node.Slot] == NoNode)
+					this->_OccupiedSlots[node.Level] &= ~(static_cast<uint64_t>(1) << node.Slot);
+			}
+
+			/*!
+			 * \brief Take all nodes out of a slot
+			 * \return Returns the first node of the slot
+			 */
+			node_index_t TakeSlot(const unsigned int Level, const unsigned int Slot)
+			{
+				const node_index_t firstNode = this->_Slots[Level][Slot];
+
+				this->_Slots[Level][Slot] = NoNode;
+				this->_OccupiedSlots[Level] &= ~(static_cast<uint64_t>(1) << Slot);
+
+				return firstNode;
+			}
+
+			/*!
+			 * \brief Get the next tick after _CurTick at which a slot must be processed. NoTick if no timer is running
+			 */
+			tick_t GetNextEventTick() const
+			{
+				tick_t nextTick = NoTick;
+
+				for(unsigned int curLevel = 0; curLevel < TimerWheelLevels; ++curLevel)
+				{
+					const uint64_t occupiedSlots = this->_OccupiedSlots[curLevel];
+					if(occupiedSlots == 0)
+						continue;
+
+					// Slot of the next tick is processed first, the current slot was already processed and comes last
+					const unsigned int levelShift = TimerWheelSlotBits*curLevel;
+					const unsigned int nextSlot = ((this->_CurTick >> levelShift) + 1) & (TimerWheelSlots-1);
+
+					const uint64_t rotatedSlots = nextSlot == 0 ? occupiedSlots : ((occupiedSlots >> nextSlot) | (occupiedSlots << (TimerWheelSlots - nextSlot)));
+					const tick_t slotDistance = static_cast<tick_t>(__builtin_ctzll(rotatedSlots)) + 1;
+
+					const tick_t slotTick = (((this->_CurTick >> levelShift) + slotDistance) << levelShift);
+					if(slotTick < nextTick)
+						nextTick = slotTick;
+				}
+
+				return nextTick;
+			}
+
+			/*!
+			 * \brief Process Tick. Cascades the higher wheels and takes out the expired timers
+			 * \param ExpiredTimers Data of expired timers is appended. Periodic timers are restarted with a copy
+			 */
+			void ProcessTick(const tick_t Tick, vector<TimerData> &ExpiredTimers)
+			{
+				this->_CurTick = Tick;
+
+				// Move timers of higher wheels whose slot starts now down to lower wheels
+				for(unsigned int curLevel = TimerWheelLevels-1; curLevel > 0; --curLevel)
+				{
+					const unsigned int levelShift = TimerWheelSlotBits*curLevel;
+					if((Tick & ((static_cast<tick_t>(1) << levelShift) - 1)) != 0)
+						continue;
+
+					node_index_t curNode = this->TakeSlot(curLevel, (Tick >> levelShift) & (TimerWheelSlots-1));
+					while(curNode != NoNode)
+					{
+						const node_index_t nextNode = this->_Nodes[curNode].Next;
+						this->LinkNode(curNode);
+						curNode = nextNode;
+					}
+				}
+
+				node_index_t curNode = this->TakeSlot(0, Tick & (TimerWheelSlots-1));
+				while(curNode != NoNode)
+				{
+					timer_node_t &node = this->_Nodes[curNode];
+					const node_index_t nextNode = node.Next;
+
+					if(node.PeriodTicks > 0)
+					{
+						ExpiredTimers.push_back(*node.Data);
+
+						node.ExpiryTick += node.PeriodTicks;
+						if(node.ExpiryTick <= Tick)
+							node.ExpiryTick = Tick + 1;
+
+						this->LinkNode(curNode);
+					}
+					else
+					{
+						ExpiredTimers.push_back(std::move(*node.Data));
+						this->FreeNode(curNode);
+					}
+
+					curNode = nextNode;
+				}
+			}
+
+			/*!
+			 * \brief Process all ticks with events up to Tick
+			 */
+			void AdvanceTo(const tick_t Tick, vector<TimerData> &ExpiredTimers)
+			{
+				while(this->_CurTick < Tick)
+				{
+					const tick_t nextTick = this->GetNextEventTick();
+					if(nextTick > Tick)
+					{
+						// Nothing to do until Tick
+						this->_CurTick = Tick;
+						break;
+					}
+
+					this->ProcessTick(nextTick, ExpiredTimers);
+				}
+			}
+
+			static void ThreadTimerFunction(TimerWheel *const Wheel)
+			{
+				vector<TimerData> expiredTimers;
+
+				unique_lock<mutex> timerLock(Wheel->_TimerLock);
+
+				while(!Wheel->_Stopping)
+				{
+					Wheel->AdvanceTo(Wheel->GetCurrentTick(), expiredTimers);
+
+					if(!expiredTimers.empty())
+					{
+						// Call expiration functions without the lock, so that they can add and cancel timers
+						Wheel->_Expiring = true;
+						timerLock.unlock();
+
+						for(auto &curTimer : expiredTimers)
+							Wheel->_ExpireFcn(curTimer, Wheel->_ExtraData);
+
+						expiredTimers.clear();
+
+						timerLock.lock();
+						Wheel->_Expiring = false;
+						Wheel->_ExpiredCondition.notify_all();
+						continue;
+					}
+
+					Wheel->_WakeTick = Wheel->GetNextEventTick();
+					if(Wheel->_WakeTick == NoTick)
+						Wheel->_TimerCondition.wait(timerLock);
+					else
+						Wheel->_TimerCondition.wait_until(timerLock, Wheel->GetTickTime(Wheel->_WakeTick));
+
+					Wheel->_WakeTick = NoTick;
+				}
+			}
+
+			friend class TestTimerWheel;
+
+			template<class U>
+			friend class ::TestingClass;
+	};
+} // namespace timer_wheel
+
+
+#endif // TIMER_WHEEL_H